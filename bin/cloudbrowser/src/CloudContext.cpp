@@ -114,6 +114,7 @@ CloudContext::CloudContext(QObject* parent)
       thread_pool_(IThreadPool::create(2)),
       context_thread_pool_(IThreadPool::create(1)),
       thumbnailer_thread_pool_(IThreadPool::create(2)),
+      transfer_pipe_(ITransferPipe::create()),
       pool_(std::make_shared<RequestPool>()),
       cache_size_(updatedCacheSize()),
       interrupt_(std::make_shared<std::atomic_bool>()) {
@@ -442,6 +443,10 @@ std::shared_ptr<CloudContext::RequestPool> CloudContext::request_pool() const {
   return pool_;
 }
 
+ITransferPipe* CloudContext::transfer_pipe() const {
+  return transfer_pipe_.get();
+}
+
 void CloudContext::receivedCode(const std::string& provider,
                                 const std::string& code) {
   auto p = ICloudStorage::create()->provider(provider, init_data(provider));
@@ -4,6 +4,7 @@
 #include "CloudItem.h"
 #include "Exec.h"
 #include "ICloudProvider.h"
+#include "ITransferPipe.h"
 #include "Request/CloudRequest.h"
 #include "Request/ListDirectory.h"
 #include "Utility/HttpServer.h"
@@ -121,6 +122,7 @@ class CloudContext : public QObject {
   std::shared_ptr<cloudstorage::IThreadPool> thumbnailer_thread_pool() const;
   std::shared_ptr<std::atomic_bool> interrupt() const;
   std::shared_ptr<RequestPool> request_pool() const;
+  cloudstorage::ITransferPipe* transfer_pipe() const;
 
  signals:
   void receivedCode(QString provider);
@@ -158,6 +160,7 @@ class CloudContext : public QObject {
   std::shared_ptr<cloudstorage::IThreadPool> thread_pool_;
   cloudstorage::IThreadPool::Pointer context_thread_pool_;
   std::shared_ptr<cloudstorage::IThreadPool> thumbnailer_thread_pool_;
+  cloudstorage::ITransferPipe::Pointer transfer_pipe_;
   std::shared_ptr<RequestPool> pool_;
   std::unordered_map<ListDirectoryCacheKey,
                      std::vector<cloudstorage::IItem::Pointer>>
@@ -1,17 +1,10 @@
 #include "CopyItem.h"
 
-#include <QTemporaryFile>
-
-#include "Utility/Utility.h"
-
 namespace {
 
-class Upload : public cloudstorage::IUploadFileCallback {
+class Transfer : public cloudstorage::ITransferPipe::ICallback {
  public:
-  Upload(RequestNotifier* notifier, std::unique_ptr<QTemporaryFile> file)
-      : notifier_(notifier), temp_file_(std::move(file)) {
-    temp_file_->reset();
-  }
+  Transfer(RequestNotifier* notifier) : notifier_(notifier) {}
 
   void done(cloudstorage::EitherError<cloudstorage::IItem> e) override {
     if (e.left()) {
@@ -22,65 +15,12 @@ class Upload : public cloudstorage::IUploadFileCallback {
     notifier_->deleteLater();
   }
 
-  uint32_t putData(char* data, uint32_t maxlength, uint64_t offset) override {
-    temp_file_->seek(offset);
-    return temp_file_->read(data, maxlength);
-  }
-
-  uint64_t size() override { return temp_file_->size(); }
-
-  void progress(uint64_t total, uint64_t now) override {
-    emit notifier_->progressChanged(2 * total, total + now);
-  }
-
- private:
-  RequestNotifier* notifier_;
-  std::unique_ptr<QTemporaryFile> temp_file_;
-};
-
-class Download : public cloudstorage::IDownloadFileCallback {
- public:
-  Download(RequestNotifier* notifier,
-           std::shared_ptr<CloudContext::RequestPool> pool,
-           cloudstorage::IItem::Pointer dest,
-           std::shared_ptr<cloudstorage::ICloudProvider> p,
-           std::string filename)
-      : notifier_(notifier),
-        temp_file_(cloudstorage::util::make_unique<QTemporaryFile>()),
-        pool_(std::move(pool)),
-        destination_(std::move(dest)),
-        destination_provider_(std::move(p)),
-        filename_(std::move(filename)) {
-    temp_file_->open();
-  }
-
-  void done(cloudstorage::EitherError<void> e) override {
-    if (e.left()) {
-      notifier_->finishedVoid(e);
-      notifier_->deleteLater();
-    } else {
-      auto r = destination_provider_->uploadFileAsync(
-          destination_, filename_,
-          std::make_shared<Upload>(notifier_, std::move(temp_file_)));
-      pool_->add(destination_provider_, std::move(r));
-    }
-  }
-
-  void receivedData(const char* data, uint32_t length) override {
-    temp_file_->write(data, length);
-  }
-
   void progress(uint64_t total, uint64_t now) override {
-    emit notifier_->progressChanged(2 * total, now);
+    emit notifier_->progressChanged(total, now);
   }
 
  private:
   RequestNotifier* notifier_;
-  std::unique_ptr<QTemporaryFile> temp_file_;
-  std::shared_ptr<CloudContext::RequestPool> pool_;
-  cloudstorage::IItem::Pointer destination_;
-  std::shared_ptr<cloudstorage::ICloudProvider> destination_provider_;
-  std::string filename_;
 };
 
 }  // namespace
@@ -88,7 +28,9 @@ class Download : public cloudstorage::IDownloadFileCallback {
 void CopyItemRequest::update(CloudContext* context, CloudItem* source,
                              CloudItem* destination) {
   set_done(false);
-  if (source->type() == "directory") {
+  bool same_provider =
+      source->provider().provider_ == destination->provider().provider_;
+  if (source->type() == "directory" && !same_provider) {
     emit context->errorOccurred("CopyItem", source->provider().variant(),
                                 cloudstorage::IHttpRequest::Failure,
                                 "Can't copy a directory");
@@ -124,11 +66,22 @@ void CopyItemRequest::update(CloudContext* context, CloudItem* source,
           });
 
   auto p = source->provider().provider_;
-  auto r = p->downloadFileAsync(
-      source->item(),
-      std::make_shared<Download>(
-          object, context->request_pool(), destination->item(),
-          destination->provider().provider_,
-          CloudContext::sanitize(source->filename()).toStdString()));
-  context->add(source->provider().provider_, std::move(r));
+  if (same_provider) {
+    auto r = p->copyItemAsync(
+        source->item(), destination->item(),
+        [object](cloudstorage::EitherError<cloudstorage::IItem> e) {
+          if (e.left())
+            emit object->finishedVoid(e.left());
+          else
+            emit object->finishedVoid(nullptr);
+          object->deleteLater();
+        });
+    return context->add(p, std::move(r));
+  }
+  auto r = context->transfer_pipe()->transfer(
+      *p, source->item(), *destination->provider().provider_,
+      destination->item(),
+      CloudContext::sanitize(source->filename()).toStdString(),
+      std::make_shared<Transfer>(object));
+  context->add(p, std::move(r));
 }
@@ -0,0 +1,98 @@
+#include "BlockCache.h"
+
+namespace cloudstorage {
+
+BlockCache::BlockCache(uint64_t budget)
+    : budget_(budget),
+      size_(),
+      hand_(),
+      hits_(),
+      misses_(),
+      evicted_blocks_(),
+      wasted_bytes_() {}
+
+BlockCache::Block BlockCache::get(FileId node, uint64_t index) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find({node, index});
+  if (it == index_.end()) {
+    misses_++;
+    return nullptr;
+  }
+  hits_++;
+  auto& entry = entries_[it->second];
+  entry.referenced_ = true;
+  entry.read_ = true;
+  return entry.block_;
+}
+
+bool BlockCache::contains(FileId node, uint64_t index) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return index_.find({node, index}) != index_.end();
+}
+
+void BlockCache::put(FileId node, uint64_t index, Block block, bool read) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Key key{node, index};
+  auto it = index_.find(key);
+  if (it != index_.end()) erase(it->second);
+  size_t slot;
+  if (free_slots_.empty()) {
+    slot = entries_.size();
+    entries_.push_back({});
+  } else {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+  }
+  size_ += block->size();
+  // Fresh blocks go through one sweep before they may be evicted, otherwise
+  // a read ahead block could be dropped before it is read.
+  entries_[slot] = {key, std::move(block), true, read};
+  index_[key] = slot;
+  node_blocks_[node].insert(index);
+  evict();
+}
+
+void BlockCache::remove(FileId node) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = node_blocks_.find(node);
+  if (it == node_blocks_.end()) return;
+  auto blocks = std::move(it->second);
+  for (auto index : blocks) erase(index_[{node, index}]);
+}
+
+BlockCache::Statistics BlockCache::statistics() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return {hits_, misses_, evicted_blocks_, wasted_bytes_, size_};
+}
+
+void BlockCache::erase(size_t slot) {
+  auto& entry = entries_[slot];
+  size_ -= entry.block_->size();
+  if (!entry.read_) wasted_bytes_ += entry.block_->size();
+  index_.erase(entry.key_);
+  auto it = node_blocks_.find(entry.key_.node_);
+  if (it != node_blocks_.end()) {
+    it->second.erase(entry.key_.index_);
+    if (it->second.empty()) node_blocks_.erase(it);
+  }
+  entry.block_ = nullptr;
+  free_slots_.push_back(slot);
+}
+
+void BlockCache::evict() {
+  while (size_ > budget_) {
+    if (hand_ >= entries_.size()) hand_ = 0;
+    auto& entry = entries_[hand_];
+    if (entry.block_) {
+      if (entry.referenced_) {
+        entry.referenced_ = false;
+      } else {
+        erase(hand_);
+        evicted_blocks_++;
+      }
+    }
+    hand_++;
+  }
+}
+
+}  // namespace cloudstorage
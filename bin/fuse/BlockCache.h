@@ -0,0 +1,108 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "IFileSystem.h"
+
+namespace cloudstorage {
+
+/**
+ * Contents of files read through the file system, kept in blocks of
+ * BLOCK_SIZE bytes which start at multiples of BLOCK_SIZE; the last block of
+ * a file may be shorter. All files share one byte budget, blocks over it are
+ * evicted with the CLOCK algorithm: a block survives one sweep of the clock
+ * hand for every lookup since the previous sweep.
+ *
+ * Blocks are immutable and reference counted, so readers keep using a block
+ * after it was evicted.
+ */
+class BlockCache {
+ public:
+  using FileId = IFileSystem::FileId;
+  using Block = std::shared_ptr<const std::string>;
+
+  static constexpr uint64_t BLOCK_SIZE = 128 * 1024;
+
+  struct Statistics {
+    uint64_t hits_;
+    uint64_t misses_;
+    uint64_t evicted_blocks_;
+    // Bytes of blocks which were dropped before any lookup found them.
+    uint64_t wasted_bytes_;
+    uint64_t size_;
+  };
+
+  explicit BlockCache(uint64_t budget);
+
+  /**
+   * @return block of node with given index or nullptr if it isn't cached
+   */
+  Block get(FileId node, uint64_t index);
+  /**
+   * Same as get != nullptr, but doesn't count as a lookup.
+   */
+  bool contains(FileId node, uint64_t index) const;
+  /**
+   * @param read whether block is being read already, i.e. it wasn't fetched
+   * ahead of reads
+   */
+  void put(FileId node, uint64_t index, Block, bool read = false);
+
+  /**
+   * Drops all blocks of node, e.g. after its content changed.
+   */
+  void remove(FileId node);
+
+  Statistics statistics() const;
+
+ private:
+  struct Key {
+    FileId node_;
+    uint64_t index_;
+
+    bool operator==(const Key& other) const {
+      return node_ == other.node_ && index_ == other.index_;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return std::hash<uint64_t>()(key.node_ * 0x9e3779b97f4a7c15ull ^
+                                   key.index_);
+    }
+  };
+
+  struct Entry {
+    Key key_;
+    Block block_;
+    bool referenced_;
+    bool read_;
+  };
+
+  void erase(size_t slot);
+  void evict();
+
+  mutable std::mutex mutex_;
+  uint64_t budget_;
+  uint64_t size_;
+  std::vector<Entry> entries_;
+  std::vector<size_t> free_slots_;
+  std::unordered_map<Key, size_t, KeyHash> index_;
+  std::unordered_map<FileId, std::unordered_set<uint64_t>> node_blocks_;
+  size_t hand_;
+  uint64_t hits_;
+  uint64_t misses_;
+  uint64_t evicted_blocks_;
+  uint64_t wasted_bytes_;
+};
+
+}  // namespace cloudstorage
+
+#endif  // BLOCK_CACHE_H
@@ -0,0 +1,216 @@
+#include "DiskCache.h"
+
+#include <cstdio>
+
+#include "Utility/Utility.h"
+
+namespace cloudstorage {
+
+namespace {
+
+// Index is compacted once it holds that many records per slot.
+const uint64_t INDEX_GROWTH = 4;
+
+}  // namespace
+
+constexpr uint64_t DiskCache::BLOCK_SIZE;
+
+DiskCache::DiskCache(const std::string& directory, uint64_t budget)
+    : directory_(directory),
+      slot_count_(budget / BLOCK_SIZE),
+      index_records_(),
+      slots_(slot_count_),
+      size_(),
+      hits_(),
+      written_blocks_(),
+      evicted_blocks_(),
+      corrupted_blocks_() {
+  auto path = directory_ + "/blocks";
+  auto mode = std::ios::in | std::ios::out | std::ios::binary;
+  blocks_.open(path, mode);
+  if (!blocks_.is_open()) {
+    std::ofstream(path, std::ios::binary);
+    blocks_.open(path, mode);
+  }
+  if (!blocks_.is_open()) {
+    util::log("couldn't open disk cache in", directory_);
+    slot_count_ = 0;
+    slots_.clear();
+    return;
+  }
+  load();
+}
+
+DiskCache::~DiskCache() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (blocks_.is_open()) compact();
+}
+
+std::string DiskCache::key(const std::string& label, const IItem& item) {
+  Json::Value json;
+  if (!item.content_hash().empty())
+    json["v"] = std::to_string(static_cast<int>(item.content_hash_type())) +
+                ":" + item.content_hash();
+  else if (item.timestamp() != IItem::UnknownTimeStamp)
+    json["v"] = Json::Int64(std::chrono::duration_cast<std::chrono::seconds>(
+                                item.timestamp().time_since_epoch())
+                                .count());
+  else
+    return "";
+  json["p"] = label;
+  json["i"] = item.id();
+  json["s"] = Json::UInt64(item.size());
+  return util::json::to_string(json);
+}
+
+DiskCache::Block DiskCache::get(const std::string& key, uint64_t index) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = slot_.find(name(key, index));
+  if (it == slot_.end()) return nullptr;
+  auto slot = it->second;
+  auto& entry = slots_[slot];
+  std::string data(entry.size_, '\0');
+  blocks_.clear();
+  blocks_.seekg(static_cast<std::streamoff>(slot * BLOCK_SIZE));
+  blocks_.read(&data[0], entry.size_);
+  if (!blocks_ || util::fnv1a(data.data(), data.size()) != entry.checksum_) {
+    corrupted_blocks_++;
+    erase(slot);
+    return nullptr;
+  }
+  usage_.splice(usage_.end(), usage_, entry.usage_);
+  hits_++;
+  return std::make_shared<const std::string>(std::move(data));
+}
+
+bool DiskCache::contains(const std::string& key, uint64_t index) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return slot_.find(name(key, index)) != slot_.end();
+}
+
+void DiskCache::put(const std::string& key, uint64_t index,
+                    const Block& block) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (slot_count_ == 0 || key.empty() || block->size() > BLOCK_SIZE) return;
+  auto block_name = name(key, index);
+  if (slot_.find(block_name) != slot_.end()) return;
+  auto slot = allocate();
+  blocks_.clear();
+  blocks_.seekp(static_cast<std::streamoff>(slot * BLOCK_SIZE));
+  blocks_.write(block->data(), static_cast<std::streamsize>(block->size()));
+  blocks_.flush();
+  if (!blocks_) {
+    free_slots_.push_back(slot);
+    return;
+  }
+  auto& entry = slots_[slot];
+  entry.key_ = key;
+  entry.index_ = index;
+  entry.size_ = static_cast<uint32_t>(block->size());
+  entry.checksum_ = util::fnv1a(block->data(), block->size());
+  entry.usage_ = usage_.insert(usage_.end(), slot);
+  slot_[block_name] = slot;
+  size_ += entry.size_;
+  written_blocks_++;
+  append(slot);
+}
+
+DiskCache::Statistics DiskCache::statistics() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return {hits_, written_blocks_, evicted_blocks_, corrupted_blocks_, size_};
+}
+
+std::string DiskCache::name(const std::string& key, uint64_t index) {
+  return key + "#" + std::to_string(index);
+}
+
+Json::Value DiskCache::toJson(size_t slot, const Slot& entry) {
+  Json::Value json;
+  json["slot"] = Json::UInt64(slot);
+  json["key"] = entry.key_;
+  json["index"] = Json::UInt64(entry.index_);
+  json["size"] = entry.size_;
+  json["checksum"] = Json::UInt64(entry.checksum_);
+  return json;
+}
+
+void DiskCache::load() {
+  blocks_.seekg(0, std::ios::end);
+  auto pack_size = static_cast<uint64_t>(blocks_.tellg());
+  std::ifstream file(directory_ + "/index");
+  std::string line;
+  while (std::getline(file, line)) {
+    try {
+      auto json = util::json::from_string(line);
+      auto slot = json["slot"].asUInt64();
+      auto size = json["size"].asUInt();
+      if (slot >= slot_count_ || size > BLOCK_SIZE ||
+          slot * BLOCK_SIZE + size > pack_size)
+        continue;
+      if (!slots_[slot].key_.empty()) erase(slot);
+      auto block_name =
+          name(json["key"].asString(), json["index"].asUInt64());
+      auto previous = slot_.find(block_name);
+      if (previous != slot_.end()) erase(previous->second);
+      auto& entry = slots_[slot];
+      entry.key_ = json["key"].asString();
+      entry.index_ = json["index"].asUInt64();
+      entry.size_ = size;
+      entry.checksum_ = json["checksum"].asUInt64();
+      entry.usage_ = usage_.insert(usage_.end(), slot);
+      slot_[block_name] = slot;
+      size_ += size;
+    } catch (const Json::Exception&) {
+      // Only the last line can be cut short, by a crash mid-append. If an
+      // older record names the same slot, its checksum won't match the
+      // block written over it, and get() drops it.
+    }
+  }
+  file.close();
+  free_slots_.clear();
+  for (auto slot = slot_count_; slot > 0; slot--)
+    if (slots_[slot - 1].key_.empty()) free_slots_.push_back(slot - 1);
+  compact();
+}
+
+void DiskCache::compact() {
+  auto path = directory_ + "/index";
+  auto temporary = path + ".tmp";
+  {
+    std::ofstream compacted(temporary, std::ios::trunc);
+    for (auto slot : usage_)
+      compacted << util::json::to_string(toJson(slot, slots_[slot])) << "\n";
+  }
+  index_.close();
+  std::rename(temporary.c_str(), path.c_str());
+  index_.clear();
+  index_.open(path, std::ios::app);
+  index_records_ = usage_.size();
+}
+
+void DiskCache::append(size_t slot) {
+  index_ << util::json::to_string(toJson(slot, slots_[slot])) << "\n";
+  index_.flush();
+  if (++index_records_ > INDEX_GROWTH * slot_count_) compact();
+}
+
+void DiskCache::erase(size_t slot) {
+  auto& entry = slots_[slot];
+  slot_.erase(name(entry.key_, entry.index_));
+  usage_.erase(entry.usage_);
+  size_ -= entry.size_;
+  entry.key_.clear();
+  free_slots_.push_back(slot);
+}
+
+size_t DiskCache::allocate() {
+  if (free_slots_.empty()) {
+    erase(usage_.front());
+    evicted_blocks_++;
+  }
+  auto slot = free_slots_.back();
+  free_slots_.pop_back();
+  return slot;
+}
+
+}  // namespace cloudstorage
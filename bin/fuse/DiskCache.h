@@ -0,0 +1,112 @@
+#ifndef DISK_CACHE_H
+#define DISK_CACHE_H
+
+#include <json/json.h>
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BlockCache.h"
+
+namespace cloudstorage {
+
+/**
+ * Blocks of BlockCache::BLOCK_SIZE bytes of file content kept in a directory
+ * across mounts. Blocks are identified by a key naming the file together
+ * with its version, see key(), so that blocks of a file which changed on the
+ * provider are never returned.
+ *
+ * The directory holds two files:
+ *  - "blocks": the pack, budget / BLOCK_SIZE slots of BLOCK_SIZE bytes each,
+ *  - "index": a log of json records, one per line, each assigning a slot to
+ *    a block; the last record of a slot wins.
+ *
+ * Block data is written before the record which points at it, and each
+ * record carries a checksum of the block, so a crash at any point loses at
+ * most the blocks written last. When the pack is full, the least recently
+ * used block is overwritten. The log is compacted when the cache is opened,
+ * when it is closed, and when it grows past a few records per slot; records
+ * are then written from the least to the most recently used block, so that
+ * usage order survives remounts.
+ */
+class DiskCache {
+ public:
+  using Block = BlockCache::Block;
+
+  static constexpr uint64_t BLOCK_SIZE = BlockCache::BLOCK_SIZE;
+
+  struct Statistics {
+    uint64_t hits_;
+    uint64_t written_blocks_;
+    uint64_t evicted_blocks_;
+    uint64_t corrupted_blocks_;
+    uint64_t size_;
+  };
+
+  /**
+   * @param directory has to exist; the cache stays empty if its files can't
+   * be opened
+   */
+  DiskCache(const std::string& directory, uint64_t budget);
+  ~DiskCache();
+
+  /**
+   * @param label name of provider's account, unique within the mount
+   * @return key of item's content or empty string if item's version can't
+   * be told, i.e. it has neither a content hash nor a timestamp
+   */
+  static std::string key(const std::string& label, const IItem& item);
+
+  /**
+   * @return block of file with given key or nullptr if it isn't cached or
+   * its data turned out damaged
+   */
+  Block get(const std::string& key, uint64_t index);
+  bool contains(const std::string& key, uint64_t index) const;
+  void put(const std::string& key, uint64_t index, const Block&);
+
+  Statistics statistics() const;
+
+ private:
+  struct Slot {
+    std::string key_;
+    uint64_t index_;
+    uint32_t size_;
+    uint64_t checksum_;
+    std::list<size_t>::iterator usage_;
+  };
+
+  static std::string name(const std::string& key, uint64_t index);
+  static Json::Value toJson(size_t slot, const Slot&);
+
+  void load();
+  void compact();
+  void append(size_t slot);
+  void erase(size_t slot);
+  size_t allocate();
+
+  std::string directory_;
+  mutable std::mutex mutex_;
+  uint64_t slot_count_;
+  std::fstream blocks_;
+  std::ofstream index_;
+  uint64_t index_records_;
+  std::vector<Slot> slots_;
+  std::vector<size_t> free_slots_;
+  // Occupied slots, the least recently used one first.
+  std::list<size_t> usage_;
+  std::unordered_map<std::string, size_t> slot_;
+  uint64_t size_;
+  uint64_t hits_;
+  uint64_t written_blocks_;
+  uint64_t evicted_blocks_;
+  uint64_t corrupted_blocks_;
+};
+
+}  // namespace cloudstorage
+
+#endif  // DISK_CACHE_H
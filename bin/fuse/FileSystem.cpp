@@ -2,6 +2,7 @@
 
 #include <json/json.h>
 #include <algorithm>
+#include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <iostream>
@@ -34,16 +35,38 @@ IItem::Pointer auth_item(const std::string& url) {
       IItem::UnknownTimeStamp, IItem::FileType::Unknown);
 }
 
-std::string id(const std::shared_ptr<ICloudProvider>& p,
-               const IItem::Pointer& i) {
-  Json::Value json;
-  if (p) json["p"] = p->name();
-  json["i"] = i->filename() + i->id();
-  return util::json::to_string(json);
+// Whether item listed by provider differs from the one node was made of;
+// timestamps are compared to a second, as precise as the ones restored by
+// restore_tree().
+bool changed(const FileSystem::Node& node, const IItem& item) {
+  auto seconds = [](IItem::TimeStamp time) {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        time.time_since_epoch());
+  };
+  return node.item()->content_hash() != item.content_hash() ||
+         seconds(node.timestamp()) != seconds(item.timestamp()) ||
+         (item.size() != IItem::UnknownSize &&
+          node.item()->size() != item.size());
+}
+
+bool same_content(const FileSystem::Node& n1, const FileSystem::Node& n2) {
+  return n1.item() && n2.item() && n1.item()->id() == n2.item()->id() &&
+         n1.size() == n2.size() && n1.timestamp() == n2.timestamp();
 }
 
 }  // namespace
 
+bool FileSystem::ItemKey::operator==(const ItemKey& key) const {
+  return provider_ == key.provider_ && id_ == key.id_ &&
+         filename_ == key.filename_;
+}
+
+size_t FileSystem::ItemKeyHash::operator()(const ItemKey& key) const {
+  size_t hash = key.id_;
+  hash = hash * 31 + key.filename_;
+  return hash * 31 + std::hash<const ICloudProvider*>()(key.provider_);
+}
+
 FileSystem::Node::Node() : parent_(), inode_(), size_() {}
 
 FileSystem::Node::Node(std::shared_ptr<ICloudProvider> p, IItem::Pointer item,
@@ -54,9 +77,7 @@ FileSystem::Node::Node(std::shared_ptr<ICloudProvider> p, IItem::Pointer item,
       inode_(inode),
       size_(size) {}
 
-FileSystem::Node::~Node() {
-  if (store_) (void)std::remove(cache_filename_.c_str());
-}
+FileSystem::Node::~Node() = default;
 
 FileSystem::FileId FileSystem::Node::inode() const { return inode_; }
 
@@ -78,44 +99,65 @@ std::shared_ptr<ICloudProvider> FileSystem::Node::provider() const {
   return provider_;
 }
 
-std::shared_ptr<IGenericRequest> FileSystem::Node::upload_request() const {
-  return upload_request_;
-}
-
-void FileSystem::Node::set_upload_request(std::shared_ptr<IGenericRequest> r) {
-  upload_request_ = std::move(r);
-}
-
 FileSystem::FileSystem(const std::vector<ProviderEntry>& provider,
-                       IHttp::Pointer http, std::string temporary_directory)
+                       IHttp::Pointer http, std::string temporary_directory,
+                       const Options& options)
     : next_(1),
       running_(true),
       http_(std::move(http)),
       temporary_directory_(std::move(temporary_directory)),
+      cache_(options.memory_cache_size_),
+      reads_(),
+      read_hits_(),
+      read_ahead_bytes_(),
+      disk_cache_(options.disk_cache_directory_.empty()
+                      ? nullptr
+                      : util::make_unique<DiskCache>(
+                            options.disk_cache_directory_,
+                            options.disk_cache_size_)),
+      tree_file_(options.disk_cache_directory_.empty()
+                     ? ""
+                     : options.disk_cache_directory_ + "/tree"),
+      write_budget_(std::make_shared<WriteBuffer::Budget>(
+          options.write_memory_size_, options.write_disk_size_)),
       cancelled_request_thread_(std::async(
           std::launch::async, std::bind(&FileSystem::cancelled, this))),
       cleanup_(std::async(std::launch::async,
-                          std::bind(&FileSystem::cleanup, this))) {
+                          std::bind(&FileSystem::cleanup, this))),
+      write_back_(std::async(std::launch::async,
+                             std::bind(&FileSystem::write_back, this))) {
   add(nullptr, 0,
       util::make_unique<cloudstorage::Item>("/", "root", IItem::UnknownSize,
                                             IItem::UnknownTimeStamp,
                                             IItem::FileType::Directory));
-  std::unordered_set<FileId> root_directory;
+  Directory root_directory;
   for (auto&& entry : provider) {
     IItem::Pointer item = util::make_unique<cloudstorage::Item>(
         entry.label_, entry.provider_->rootDirectory()->id(),
         IItem::UnknownSize, IItem::UnknownTimeStamp,
         IItem::FileType::Directory);
     auto provider_id = add(entry.provider_, 1, item)->inode();
-    root_directory.insert(provider_id);
+    root_directory[sanitize(entry.label_)] = provider_id;
+    provider_label_[entry.provider_.get()] = entry.label_;
     auth_node_[entry.label_] =
         add(entry.provider_, provider_id, auth_item(entry.provider_->name()))
             ->inode();
   }
   node_directory_[1] = root_directory;
+  restore_tree();
 }
 
 FileSystem::~FileSystem() {
+  auto statistics = readStatistics();
+  log("reads", statistics.reads_, "hits", statistics.hits_, "read ahead",
+      statistics.read_ahead_bytes_, "wasted", statistics.wasted_bytes_);
+  {
+    std::lock_guard<mutex> lock(write_back_mutex_);
+    closing_ = true;
+  }
+  write_back_condition_.notify_one();
+  write_back_.wait();
+  store_tree();
   running_ = false;
   request_data_condition_.notify_one();
   cancelled_request_condition_.notify_one();
@@ -176,51 +218,70 @@ void FileSystem::add(RequestData r) {
 FileSystem::Node::Pointer FileSystem::add(std::shared_ptr<ICloudProvider> p,
                                           FileId parent, IItem::Pointer i) {
   std::lock_guard<mutex> lock(node_data_mutex_);
-  auto it = node_id_map_.find(id(p, i));
+  ItemKey key;
+  auto it = find_key(p.get(), i->id(), i->filename(), key)
+                ? node_id_map_.find(key)
+                : std::end(node_id_map_);
   if (it == std::end(node_id_map_)) {
     auto idx = next_++;
     auto node = std::make_shared<Node>(p, i, parent, idx, i->size());
     node_map_[idx] = node;
-    node_id_map_[id(p, i)] = node;
-    if (parent > 0) {
-      auto parent_node = node_map_[parent];
-      node->path_ = parent_node->path_ + "/" + sanitize(i->filename());
-      node_path_to_id_[node->path_] = idx;
-    } else {
-      node_path_to_id_[""] = idx;
-    }
+    node_id_map_[intern_key(p.get(), i->id(), i->filename())] = idx;
     return node;
-  } else
-    return it->second;
+  }
+  auto node = node_map_[it->second];
+  if (!changed(*node, *i)) return node;
+  {
+    // Data written locally is newer than the one reported by provider.
+    std::lock_guard<mutex> lock(write_back_mutex_);
+    if (dirty_file_.find(node->inode()) != dirty_file_.end()) return node;
+  }
+  auto updated = std::make_shared<Node>(p, i, parent, node->inode(), i->size());
+  set(node->inode(), updated);
+  return updated;
 }
 
 void FileSystem::set(FileId idx, const Node::Pointer& node) {
   std::lock_guard<mutex> lock(node_data_mutex_);
+  auto previous = node_map_.find(idx);
+  if (previous != node_map_.end()) {
+    if (previous->second != node && !same_content(*previous->second, *node))
+      cache_.remove(idx);
+    ItemKey key;
+    if (find_key(previous->second->provider().get(),
+                 previous->second->item()->id(), previous->second->filename(),
+                 key)) {
+      auto it = node_id_map_.find(key);
+      if (it != node_id_map_.end() && it->second == idx) {
+        node_id_map_.erase(it);
+        release_key(key);
+      }
+    }
+  }
   if (node->item()) {
     node_map_[idx] = node;
-    node_id_map_[id(node->provider(), node->item())] = node;
-    if (node->parent_ > 0) {
-      node->path_ =
-          node_map_[node->parent_]->path_ + "/" + sanitize(node->filename());
-      node_path_to_id_[node->path_] = idx;
-    } else {
-      node_path_to_id_[""] = idx;
+    auto key =
+        intern_key(node->provider().get(), node->item()->id(), node->filename());
+    auto it = node_id_map_.emplace(key, idx);
+    if (!it.second) {
+      it.first->second = idx;
+      release_key(key);
     }
   } else {
-    auto it1 = node_map_.find(idx);
-    if (it1 != std::end(node_map_)) {
-      auto it2 =
-          node_id_map_.find(id(it1->second->provider(), it1->second->item()));
-      if (it2 != std::end(node_id_map_)) node_id_map_.erase(it2);
-      node_map_.erase(it1);
-    }
-    auto it3 = node_directory_.find(idx);
-    if (it3 != std::end(node_directory_)) node_directory_.erase(it3);
-    auto it4 = node_path_to_id_.find(node->path_);
-    if (it4 != node_path_to_id_.end()) node_path_to_id_.erase(it4);
+    if (previous != node_map_.end()) node_map_.erase(previous);
+    auto it = node_directory_.find(idx);
+    if (it != std::end(node_directory_)) node_directory_.erase(it);
   }
 }
 
+void FileSystem::unlink(FileId parent, const Node& node) {
+  auto it = node_directory_.find(parent);
+  if (it == node_directory_.end()) return;
+  auto child = it->second.find(sanitize(node.filename()));
+  if (child != it->second.end() && child->second == node.inode())
+    it->second.erase(child);
+}
+
 IFileSystem::FileId FileSystem::mknod(FileId parent, const char* name) {
   std::lock_guard<mutex> lock(node_data_mutex_);
   auto p = get(parent);
@@ -228,19 +289,45 @@ IFileSystem::FileId FileSystem::mknod(FileId parent, const char* name) {
   auto node = add(p->provider(), parent,
                   std::make_shared<Item>(name, "", 0, IItem::UnknownTimeStamp,
                                          IItem::FileType::Unknown));
-  node->cache_filename_ =
-      temporary_directory_ + "cloudstorage" + std::to_string(node->inode());
-  node->store_ = util::make_unique<std::fstream>(
-      node->cache_filename_,
-      std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+  {
+    // New file is uploaded even if nothing gets written to it.
+    std::lock_guard<mutex> lock(write_back_mutex_);
+    auto file = dirty_file(node->inode());
+    file->generation_++;
+    schedule(*file);
+  }
+  write_back_condition_.notify_one();
   {
     std::lock_guard<mutex> lock(node_data_mutex_);
     auto it = node_directory_.find(node->parent_);
-    if (it != node_directory_.end()) it->second.insert(node->inode());
+    if (it != node_directory_.end())
+      it->second[sanitize(node->filename())] = node->inode();
   }
   return node->inode();
 }
 
+bool FileSystem::find_key(const ICloudProvider* p, const std::string& id,
+                          const std::string& filename, ItemKey& key) {
+  auto strings = item_strings_.find(p);
+  if (strings == item_strings_.end()) return false;
+  key.provider_ = p;
+  return strings->second.find(id, key.id_) &&
+         strings->second.find(filename, key.filename_);
+}
+
+FileSystem::ItemKey FileSystem::intern_key(const ICloudProvider* p,
+                                           const std::string& id,
+                                           const std::string& filename) {
+  auto& strings = item_strings_[p];
+  return ItemKey{p, strings.intern(id), strings.intern(filename)};
+}
+
+void FileSystem::release_key(const ItemKey& key) {
+  auto& strings = item_strings_[key.provider_];
+  strings.release(key.id_);
+  strings.release(key.filename_);
+}
+
 FileSystem::Node::Pointer FileSystem::get(FileId node) {
   std::unique_lock<mutex> lock(node_data_mutex_);
   auto it = node_map_.find(node);
@@ -311,17 +398,21 @@ void FileSystem::getattr(FileId node, GetItemCallback cb) {
 void FileSystem::getattr(const std::string& full_path,
                          GetItemCallback callback) {
   std::unique_lock<mutex> lock(node_data_mutex_);
-  std::string path = full_path;
-  if (!path.empty() && path.back() == '/') {
-    path.pop_back();
-  }
-  auto it = node_path_to_id_.find(path);
-  if (it == node_path_to_id_.end()) {
-    lock.unlock();
-    callback(Error{IHttpRequest::NotFound, "file not found"});
-  } else {
-    getattr(it->second, callback);
+  FileId node = 1;
+  std::stringstream stream(full_path);
+  std::string name;
+  while (std::getline(stream, name, '/')) {
+    if (name.empty()) continue;
+    auto directory = node_directory_.find(node);
+    if (directory == node_directory_.end() ||
+        directory->second.find(name) == directory->second.end()) {
+      lock.unlock();
+      return callback(Error{IHttpRequest::NotFound, "file not found"});
+    }
+    node = directory->second[name];
   }
+  lock.unlock();
+  getattr(node, callback);
 }
 
 void FileSystem::get_path(FileId node, const std::string& path,
@@ -342,21 +433,23 @@ void FileSystem::write(FileId inode, const char* data, uint32_t size,
   getattr(inode, [=](EitherError<INode> e) {
     if (e.left()) return callback(0);
     auto n = static_cast<Node*>(e.right().get());
-    std::lock_guard<mutex> lock(n->mutex_);
-    if (!n->store_) {
-      n->cache_filename_ =
-          temporary_directory_ + "cloudstorage" + std::to_string(n->inode());
-      n->store_ = util::make_unique<std::fstream>(
-          n->cache_filename_,
-          std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
-    }
-    util::log("writing", e.right()->filename(), offset, "-", offset + size - 1);
-    n->store_->seekp(offset);
-    n->store_->write(data, size);
-    if (!n->store_)
-      return callback(0);
-    else
-      return callback(size);
+    {
+      std::lock_guard<mutex> lock(write_back_mutex_);
+      auto file = dirty_file(inode);
+      if (!file->buffer_->write(data, size, offset))
+        return callback(Error{NoSpace, "write buffer full"});
+      file->generation_++;
+      if (file->uploading_ && !file->upload_cancelled_ &&
+          file->upload_cancel_count_ < MAX_UPLOAD_CANCEL_COUNT) {
+        file->upload_cancelled_ = true;
+        file->upload_cancel_count_++;
+        if (file->upload_) cancel(file->upload_);
+      }
+      schedule(*file);
+      n->set_size(file->buffer_->size());
+    }
+    write_back_condition_.notify_one();
+    callback(size);
   });
 }
 
@@ -367,7 +460,7 @@ void FileSystem::readdir(FileId node, ListDirectoryCallback cb) {
     auto it = node_directory_.find(node);
     if (it != std::end(node_directory_)) {
       INode::List ret;
-      for (auto&& r : it->second) ret.push_back(get(r));
+      for (auto&& r : it->second) ret.push_back(get(r.second));
       reported = true;
       lock.unlock();
       cb(ret);
@@ -391,11 +484,12 @@ void FileSystem::readdir(FileId node, ListDirectoryCallback cb) {
   list_directory_async(
       nd->provider(), nd->item(), [=](EitherError<IItem::List> e) {
         if (auto lst = e.right()) {
-          std::unordered_set<FileId> ret;
+          Directory ret;
           for (auto&& i : *lst)
             if (i->type() == IItem::FileType::Directory ||
                 i->size() != IItem::UnknownSize || !IGNORE_UNKNOWN_SIZE)
-              ret.insert(this->add(nd->provider(), node, i)->inode());
+              ret[this->sanitize(i->filename())] =
+                  this->add(nd->provider(), node, i)->inode();
           {
             std::lock_guard<mutex> lock(node_data_mutex_);
             node_directory_[node] = ret;
@@ -403,7 +497,7 @@ void FileSystem::readdir(FileId node, ListDirectoryCallback cb) {
           }
           if (!reported) {
             INode::List nodes;
-            for (auto&& r : ret) nodes.push_back(this->get(r));
+            for (auto&& r : ret) nodes.push_back(this->get(r.second));
             cb(nodes);
           }
         } else {
@@ -426,84 +520,334 @@ void FileSystem::read(FileId node, size_t offset, size_t sz,
                       DownloadItemCallback cb) {
   getattr(node, [=](EitherError<INode> e) {
     if (e.left()) return cb(e.left());
+    {
+      // Data which wasn't uploaded yet is read from where it was written.
+      std::unique_lock<mutex> lock(write_back_mutex_);
+      auto it = dirty_file_.find(node);
+      if (it != dirty_file_.end()) {
+        auto& buffer = *it->second->buffer_;
+        auto size = offset < buffer.size()
+                        ? std::min<uint64_t>(sz, buffer.size() - offset)
+                        : 0;
+        std::string data(static_cast<size_t>(size), '\0');
+        buffer.read(&data[0], static_cast<uint32_t>(data.size()), offset);
+        lock.unlock();
+        return cb(ReadBuffer(std::move(data)));
+      }
+    }
     auto nd = std::static_pointer_cast<Node>(e.right());
     if (nd->size() == IItem::UnknownSize || nd->size() == 0 || !nd->provider())
-      return cb(std::string());
+      return cb(ReadBuffer());
     if (nd->item()->id() == AUTH_ITEM_ID) {
       auto data = authorize_file(nd->provider()->authorizeLibraryUrl());
       auto start = std::min<size_t>(offset, data.size() - 1);
       auto size = std::min<size_t>(data.size() - start, sz);
-      auto d = data.substr(start, size);
-      return cb(d);
-    }
-    auto fit = [=](Range r) {
-      r.start_ =
-          std::min<size_t>(r.start_, static_cast<size_t>(nd->size() - 1));
-      r.size_ =
-          std::min<size_t>(r.size_, static_cast<size_t>(nd->size() - r.start_));
-      return r;
-    };
-    Range range = fit({offset, sz});
+      return cb(ReadBuffer(data.substr(start, size)));
+    }
+    if (offset >= nd->size() || sz == 0) return cb(ReadBuffer());
+    Range range{offset, std::min<uint64_t>(sz, nd->size() - offset)};
+    auto request = nd->provider()->chunkSizer()->chunkSize(
+                       "read_ahead", IChunkSizer::Direction::Download,
+                       READ_AHEAD) /
+                   BlockCache::BLOCK_SIZE;
+    auto first = range.start_ / BlockCache::BLOCK_SIZE;
+    auto last = (range.start_ + range.size_ - 1) / BlockCache::BLOCK_SIZE;
     std::unique_lock<mutex> lock(nd->mutex_);
-    auto inside = [=](Range r1, Range r2) {
-      r1 = fit(r1);
-      r2 = fit(r2);
-      return r1.start_ >= r2.start_ &&
-             r1.start_ + r1.size_ <= r2.start_ + r2.size_;
-    };
-    auto download = [=](Range range) {
-      for (auto&& download_range : nd->pending_download_)
-        if (inside(range, download_range)) return;
-      range = fit({range.start_, std::max<size_t>(range.size_, READ_AHEAD)});
-      nd->pending_download_.push_back(range);
-      download_item_async(
-          nd->provider(), nd->item(), range, [=](EitherError<std::string> e) {
-            std::unique_lock<mutex> lock(nd->mutex_);
-            auto requests = nd->read_request_;
-            for (auto&& read : requests)
-              if (inside(read.range_, range)) {
-                if (e.left())
-                  read.callback_(e.left());
-                else
-                  read.callback_(e.right()->substr(
-                      read.range_.start_ - range.start_, read.range_.size_));
-                auto it = std::find(nd->read_request_.begin(),
-                                    nd->read_request_.end(), read);
-                if (it != nd->read_request_.end()) nd->read_request_.erase(it);
-              }
-            auto it = std::find(nd->pending_download_.begin(),
-                                nd->pending_download_.end(), range);
-            if (it != nd->pending_download_.end())
-              nd->pending_download_.erase(it);
-            if (e.right()) {
-              nd->chunk_.push_back({range, std::move(*e.right())});
-              if (nd->chunk_.size() >= CACHED_CHUNK_COUNT)
-                nd->chunk_.pop_front();
-            }
-          });
-    };
-    bool read_ahead = true;
-    for (auto&& chunk : nd->chunk_)
-      if (inside(Range{range.start_ + READ_AHEAD / 2, READ_AHEAD / 2},
-                 chunk.range_))
-        read_ahead = false;
-    if (read_ahead) download(Range{range.start_ + READ_AHEAD / 2, range.size_});
-    for (auto&& chunk : nd->chunk_)
-      if (inside(range, chunk.range_))
-        return cb(chunk.data_.substr(range.start_ - chunk.range_.start_,
-                                     range.size_));
-    nd->read_request_.push_back({range, cb});
-    download(range);
+    restore(*nd, first, last - first + 1);
+    ReadBuffer data;
+    bool hit = gather(*nd, range, {}, data);
+    reads_++;
+    if (hit) {
+      read_hits_++;
+    } else {
+      nd->read_request_.push_back({range, cb});
+      download(nd, first, last - first + 1);
+    }
+    read_ahead(nd, range, hit, request);
+    lock.unlock();
+    if (hit) cb(std::move(data));
   });
 }
 
+bool FileSystem::gather(
+    const Node& nd, Range range,
+    const std::unordered_map<uint64_t, BlockCache::Block>& downloaded,
+    ReadBuffer& result) {
+  ReadBuffer data;
+  auto offset = range.start_;
+  auto end = range.start_ + range.size_;
+  while (offset < end) {
+    auto index = offset / BlockCache::BLOCK_SIZE;
+    auto it = downloaded.find(index);
+    auto block =
+        it != downloaded.end() ? it->second : cache_.get(nd.inode(), index);
+    auto block_offset = offset - index * BlockCache::BLOCK_SIZE;
+    if (!block || block->size() <= block_offset) return false;
+    auto size = std::min<uint64_t>(block->size() - block_offset, end - offset);
+    data.append({block, static_cast<size_t>(block_offset),
+                 static_cast<size_t>(size)});
+    offset += size;
+  }
+  result = std::move(data);
+  return true;
+}
+
+void FileSystem::read_ahead(const Node::Pointer& nd, Range range, bool hit,
+                            uint64_t request) {
+  auto last = (range.start_ + range.size_ - 1) / BlockCache::BLOCK_SIZE;
+  Node::ReadStream* stream = nullptr;
+  for (auto&& s : nd->read_stream_)
+    if (range.start_ + SEQUENTIAL_READ_DISTANCE >= s.next_ &&
+        range.start_ <= s.next_ + SEQUENTIAL_READ_DISTANCE) {
+      stream = &s;
+      break;
+    }
+  bool sequential = stream != nullptr || range.start_ == 0;
+  if (!stream) {
+    if (nd->read_stream_.size() < READ_STREAM_COUNT) {
+      nd->read_stream_.push_back({});
+      stream = &nd->read_stream_.back();
+    } else {
+      stream = &*std::min_element(nd->read_stream_.begin(),
+                                  nd->read_stream_.end(),
+                                  [](const Node::ReadStream& s1,
+                                     const Node::ReadStream& s2) {
+                                    return s1.last_use_ < s2.last_use_;
+                                  });
+    }
+    *stream = {0, READ_AHEAD.min_ / BlockCache::BLOCK_SIZE, last + 1, 0};
+  }
+  stream->next_ = std::max(stream->next_, range.start_ + range.size_);
+  stream->last_use_ = ++nd->read_count_;
+  // On a miss, blocks read ahead earlier are either still being downloaded
+  // or were evicted before the reader got to them; download skips the former
+  // and fetches the latter again.
+  if (!hit || stream->frontier_ < last + 1) stream->frontier_ = last + 1;
+  // Next window is fetched once the reader is half way through the current
+  // one.
+  if (!sequential || stream->frontier_ - (last + 1) > stream->window_ / 2)
+    return;
+  read_ahead_bytes_ += download(nd, stream->frontier_, stream->window_,
+                                std::max<uint64_t>(request, 1));
+  stream->frontier_ += stream->window_;
+  stream->window_ = std::min<uint64_t>(
+      stream->window_ * 2, READ_AHEAD.max_ / BlockCache::BLOCK_SIZE);
+}
+
+uint64_t FileSystem::download(const Node::Pointer& nd, uint64_t first,
+                              uint64_t count, uint64_t max_request) {
+  auto block_count =
+      (nd->size() + BlockCache::BLOCK_SIZE - 1) / BlockCache::BLOCK_SIZE;
+  auto end = std::min(first + count, block_count);
+  if (first >= end) return 0;
+  restore(*nd, first, end - first);
+  uint64_t requested = 0;
+  auto missing = [&](uint64_t index) {
+    return nd->pending_block_.find(index) == nd->pending_block_.end() &&
+           !cache_.contains(nd->inode(), index);
+  };
+  for (auto index = first; index < end;) {
+    if (!missing(index)) {
+      index++;
+      continue;
+    }
+    auto run = index;
+    while (index < end && index - run < max_request && missing(index))
+      nd->pending_block_.insert(index++);
+    auto start = run * BlockCache::BLOCK_SIZE;
+    auto size = std::min(index * BlockCache::BLOCK_SIZE, nd->size()) - start;
+    requested += size;
+    download_item_async(nd->provider(), nd->item(), Range{start, size},
+                        [=](EitherError<ReadBuffer> e) {
+                          downloaded(nd, run, index - run, e);
+                        });
+  }
+  return requested;
+}
+
+void FileSystem::downloaded(const Node::Pointer& nd, uint64_t first,
+                            uint64_t count, EitherError<ReadBuffer> e) {
+  std::unordered_map<uint64_t, BlockCache::Block> blocks;
+  std::vector<std::pair<DownloadItemCallback, EitherError<ReadBuffer>>> ready;
+  // Blocks from failed_block on weren't received whole.
+  auto error = e.left();
+  auto failed_block = first;
+  {
+    std::unique_lock<mutex> lock(nd->mutex_);
+    for (auto index = first; index < first + count; index++)
+      nd->pending_block_.erase(index);
+    if (auto data = e.right()) {
+      auto requested = [&](uint64_t index) {
+        for (auto&& read : nd->read_request_)
+          if (index >= read.range_.start_ / BlockCache::BLOCK_SIZE &&
+              index <= (read.range_.start_ + read.range_.size_ - 1) /
+                           BlockCache::BLOCK_SIZE)
+            return true;
+        return false;
+      };
+      auto index = first;
+      for (auto&& slice : data->slices()) {
+        auto start = index * BlockCache::BLOCK_SIZE;
+        if (index >= first + count || start >= nd->size() ||
+            slice.buffer_->size() <
+                std::min(BlockCache::BLOCK_SIZE, nd->size() - start))
+          break;
+        cache_.put(nd->inode(), index, slice.buffer_, requested(index));
+        blocks[index++] = slice.buffer_;
+      }
+      // A short block which isn't the last one of the file would be taken
+      // for complete; the file likely changed since its size was fetched.
+      if (index < first + count) {
+        error = std::make_shared<Error>(
+            Error{IHttpRequest::Failure, util::Error::INCOMPLETE_DOWNLOAD});
+        failed_block = index;
+      }
+    }
+    std::vector<Node::ReadRequest> waiting;
+    for (auto&& read : nd->read_request_) {
+      auto read_first = read.range_.start_ / BlockCache::BLOCK_SIZE;
+      auto read_last =
+          (read.range_.start_ + read.range_.size_ - 1) / BlockCache::BLOCK_SIZE;
+      ReadBuffer result;
+      if (error && read_first < first + count && read_last >= failed_block)
+        ready.push_back({read.callback_, error});
+      else if (gather(*nd, read.range_, blocks, result))
+        ready.push_back({read.callback_, std::move(result)});
+      else
+        waiting.push_back(read);
+    }
+    nd->read_request_ = waiting;
+    // Blocks downloaded earlier for waiting requests might have been evicted
+    // in the meantime.
+    for (auto&& read : waiting) {
+      auto read_first = read.range_.start_ / BlockCache::BLOCK_SIZE;
+      auto read_last =
+          (read.range_.start_ + read.range_.size_ - 1) / BlockCache::BLOCK_SIZE;
+      download(nd, read_first, read_last - read_first + 1);
+    }
+  }
+  for (auto&& r : ready) r.first(r.second);
+  if (error && !e.left()) refresh_size(nd);
+  auto key = disk_key(*nd);
+  if (key.empty()) return;
+  for (auto&& block : blocks)
+    // Only whole blocks are kept, the last block of a file may be shorter.
+    if (block.second->size() == BlockCache::BLOCK_SIZE ||
+        block.first * BlockCache::BLOCK_SIZE + block.second->size() ==
+            nd->size())
+      disk_cache_->put(key, block.first, block.second);
+}
+
+void FileSystem::refresh_size(const Node::Pointer& nd) {
+  auto p = nd->provider();
+  if (!p || !nd->item()) return;
+  add({p, p->getItemDataAsync(nd->item()->id(), [=](EitherError<IItem> e) {
+         if (e.left()) return;
+         std::unique_lock<mutex> lock(nd->mutex_);
+         log("size of", nd->filename(), "changed to", e.right()->size());
+         nd->set_size(e.right()->size());
+         cache_.remove(nd->inode());
+       })});
+}
+
+void FileSystem::restore(const Node& nd, uint64_t first, uint64_t count) {
+  auto key = disk_key(nd);
+  if (key.empty()) return;
+  for (auto index = first; index < first + count; index++) {
+    if (cache_.contains(nd.inode(), index) ||
+        nd.pending_block_.find(index) != nd.pending_block_.end() ||
+        !disk_cache_->contains(key, index))
+      continue;
+    if (auto block = disk_cache_->get(key, index))
+      cache_.put(nd.inode(), index, block);
+  }
+}
+
+std::string FileSystem::disk_key(const Node& nd) const {
+  if (!disk_cache_ || !nd.item()) return "";
+  auto it = provider_label_.find(nd.provider().get());
+  if (it == provider_label_.end()) return "";
+  return DiskCache::key(it->second, *nd.item());
+}
+
+void FileSystem::restore_tree() {
+  if (tree_file_.empty()) return;
+  std::lock_guard<mutex> lock(node_data_mutex_);
+  // Inodes of the previous mount to the current ones.
+  std::unordered_map<FileId, FileId> inode;
+  std::ifstream file(tree_file_);
+  std::string line;
+  while (std::getline(file, line)) {
+    try {
+      auto json = util::json::from_string(line);
+      FileId current;
+      if (json.isMember("label")) {
+        auto& root = node_directory_[1];
+        auto it = root.find(json["label"].asString());
+        if (it == root.end()) continue;
+        current = it->second;
+      } else {
+        auto parent = inode.find(json["parent"].asUInt64());
+        if (parent == inode.end()) continue;
+        auto node = add(get(parent->second)->provider(), parent->second,
+                        IItem::fromString(json["item"].asString()));
+        node_directory_[parent->second][sanitize(node->filename())] =
+            node->inode();
+        current = node->inode();
+      }
+      inode[json["inode"].asUInt64()] = current;
+      if (json["listed"].asBool()) node_directory_[current];
+    } catch (const Json::Exception&) {
+      // Tree stays as far as it was read.
+    }
+  }
+}
+
+void FileSystem::store_tree() {
+  if (tree_file_.empty()) return;
+  std::lock_guard<mutex> lock(node_data_mutex_);
+  auto temporary = tree_file_ + ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::trunc);
+    // Directories are stored before their children, pairs of parent and node.
+    std::deque<std::pair<FileId, FileId>> pending;
+    auto store = [&](FileId inode, Json::Value& json) {
+      auto directory = node_directory_.find(inode);
+      if (directory != node_directory_.end()) {
+        json["listed"] = true;
+        for (auto&& child : directory->second)
+          pending.emplace_back(inode, child.second);
+      }
+      json["inode"] = Json::UInt64(inode);
+      file << util::json::to_string(json) << "\n";
+    };
+    for (auto&& root : node_directory_[1]) {
+      Json::Value json;
+      json["label"] = root.first;
+      store(root.second, json);
+    }
+    while (!pending.empty()) {
+      auto entry = pending.front();
+      pending.pop_front();
+      auto it = node_map_.find(entry.second);
+      // Files which weren't uploaded have no id to be found by.
+      if (it == node_map_.end() || it->second->item()->id().empty()) continue;
+      Json::Value json;
+      json["parent"] = Json::UInt64(entry.first);
+      json["item"] = it->second->item()->toString();
+      store(entry.second, json);
+    }
+  }
+  std::rename(temporary.c_str(), tree_file_.c_str());
+}
+
 void FileSystem::invalidate(FileId root) {
   std::lock_guard<mutex> lock(node_data_mutex_);
   auto it = node_directory_.find(root);
   if (it != node_directory_.end()) {
     for (auto&& n : it->second) {
-      invalidate(n);
-      set(n, std::make_shared<Node>());
+      invalidate(n.second);
+      set(n.second, std::make_shared<Node>());
     }
     node_directory_.erase(it);
   }
@@ -535,14 +879,13 @@ void FileSystem::rename(FileId parent, const char* name, FileId newparent,
           if (e.right()) {
             std::lock_guard<mutex> lock(node_data_mutex_);
             this->invalidate(node->inode());
-            auto& old_lst = node_directory_[parent];
-            auto it = old_lst.find(node->inode());
-            if (it != std::end(old_lst)) old_lst.erase(it);
+            this->unlink(parent, *node);
             auto nit = node_directory_.find(newparent);
             if (nit != std::end(node_directory_))
-              nit->second.insert(node->inode());
+              nit->second[this->sanitize(e.right()->filename())] =
+                  node->inode();
             this->set(node->inode(),
-                      std::make_shared<Node>(p, e.right(), node->parent_,
+                      std::make_shared<Node>(p, e.right(), newparent,
                                              node->inode(), node->size()));
           }
           callback(e);
@@ -555,16 +898,26 @@ void FileSystem::remove(FileId parent, const char* name,
   util::log("removing", name);
   auto update_lists = [=](Node::Pointer node) {
     std::lock_guard<mutex> lock(node_data_mutex_);
-    auto it = node_directory_.find(parent);
-    if (it != node_directory_.end()) {
-      auto d = it->second.find(node->inode());
-      if (d != it->second.end()) it->second.erase(d);
-    }
+    this->unlink(parent, *node);
   };
   auto remove_file = [=](Node::Pointer node) {
-    std::lock_guard<mutex> lock(node_data_mutex_);
-    if (node->upload_request()) {
-      this->cancel(node->upload_request());
+    std::vector<DataSynchronizedCallback> synchronized;
+    {
+      std::lock_guard<mutex> lock(write_back_mutex_);
+      auto it = dirty_file_.find(node->inode());
+      if (it != dirty_file_.end()) {
+        if (it->second->uploading_) {
+          it->second->upload_cancelled_ = true;
+          if (it->second->upload_) this->cancel(it->second->upload_);
+        }
+        synchronized = std::move(it->second->sync_);
+        dirty_file_.erase(it);
+      }
+    }
+    // There is nothing left to synchronize in a removed file.
+    for (auto&& cb : synchronized) cb(nullptr);
+    // File created with mknod which never got uploaded.
+    if (node->item()->id().empty()) {
       update_lists(node);
       return callback(nullptr);
     }
@@ -594,66 +947,219 @@ void FileSystem::remove(FileId parent, const char* name,
 }
 
 void FileSystem::fsync(FileId inode, DataSynchronizedCallback cb) {
-  auto node = get(inode);
-  auto parent_node = get(node->parent_);
-  auto p = parent_node->provider();
-  if (!p) return cb(Error{IHttpRequest::ServiceUnavailable, ""});
   {
-    std::lock_guard<mutex> lock(node->mutex_);
-    if (!node->store_) return cb(nullptr);
+    std::unique_lock<mutex> lock(write_back_mutex_);
+    auto it = dirty_file_.find(inode);
+    if (it != dirty_file_.end()) {
+      auto& file = *it->second;
+      if (file.uploading_ && !file.upload_cancelled_ &&
+          file.upload_generation_ == file.generation_) {
+        file.uploading_sync_.push_back(cb);
+        return;
+      }
+      if (file.generation_ != file.uploaded_generation_) {
+        if (file.sync_.empty()) file.first_sync_ = DirtyFile::Clock::now();
+        file.sync_.push_back(cb);
+        schedule(file);
+        lock.unlock();
+        write_back_condition_.notify_one();
+        return;
+      }
+    }
+  }
+  cb(nullptr);
+}
+
+std::shared_ptr<FileSystem::DirtyFile> FileSystem::dirty_file(FileId inode) {
+  auto& file = dirty_file_[inode];
+  if (!file) {
+    file = std::make_shared<DirtyFile>();
+    file->buffer_ = util::make_unique<WriteBuffer>(
+        write_budget_,
+        temporary_directory_ + "cloudstorage" + std::to_string(inode));
   }
+  return file;
+}
+
+void FileSystem::schedule(DirtyFile& file) {
+  auto now = DirtyFile::Clock::now();
+  if (!file.sync_.empty())
+    file.due_ = std::min(now + FSYNC_DELAY, file.first_sync_ + MAX_FSYNC_DELAY);
+  else
+    file.due_ = now + WRITE_BACK_DELAY;
+}
+
+void FileSystem::write_back() {
+  util::set_thread_name("fs-write-back");
+  std::unique_lock<mutex> lock(write_back_mutex_);
+  while (true) {
+    auto now = DirtyFile::Clock::now();
+    auto next = DirtyFile::Clock::time_point::max();
+    bool uploading = false;
+    std::vector<std::pair<FileId, std::shared_ptr<DirtyFile>>> due;
+    for (auto&& d : dirty_file_) {
+      auto& file = *d.second;
+      if (file.uploading_)
+        uploading = true;
+      else if (file.due_ != DirtyFile::Clock::time_point::max()) {
+        if (closing_ || file.due_ <= now)
+          due.push_back(d);
+        else
+          next = std::min(next, file.due_);
+      }
+    }
+    if (!due.empty()) {
+      for (auto&& d : due) {
+        auto& file = *d.second;
+        file.uploading_ = true;
+        file.upload_cancelled_ = false;
+        file.upload_generation_ = file.generation_;
+        file.uploading_sync_ = std::move(file.sync_);
+        file.sync_.clear();
+        file.due_ = DirtyFile::Clock::time_point::max();
+      }
+      lock.unlock();
+      for (auto&& d : due) upload(d.first, d.second);
+      lock.lock();
+      continue;
+    }
+    if (closing_ && !uploading) break;
+    if (next == DirtyFile::Clock::time_point::max())
+      write_back_condition_.wait(lock);
+    else
+      write_back_condition_.wait_until(lock, next);
+  }
+  for (auto&& d : dirty_file_)
+    if (d.second->generation_ != d.second->uploaded_generation_)
+      log("data written to", d.first, "wasn't uploaded");
+}
+
+void FileSystem::upload(FileId inode, const std::shared_ptr<DirtyFile>& file) {
   class UploadCallback : public IUploadFileCallback {
    public:
-    UploadCallback(FileSystem* ctx, std::shared_ptr<ICloudProvider> provider,
-                   Node::Pointer node, const DeleteItemCallback& cb)
+    UploadCallback(FileSystem* ctx, FileId inode,
+                   std::shared_ptr<DirtyFile> file,
+                   std::shared_ptr<ICloudProvider> provider, uint64_t size)
         : fuse_(ctx),
+          inode_(inode),
+          file_(std::move(file)),
           provider_(std::move(provider)),
-          node_(std::move(node)),
-          callback_(cb) {
-      node_->store_->seekg(0, std::ios::end);
-      size_ = node_->store_->tellg();
-      node_->store_->seekg(std::ios::beg);
-    }
+          size_(size) {}
 
     uint32_t putData(char* data, uint32_t maxlength, uint64_t offset) override {
-      node_->store_->seekg(offset);
-      node_->store_->read(data, maxlength);
-      return static_cast<uint32_t>(node_->store_->gcount());
+      std::lock_guard<mutex> lock(fuse_->write_back_mutex_);
+      if (offset >= size_) return 0;
+      return file_->buffer_->read(
+          data,
+          static_cast<uint32_t>(std::min<uint64_t>(maxlength, size_ - offset)),
+          offset);
     }
 
     uint64_t size() override { return size_; }
 
     void done(EitherError<IItem> e) override {
-      if (e.left()) return callback_(e.left());
-      std::lock_guard<mutex> lock(fuse_->node_data_mutex_);
-      fuse_->set(node_->inode_,
-                 std::make_shared<Node>(provider_, e.right(), node_->parent_,
-                                        node_->inode_, e.right()->size()));
-      log("fsynced", node_->filename());
-      callback_(nullptr);
+      fuse_->uploaded(inode_, file_, provider_, e);
     }
 
-    void progress(uint64_t, uint64_t now) override {
-      std::lock_guard<mutex> lock(fuse_->node_data_mutex_);
-      auto node = fuse_->get(node_->inode_);
-      node->set_size(now);
-      fuse_->set(node_->inode_, node);
-    }
+    void progress(uint64_t, uint64_t) override {}
 
    private:
     FileSystem* fuse_;
+    FileId inode_;
+    std::shared_ptr<DirtyFile> file_;
     std::shared_ptr<ICloudProvider> provider_;
-    Node::Pointer node_;
-    DeleteItemCallback callback_;
     uint64_t size_;
   };
-  auto filename = node->filename();
-  log("fsync", filename);
-  std::shared_ptr<IGenericRequest> upload_request = p->uploadFileAsync(
-      parent_node->item(), filename,
-      util::make_unique<UploadCallback>(this, p, std::move(node), cb));
-  get(inode)->set_upload_request(upload_request);
-  add({p, upload_request});
+  auto node = get(inode);
+  auto parent_node = get(node->parent_);
+  auto p = parent_node->provider();
+  if (!p || !parent_node->item())
+    return uploaded(inode, file, p,
+                    Error{IHttpRequest::ServiceUnavailable, "no parent"});
+  uint64_t size;
+  {
+    std::lock_guard<mutex> lock(write_back_mutex_);
+    size = file->buffer_->size();
+  }
+  log("uploading", node->filename(), size);
+  std::shared_ptr<IGenericRequest> request = p->uploadFileAsync(
+      parent_node->item(), node->filename(),
+      util::make_unique<UploadCallback>(this, inode, file, p, size));
+  {
+    std::lock_guard<mutex> lock(write_back_mutex_);
+    // The upload might have finished already.
+    if (file->uploading_) {
+      file->upload_ = request;
+      if (file->upload_cancelled_) cancel(request);
+    }
+  }
+  add({p, request});
+}
+
+void FileSystem::uploaded(FileId inode, const std::shared_ptr<DirtyFile>& file,
+                          const std::shared_ptr<ICloudProvider>& p,
+                          EitherError<IItem> e) {
+  auto node = get(inode);
+  if (auto item = e.right()) {
+    std::lock_guard<mutex> lock(node_data_mutex_);
+    auto previous = node;
+    node = std::make_shared<Node>(p, item, node->parent_, inode, item->size());
+    set(inode, node);
+    if (previous->item() && previous->filename() != item->filename()) {
+      // Provider might have picked another name, e.g. to avoid a conflict.
+      unlink(node->parent_, *previous);
+      auto it = node_directory_.find(node->parent_);
+      if (it != node_directory_.end())
+        it->second[sanitize(item->filename())] = inode;
+    }
+    log("uploaded", item->filename());
+  }
+  std::vector<DataSynchronizedCallback> callbacks, removed;
+  {
+    std::lock_guard<mutex> lock(write_back_mutex_);
+    file->uploading_ = false;
+    file->upload_ = nullptr;
+    bool retry = false;
+    if (e.right()) {
+      file->uploaded_generation_ = file->upload_generation_;
+      file->upload_cancel_count_ = 0;
+      callbacks = std::move(file->uploading_sync_);
+      retry = true;
+    } else if (file->upload_cancelled_) {
+      // Upload was superseded by writes, its fsyncs wait for the next one.
+      if (file->sync_.empty()) file->first_sync_ = DirtyFile::Clock::now();
+      file->sync_.insert(file->sync_.end(), file->uploading_sync_.begin(),
+                         file->uploading_sync_.end());
+      retry = true;
+    } else {
+      log("upload failed", inode, e.left()->code_, e.left()->description_);
+      callbacks = std::move(file->uploading_sync_);
+    }
+    file->uploading_sync_.clear();
+    file->upload_cancelled_ = false;
+    auto it = dirty_file_.find(inode);
+    if (it == dirty_file_.end() || it->second != file) {
+      // There is nothing left to synchronize in a removed file.
+      removed = std::move(file->sync_);
+      file->sync_.clear();
+    } else {
+      if (file->generation_ == file->uploaded_generation_) {
+        if (file->sync_.empty()) dirty_file_.erase(it);
+      } else {
+        // Failed upload is retried only by a write or an fsync.
+        if (retry || !file->sync_.empty()) schedule(*file);
+        node->set_size(file->buffer_->size());
+      }
+    }
+  }
+  write_back_condition_.notify_one();
+  for (auto&& cb : callbacks)
+    cb(e.left() ? EitherError<void>(e.left()) : EitherError<void>(nullptr));
+  for (auto&& cb : removed) cb(nullptr);
+}
+
+WriteBuffer::Budget::Statistics FileSystem::writeStatistics() const {
+  return write_budget_->statistics();
 }
 
 void FileSystem::mkdir(FileId parent, const char* name,
@@ -667,7 +1173,8 @@ void FileSystem::mkdir(FileId parent, const char* name,
          std::lock_guard<mutex> lock(node_data_mutex_);
          auto node = this->add(p, parent, e.right());
          auto it = node_directory_.find(parent);
-         if (it != node_directory_.end()) it->second.insert(node->inode());
+         if (it != node_directory_.end())
+           it->second[this->sanitize(node->filename())] = node->inode();
          callback(std::static_pointer_cast<INode>(node));
        })});
 }
@@ -712,8 +1219,18 @@ void FileSystem::download_item_async(const std::shared_ptr<ICloudProvider>& p,
     Callback(const DownloadItemCallback& cb)
         : start_(std::chrono::system_clock::now()), callback_(cb) {}
 
+    // Data is split into cache blocks as it arrives.
     void receivedData(const char* data, uint32_t length) override {
-      buffer_ += std::string(data, length);
+      while (length > 0) {
+        if (block_.size() == BlockCache::BLOCK_SIZE) flush();
+        if (block_.capacity() < BlockCache::BLOCK_SIZE)
+          block_.reserve(BlockCache::BLOCK_SIZE);
+        auto size = std::min<uint64_t>(length,
+                                       BlockCache::BLOCK_SIZE - block_.size());
+        block_.append(data, size);
+        data += size;
+        length -= static_cast<uint32_t>(size);
+      }
     }
 
     void done(EitherError<void> e) override {
@@ -721,14 +1238,23 @@ void FileSystem::download_item_async(const std::shared_ptr<ICloudProvider>& p,
                              std::chrono::system_clock::now() - start_)
                              .count());
       if (e.left()) return callback_(e.left());
+      if (!block_.empty()) flush();
       callback_(buffer_);
     }
 
     void progress(uint64_t, uint64_t) override {}
 
    private:
+    void flush() {
+      auto size = block_.size();
+      buffer_.append(
+          {std::make_shared<const std::string>(std::move(block_)), 0, size});
+      block_ = std::string();
+    }
+
     std::chrono::system_clock::time_point start_;
-    std::string buffer_;
+    std::string block_;
+    ReadBuffer buffer_;
     DownloadItemCallback callback_;
   };
   log("requesting", item->filename(), range.start_, "-",
@@ -742,6 +1268,19 @@ void FileSystem::get_url_async(const std::shared_ptr<ICloudProvider>& p,
   add({p, p->getItemUrlAsync(i, cb)});
 }
 
+FileSystem::ReadStatistics FileSystem::readStatistics() const {
+  return {reads_, read_hits_, read_ahead_bytes_,
+          cache_.statistics().wasted_bytes_};
+}
+
+BlockCache::Statistics FileSystem::cacheStatistics() const {
+  return cache_.statistics();
+}
+
+DiskCache::Statistics FileSystem::diskCacheStatistics() const {
+  return disk_cache_ ? disk_cache_->statistics() : DiskCache::Statistics{};
+}
+
 std::string FileSystem::sanitize(const std::string& name) {
   const std::string forbidden = "~\"#%&*:<>?/\\{|}";
   std::string res;
@@ -757,8 +1296,9 @@ std::string FileSystem::sanitize(const std::string& name) {
 
 IFileSystem::Pointer IFileSystem::create(
     const std::vector<ProviderEntry>& p, IHttp::Pointer http,
-    const std::string& temporary_directory) {
-  return util::make_unique<FileSystem>(p, std::move(http), temporary_directory);
+    const std::string& temporary_directory, const Options& options) {
+  return util::make_unique<FileSystem>(p, std::move(http), temporary_directory,
+                                       options);
 }
 
 }  // namespace cloudstorage
@@ -8,19 +8,40 @@
 #include <future>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <mutex>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "BlockCache.h"
+#include "DiskCache.h"
 #include "ICloudStorage.h"
 #include "IFileSystem.h"
+#include "StringTable.h"
 #include "Utility/Utility.h"
+#include "WriteBuffer.h"
 
 namespace cloudstorage {
 
-const int READ_AHEAD = 2 * 1024 * 1024;
-const int CACHED_CHUNK_COUNT = 4;
+const IChunkSizer::Limits READ_AHEAD = {
+    2 * BlockCache::BLOCK_SIZE, 16 * 1024 * 1024, BlockCache::BLOCK_SIZE,
+    2 * 1024 * 1024};
 const auto CACHE_DIRECTORY_DURATION = std::chrono::seconds(60);
+// Count of sequential readers of a file told apart at a time.
+const size_t READ_STREAM_COUNT = 4;
+// Read continues a stream if it starts that close to where the stream's
+// previous read ended; concurrent reads of one reader may come out of order.
+const uint64_t SEQUENTIAL_READ_DISTANCE = 4 * BlockCache::BLOCK_SIZE;
+// Upload starts once fsyncs stop coming for that long, but no later than
+// MAX_FSYNC_DELAY after the first fsync it waits for.
+const auto FSYNC_DELAY = std::chrono::milliseconds(200);
+const auto MAX_FSYNC_DELAY = std::chrono::seconds(2);
+// Data which wasn't written to for that long is uploaded without an fsync.
+const auto WRITE_BACK_DELAY = std::chrono::seconds(5);
+// Writes cancel the upload of their file at most that many times in a row;
+// after that the upload is let finish and the file is uploaded again, so
+// that files written to all the time get uploaded too.
+const uint32_t MAX_UPLOAD_CANCEL_COUNT = 3;
 
 class FileSystem : public IFileSystem {
  public:
@@ -43,23 +64,24 @@ class FileSystem : public IFileSystem {
 
     IItem::Pointer item() const;
     std::shared_ptr<ICloudProvider> provider() const;
-    std::shared_ptr<IGenericRequest> upload_request() const;
-    void set_upload_request(std::shared_ptr<IGenericRequest> r);
     void set_size(uint64_t size);
 
    private:
     friend class FileSystem;
 
-    struct Chunk {
-      Range range_;
-      std::string data_;
-    };
-
     struct ReadRequest {
       Range range_;
       DownloadItemCallback callback_;
+    };
 
-      bool operator==(const ReadRequest &r) const { return range_ == r.range_; }
+    struct ReadStream {
+      // Offset where the last read of the stream ended.
+      uint64_t next_;
+      // Count of blocks fetched by the next read ahead.
+      uint64_t window_;
+      // First block which wasn't read ahead yet.
+      uint64_t frontier_;
+      uint64_t last_use_;
     };
 
     mutex mutex_;
@@ -68,18 +90,16 @@ class FileSystem : public IFileSystem {
     FileId parent_;
     FileId inode_;
     uint64_t size_;
-    std::shared_ptr<IGenericRequest> upload_request_;
     std::vector<ReadRequest> read_request_;
-    std::vector<Range> pending_download_;
-    std::deque<Chunk> chunk_;
-    std::string cache_filename_;
-    std::string path_;
-    std::unique_ptr<std::fstream> store_;
+    // Indices of blocks being downloaded.
+    std::unordered_set<uint64_t> pending_block_;
+    std::vector<ReadStream> read_stream_;
+    uint64_t read_count_ = 0;
     bool list_directory_pending_ = false;
   };
 
   FileSystem(const std::vector<ProviderEntry> &, IHttp::Pointer http,
-             std::string temporary_directory);
+             std::string temporary_directory, const Options &);
   ~FileSystem() override;
 
   FileId mknod(FileId parent, const char *name) override;
@@ -99,21 +119,169 @@ class FileSystem : public IFileSystem {
   void fsync(FileId, DataSynchronizedCallback) override;
   std::string sanitize(const std::string &) override;
 
+  struct ReadStatistics {
+    uint64_t reads_;
+    // Reads answered from cache right away.
+    uint64_t hits_;
+    uint64_t read_ahead_bytes_;
+    // Bytes of blocks dropped from memory before they were read.
+    uint64_t wasted_bytes_;
+  };
+
+  ReadStatistics readStatistics() const;
+  WriteBuffer::Budget::Statistics writeStatistics() const;
+  BlockCache::Statistics cacheStatistics() const;
+  DiskCache::Statistics diskCacheStatistics() const;
+
  private:
   struct RequestData {
     std::shared_ptr<ICloudProvider> provider_;
     std::shared_ptr<IGenericRequest> request_;
   };
 
+  /**
+   * Identifies item of a provider by numbers of its id and filename in the
+   * provider's StringTable; filename is a part of it, because files which
+   * weren't uploaded yet have empty ids.
+   */
+  struct ItemKey {
+    const ICloudProvider *provider_;
+    uint32_t id_;
+    uint32_t filename_;
+
+    bool operator==(const ItemKey &) const;
+  };
+
+  struct ItemKeyHash {
+    size_t operator()(const ItemKey &) const;
+  };
+
+  // Children of a directory, by sanitized filename.
+  using Directory = std::unordered_map<std::string, FileId>;
+
+  /**
+   * Write back state of a file with data which wasn't uploaded yet.
+   */
+  struct DirtyFile {
+    using Clock = std::chrono::steady_clock;
+
+    std::unique_ptr<WriteBuffer> buffer_;
+    // Bumped by each write.
+    uint64_t generation_ = 0;
+    uint64_t uploaded_generation_ = 0;
+    uint64_t upload_generation_ = 0;
+    bool uploading_ = false;
+    // Upload was cancelled since its data was written to.
+    bool upload_cancelled_ = false;
+    // Uploads cancelled by writes since the last one which succeeded.
+    uint32_t upload_cancel_count_ = 0;
+    std::shared_ptr<IGenericRequest> upload_;
+    // Fsyncs waiting for the next upload and for the one in progress.
+    std::vector<DataSynchronizedCallback> sync_;
+    std::vector<DataSynchronizedCallback> uploading_sync_;
+    Clock::time_point first_sync_;
+    // When next upload starts, max() if it isn't scheduled.
+    Clock::time_point due_ = Clock::time_point::max();
+  };
+
   void add(RequestData r);
   Node::Pointer add(std::shared_ptr<ICloudProvider>, FileId parent,
                     IItem::Pointer);
 
   void set(FileId, const Node::Pointer &);
 
+  /**
+   * Key of item in node_id_map_; find_key doesn't add strings to provider's
+   * table, while intern_key takes references which release_key gives back.
+   * node_data_mutex_ has to be held.
+   */
+  bool find_key(const ICloudProvider *, const std::string &id,
+                const std::string &filename, ItemKey &);
+  ItemKey intern_key(const ICloudProvider *, const std::string &id,
+                     const std::string &filename);
+  void release_key(const ItemKey &);
+
+  /**
+   * Removes node from listing of directory parent, if it is there;
+   * node_data_mutex_ has to be held.
+   */
+  void unlink(FileId parent, const Node &);
+
   Node::Pointer get(FileId node);
   void get_path(FileId node, const std::string &path, const GetItemCallback &);
 
+  /**
+   * Fills result with range of node's data if all of its blocks are either in
+   * downloaded or cached.
+   */
+  bool gather(const Node &, Range,
+              const std::unordered_map<uint64_t, BlockCache::Block> &downloaded,
+              ReadBuffer &result);
+  /**
+   * Downloads blocks [first, first + count) of node which are neither cached
+   * nor already being downloaded, at most max_request blocks per request;
+   * node's mutex has to be held.
+   *
+   * @return count of bytes requested
+   */
+  uint64_t download(
+      const Node::Pointer &, uint64_t first, uint64_t count,
+      uint64_t max_request = std::numeric_limits<uint64_t>::max());
+  /**
+   * Caches downloaded blocks and answers the reads waiting for them; blocks
+   * shorter than node's size says, other than its last one, fail the reads
+   * which need them and get the size refreshed.
+   */
+  void downloaded(const Node::Pointer &, uint64_t first, uint64_t count,
+                  EitherError<ReadBuffer>);
+  /**
+   * Fetches node's size again and drops its cached blocks.
+   */
+  void refresh_size(const Node::Pointer &);
+  /**
+   * Copies blocks [first, first + count) of node from disk cache to memory
+   * cache, unless they are already there.
+   */
+  void restore(const Node &, uint64_t first, uint64_t count);
+  /**
+   * Finds the stream range continues and reads ahead of it; the window of a
+   * stream doubles with every read ahead, up to READ_AHEAD.max_. Reads which
+   * continue no stream start a new one and aren't followed by a read ahead,
+   * unless they start at the beginning of the file.
+   *
+   * @param hit whether range was cached
+   * @param request count of blocks per read ahead request
+   */
+  void read_ahead(const Node::Pointer &, Range range, bool hit,
+                  uint64_t request);
+  /**
+   * @return key of node's content in disk cache, empty if it shouldn't be
+   * cached there
+   */
+  std::string disk_key(const Node &) const;
+
+  /**
+   * @return write back state of node, created if it doesn't exist;
+   * write_back_mutex_ has to be held
+   */
+  std::shared_ptr<DirtyFile> dirty_file(FileId);
+  void schedule(DirtyFile &);
+  void upload(FileId, const std::shared_ptr<DirtyFile> &);
+  void uploaded(FileId, const std::shared_ptr<DirtyFile> &,
+                const std::shared_ptr<ICloudProvider> &, EitherError<IItem>);
+  void write_back();
+
+  /**
+   * Restores directory tree saved by store_tree() on the previous unmount;
+   * listings restored that way count as expired, so they are reported right
+   * away and refreshed from providers in the background.
+   */
+  void restore_tree();
+  /**
+   * Saves listings of directories reachable from the root to tree_file_.
+   */
+  void store_tree();
+
   void invalidate(FileId);
   void cleanup();
   void cancelled();
@@ -134,23 +302,38 @@ class FileSystem : public IFileSystem {
 
   mutable mutex node_data_mutex_;
   mutable mutex request_data_mutex_;
-  std::unordered_map<std::string, FileId> node_path_to_id_;
   std::unordered_map<FileId, Node::Pointer> node_map_;
-  std::unordered_map<std::string, Node::Pointer> node_id_map_;
-  std::unordered_map<FileId, std::unordered_set<FileId>> node_directory_;
+  std::unordered_map<ItemKey, FileId, ItemKeyHash> node_id_map_;
+  // Ids and filenames of items in node_id_map_, which holds one reference to
+  // each of its keys' strings.
+  std::unordered_map<const ICloudProvider *, StringTable> item_strings_;
+  std::unordered_map<FileId, Directory> node_directory_;
   std::unordered_map<FileId, std::chrono::system_clock::time_point>
       node_timestamp_;
   std::unordered_map<std::string, FileId> auth_node_;
+  std::unordered_map<const ICloudProvider *, std::string> provider_label_;
   FileId next_;
   std::deque<RequestData> request_data_;
   std::deque<std::shared_ptr<IGenericRequest>> cancelled_request_;
   std::atomic_bool running_;
   IHttp::Pointer http_;
   std::string temporary_directory_;
+  BlockCache cache_;
+  std::atomic<uint64_t> reads_;
+  std::atomic<uint64_t> read_hits_;
+  std::atomic<uint64_t> read_ahead_bytes_;
+  std::unique_ptr<DiskCache> disk_cache_;
+  std::string tree_file_;
+  std::shared_ptr<WriteBuffer::Budget> write_budget_;
+  mutex write_back_mutex_;
+  std::unordered_map<FileId, std::shared_ptr<DirtyFile>> dirty_file_;
+  bool closing_ = false;
+  std::condition_variable_any write_back_condition_;
   std::condition_variable_any cancelled_request_condition_;
   std::condition_variable_any request_data_condition_;
   std::future<void> cancelled_request_thread_;
   std::future<void> cleanup_;
+  std::future<void> write_back_;
 };
 
 }  // namespace cloudstorage
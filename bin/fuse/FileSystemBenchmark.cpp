@@ -0,0 +1,237 @@
+// Measures reads through FileSystem, the layer below the FUSE backends, from
+// a file on a LocalDrive provider, so that the numbers reflect the read path
+// and its cache rather than network.
+//
+// usage: cloudstorage-fuse-benchmark [file size MiB] [memory cache MiB]
+//                                    [disk cache MiB]
+//
+// With a disk cache, the file system is created again after the first passes
+// to measure opening and reading the file in a remounted file system, which
+// starts with the directory tree saved by the previous one. The last pass
+// writes a file of the same size, calling fsync after every few MiB, and waits
+// until all fsyncs complete.
+
+#include <json/json.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "FileSystem.h"
+#include "ICloudStorage.h"
+#include "Utility/Utility.h"
+
+using namespace cloudstorage;
+
+namespace {
+
+const uint32_t READ_SIZE = 128 * 1024;
+const uint32_t RANDOM_READ_SIZE = 4 * 1024;
+const uint32_t RANDOM_READ_COUNT = 4096;
+const uint64_t FSYNC_INTERVAL = 4 * 1024 * 1024;
+
+using Clock = std::chrono::steady_clock;
+
+IFileSystem::INode::Pointer find(FileSystem& fs, IFileSystem::FileId parent,
+                                 const std::string& name) {
+  std::promise<IFileSystem::INode::Pointer> result;
+  fs.lookup(parent, name, [&](EitherError<IFileSystem::INode> e) {
+    result.set_value(e.right());
+  });
+  return result.get_future().get();
+}
+
+size_t read(FileSystem& fs, IFileSystem::FileId node, uint64_t offset,
+            uint32_t size) {
+  std::promise<size_t> result;
+  fs.read(node, offset, size, [&](EitherError<IFileSystem::ReadBuffer> e) {
+    result.set_value(e.right() ? e.right()->size() : 0);
+  });
+  return result.get_future().get();
+}
+
+struct Snapshot {
+  BlockCache::Statistics memory_;
+  DiskCache::Statistics disk_;
+  FileSystem::ReadStatistics read_;
+};
+
+Snapshot snapshot(const FileSystem& fs) {
+  return {fs.cacheStatistics(), fs.diskCacheStatistics(),
+          fs.readStatistics()};
+}
+
+void report(const std::string& name, uint64_t bytes, uint32_t count,
+            Clock::duration elapsed, const Snapshot& before,
+            const Snapshot& after) {
+  auto seconds = std::chrono::duration<double>(elapsed).count();
+  auto reads = after.read_.reads_ - before.read_.reads_;
+  auto hits = after.read_.hits_ - before.read_.hits_;
+  std::cout << name << ": " << bytes / seconds / 1e6 << " MB/s, "
+            << count / seconds << " reads/s, hit rate "
+            << (reads > 0 ? 100.0 * hits / reads : 0) << "%, read ahead "
+            << (after.read_.read_ahead_bytes_ -
+                before.read_.read_ahead_bytes_) /
+                   1e6
+            << " MB, wasted "
+            << (after.read_.wasted_bytes_ - before.read_.wasted_bytes_) / 1e6
+            << " MB, evicted "
+            << after.memory_.evicted_blocks_ - before.memory_.evicted_blocks_
+            << ", disk hits " << after.disk_.hits_ - before.disk_.hits_
+            << ", disk writes "
+            << after.disk_.written_blocks_ - before.disk_.written_blocks_
+            << "\n";
+}
+
+// Reads the file with readers starting at offsets evenly spread over it,
+// taking turns.
+void sequential(FileSystem& fs, IFileSystem::FileId node, uint64_t file_size,
+                uint32_t readers, const std::string& name) {
+  auto before = snapshot(fs);
+  auto start = Clock::now();
+  uint64_t total = 0;
+  uint32_t count = 0;
+  auto part = file_size / readers;
+  for (uint64_t offset = 0; offset < part; offset += READ_SIZE)
+    for (uint32_t reader = 0; reader < readers; reader++) {
+      total += read(fs, node, reader * part + offset,
+                    static_cast<uint32_t>(
+                        std::min<uint64_t>(READ_SIZE, part - offset)));
+      count++;
+    }
+  report(name, total, count, Clock::now() - start, before, snapshot(fs));
+}
+
+void write(FileSystem& fs, IFileSystem::FileId parent, uint64_t file_size) {
+  auto start = Clock::now();
+  auto node = fs.mknod(parent, "written");
+  std::string buffer(READ_SIZE, 'x');
+  std::vector<std::future<bool>> synchronized;
+  uint64_t total = 0;
+  for (uint64_t offset = 0; offset < file_size; offset += READ_SIZE) {
+    std::promise<uint32_t> written;
+    fs.write(node, buffer.data(),
+             static_cast<uint32_t>(
+                 std::min<uint64_t>(READ_SIZE, file_size - offset)),
+             offset, [&](EitherError<uint32_t> e) {
+               written.set_value(e.right() ? *e.right() : 0);
+             });
+    total += written.get_future().get();
+    if ((offset + READ_SIZE) % FSYNC_INTERVAL == 0 ||
+        offset + READ_SIZE >= file_size) {
+      auto result = std::make_shared<std::promise<bool>>();
+      synchronized.push_back(result->get_future());
+      fs.fsync(node,
+               [=](EitherError<void> e) { result->set_value(!e.left()); });
+    }
+  }
+  uint32_t failed = 0;
+  for (auto&& r : synchronized) failed += !r.get();
+  auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  auto statistics = fs.writeStatistics();
+  std::cout << "write: " << total / seconds / 1e6 << " MB/s, "
+            << synchronized.size() << " fsyncs, " << failed << " failed, "
+            << statistics.spilled_blocks_ << " blocks spilled\n";
+  std::promise<void> removed;
+  fs.remove(parent, "written", [&](EitherError<void>) { removed.set_value(); });
+  removed.get_future().get();
+}
+
+IFileSystem::INode::Pointer open(FileSystem& fs, const std::string& name) {
+  auto start = Clock::now();
+  auto root = find(fs, 1, "local");
+  auto file = root ? find(fs, root->inode(), "data") : nullptr;
+  std::cout << name << ": "
+            << std::chrono::duration<double, std::milli>(Clock::now() - start)
+                   .count()
+            << " ms\n";
+  return file;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint64_t file_size = (argc > 1 ? std::stoull(argv[1]) : 256) * 1024 * 1024;
+  uint64_t cache_size =
+      argc > 2 ? std::stoull(argv[2]) * 1024 * 1024
+               : IFileSystem::DEFAULT_MEMORY_CACHE_SIZE;
+  uint64_t disk_cache_size = argc > 3 ? std::stoull(argv[3]) * 1024 * 1024 : 0;
+  auto directory = util::temporary_directory() + "cloudstorage-benchmark";
+  auto path = directory + "/data";
+  auto disk_cache_directory =
+      disk_cache_size > 0 ? util::temporary_directory() +
+                                "cloudstorage-benchmark-cache"
+                          : "";
+  if (std::system(("mkdir -p " + directory).c_str()) != 0) return 1;
+  if (!disk_cache_directory.empty() &&
+      std::system(("rm -rf " + disk_cache_directory + " && mkdir -p " +
+                   disk_cache_directory)
+                      .c_str()) != 0)
+    return 1;
+  {
+    std::ofstream file(path, std::ios::binary);
+    std::string buffer(1024 * 1024, 0);
+    std::mt19937_64 random;
+    for (uint64_t i = 0; i < file_size; i += buffer.size()) {
+      for (auto& c : buffer) c = static_cast<char>(random());
+      file.write(buffer.data(),
+                 static_cast<std::streamsize>(
+                     std::min<uint64_t>(buffer.size(), file_size - i)));
+    }
+  }
+
+  Json::Value credentials;
+  credentials["path"] = directory;
+  ICloudProvider::InitData data;
+  data.token_ = util::encode_token(util::json::to_string(credentials));
+  data.thread_pool_ = IThreadPool::create(4);
+  std::shared_ptr<ICloudProvider> provider =
+      ICloudStorage::create()->provider("local", std::move(data));
+  if (!provider) {
+    std::cerr << "local provider not available\n";
+    return 1;
+  }
+  IFileSystem::Options options;
+  options.memory_cache_size_ = cache_size;
+  options.disk_cache_directory_ = disk_cache_directory;
+  options.disk_cache_size_ = disk_cache_size;
+  {
+    FileSystem fs({{"local", provider}}, IHttp::create(),
+                  util::temporary_directory(), options);
+    auto file = open(fs, "open, cold");
+    if (!file) {
+      std::cerr << "couldn't find benchmark file\n";
+      return 1;
+    }
+    sequential(fs, file->inode(), file_size, 1, "sequential, cold");
+    sequential(fs, file->inode(), file_size, 1, "sequential, warm");
+    std::mt19937_64 random;
+    auto before = snapshot(fs);
+    auto start = Clock::now();
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < RANDOM_READ_COUNT; i++)
+      total += read(fs, file->inode(),
+                    random() % (file_size - RANDOM_READ_SIZE),
+                    RANDOM_READ_SIZE);
+    report("random", total, RANDOM_READ_COUNT, Clock::now() - start, before,
+           snapshot(fs));
+    sequential(fs, file->inode(), file_size, 3, "3 interleaved readers");
+  }
+  if (!disk_cache_directory.empty()) {
+    FileSystem fs({{"local", provider}}, IHttp::create(),
+                  util::temporary_directory(), options);
+    auto file = open(fs, "open, remount");
+    if (file)
+      sequential(fs, file->inode(), file_size, 1, "sequential, remount");
+  }
+  {
+    FileSystem fs({{"local", provider}}, IHttp::create(),
+                  util::temporary_directory(), options);
+    write(fs, find(fs, 1, "local")->inode(), file_size);
+  }
+  (void)std::remove(path.c_str());
+  return 0;
+}
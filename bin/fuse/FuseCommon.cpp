@@ -29,17 +29,23 @@ struct options {
     free(config_file);
     free(add_provider_label);
     free(remove_provider_label);
+    free(cache_directory);
+    free(cache_size);
   }
   char *config_file;
   char *add_provider_label;
   char *remove_provider_label;
+  char *cache_directory;
+  char *cache_size;
   int list_providers;
 };
 
 const struct fuse_opt option_spec[] = {
     OPTION("--config=%s", config_file), OPTION("--add=%s", add_provider_label),
     OPTION("--remove=%s", remove_provider_label),
-    OPTION("--list", list_providers), FUSE_OPT_END};
+    OPTION("--cache-dir=%s", cache_directory),
+    OPTION("--cache-size=%s", cache_size), OPTION("--list", list_providers),
+    FUSE_OPT_END};
 }  // namespace
 
 std::string to_string(const std::wstring &str) {
@@ -149,7 +155,8 @@ std::vector<IFileSystem::ProviderEntry> providers(
 }
 
 template <class Backend>
-int fuse_run(fuse_args *args, fuse_cmdline_opts *opts, Json::Value &json) {
+int fuse_run(fuse_args *args, fuse_cmdline_opts *opts, const options &options,
+             Json::Value &json) {
   if (!opts->mountpoint) {
     std::cerr << "missing mountpoint\n";
     return 1;
@@ -167,8 +174,19 @@ int fuse_run(fuse_args *args, fuse_cmdline_opts *opts, Json::Value &json) {
     temporary_directory = util::temporary_directory();
   auto p = providers(json["providers"], http_server_factory, http, thread_pool,
                      temporary_directory);
+  IFileSystem::Options fs_options;
+  if (json.isMember("memory_cache_size"))
+    fs_options.memory_cache_size_ = json["memory_cache_size"].asUInt64();
+  if (json.isMember("write_memory_size"))
+    fs_options.write_memory_size_ = json["write_memory_size"].asUInt64();
+  if (json.isMember("write_disk_size"))
+    fs_options.write_disk_size_ = json["write_disk_size"].asUInt64();
+  if (options.cache_directory)
+    fs_options.disk_cache_directory_ = options.cache_directory;
+  if (options.cache_size)
+    fs_options.disk_cache_size_ = std::stoull(options.cache_size) * 1024 * 1024;
   *ctx = IFileSystem::create(p, util::make_unique<HttpWrapper>(http),
-                             temporary_directory)
+                             temporary_directory, fs_options)
              .release();
   int ret = fuse.run(opts->singlethread, opts->clone_fd);
   for (size_t i = 0; i < p.size(); i++) {
@@ -200,6 +218,14 @@ int fuse_run(int argc, char **argv) {
                                     delete opts;
                                   });
   if (fuse_parse_cmdline(args.get(), opts.get()) != 0) return 1;
+  if (options.cache_size) {
+    try {
+      std::stoull(options.cache_size);
+    } catch (const std::logic_error &) {
+      std::cerr << "invalid cache size " << options.cache_size << "\n";
+      return 1;
+    }
+  }
   if (opts->show_help) {
     std::cerr << util::libcloudstorage_ascii_art() << "\n\n";
     std::cerr << "    --add=label            add cloud provider with label\n";
@@ -208,6 +234,13 @@ int fuse_run(int argc, char **argv) {
     std::cerr << "    --config=config_path   path to configuration file\n";
     std::cerr << "                           (default: "
                  "~/.libcloudstorage-fuse.json)\n";
+    std::cerr << "    --cache-dir=path       existing directory where file "
+                 "content is\n";
+    std::cerr << "                           and directory tree are cached "
+                 "across mounts\n";
+    std::cerr << "    --cache-size=MiB       size of the cache in "
+                 "--cache-dir\n";
+    std::cerr << "                           (default: 1024)\n";
     std::cerr << "\n";
     fuse_cmdline_help();
 #ifdef WITH_FUSE
@@ -299,14 +332,14 @@ int fuse_run(int argc, char **argv) {
   int ret = 0;
 
 #ifdef WITH_WINFSP
-  ret = fuse_run<FuseWinFsp>(args.get(), opts.get(), json);
+  ret = fuse_run<FuseWinFsp>(args.get(), opts.get(), options, json);
 #elif WITH_DOKAN
-  ret = fuse_run<FuseDokan>(args.get(), opts.get(), json);
+  ret = fuse_run<FuseDokan>(args.get(), opts.get(), options, json);
 #else
 #ifdef FUSE_LOWLEVEL
-  ret = fuse_run<FuseLowLevel>(args.get(), opts.get(), json);
+  ret = fuse_run<FuseLowLevel>(args.get(), opts.get(), options, json);
 #else
-  ret = fuse_run<FuseHighLevel>(args.get(), opts.get(), json);
+  ret = fuse_run<FuseHighLevel>(args.get(), opts.get(), options, json);
 #endif
 #endif
 
@@ -170,12 +170,12 @@ NTSTATUS read_file(DOKAN_READ_FILE_EVENT *e) {
     }
     context()->read(
         d.right()->inode(), e->Offset, e->NumberOfBytesToRead,
-        [=](EitherError<std::string> d) {
+        [=](EitherError<IFileSystem::ReadBuffer> d) {
           if (d.left()) {
             return DokanEndDispatchRead(e, STATUS_INTERNAL_ERROR);
           }
-          e->NumberOfBytesRead = static_cast<DWORD>(d.right()->length());
-          memcpy(e->Buffer, d.right()->data(), e->NumberOfBytesRead);
+          e->NumberOfBytesRead = static_cast<DWORD>(d.right()->size());
+          d.right()->copy(static_cast<char *>(e->Buffer));
           DokanEndDispatchRead(e, STATUS_SUCCESS);
         });
   });
@@ -280,7 +280,11 @@ NTSTATUS write_file(DOKAN_WRITE_FILE_EVENT *e) {
     context()->write(
         d.right()->inode(), reinterpret_cast<const char *>(e->Buffer),
         e->NumberOfBytesToWrite, e->Offset, [=](EitherError<uint32_t> d) {
-          if (d.left()) return DokanEndDispatchWrite(e, STATUS_INTERNAL_ERROR);
+          if (d.left())
+            return DokanEndDispatchWrite(
+                e, d.left()->code_ == IFileSystem::NoSpace
+                       ? STATUS_DISK_FULL
+                       : STATUS_INTERNAL_ERROR);
           e->NumberOfBytesWritten = *d.right();
           DokanEndDispatchWrite(e, STATUS_SUCCESS);
         });
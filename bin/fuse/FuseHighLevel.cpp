@@ -78,9 +78,9 @@ int read(const char *path, char *buffer, size_t size, FUSE_OFF_T offset,
   ctx->getattr(path, [&](EitherError<IFileSystem::INode> e) {
     if (e.left()) return ret.set_value(-ENOENT);
     ctx->read(e.right()->inode(), offset, size,
-              [&](EitherError<std::string> e) {
+              [&](EitherError<IFileSystem::ReadBuffer> e) {
                 if (e.left()) return ret.set_value(-EIO);
-                memcpy(buffer, e.right()->data(), e.right()->size());
+                e.right()->copy(buffer);
                 ret.set_value(static_cast<int>(e.right()->size()));
               });
   });
@@ -168,7 +168,10 @@ int write(const char *path, const char *data, size_t size, FUSE_OFF_T offset,
     if (e.left()) return ret.set_value(-ENOENT);
     ctx->write(e.right()->inode(), data, static_cast<uint32_t>(size),
                static_cast<uint64_t>(offset), [&](EitherError<uint32_t> e) {
-                 if (e.left()) return ret.set_value(-ENOENT);
+                 if (e.left())
+                   return ret.set_value(
+                       e.left()->code_ == IFileSystem::NoSpace ? -ENOSPC
+                                                               : -ENOENT);
                  ret.set_value(static_cast<int>(*e.right()));
                });
   });
@@ -58,14 +58,20 @@ void flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *f) {
 
 void read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
           struct fuse_file_info *) {
-  context(req)->read(ino, off, size, [=](EitherError<std::string> e) {
-    if (auto data = e.right()) {
-      fuse_reply_buf(req, data->data(), data->size());
-    } else {
-      log("read:", e.left()->code_, e.left()->description_);
-      fuse_reply_err(req, ENOENT);
-    }
-  });
+  context(req)->read(
+      ino, off, size, [=](EitherError<IFileSystem::ReadBuffer> e) {
+        if (auto data = e.right()) {
+          // Cached blocks go to the kernel as they are, without gathering
+          // them into one buffer first.
+          std::vector<struct iovec> iov;
+          for (auto &&slice : data->slices())
+            iov.push_back({const_cast<char *>(slice.data()), slice.size_});
+          fuse_reply_iov(req, iov.data(), static_cast<int>(iov.size()));
+        } else {
+          log("read:", e.left()->code_, e.left()->description_);
+          fuse_reply_err(req, ENOENT);
+        }
+      });
 }
 
 void readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
@@ -193,7 +199,8 @@ void write(fuse_req_t req, fuse_ino_t ino, const char *data, size_t size,
   context(req)->write(ino, data, size, off, [=](EitherError<uint32_t> e) {
     if (e.left()) {
       log("write:", e.left()->code_, e.left()->description_);
-      fuse_reply_err(req, ENOSYS);
+      fuse_reply_err(req, e.left()->code_ == IFileSystem::NoSpace ? ENOSPC
+                                                                  : ENOSYS);
     } else {
       fuse_reply_write(req, *e.right());
     }
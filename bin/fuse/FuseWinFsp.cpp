@@ -216,7 +216,8 @@ NTSTATUS read(FSP_FILE_SYSTEM *fs, PVOID file_context, PVOID buffer,
     return STATUS_END_OF_FILE;
   }
   c->context()->read(
-      file->inode_->inode(), offset, length, [=](EitherError<std::string> e) {
+      file->inode_->inode(), offset, length,
+      [=](EitherError<IFileSystem::ReadBuffer> e) {
         FSP_FSCTL_TRANSACT_RSP response;
         memset(&response, 0, sizeof(response));
         response.Size = sizeof(response);
@@ -229,7 +230,7 @@ NTSTATUS read(FSP_FILE_SYSTEM *fs, PVOID file_context, PVOID buffer,
           return;
         }
         auto b = e.right();
-        memcpy(buffer, b->c_str(), b->size());
+        b->copy(static_cast<char *>(buffer));
         response.IoStatus.Status = STATUS_SUCCESS;
         response.IoStatus.Information = static_cast<UINT32>(b->size());
         FspFileSystemSendResponse(fs, &response);
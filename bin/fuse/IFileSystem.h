@@ -3,7 +3,9 @@
 
 #include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <memory>
+#include <vector>
 #include "ICloudProvider.h"
 #include "IItem.h"
 #include "IRequest.h"
@@ -18,6 +20,12 @@ class IFileSystem {
   using Pointer = std::unique_ptr<IFileSystem>;
 
   static constexpr int NotEmpty = 1001;
+  static constexpr int NoSpace = 1002;
+  static constexpr uint64_t DEFAULT_MEMORY_CACHE_SIZE = 128 * 1024 * 1024;
+  static constexpr uint64_t DEFAULT_DISK_CACHE_SIZE = 1024 * 1024 * 1024;
+  static constexpr uint64_t DEFAULT_WRITE_MEMORY_SIZE = 64 * 1024 * 1024;
+  static constexpr uint64_t DEFAULT_WRITE_DISK_SIZE =
+      4ull * 1024 * 1024 * 1024;
 
   class INode {
    public:
@@ -33,9 +41,49 @@ class IFileSystem {
     virtual IItem::FileType type() const = 0;
   };
 
+  /**
+   * Data returned by read; refers to parts of shared, immutable buffers, e.g.
+   * blocks of the cache, so that it can be passed on without copying.
+   */
+  class ReadBuffer {
+   public:
+    struct Slice {
+      std::shared_ptr<const std::string> buffer_;
+      size_t offset_;
+      size_t size_;
+
+      const char *data() const { return buffer_->data() + offset_; }
+    };
+
+    ReadBuffer() = default;
+    explicit ReadBuffer(std::string data) {
+      auto size = data.size();
+      append({std::make_shared<const std::string>(std::move(data)), 0, size});
+    }
+
+    void append(Slice slice) {
+      size_ += slice.size_;
+      slices_.push_back(std::move(slice));
+    }
+
+    const std::vector<Slice> &slices() const { return slices_; }
+    size_t size() const { return size_; }
+
+    void copy(char *destination) const {
+      for (auto &&slice : slices_) {
+        memcpy(destination, slice.data(), slice.size_);
+        destination += slice.size_;
+      }
+    }
+
+   private:
+    std::vector<Slice> slices_;
+    size_t size_ = 0;
+  };
+
   using ListDirectoryCallback = GenericCallback<EitherError<INode::List>>;
   using GetItemCallback = GenericCallback<EitherError<INode>>;
-  using DownloadItemCallback = GenericCallback<EitherError<std::string>>;
+  using DownloadItemCallback = GenericCallback<EitherError<ReadBuffer>>;
   using WriteDataCallback = GenericCallback<EitherError<uint32_t>>;
   using DataSynchronizedCallback = GenericCallback<EitherError<void>>;
 
@@ -44,11 +92,34 @@ class IFileSystem {
     std::shared_ptr<ICloudProvider> provider_;
   };
 
+  struct Options {
+    /**
+     * Count of bytes of file content kept in memory.
+     */
+    uint64_t memory_cache_size_ = DEFAULT_MEMORY_CACHE_SIZE;
+
+    /**
+     * Existing directory where file content and the directory tree are kept
+     * across mounts; empty disables the disk cache.
+     */
+    std::string disk_cache_directory_;
+    uint64_t disk_cache_size_ = DEFAULT_DISK_CACHE_SIZE;
+
+    /**
+     * Count of bytes written to files, but not uploaded yet, kept in memory;
+     * the rest goes to temporary directory, up to write_disk_size_. Writes
+     * fail with NoSpace once both are used up.
+     */
+    uint64_t write_memory_size_ = DEFAULT_WRITE_MEMORY_SIZE;
+    uint64_t write_disk_size_ = DEFAULT_WRITE_DISK_SIZE;
+  };
+
   virtual ~IFileSystem() = default;
 
   static IFileSystem::Pointer create(const std::vector<ProviderEntry> &,
                                      IHttp::Pointer http,
-                                     const std::string &temporary_directory);
+                                     const std::string &temporary_directory,
+                                     const Options &);
 
   virtual std::string sanitize(const std::string &filename) = 0;
 
@@ -76,6 +147,12 @@ class IFileSystem {
 
   virtual void remove(FileId parent, const char *name, DeleteItemCallback) = 0;
 
+  /**
+   * Uploads data written to the file. Uploads are written back: fsyncs which
+   * come shortly one after another share one upload, which starts once they
+   * stop coming, and data written and left alone long enough is uploaded
+   * without an fsync.
+   */
   virtual void fsync(FileId, DataSynchronizedCallback) = 0;
 };
 
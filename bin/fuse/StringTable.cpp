@@ -0,0 +1,39 @@
+#include "StringTable.h"
+
+namespace cloudstorage {
+
+uint32_t StringTable::intern(const std::string &value) {
+  auto it = index_.find(value);
+  if (it != index_.end()) {
+    entries_[it->second].references_++;
+    return it->second;
+  }
+  uint32_t number;
+  if (!free_.empty()) {
+    number = free_.back();
+    free_.pop_back();
+  } else {
+    number = static_cast<uint32_t>(entries_.size());
+    entries_.push_back({});
+  }
+  it = index_.emplace(value, number).first;
+  entries_[number] = {&it->first, 1};
+  return number;
+}
+
+bool StringTable::find(const std::string &value, uint32_t &number) const {
+  auto it = index_.find(value);
+  if (it == index_.end()) return false;
+  number = it->second;
+  return true;
+}
+
+void StringTable::release(uint32_t number) {
+  auto &entry = entries_[number];
+  if (--entry.references_ > 0) return;
+  index_.erase(index_.find(*entry.value_));
+  entry.value_ = nullptr;
+  free_.push_back(number);
+}
+
+}  // namespace cloudstorage
@@ -0,0 +1,46 @@
+#ifndef STRING_TABLE_H
+#define STRING_TABLE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cloudstorage {
+
+/**
+ * Strings stored once and referred to by number. Each intern() takes a
+ * reference to the string, which release() gives back; the string is dropped
+ * and its number reused once no references are left.
+ */
+class StringTable {
+ public:
+  /**
+   * @return number of string, which is added if it isn't there
+   */
+  uint32_t intern(const std::string &);
+
+  /**
+   * Looks up number of string without taking a reference to it.
+   *
+   * @return whether string is there
+   */
+  bool find(const std::string &, uint32_t &number) const;
+
+  void release(uint32_t number);
+
+ private:
+  struct Entry {
+    // Key of index_, which doesn't move while it's there.
+    const std::string *value_;
+    uint32_t references_;
+  };
+
+  std::unordered_map<std::string, uint32_t> index_;
+  std::vector<Entry> entries_;
+  std::vector<uint32_t> free_;
+};
+
+}  // namespace cloudstorage
+
+#endif  // STRING_TABLE_H
@@ -0,0 +1,152 @@
+#include "WriteBuffer.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace cloudstorage {
+
+constexpr uint64_t WriteBuffer::BLOCK_SIZE;
+
+WriteBuffer::Budget::Budget(uint64_t memory, uint64_t disk)
+    : memory_limit_(memory),
+      disk_limit_(disk),
+      memory_(),
+      disk_(),
+      spilled_blocks_() {}
+
+WriteBuffer::Budget::Statistics WriteBuffer::Budget::statistics() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return {memory_, disk_, spilled_blocks_};
+}
+
+bool WriteBuffer::Budget::reserveMemory() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (memory_ + BLOCK_SIZE > memory_limit_) return false;
+  memory_ += BLOCK_SIZE;
+  return true;
+}
+
+bool WriteBuffer::Budget::reserveDisk() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (disk_ + BLOCK_SIZE > disk_limit_) return false;
+  disk_ += BLOCK_SIZE;
+  return true;
+}
+
+void WriteBuffer::Budget::release(uint64_t memory, uint64_t disk) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  memory_ -= memory;
+  disk_ -= disk;
+}
+
+WriteBuffer::WriteBuffer(std::shared_ptr<Budget> budget,
+                         std::string spill_file)
+    : budget_(std::move(budget)), spill_file_(std::move(spill_file)), size_() {}
+
+WriteBuffer::~WriteBuffer() {
+  budget_->release(memory_block_.size() * BLOCK_SIZE,
+                   disk_block_.size() * BLOCK_SIZE);
+  if (spill_.is_open()) {
+    spill_.close();
+    (void)std::remove(spill_file_.c_str());
+  }
+}
+
+bool WriteBuffer::write(const char* data, uint32_t size, uint64_t offset) {
+  while (size > 0) {
+    auto index = offset / BLOCK_SIZE;
+    auto block_offset = offset % BLOCK_SIZE;
+    auto length = static_cast<uint32_t>(
+        std::min<uint64_t>(size, BLOCK_SIZE - block_offset));
+    auto it = memory_block_.find(index);
+    if (it == memory_block_.end() &&
+        disk_block_.find(index) == disk_block_.end()) {
+      if (budget_->reserveMemory() || spill())
+        it = memory_block_.insert({index, std::string()}).first;
+      else if (budget_->reserveDisk())
+        disk_block_.insert(index);
+      else
+        return false;
+    }
+    if (it != memory_block_.end()) {
+      auto& block = it->second;
+      if (block.size() < block_offset + length)
+        block.resize(block_offset + length);
+      memcpy(&block[block_offset], data, length);
+    } else {
+      if (!open()) return false;
+      spill_.clear();
+      spill_.seekp(static_cast<std::streamoff>(offset));
+      spill_.write(data, length);
+      if (!spill_) return false;
+    }
+    data += length;
+    size -= length;
+    offset += length;
+    size_ = std::max(size_, offset);
+  }
+  return true;
+}
+
+uint32_t WriteBuffer::read(char* data, uint32_t size, uint64_t offset) {
+  if (offset >= size_) return 0;
+  auto total = static_cast<uint32_t>(std::min<uint64_t>(size, size_ - offset));
+  size = total;
+  while (size > 0) {
+    auto index = offset / BLOCK_SIZE;
+    auto block_offset = offset % BLOCK_SIZE;
+    auto length = static_cast<uint32_t>(
+        std::min<uint64_t>(size, BLOCK_SIZE - block_offset));
+    uint64_t available = 0;
+    auto it = memory_block_.find(index);
+    if (it != memory_block_.end()) {
+      auto& block = it->second;
+      if (block.size() > block_offset)
+        available = std::min<uint64_t>(length, block.size() - block_offset);
+      memcpy(data, block.data() + block_offset, available);
+    } else if (disk_block_.find(index) != disk_block_.end()) {
+      spill_.clear();
+      spill_.seekg(static_cast<std::streamoff>(offset));
+      spill_.read(data, length);
+      available = static_cast<uint64_t>(spill_.gcount());
+    }
+    memset(data + available, 0, length - available);
+    data += length;
+    size -= length;
+    offset += length;
+  }
+  return total;
+}
+
+uint64_t WriteBuffer::size() const { return size_; }
+
+bool WriteBuffer::spill() {
+  if (memory_block_.empty() || !budget_->reserveDisk()) return false;
+  auto it = memory_block_.begin();
+  if (!open()) {
+    budget_->release(0, BLOCK_SIZE);
+    return false;
+  }
+  spill_.clear();
+  spill_.seekp(static_cast<std::streamoff>(it->first * BLOCK_SIZE));
+  spill_.write(it->second.data(),
+               static_cast<std::streamsize>(it->second.size()));
+  if (!spill_) {
+    budget_->release(0, BLOCK_SIZE);
+    return false;
+  }
+  disk_block_.insert(it->first);
+  memory_block_.erase(it);
+  std::lock_guard<std::mutex> lock(budget_->mutex_);
+  budget_->spilled_blocks_++;
+  return true;
+}
+
+bool WriteBuffer::open() {
+  if (!spill_.is_open())
+    spill_.open(spill_file_, std::ios::in | std::ios::out | std::ios::binary |
+                                 std::ios::trunc);
+  return spill_.is_open();
+}
+
+}  // namespace cloudstorage
@@ -0,0 +1,94 @@
+#ifndef WRITE_BUFFER_H
+#define WRITE_BUFFER_H
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+#include "BlockCache.h"
+
+namespace cloudstorage {
+
+/**
+ * Data written to a file which wasn't uploaded yet, kept in blocks of
+ * BLOCK_SIZE bytes. Blocks stay in memory while the budget shared by all
+ * buffers allows it; past that, the buffer moves its blocks to a spill file,
+ * lowest first, so that a file written front to back keeps its most recently
+ * written part in memory. Writing fails once spilled blocks of all buffers
+ * would exceed the disk budget.
+ *
+ * Parts of the file which weren't written read as zeros.
+ */
+class WriteBuffer {
+ public:
+  static constexpr uint64_t BLOCK_SIZE = BlockCache::BLOCK_SIZE;
+
+  class Budget {
+   public:
+    struct Statistics {
+      uint64_t memory_;
+      uint64_t disk_;
+      uint64_t spilled_blocks_;
+    };
+
+    Budget(uint64_t memory, uint64_t disk);
+
+    Statistics statistics() const;
+
+   private:
+    friend class WriteBuffer;
+
+    bool reserveMemory();
+    bool reserveDisk();
+    void release(uint64_t memory, uint64_t disk);
+
+    mutable std::mutex mutex_;
+    uint64_t memory_limit_;
+    uint64_t disk_limit_;
+    uint64_t memory_;
+    uint64_t disk_;
+    uint64_t spilled_blocks_;
+  };
+
+  /**
+   * @param spill_file path of file created once blocks don't fit in memory
+   */
+  WriteBuffer(std::shared_ptr<Budget>, std::string spill_file);
+  ~WriteBuffer();
+
+  /**
+   * @return false if data couldn't be stored, because of the disk budget or
+   * an error of the spill file
+   */
+  bool write(const char* data, uint32_t size, uint64_t offset);
+
+  /**
+   * @return count of bytes read, less than size only at the end of the file
+   */
+  uint32_t read(char* data, uint32_t size, uint64_t offset);
+
+  uint64_t size() const;
+
+ private:
+  /**
+   * Moves block with the lowest index from memory to the spill file; the
+   * memory it used stays reserved for the caller.
+   */
+  bool spill();
+  bool open();
+
+  std::shared_ptr<Budget> budget_;
+  std::string spill_file_;
+  std::fstream spill_;
+  std::map<uint64_t, std::string> memory_block_;
+  std::unordered_set<uint64_t> disk_block_;
+  uint64_t size_;
+};
+
+}  // namespace cloudstorage
+
+#endif  // WRITE_BUFFER_H
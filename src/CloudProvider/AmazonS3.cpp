@@ -27,6 +27,8 @@
 #include <tinyxml2.h>
 #include <algorithm>
 #include <iomanip>
+#include <limits>
+#include <mutex>
 
 #include "Request/RecursiveRequest.h"
 #include "Utility/Utility.h"
@@ -37,6 +39,12 @@ namespace cloudstorage {
 
 namespace {
 
+const uint64_t DEFAULT_UPLOAD_PART_SIZE = 8 * 1024 * 1024;
+// S3 rejects smaller parts other than the last one.
+const uint64_t MIN_UPLOAD_PART_SIZE = 5 * 1024 * 1024;
+const uint64_t MAX_UPLOAD_PART_COUNT = 10000;
+const uint32_t UPLOAD_STREAM_COUNT = 4;
+
 std::string escapePath(const std::string& str) {
   std::string data = util::Url::escape(str);
   std::string slash = util::Url::escape("/");
@@ -52,6 +60,22 @@ std::string escapePath(const std::string& str) {
   return result;
 }
 
+// Whether the failure of a request of a multipart upload means the upload
+// can't be completed anymore; otherwise it is kept, so it may be resumed.
+bool definitive(const Error& e) {
+  if (e.code_ == IHttpRequest::NotFound) return true;
+  tinyxml2::XMLDocument document;
+  if (document.Parse(e.description_.c_str(), e.description_.size()) !=
+          tinyxml2::XML_SUCCESS ||
+      !document.RootElement())
+    return false;
+  auto code = document.RootElement()->FirstChildElement("Code");
+  if (!code || !code->GetText()) return false;
+  std::string text = code->GetText();
+  return text == "NoSuchUpload" || text == "InvalidPart" ||
+         text == "InvalidPartOrder" || text == "EntityTooSmall";
+}
+
 std::string currentDate() {
   auto time =
       util::gmtime(std::chrono::duration_cast<std::chrono::seconds>(
@@ -74,7 +98,39 @@ std::string currentDateAndTime() {
 
 }  // namespace
 
-AmazonS3::AmazonS3() : CloudProvider(util::make_unique<Auth>()) {}
+struct AmazonS3::MultipartUpload {
+  Request<EitherError<IItem>>::Pointer request_;
+  IUploadFileCallback::Pointer callback_;
+  IItem::Pointer directory_;
+  std::string filename_;
+  std::string url_;
+  std::string upload_id_;
+  uint64_t size_;
+  uint64_t part_size_;
+  uint64_t part_count_;
+  std::string journal_key_;
+  bool resumed_ = false;
+
+  std::mutex mutex_;
+  std::mutex read_mutex_;
+  uint64_t next_part_ = 0;
+  uint32_t running_ = 0;
+  uint64_t uploaded_ = 0;
+  std::vector<std::string> etags_;
+  // Count of leading parts which were uploaded; the journal records these.
+  uint64_t committed_ = 0;
+  std::shared_ptr<Error> error_;
+  bool finished_ = false;
+
+  Range part(uint64_t index) const {
+    auto start = index * part_size_;
+    return {start, std::min(part_size_, size_ - start)};
+  }
+};
+
+AmazonS3::AmazonS3()
+    : CloudProvider(util::make_unique<Auth>()),
+      upload_part_size_(DEFAULT_UPLOAD_PART_SIZE) {}
 
 void AmazonS3::initialize(InitData&& init_data) {
   if (init_data.token_.empty())
@@ -86,6 +142,10 @@ void AmazonS3::initialize(InitData&& init_data) {
                 [&](const std::string& v) { rewritten_endpoint_ = v; });
     setWithHint(init_data.hints_, "region",
                 [&](const std::string& v) { region_ = v; });
+    setWithHint(init_data.hints_, "upload_part_size",
+                [&](const std::string& v) {
+                  upload_part_size_ = std::stoull(v);
+                });
   }
   CloudProvider::initialize(std::move(init_data));
 }
@@ -109,6 +169,12 @@ std::string AmazonS3::endpoint() const {
     return s3_endpoint_ + "/" + bucket_;
 }
 
+ICloudProvider::OperationSet AmazonS3::supportedOperations() const {
+  return CloudProvider::supportedOperations() & ~StreamUpload;
+}
+
+uint32_t AmazonS3::defaultDownloadStreamCount() const { return 4; }
+
 IItem::Pointer AmazonS3::rootDirectory() const {
   return util::make_unique<Item>("/", "", IItem::UnknownSize,
                                  IItem::UnknownTimeStamp,
@@ -179,29 +245,32 @@ ICloudProvider::MoveItemRequest::Pointer AmazonS3::moveItemAsync(
                            Request::CompleteCallback callback) {
     auto l = getPath("/" + source->id()).length();
     std::string new_path = destination->id() + item->id().substr(l);
-    r->request(
-        [=, this](util::Output) {
-          auto request = http()->create(endpoint() + "/" + new_path, "PUT");
-          if (item->type() != IItem::FileType::Directory)
-            request->setHeaderParameter(
-                "x-amz-copy-source", bucket() + "/" + escapePath(item->id()));
-          return request;
-        },
-        [=, this](EitherError<Response> e) {
-          if (e.left()) return callback(e.left());
-          r->request(
-              [=, this](util::Output) {
-                return http()->create(endpoint() + "/" + escapePath(item->id()),
-                                      "DELETE");
-              },
-              [=](EitherError<Response> e) {
-                if (e.left()) return callback(e.left());
-                IItem::Pointer renamed = std::make_shared<Item>(
-                    getFilename(new_path), new_path, item->size(),
-                    item->timestamp(), item->type());
-                callback(renamed);
-              });
-        });
+    copyObject(r, item, new_path, [=, this](EitherError<IItem> e) {
+      if (e.left()) return callback(e.left());
+      r->request(
+          [=, this](util::Output) {
+            return http()->create(endpoint() + "/" + escapePath(item->id()),
+                                  "DELETE");
+          },
+          [=](EitherError<Response> d) {
+            if (d.left()) return callback(d.left());
+            callback(e);
+          });
+    });
+  };
+  return std::make_shared<Request>(shared_from_this(), source, callback,
+                                   visitor)
+      ->run();
+}
+
+ICloudProvider::CopyItemRequest::Pointer AmazonS3::copyItemAsync(
+    IItem::Pointer source, IItem::Pointer destination,
+    CopyItemCallback callback) {
+  using Request = RecursiveRequest<EitherError<IItem>>;
+  auto visitor = [=, this](Request::Pointer r, IItem::Pointer item,
+                           Request::CompleteCallback callback) {
+    auto l = getPath("/" + source->id()).length();
+    copyObject(r, item, destination->id() + item->id().substr(l), callback);
   };
   return std::make_shared<Request>(shared_from_this(), source, callback,
                                    visitor)
@@ -316,10 +385,9 @@ ICloudProvider::GetItemDataRequest::Pointer AmazonS3::getItemDataAsync(
                };
                r->request(factory, [=, this](EitherError<Response> e) {
                  if (e.left()) return r->done(e.left());
-                 std::stringstream sstream;
-                 sstream << e.right()->output().rdbuf();
+                 auto data = e.right()->output().view();
                  tinyxml2::XMLDocument document;
-                 if (document.Parse(sstream.str().c_str()) !=
+                 if (document.Parse(data.data(), data.size()) !=
                      tinyxml2::XML_SUCCESS)
                    return r->done(Error{IHttpRequest::Failure,
                                         util::Error::FAILED_TO_PARSE_XML});
@@ -352,6 +420,36 @@ ICloudProvider::GetItemDataRequest::Pointer AmazonS3::getItemDataAsync(
       ->run();
 }
 
+ICloudProvider::UploadFileRequest::Pointer AmazonS3::uploadFileAsync(
+    IItem::Pointer directory, const std::string& filename,
+    IUploadFileCallback::Pointer callback) {
+  auto size = callback->size();
+  auto part_size = uploadPartSize(size);
+  if (size <= part_size)
+    return CloudProvider::uploadFileAsync(directory, filename, callback);
+  auto url = endpoint() + "/" + escapePath(directory->id() + filename);
+  return std::make_shared<Request<EitherError<IItem>>>(
+             shared_from_this(),
+             [=](EitherError<IItem> e) { callback->done(e); },
+             [=, this](Request<EitherError<IItem>>::Pointer r) {
+               auto upload = std::make_shared<MultipartUpload>();
+               upload->request_ = r;
+               upload->callback_ = callback;
+               upload->directory_ = directory;
+               upload->filename_ = filename;
+               upload->url_ = url;
+               upload->size_ = size;
+               upload->part_size_ = part_size;
+               upload->part_count_ = (size + part_size - 1) / part_size;
+               upload->etags_.resize(upload->part_count_);
+               upload->journal_key_ =
+                   transferKey(*directory, filename, *callback);
+               if (resumeMultipartUpload(*upload)) return uploadParts(upload);
+               createMultipartUpload(upload);
+             })
+      ->run();
+}
+
 IHttpRequest::Pointer AmazonS3::listDirectoryRequest(
     const IItem& item, const std::string& page_token, std::ostream&) const {
   auto request = http()->create(endpoint() + "/", "GET");
@@ -388,55 +486,84 @@ IHttpRequest::Pointer AmazonS3::downloadFileRequest(const IItem& item,
 IItem::List AmazonS3::listDirectoryResponse(
     const IItem& parent, std::istream& stream,
     std::string& next_page_token) const {
-  std::stringstream sstream;
-  sstream << stream.rdbuf();
+  std::string storage;
+  auto content = util::contents(stream, storage);
   tinyxml2::XMLDocument document;
-  if (document.Parse(sstream.str().c_str()) != tinyxml2::XML_SUCCESS)
+  if (document.Parse(content.data(), content.size()) != tinyxml2::XML_SUCCESS)
     throw std::logic_error(util::Error::FAILED_TO_PARSE_XML);
   IItem::List result;
   if (document.RootElement()->FirstChildElement("Name")) {
     for (auto child = document.RootElement()->FirstChildElement("Contents");
-         child; child = child->NextSiblingElement("Contents")) {
-      auto size_element = child->FirstChildElement("Size");
-      if (!size_element) throw std::logic_error(util::Error::INVALID_XML);
-      auto size = std::stoull(size_element->GetText());
-      auto key_element = child->FirstChildElement("Key");
-      if (!key_element) throw std::logic_error(util::Error::INVALID_XML);
-      std::string id = key_element->GetText();
-      if (size == 0 && id == parent.id()) continue;
-      auto timestamp_element = child->FirstChildElement("LastModified");
-      if (!timestamp_element) throw std::logic_error(util::Error::INVALID_XML);
-      std::string timestamp = timestamp_element->GetText();
-      auto item = util::make_unique<Item>(getFilename(id), id, size,
-                                          util::parse_time(timestamp),
-                                          IItem::FileType::Unknown);
-      item->set_url(getUrl(*item));
-      result.push_back(std::move(item));
-    }
+         child; child = child->NextSiblingElement("Contents"))
+      if (auto item = toItem(parent.id(), child))
+        result.push_back(std::move(item));
     for (auto child =
              document.RootElement()->FirstChildElement("CommonPrefixes");
-         child; child = child->NextSiblingElement("CommonPrefixes")) {
-      auto prefix_element = child->FirstChildElement("Prefix");
-      if (!prefix_element) throw std::logic_error(util::Error::INVALID_XML);
-      std::string id = prefix_element->GetText();
-      auto item = util::make_unique<Item>(
-          getFilename(id), id, IItem::UnknownSize, IItem::UnknownTimeStamp,
-          IItem::FileType::Directory);
-      result.push_back(std::move(item));
-    }
-    auto is_truncated_element =
-        document.RootElement()->FirstChildElement("IsTruncated");
-    if (!is_truncated_element) throw std::logic_error(util::Error::INVALID_XML);
-    if (is_truncated_element->GetText() == std::string("true")) {
-      auto next_token_element =
-          document.RootElement()->FirstChildElement("NextContinuationToken");
-      if (!next_token_element) throw std::logic_error(util::Error::INVALID_XML);
-      next_page_token = next_token_element->GetText();
-    }
+         child; child = child->NextSiblingElement("CommonPrefixes"))
+      result.push_back(toItem(parent.id(), child));
+    next_page_token = nextPageToken(document.RootElement());
   }
   return result;
 }
 
+ListDirectoryParser::Pointer AmazonS3::listDirectoryParser(
+    const IItem& directory,
+    const ListDirectoryParser::ItemCallback& callback) const {
+  auto parent = directory.id();
+  return util::make_unique<XmlListParser>(
+      std::vector<std::string>{"Contents", "CommonPrefixes"},
+      [=, this](const tinyxml2::XMLElement* element) {
+        if (auto item = toItem(parent, element)) callback(std::move(item));
+      },
+      [](const tinyxml2::XMLElement* root) -> std::string {
+        if (!root->FirstChildElement("Name")) return "";
+        return nextPageToken(root);
+      });
+}
+
+IItem::Pointer AmazonS3::toItem(const std::string& parent,
+                                const tinyxml2::XMLElement* element) const {
+  if (element->Name() == std::string("CommonPrefixes")) {
+    auto prefix_element = element->FirstChildElement("Prefix");
+    if (!prefix_element) throw std::logic_error(util::Error::INVALID_XML);
+    std::string id = prefix_element->GetText();
+    return util::make_unique<Item>(getFilename(id), id, IItem::UnknownSize,
+                                   IItem::UnknownTimeStamp,
+                                   IItem::FileType::Directory);
+  }
+  auto size_element = element->FirstChildElement("Size");
+  if (!size_element) throw std::logic_error(util::Error::INVALID_XML);
+  auto size = std::stoull(size_element->GetText());
+  auto key_element = element->FirstChildElement("Key");
+  if (!key_element) throw std::logic_error(util::Error::INVALID_XML);
+  std::string id = key_element->GetText();
+  if (size == 0 && id == parent) return nullptr;
+  auto timestamp_element = element->FirstChildElement("LastModified");
+  if (!timestamp_element) throw std::logic_error(util::Error::INVALID_XML);
+  std::string timestamp = timestamp_element->GetText();
+  auto item = util::make_unique<Item>(getFilename(id), id, size,
+                                      util::parse_time(timestamp),
+                                      IItem::FileType::Unknown);
+  item->set_url(getUrl(*item));
+  // ETags of objects uploaded in parts aren't hashes of their content.
+  auto etag_element = element->FirstChildElement("ETag");
+  std::string etag =
+      etag_element && etag_element->GetText() ? etag_element->GetText() : "";
+  etag.erase(std::remove(etag.begin(), etag.end(), '"'), etag.end());
+  if (etag.find('-') == std::string::npos)
+    item->set_content_hash(IItem::HashType::MD5, util::to_lower(etag));
+  return item;
+}
+
+std::string AmazonS3::nextPageToken(const tinyxml2::XMLElement* root) {
+  auto is_truncated_element = root->FirstChildElement("IsTruncated");
+  if (!is_truncated_element) throw std::logic_error(util::Error::INVALID_XML);
+  if (is_truncated_element->GetText() != std::string("true")) return "";
+  auto next_token_element = root->FirstChildElement("NextContinuationToken");
+  if (!next_token_element) throw std::logic_error(util::Error::INVALID_XML);
+  return next_token_element->GetText();
+}
+
 void AmazonS3::authorizeRequest(IHttpRequest& request) const {
   if (!crypto()) throw std::runtime_error("no crypto functions provided");
   std::string region = this->region().empty() ? "us-east-1" : this->region();
@@ -510,6 +637,306 @@ void AmazonS3::authorizeRequest(IHttpRequest& request) const {
     request.setParameter(p.first, util::Url::escape(p.second));
 }
 
+void AmazonS3::copyObject(
+    const Request<EitherError<IItem>>::Pointer& r, const IItem::Pointer& item,
+    const std::string& new_path,
+    const std::function<void(EitherError<IItem>)>& callback) {
+  r->request(
+      [=, this](util::Output) {
+        auto request = http()->create(endpoint() + "/" + new_path, "PUT");
+        if (item->type() != IItem::FileType::Directory)
+          request->setHeaderParameter(
+              "x-amz-copy-source", bucket() + "/" + escapePath(item->id()));
+        return request;
+      },
+      [=](EitherError<Response> e) {
+        if (e.left()) return callback(e.left());
+        IItem::Pointer copied = std::make_shared<Item>(
+            getFilename(new_path), new_path, item->size(), item->timestamp(),
+            item->type());
+        callback(copied);
+      });
+}
+
+uint64_t AmazonS3::uploadPartSize(uint64_t file_size) const {
+  uint64_t part_size;
+  {
+    auto lock = auth_lock();
+    part_size = upload_part_size_;
+  }
+  return std::max({part_size, MIN_UPLOAD_PART_SIZE,
+                   (file_size + MAX_UPLOAD_PART_COUNT - 1) /
+                       MAX_UPLOAD_PART_COUNT});
+}
+
+void AmazonS3::createMultipartUpload(
+    const std::shared_ptr<MultipartUpload>& upload) {
+  auto r = upload->request_;
+  r->request(
+      [=, this](util::Output) {
+        auto request = http()->create(upload->url_, "POST");
+        request->setParameter("uploads", "");
+        return request;
+      },
+      [=, this](EitherError<Response> e) {
+        if (e.left()) return r->done(e.left());
+        auto data = e.right()->output().view();
+        tinyxml2::XMLDocument document;
+        if (document.Parse(data.data(), data.size()) != tinyxml2::XML_SUCCESS)
+          return r->done(
+              Error{IHttpRequest::Failure, util::Error::FAILED_TO_PARSE_XML});
+        auto upload_id = document.RootElement()->FirstChildElement("UploadId");
+        if (!upload_id || !upload_id->GetText())
+          return r->done(
+              Error{IHttpRequest::Failure, util::Error::INVALID_XML});
+        upload->upload_id_ = upload_id->GetText();
+        journalMultipartUpload(*upload);
+        uploadParts(upload);
+      });
+}
+
+bool AmazonS3::resumeMultipartUpload(MultipartUpload& upload) {
+  TransferJournal::Entry entry;
+  if (upload.journal_key_.empty() ||
+      !transfer_journal()->find(upload.journal_key_, entry,
+                                *upload.callback_))
+    return false;
+  const auto& etags = entry.data_["etags"];
+  auto part_size = entry.data_["part_size"].asUInt64();
+  if (part_size == 0 || !etags.isArray() ||
+      etags.size() > (upload.size_ + part_size - 1) / part_size ||
+      std::min(etags.size() * part_size, upload.size_) != entry.offset_) {
+    transfer_journal()->remove(upload.journal_key_);
+    return false;
+  }
+  // Part size may have been configured differently since.
+  upload.upload_id_ = entry.session_;
+  upload.part_size_ = part_size;
+  upload.part_count_ = (upload.size_ + part_size - 1) / part_size;
+  upload.etags_.assign(upload.part_count_, "");
+  for (Json::ArrayIndex i = 0; i < etags.size(); i++)
+    upload.etags_[i] = etags[i].asString();
+  upload.next_part_ = upload.committed_ = etags.size();
+  upload.uploaded_ = entry.offset_;
+  upload.resumed_ = true;
+  return true;
+}
+
+void AmazonS3::journalMultipartUpload(MultipartUpload& upload) {
+  if (upload.journal_key_.empty()) return;
+  // Journal reads the committed parts to checksum them.
+  std::lock_guard<std::mutex> read_lock(upload.read_mutex_);
+  Json::Value data;
+  uint64_t offset;
+  {
+    std::lock_guard<std::mutex> lock(upload.mutex_);
+    data["part_size"] = Json::UInt64(upload.part_size_);
+    data["etags"] = Json::arrayValue;
+    for (uint64_t i = 0; i < upload.committed_; i++)
+      data["etags"].append(upload.etags_[i]);
+    offset = std::min(upload.committed_ * upload.part_size_, upload.size_);
+  }
+  transfer_journal()->put(upload.journal_key_,
+                          {upload.upload_id_, offset, data}, *upload.callback_);
+}
+
+void AmazonS3::uploadParts(const std::shared_ptr<MultipartUpload>& upload) {
+  std::vector<uint64_t> parts;
+  {
+    std::lock_guard<std::mutex> lock(upload->mutex_);
+    while (!upload->error_ && upload->running_ < UPLOAD_STREAM_COUNT &&
+           upload->next_part_ < upload->part_count_) {
+      upload->running_++;
+      parts.push_back(upload->next_part_++);
+    }
+  }
+  if (!parts.empty()) {
+    // This runs on the http thread once a part was sent; reading whole parts
+    // there would hold up other transfers.
+    if (auto pool = thread_pool())
+      return pool->schedule([=, this] {
+        bool failed = false;
+        for (auto index : parts) {
+          auto data = readPart(*upload, index);
+          if (data) {
+            uploadPart(upload, index, data);
+          } else {
+            failed = true;
+            std::lock_guard<std::mutex> lock(upload->mutex_);
+            upload->running_--;
+            if (!upload->error_)
+              upload->error_ = std::make_shared<Error>(Error{
+                  IHttpRequest::Failure, util::Error::COULD_NOT_READ_FILE});
+          }
+        }
+        if (failed) uploadParts(upload);
+      });
+    std::lock_guard<std::mutex> lock(upload->mutex_);
+    upload->running_ -= static_cast<uint32_t>(parts.size());
+    if (!upload->error_)
+      upload->error_ = std::make_shared<Error>(
+          Error{IHttpRequest::Aborted, util::Error::ABORTED});
+  }
+  {
+    std::lock_guard<std::mutex> lock(upload->mutex_);
+    if (upload->finished_ || upload->running_ > 0 ||
+        (!upload->error_ && upload->next_part_ < upload->part_count_))
+      return;
+    upload->finished_ = true;
+  }
+  if (upload->error_) {
+    if (upload->resumed_ && upload->error_->code_ == IHttpRequest::NotFound) {
+      // Upload from the journal was completed or aborted meanwhile.
+      auto restarted = std::make_shared<MultipartUpload>();
+      restarted->request_ = upload->request_;
+      restarted->callback_ = upload->callback_;
+      restarted->directory_ = upload->directory_;
+      restarted->filename_ = upload->filename_;
+      restarted->url_ = upload->url_;
+      restarted->size_ = upload->size_;
+      restarted->part_size_ = uploadPartSize(upload->size_);
+      restarted->part_count_ =
+          (upload->size_ + restarted->part_size_ - 1) / restarted->part_size_;
+      restarted->etags_.resize(restarted->part_count_);
+      restarted->journal_key_ = upload->journal_key_;
+      return createMultipartUpload(restarted);
+    }
+    if (definitive(*upload->error_)) abortMultipartUpload(*upload);
+    upload->request_->done(*upload->error_);
+  } else {
+    completeMultipartUpload(upload);
+  }
+}
+
+util::ChunkedBuffer::Chunk AmazonS3::readPart(MultipartUpload& upload,
+                                              uint64_t index) {
+  {
+    std::lock_guard<std::mutex> lock(upload.mutex_);
+    if (upload.error_) return nullptr;
+  }
+  auto range = upload.part(index);
+  auto data = std::make_shared<std::vector<char>>(range.size_);
+  // The callback isn't required to handle concurrent reads; holding a lock of
+  // its own doesn't block parts which are being sent from finishing.
+  std::lock_guard<std::mutex> lock(upload.read_mutex_);
+  uint64_t read = 0;
+  while (read < range.size_) {
+    auto length = upload.callback_->putData(
+        data->data() + read,
+        static_cast<uint32_t>(std::min<uint64_t>(
+            range.size_ - read, std::numeric_limits<uint32_t>::max())),
+        range.start_ + read);
+    if (length == 0) return nullptr;
+    read += length;
+  }
+  return data;
+}
+
+void AmazonS3::uploadPart(const std::shared_ptr<MultipartUpload>& upload,
+                          uint64_t index,
+                          const util::ChunkedBuffer::Chunk& data) {
+  upload->request_->send(
+      [=, this](util::Output stream) {
+        auto request = http()->create(upload->url_, "PUT");
+        request->setParameter("partNumber", std::to_string(index + 1));
+        request->setParameter("uploadId", upload->upload_id_);
+        static_cast<util::ChunkedStream&>(*stream).buffer().append(data);
+        return request;
+      },
+      [=, this](EitherError<Response> e) {
+        auto error = e.left();
+        auto etag = error ? e.right()->headers().end()
+                          : e.right()->headers().find("etag");
+        if (!error && etag == e.right()->headers().end())
+          error = std::make_shared<Error>(
+              Error{IHttpRequest::Failure, util::Error::MISSING_ETAG});
+        uint64_t uploaded;
+        bool committed = false;
+        {
+          std::lock_guard<std::mutex> lock(upload->mutex_);
+          if (!error) {
+            upload->etags_[index] = etag->second;
+            upload->uploaded_ += data->size();
+            while (upload->committed_ < upload->part_count_ &&
+                   !upload->etags_[upload->committed_].empty()) {
+              upload->committed_++;
+              committed = true;
+            }
+          } else if (!upload->error_) {
+            upload->error_ = error;
+          }
+          uploaded = upload->uploaded_;
+        }
+        auto finished = [=, this] {
+          {
+            std::lock_guard<std::mutex> lock(upload->mutex_);
+            upload->running_--;
+          }
+          if (!error) upload->callback_->progress(upload->size_, uploaded);
+          uploadParts(upload);
+        };
+        // Part stays running until it is journaled, so that the journal isn't
+        // written to after the upload finished. Journal reads the committed
+        // parts, which is left to the thread pool as well.
+        auto pool = thread_pool();
+        if (committed && pool)
+          return pool->schedule([=, this] {
+            journalMultipartUpload(*upload);
+            finished();
+          });
+        finished();
+      },
+      [] { return std::make_shared<util::ChunkedStream>(); },
+      std::make_shared<util::ChunkedStream>(), nullptr, nullptr, true);
+}
+
+void AmazonS3::completeMultipartUpload(
+    const std::shared_ptr<MultipartUpload>& upload) {
+  auto r = upload->request_;
+  r->request(
+      [=, this](util::Output input) {
+        auto request = http()->create(upload->url_, "POST");
+        request->setParameter("uploadId", upload->upload_id_);
+        *input << "<CompleteMultipartUpload>";
+        for (size_t i = 0; i < upload->etags_.size(); i++)
+          *input << "<Part><PartNumber>" << i + 1 << "</PartNumber><ETag>"
+                 << upload->etags_[i] << "</ETag></Part>";
+        *input << "</CompleteMultipartUpload>";
+        return request;
+      },
+      [=, this](EitherError<Response> e) {
+        if (e.left()) {
+          if (definitive(*e.left())) abortMultipartUpload(*upload);
+          return r->done(e.left());
+        }
+        // S3 may report a failure after sending 200 OK already.
+        auto data = e.right()->output().view();
+        tinyxml2::XMLDocument document;
+        if (document.Parse(data.data(), data.size()) ==
+                tinyxml2::XML_SUCCESS &&
+            std::string(document.RootElement()->Name()) == "Error") {
+          abortMultipartUpload(*upload);
+          return r->done(Error{IHttpRequest::Failure, std::string(data)});
+        }
+        if (!upload->journal_key_.empty())
+          transfer_journal()->remove(upload->journal_key_);
+        r->done(uploadFileResponse(*upload->directory_, upload->filename_,
+                                   upload->size_, e.right()->output()));
+      });
+}
+
+void AmazonS3::abortMultipartUpload(const MultipartUpload& upload) {
+  if (!upload.journal_key_.empty())
+    transfer_journal()->remove(upload.journal_key_);
+  auto request = http()->create(upload.url_, "DELETE");
+  request->setParameter("uploadId", upload.upload_id_);
+  authorizeRequest(*request);
+  request->send([request](IHttpRequest::Response) {},
+                std::make_shared<std::stringstream>(),
+                std::make_shared<std::stringstream>(),
+                std::make_shared<std::stringstream>());
+}
+
 bool AmazonS3::reauthorize(int code,
                            const IHttpRequest::HeaderParameters& h) const {
   return CloudProvider::reauthorize(code, h) ||
@@ -602,8 +1029,9 @@ void AmazonS3::getRegion(const AuthorizeRequest::Pointer& r,
           }
           complete(e.left());
         } else {
+          auto data = e.right()->output().view();
           tinyxml2::XMLDocument document;
-          if (document.Parse(e.right()->output().str().c_str()) != 0)
+          if (document.Parse(data.data(), data.size()) != 0)
             return complete(
                 Error{IHttpRequest::Failure, util::Error::FAILED_TO_PARSE_XML});
           auto location = document.RootElement();
@@ -47,8 +47,10 @@ class AmazonS3 : public CloudProvider {
   std::string token() const override;
   std::string name() const override;
   std::string endpoint() const override;
+  OperationSet supportedOperations() const override;
   IItem::Pointer rootDirectory() const override;
   Hints hints() const override;
+  uint32_t defaultDownloadStreamCount() const override;
 
   AuthorizeRequest::Pointer authorizeAsync() override;
   GetItemDataRequest::Pointer getItemDataAsync(const std::string& id,
@@ -56,12 +58,18 @@ class AmazonS3 : public CloudProvider {
   MoveItemRequest::Pointer moveItemAsync(IItem::Pointer source,
                                          IItem::Pointer destination,
                                          MoveItemCallback) override;
+  CopyItemRequest::Pointer copyItemAsync(IItem::Pointer source,
+                                         IItem::Pointer destination,
+                                         CopyItemCallback) override;
   RenameItemRequest::Pointer renameItemAsync(IItem::Pointer item,
                                              const std::string&,
                                              RenameItemCallback) override;
   DeleteItemRequest::Pointer deleteItemAsync(IItem::Pointer,
                                              DeleteItemCallback) override;
   GeneralDataRequest::Pointer getGeneralDataAsync(GeneralDataCallback) override;
+  UploadFileRequest::Pointer uploadFileAsync(
+      IItem::Pointer, const std::string& filename,
+      IUploadFileCallback::Pointer) override;
 
   IHttpRequest::Pointer createDirectoryRequest(const IItem&,
                                                const std::string& name,
@@ -77,6 +85,9 @@ class AmazonS3 : public CloudProvider {
 
   IItem::List listDirectoryResponse(
       const IItem&, std::istream&, std::string& next_page_token) const override;
+  ListDirectoryParser::Pointer listDirectoryParser(
+      const IItem&,
+      const ListDirectoryParser::ItemCallback&) const override;
   IItem::Pointer createDirectoryResponse(const IItem& parent,
                                          const std::string& name,
                                          std::istream& response) const override;
@@ -96,19 +107,44 @@ class AmazonS3 : public CloudProvider {
   std::string s3_endpoint() const;
 
  private:
+  struct MultipartUpload;
+
   bool unpackCredentials(const std::string&) override;
   std::string getUrl(const Item&) const;
+  IItem::Pointer toItem(const std::string& parent,
+                        const tinyxml2::XMLElement*) const;
+  static std::string nextPageToken(const tinyxml2::XMLElement* root);
   void getRegion(const AuthorizeRequest::Pointer& r,
                  const AuthorizeRequest::AuthorizeCompleted& complete);
   void getEndpoint(const AuthorizeRequest::Pointer& r,
                    const AuthorizeRequest::AuthorizeCompleted& complete);
 
+  void copyObject(const Request<EitherError<IItem>>::Pointer&,
+                  const IItem::Pointer& item, const std::string& new_path,
+                  const std::function<void(EitherError<IItem>)>&);
+
+  uint64_t uploadPartSize(uint64_t file_size) const;
+  void createMultipartUpload(const std::shared_ptr<MultipartUpload>&);
+  bool resumeMultipartUpload(MultipartUpload&);
+  void journalMultipartUpload(MultipartUpload&);
+  void uploadParts(const std::shared_ptr<MultipartUpload>&);
+  util::ChunkedBuffer::Chunk readPart(MultipartUpload&, uint64_t index);
+  void uploadPart(const std::shared_ptr<MultipartUpload>&, uint64_t index,
+                  const util::ChunkedBuffer::Chunk& data);
+  void completeMultipartUpload(const std::shared_ptr<MultipartUpload>&);
+  /**
+   * Deletes upload along with its parts and drops its journal entry; only
+   * called once the upload can't be completed, others are left resumable.
+   */
+  void abortMultipartUpload(const MultipartUpload&);
+
   std::string access_id_;
   std::string secret_;
   std::string region_;
   std::string bucket_;
   std::string s3_endpoint_;
   std::string rewritten_endpoint_;
+  uint64_t upload_part_size_;
 };
 
 }  // namespace cloudstorage
@@ -178,6 +178,25 @@ IHttpRequest::Pointer Box::moveItemRequest(const IItem& source,
   return request;
 }
 
+IHttpRequest::Pointer Box::copyItemRequest(const IItem& source,
+                                           const IItem& destination,
+                                           std::ostream& stream) const {
+  IHttpRequest::Pointer request;
+  auto data = FileId(source.id());
+  if (source.type() == IItem::FileType::Directory)
+    request = http()->create(endpoint() + "/2.0/folders/" + data.id_ + "/copy",
+                             "POST");
+  else
+    request = http()->create(endpoint() + "/2.0/files/" + data.id_ + "/copy",
+                             "POST");
+
+  request->setHeaderParameter("Content-Type", "application/json");
+  Json::Value json;
+  json["parent"]["id"] = FileId(destination.id()).id_;
+  stream << json;
+  return request;
+}
+
 IHttpRequest::Pointer Box::renameItemRequest(const IItem& item,
                                              const std::string& name,
                                              std::ostream& input) const {
@@ -214,6 +233,20 @@ IItem::List Box::listDirectoryResponse(const IItem&, std::istream& stream,
   return result;
 }
 
+ListDirectoryParser::Pointer Box::listDirectoryParser(
+    const IItem&, const ListDirectoryParser::ItemCallback& callback) const {
+  return util::make_unique<JsonListParser>(
+      "entries", [=, this](const Json::Value& v) { callback(toItem(v)); },
+      [](const Json::Value& response) -> std::string {
+        int offset = response["offset"].asInt();
+        int limit = response["limit"].asInt();
+        int total_count = response["total_count"].asInt();
+        if (offset + limit < total_count)
+          return std::to_string(offset + limit);
+        return "";
+      });
+}
+
 IItem::Pointer Box::toItem(const Json::Value& v) const {
   IItem::FileType type = IItem::FileType::Unknown;
   if (v["type"].asString() == "folder") type = IItem::FileType::Directory;
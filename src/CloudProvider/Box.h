@@ -61,6 +61,8 @@ class Box : public CloudProvider {
                                                std::ostream&) const override;
   IHttpRequest::Pointer moveItemRequest(const IItem&, const IItem&,
                                         std::ostream&) const override;
+  IHttpRequest::Pointer copyItemRequest(const IItem&, const IItem&,
+                                        std::ostream&) const override;
   IHttpRequest::Pointer renameItemRequest(const IItem&, const std::string& name,
                                           std::ostream&) const override;
   IHttpRequest::Pointer getGeneralDataRequest(std::ostream&) const override;
@@ -68,6 +70,9 @@ class Box : public CloudProvider {
   IItem::Pointer getItemDataResponse(std::istream& response) const override;
   IItem::List listDirectoryResponse(
       const IItem&, std::istream&, std::string& next_page_token) const override;
+  ListDirectoryParser::Pointer listDirectoryParser(
+      const IItem&,
+      const ListDirectoryParser::ItemCallback&) const override;
   std::string getItemUrlResponse(const IItem& item,
                                  const IHttpRequest::HeaderParameters&,
                                  std::istream& response) const override;
@@ -31,8 +31,10 @@
 
 #include "Utility/FileServer.h"
 #include "Utility/Item.h"
+#include "Utility/TransferPipe.h"
 #include "Utility/Utility.h"
 
+#include "Request/CopyItemRequest.h"
 #include "Request/CreateDirectoryRequest.h"
 #include "Request/DeleteItemRequest.h"
 #include "Request/DownloadFileRequest.h"
@@ -44,6 +46,7 @@
 #include "Request/ListDirectoryRequest.h"
 #include "Request/MoveItemRequest.h"
 #include "Request/RenameItemRequest.h"
+#include "Request/SkipIdenticalUploadRequest.h"
 #include "Request/UploadFileRequest.h"
 
 #undef CreateDirectory
@@ -52,6 +55,8 @@ using namespace std::placeholders;
 
 const std::string DEFAULT_STATE = "DEFAULT_STATE";
 const std::string DEFAULT_FILE_URL = "http://127.0.0.1:12346";
+// Matches the window over which CurlHttp measures throughput.
+const auto LINK_SAMPLE_INTERVAL = std::chrono::seconds(1);
 
 namespace {
 
@@ -130,7 +135,12 @@ class UploadFileCallback : public cloudstorage::IUploadFileCallback {
 namespace cloudstorage {
 
 CloudProvider::CloudProvider(IAuth::Pointer auth)
-    : auth_(std::move(auth)), http_(), deleted_() {}
+    : auth_(std::move(auth)),
+      http_(),
+      download_stream_count_(),
+      chunk_sizer_(IChunkSizer::create()),
+      sampling_link_(),
+      deleted_() {}
 
 void CloudProvider::initialize(InitData&& data) {
   auto lock = auth_lock();
@@ -163,6 +173,18 @@ void CloudProvider::initialize(InitData&& data) {
               [this](std::string v) { auth()->set_error_page(v); });
   setWithHint(data.hints_, "file_url",
               [this](std::string v) { file_url_ = v; });
+  setWithHint(data.hints_, "retry_limit", [this](std::string v) {
+    retry_policy_.set_max_attempts(std::stoul(v));
+  });
+  setWithHint(data.hints_, "download_streams", [this](std::string v) {
+    download_stream_count_ = std::stoul(v);
+  });
+  setWithHint(data.hints_, "transfer_journal", [this](std::string v) {
+    transfer_journal_ = TransferJournal::open(v);
+  });
+  setWithHint(data.hints_, "chunk_memory_budget", [this](std::string v) {
+    chunk_sizer_ = IChunkSizer::create(std::stoull(v));
+  });
 
 #ifdef WITH_CRYPTOPP
   if (!crypto_) crypto_ = ICrypto::create();
@@ -193,9 +215,21 @@ void CloudProvider::initialize(InitData&& data) {
   if (auth()->error_page().empty())
     auth()->set_error_page(util::error_page(name()));
   auth()->initialize(http(), http_server());
+
+  {
+    std::lock_guard<std::mutex> lock(link_sample_mutex_);
+    sampling_link_ = true;
+  }
+  sampleLink();
 }
 
 void CloudProvider::destroy() {
+  {
+    // Thread pool runs delayed tasks when it's destroyed; the sample which
+    // runs then mustn't schedule another one.
+    std::lock_guard<std::mutex> lock(link_sample_mutex_);
+    sampling_link_ = false;
+  }
   cancelStreamRequests();
   file_daemon_ = nullptr;
   crypto_ = nullptr;
@@ -267,10 +301,25 @@ IItem::Pointer CloudProvider::rootDirectory() const {
                                  IItem::FileType::Directory);
 }
 
+IChunkSizer* CloudProvider::chunkSizer() const { return chunk_sizer_.get(); }
+
+void CloudProvider::sampleLink() {
+  std::lock_guard<std::mutex> lock(link_sample_mutex_);
+  if (!sampling_link_) return;
+  // Requests of the provider are grouped under its name, see CloudFactory.
+  chunk_sizer_->update(http_->bandwidth(name()), http_->latency(name()));
+  std::weak_ptr<CloudProvider> provider = shared_from_this();
+  thread_pool_->schedule(
+      [provider] {
+        if (auto p = provider.lock()) p->sampleLink();
+      },
+      std::chrono::system_clock::now() + LINK_SAMPLE_INTERVAL);
+}
+
 ICloudProvider::OperationSet CloudProvider::supportedOperations() const {
   return ExchangeCode | GetItemUrl | ListDirectoryPage | ListDirectory |
          GetItem | DownloadFile | UploadFile | DeleteItem | CreateDirectory |
-         MoveItem | RenameItem;
+         MoveItem | RenameItem | CopyItem | StreamUpload;
 }
 
 ICloudProvider::IAuthCallback* CloudProvider::auth_callback() const {
@@ -289,6 +338,26 @@ IHttpServerFactory* CloudProvider::http_server() const {
 
 IThreadPool* CloudProvider::thread_pool() const { return thread_pool_.get(); }
 
+RetryPolicy* CloudProvider::retry_policy() const { return &retry_policy_; }
+
+TransferJournal* CloudProvider::transfer_journal() const {
+  return transfer_journal_.get();
+}
+
+std::string CloudProvider::transferKey(const IItem& directory,
+                                       const std::string& filename,
+                                       IUploadFileCallback& callback) const {
+  if (!transfer_journal_) return "";
+  return TransferJournal::key(name(), directory.id(), filename, callback);
+}
+
+uint32_t CloudProvider::downloadStreamCount() const {
+  return download_stream_count_ ? download_stream_count_
+                                : defaultDownloadStreamCount();
+}
+
+uint32_t CloudProvider::defaultDownloadStreamCount() const { return 1; }
+
 IThreadPool* CloudProvider::thumbnailer_thread_pool() const {
   return thumbnailer_thread_pool_ ? thumbnailer_thread_pool_.get()
                                   : thread_pool_.get();
@@ -337,6 +406,18 @@ ICloudProvider::UploadFileRequest::Pointer CloudProvider::uploadFileAsync(
       ->run();
 }
 
+ICloudProvider::UploadFileRequest::Pointer CloudProvider::uploadFileAsync(
+    IItem::Pointer directory, const std::string& filename,
+    IUploadFileCallback::Pointer callback, UploadMode mode) {
+  if (mode == UploadMode::Always)
+    return uploadFileAsync(std::move(directory), filename,
+                           std::move(callback));
+  return std::make_shared<SkipIdenticalUploadRequest>(
+             shared_from_this(), std::move(directory), filename,
+             std::move(callback))
+      ->run();
+}
+
 ICloudProvider::GetItemDataRequest::Pointer CloudProvider::getItemDataAsync(
     const std::string& id, GetItemDataCallback f) {
   return std::make_shared<cloudstorage::GetItemDataRequest>(shared_from_this(),
@@ -511,6 +592,14 @@ ICloudProvider::MoveItemRequest::Pointer CloudProvider::moveItemAsync(
       ->run();
 }
 
+ICloudProvider::CopyItemRequest::Pointer CloudProvider::copyItemAsync(
+    IItem::Pointer source, IItem::Pointer destination,
+    CopyItemCallback callback) {
+  return std::make_shared<cloudstorage::CopyItemRequest>(
+             shared_from_this(), source, destination, callback)
+      ->run();
+}
+
 ICloudProvider::RenameItemRequest::Pointer CloudProvider::renameItemAsync(
     IItem::Pointer item, const std::string& name, RenameItemCallback callback) {
   return std::make_shared<cloudstorage::RenameItemRequest>(shared_from_this(),
@@ -669,6 +758,11 @@ IHttpRequest::Pointer CloudProvider::moveItemRequest(const IItem&, const IItem&,
   return nullptr;
 }
 
+IHttpRequest::Pointer CloudProvider::copyItemRequest(const IItem&, const IItem&,
+                                                     std::ostream&) const {
+  return nullptr;
+}
+
 IHttpRequest::Pointer CloudProvider::renameItemRequest(const IItem&,
                                                        const std::string&,
                                                        std::ostream&) const {
@@ -695,6 +789,12 @@ IItem::Pointer CloudProvider::moveItemResponse(const IItem&, const IItem&,
   return getItemDataResponse(response);
 }
 
+IItem::Pointer CloudProvider::copyItemResponse(const IItem& source,
+                                               const IItem& destination,
+                                               std::istream& response) const {
+  return moveItemResponse(source, destination, response);
+}
+
 IItem::Pointer CloudProvider::uploadFileResponse(const IItem&,
                                                  const std::string&, uint64_t,
                                                  std::istream& response) const {
@@ -716,6 +816,11 @@ IItem::List CloudProvider::listDirectoryResponse(const IItem&, std::istream&,
   return {};
 }
 
+ListDirectoryParser::Pointer CloudProvider::listDirectoryParser(
+    const IItem&, const ListDirectoryParser::ItemCallback&) const {
+  return nullptr;
+}
+
 IItem::Pointer CloudProvider::createDirectoryResponse(
     const IItem&, const std::string&, std::istream& stream) const {
   return getItemDataResponse(stream);
@@ -744,4 +849,24 @@ CloudProvider::downloadFileRangeAsync(IItem::Pointer item, Range range,
   return downloadFileAsync(std::move(item), std::move(callback), range);
 }
 
+ICloudProvider::CopyItemRequest::Pointer CloudProvider::transferFileAsync(
+    IItem::Pointer source, IItem::Pointer destination,
+    CopyItemCallback callback) {
+  class TransferCallback : public ITransferPipe::ICallback {
+   public:
+    TransferCallback(CopyItemCallback callback) : callback_(callback) {}
+
+    void progress(uint64_t, uint64_t) override {}
+
+    void done(EitherError<IItem> e) override { callback_(e); }
+
+   private:
+    CopyItemCallback callback_;
+  };
+  return TransferPipe::transfer(
+      thread_pool(), ITransferPipe::DEFAULT_BUFFER_SIZE, *this, source, *this,
+      destination, source->filename(),
+      std::make_shared<TransferCallback>(callback));
+}
+
 }  // namespace cloudstorage
@@ -32,7 +32,10 @@
 
 #include "ICloudProvider.h"
 #include "Request/AuthorizeRequest.h"
+#include "Request/ListDirectoryParser.h"
+#include "Request/RetryPolicy.h"
 #include "Utility/Auth.h"
+#include "Utility/TransferJournal.h"
 
 namespace cloudstorage {
 
@@ -54,11 +57,31 @@ class CloudProvider : public ICloudProvider,
   std::string token() const override;
   IItem::Pointer rootDirectory() const override;
   OperationSet supportedOperations() const override;
+  IChunkSizer* chunkSizer() const override;
   ICrypto* crypto() const;
   IHttp* http() const;
   IHttpServerFactory* http_server() const;
   IThreadPool* thread_pool() const;
   IThreadPool* thumbnailer_thread_pool() const;
+  RetryPolicy* retry_policy() const;
+
+  /**
+   * Maximum count of connections a single file download may be split into;
+   * set with the download_streams hint or provider's default.
+   */
+  uint32_t downloadStreamCount() const;
+
+  /**
+   * Journal of unfinished uploads, set with the transfer_journal hint;
+   * nullptr if there is none.
+   */
+  TransferJournal* transfer_journal() const;
+
+  /**
+   * Key of an upload in the transfer journal, empty if there is no journal.
+   */
+  std::string transferKey(const IItem& directory, const std::string& filename,
+                          IUploadFileCallback&) const;
   IAuthCallback* auth_callback() const;
   std::string file_url() const;
 
@@ -80,6 +103,10 @@ class CloudProvider : public ICloudProvider,
   UploadFileRequest::Pointer uploadFileAsync(
       IItem::Pointer, const std::string&,
       IUploadFileCallback::Pointer) override;
+  UploadFileRequest::Pointer uploadFileAsync(IItem::Pointer,
+                                             const std::string&,
+                                             IUploadFileCallback::Pointer,
+                                             UploadMode) override;
   GetItemDataRequest::Pointer getItemDataAsync(const std::string& id,
                                                GetItemDataCallback f) override;
   DownloadFileRequest::Pointer getThumbnailAsync(
@@ -92,6 +119,9 @@ class CloudProvider : public ICloudProvider,
   MoveItemRequest::Pointer moveItemAsync(IItem::Pointer source,
                                          IItem::Pointer destination,
                                          MoveItemCallback) override;
+  CopyItemRequest::Pointer copyItemAsync(IItem::Pointer source,
+                                         IItem::Pointer destination,
+                                         CopyItemCallback) override;
   RenameItemRequest::Pointer renameItemAsync(IItem::Pointer item,
                                              const std::string&,
                                              RenameItemCallback) override;
@@ -199,6 +229,19 @@ class CloudProvider : public ICloudProvider,
                                                 const IItem& destination,
                                                 std::ostream&) const;
 
+  /**
+   * Used by default implementation of copyItemAsync; providers without a
+   * server side copy return nullptr, files are then downloaded and uploaded
+   * again and directories are recreated item by item.
+   *
+   * @param source
+   * @param destination
+   * @return http request
+   */
+  virtual IHttpRequest::Pointer copyItemRequest(const IItem& source,
+                                                const IItem& destination,
+                                                std::ostream&) const;
+
   /**
    * Used by default implementation of renameItemAsync.
    *
@@ -240,6 +283,20 @@ class CloudProvider : public ICloudProvider,
                                             std::istream& response,
                                             std::string& next_page_token) const;
 
+  /**
+   * Used by default implementation of listDirectoryAsync; if a parser is
+   * returned, items are reported while the page is still being received and
+   * listDirectoryResponse isn't called.
+   *
+   * @param directory
+   * @param callback should be called with every item found
+   *
+   * @return parser or nullptr if only listDirectoryResponse is supported
+   */
+  virtual ListDirectoryParser::Pointer listDirectoryParser(
+      const IItem& directory,
+      const ListDirectoryParser::ItemCallback& callback) const;
+
   virtual IItem::Pointer renameItemResponse(const IItem& old_item,
                                             const std::string& name,
                                             std::istream& response) const;
@@ -247,6 +304,14 @@ class CloudProvider : public ICloudProvider,
   virtual IItem::Pointer moveItemResponse(const IItem&, const IItem&,
                                           std::istream&) const;
 
+  /**
+   * Used by default implementation of copyItemAsync, by default parses the
+   * response the same way moveItemResponse does.
+   */
+  virtual IItem::Pointer copyItemResponse(const IItem& source,
+                                          const IItem& destination,
+                                          std::istream&) const;
+
   virtual IItem::Pointer uploadFileResponse(const IItem& parent,
                                             const std::string& filename,
                                             uint64_t size,
@@ -299,7 +364,20 @@ class CloudProvider : public ICloudProvider,
   DownloadFileRequest::Pointer downloadFileRangeAsync(
       IItem::Pointer, Range, IDownloadFileCallback::Pointer);
 
+  /**
+   * Copies file source to directory destination through ITransferPipe.
+   */
+  CopyItemRequest::Pointer transferFileAsync(IItem::Pointer source,
+                                             IItem::Pointer destination,
+                                             CopyItemCallback);
+
  protected:
+  /**
+   * Providers which serve byte ranges of a file from independent connections
+   * with per connection throughput limits can download files in parallel.
+   */
+  virtual uint32_t defaultDownloadStreamCount() const;
+
   void setWithHint(const Hints& hints, const std::string& name,
                    const std::function<void(std::string)>&) const;
   std::string defaultFileDaemonUrl(const IItem& item, uint64_t size) const;
@@ -310,6 +388,12 @@ class CloudProvider : public ICloudProvider,
   template <class T>
   friend class Request;
 
+  /**
+   * Feeds throughput and latency measured by the http module to the chunk
+   * sizer every LINK_SAMPLE_INTERVAL, until the provider is destroyed.
+   */
+  void sampleLink();
+
   DownloadFileRequest::Pointer makeDownloadFileRequest(
       IItem::Pointer file, Range,
       std::function<IHttpRequest::Pointer(const IItem&, std::ostream&)>,
@@ -322,6 +406,10 @@ class CloudProvider : public ICloudProvider,
   IHttpServerFactory::Pointer http_server_;
   IThreadPool::Pointer thread_pool_;
   IThreadPool::Pointer thumbnailer_thread_pool_;
+  mutable RetryPolicy retry_policy_;
+  uint32_t download_stream_count_;
+  IChunkSizer::Pointer chunk_sizer_;
+  std::shared_ptr<TransferJournal> transfer_journal_;
   AuthorizeRequest::Pointer current_authorization_;
   std::unordered_map<IGenericRequest*,
                      std::vector<AuthorizeRequest::AuthorizeCompleted>>
@@ -333,6 +421,8 @@ class CloudProvider : public ICloudProvider,
   std::mutex stream_request_mutex_;
   std::mutex current_authorization_mutex_;
   mutable std::mutex auth_mutex_;
+  std::mutex link_sample_mutex_;
+  bool sampling_link_;
   bool deleted_;
 };
 
@@ -25,35 +25,66 @@
 
 #include <json/json.h>
 #include <algorithm>
+#include <chrono>
 #include <sstream>
 
 #include "Utility/Item.h"
+#include "Utility/UploadStream.h"
 #include "Utility/Utility.h"
 
 #include "Request/Request.h"
 
 const std::string DROPBOXAPI_ENDPOINT = "https://api.dropboxapi.com";
-const int CHUNK_SIZE = 60 * 1024 * 1024;
+// A request of an upload session may carry at most 150 MiB.
+const cloudstorage::IChunkSizer::Limits UPLOAD_CHUNK = {
+    4 * 1024 * 1024, 128 * 1024 * 1024, 1, 60 * 1024 * 1024};
+const uint32_t MAX_UPLOAD_BATCH_SIZE = 1000;
+const auto UPLOAD_BATCH_DELAY = std::chrono::milliseconds(200);
 
 namespace cloudstorage {
 
 namespace {
+// Whether an upload session from the journal can't be continued: it has
+// expired or the server committed a different offset than was recorded.
+bool stale_session(const Error& e) {
+  if (e.code_ != IHttpRequest::Conflict) return false;
+  try {
+    auto summary =
+        util::json::from_string(e.description_)["error_summary"].asString();
+    return summary.find("not_found") != std::string::npos ||
+           summary.find("incorrect_offset") != std::string::npos;
+  } catch (const Json::Exception&) {
+    return false;
+  }
+}
+
 void upload(const Request<EitherError<IItem>>::Pointer& r,
             const std::string& session_id, const std::string& path,
-            uint64_t sent, IUploadFileCallback* callback) {
+            uint64_t sent, IUploadFileCallback* callback, bool batch,
+            const std::string& journal_key, bool resumed) {
+  auto journal = journal_key.empty() ? nullptr
+                                     : r->provider()->transfer_journal();
   auto size = callback->size();
-  auto length = std::make_shared<uint64_t>(0);
+  auto chunk_size = r->provider()->chunkSizer()->chunkSize(
+      "upload", IChunkSizer::Direction::Upload, UPLOAD_CHUNK);
+  auto length = sent < size ? std::min<uint64_t>(chunk_size, size - sent) : 0;
+  if (batch && !session_id.empty() && sent >= size) {
+    Json::Value entry;
+    entry["cursor"]["session_id"] = session_id;
+    entry["cursor"]["offset"] = Json::Int64(static_cast<int64_t>(sent));
+    entry["commit"]["path"] = path;
+    entry["commit"]["mode"] = "overwrite";
+    return static_cast<Dropbox*>(r->provider().get())
+        ->commitUpload(r, entry, journal_key);
+  }
   r->send(
-      [=](util::Output stream) {
-        std::vector<char> buffer(CHUNK_SIZE);
-        if (sent < size)
-          *length = callback->putData(buffer.data(), CHUNK_SIZE, sent);
+      [=](util::Output) {
         std::string upload_url =
             "https://content.dropboxapi.com/2/files/upload_session";
         Json::Value json;
         if (sent == 0)
           upload_url += "/start";
-        else if (sent + *length >= size) {
+        else if (!batch && sent + length >= size) {
           json["commit"]["path"] = path;
           json["commit"]["mode"] = "overwrite";
           upload_url += "/finish";
@@ -64,37 +95,66 @@ void upload(const Request<EitherError<IItem>>::Pointer& r,
           json["cursor"]["session_id"] = session_id;
           json["cursor"]["offset"] = Json::Int64(static_cast<int64_t>(sent));
         }
+        if (batch && sent + length >= size) json["close"] = true;
         request->setHeaderParameter("Content-Type", "application/octet-stream");
         request->setHeaderParameter("Dropbox-API-Arg",
                                     util::json::to_string(json));
-        stream->write(buffer.data(), *length);
         return request;
       },
       [=](EitherError<Response> e) {
+        if (e.left() && resumed && stale_session(*e.left())) {
+          journal->remove(journal_key);
+          return upload(r, "", path, 0, callback, batch, journal_key, false);
+        }
         if (e.left()) return r->done(e.left());
         try {
           auto json = util::json::from_stream(e.right()->output());
-          if (sent < size)
-            upload(
-                r,
-                session_id.empty() ? json["session_id"].asString() : session_id,
-                path, sent + *length, callback);
-          else
+          if (sent < size || (batch && session_id.empty())) {
+            auto id = session_id.empty() ? json["session_id"].asString()
+                                         : session_id;
+            auto next = [=] {
+              upload(r, id, path, sent + length, callback, batch, journal_key,
+                     false);
+            };
+            // Journal reads the committed chunk to checksum it; that is left
+            // to the thread pool, so that the http thread isn't held up.
+            auto pool = r->provider()->thread_pool();
+            if (!journal || !pool) return next();
+            pool->schedule([=] {
+              journal->put(journal_key, {id, sent + length, {}}, *callback);
+              next();
+            });
+          } else {
+            if (journal) journal->remove(journal_key);
             r->done(Dropbox::toItem(json));
+          }
         } catch (const Json::Exception&) {
           r->done(Error{IHttpRequest::Failure, e.right()->output().str()});
         }
       },
-      [] { return std::make_shared<std::stringstream>(); },
-      std::make_shared<std::stringstream>(), nullptr,
+      [=] {
+        return std::make_shared<util::UploadStream>(callback, sent, length);
+      },
+      std::make_shared<util::ChunkedStream>(), nullptr,
       [=](uint64_t, uint64_t now) { callback->progress(size, sent + now); },
       true);
 }
 }  // namespace
 
-Dropbox::Dropbox() : CloudProvider(util::make_unique<Auth>()) {}
+struct Dropbox::UploadCommit {
+  Request<EitherError<IItem>>::Pointer request_;
+  Json::Value entry_;
+  std::string journal_key_;
+};
+
+Dropbox::Dropbox()
+    : CloudProvider(util::make_unique<Auth>()), upload_batch_size_(1) {}
 
 void Dropbox::initialize(InitData&& data) {
+  setWithHint(data.hints_, "upload_batch_size", [this](std::string v) {
+    upload_batch_size_ = std::min<uint32_t>(
+        std::max<uint32_t>(std::stoul(v), 1), MAX_UPLOAD_BATCH_SIZE);
+  });
   CloudProvider::initialize(std::move(data));
   auto lock = auth_lock();
   setWithHint(data.hints_, "code_verifier",
@@ -107,6 +167,10 @@ std::string Dropbox::name() const { return "dropbox"; }
 
 std::string Dropbox::endpoint() const { return DROPBOXAPI_ENDPOINT; }
 
+ICloudProvider::OperationSet Dropbox::supportedOperations() const {
+  return CloudProvider::supportedOperations() & ~StreamUpload;
+}
+
 IItem::Pointer Dropbox::rootDirectory() const {
   return util::make_unique<Item>("/", "", IItem::UnknownSize,
                                  IItem::UnknownTimeStamp,
@@ -124,12 +188,99 @@ ICloudProvider::UploadFileRequest::Pointer Dropbox::uploadFileAsync(
   auto callback = cb.get();
   return std::make_shared<Request<EitherError<IItem>>>(
              shared_from_this(), [=](EitherError<IItem> e) { cb->done(e); },
-             [=](Request<EitherError<IItem>>::Pointer r) {
-               upload(r, "", parent->id() + "/" + filename, 0, callback);
+             [=, this](Request<EitherError<IItem>>::Pointer r) {
+               auto path = parent->id() + "/" + filename;
+               auto batch = upload_batch_size_ > 1;
+               auto key = transferKey(*parent, filename, *callback);
+               TransferJournal::Entry entry;
+               if (!key.empty() && transfer_journal()->find(key, entry, *callback))
+                 return upload(r, entry.session_, path, entry.offset_,
+                               callback, batch, key, true);
+               upload(r, "", path, 0, callback, batch, key, false);
              })
       ->run();
 }
 
+void Dropbox::commitUpload(const Request<EitherError<IItem>>::Pointer& r,
+                           const Json::Value& entry,
+                           const std::string& journal_key) {
+  std::unique_lock<std::mutex> lock(upload_batch_mutex_);
+  upload_batch_.push_back(
+      std::make_shared<UploadCommit>(UploadCommit{r, entry, journal_key}));
+  if (upload_batch_.size() >= upload_batch_size_) {
+    auto batch = std::move(upload_batch_);
+    upload_batch_.clear();
+    lock.unlock();
+    return finishUploadBatch(batch);
+  }
+  if (upload_batch_.size() > 1) return;
+  lock.unlock();
+  std::weak_ptr<CloudProvider> provider = shared_from_this();
+  thread_pool()->schedule(
+      [=, this] {
+        auto p = provider.lock();
+        if (!p) return;
+        std::unique_lock<std::mutex> lock(upload_batch_mutex_);
+        auto batch = std::move(upload_batch_);
+        upload_batch_.clear();
+        lock.unlock();
+        if (!batch.empty()) finishUploadBatch(batch);
+      },
+      std::chrono::system_clock::now() + UPLOAD_BATCH_DELAY);
+}
+
+void Dropbox::finishUploadBatch(
+    const std::vector<std::shared_ptr<UploadCommit>>& batch) {
+  auto done = [=, this](EitherError<Response> e) {
+    if (e.left()) {
+      for (const auto& c : batch) c->request_->done(e.left());
+      return;
+    }
+    try {
+      auto json = util::json::from_stream(e.right()->output());
+      const auto& entries = json["entries"];
+      if (!entries.isArray() || entries.size() != batch.size())
+        throw Json::LogicError("invalid finish_batch response");
+      for (Json::ArrayIndex i = 0; i < entries.size(); i++) {
+        if (entries[i][".tag"].asString() == "success") {
+          if (!batch[i]->journal_key_.empty())
+            transfer_journal()->remove(batch[i]->journal_key_);
+          batch[i]->request_->done(toItem(entries[i]));
+        } else
+          batch[i]->request_->done(
+              Error{IHttpRequest::Failure,
+                    util::json::to_string(entries[i]["failure"])});
+      }
+    } catch (const Json::Exception&) {
+      for (const auto& c : batch)
+        c->request_->done(
+            Error{IHttpRequest::Failure, e.right()->output().str()});
+    }
+  };
+  // The commit is a request of its own; cancelling one of the uploads of the
+  // batch must not abort the commit of the others.
+  auto commit = std::make_shared<Request<EitherError<void>>>(
+      shared_from_this(), [](EitherError<void>) {}, nullptr);
+  commit->request(
+      [=, this](util::Output stream) {
+        Json::Value json;
+        for (const auto& c : batch) json["entries"].append(c->entry_);
+        auto request = http()->create(
+            "https://api.dropboxapi.com/2/files/upload_session/finish_batch_v2",
+            "POST");
+        request->setHeaderParameter("Content-Type", "application/json");
+        *stream << util::json::to_string(json);
+        return request;
+      },
+      [=](EitherError<Response> e) {
+        done(e);
+        if (e.left())
+          commit->done(e.left());
+        else
+          commit->done(nullptr);
+      });
+}
+
 ICloudProvider::GeneralDataRequest::Pointer Dropbox::getGeneralDataAsync(
     GeneralDataCallback callback) {
   auto resolver = [=, this](Request<EitherError<GeneralData>>::Pointer r) {
@@ -289,6 +440,18 @@ IHttpRequest::Pointer Dropbox::moveItemRequest(const IItem& source,
   return request;
 }
 
+IHttpRequest::Pointer Dropbox::copyItemRequest(const IItem& source,
+                                               const IItem& destination,
+                                               std::ostream& stream) const {
+  auto request = http()->create(endpoint() + "/2/files/copy_v2", "POST");
+  request->setHeaderParameter("Content-Type", "application/json");
+  Json::Value json;
+  json["from_path"] = source.id();
+  json["to_path"] = destination.id() + "/" + source.filename();
+  stream << json;
+  return request;
+}
+
 IHttpRequest::Pointer Dropbox::renameItemRequest(const IItem& item,
                                                  const std::string& name,
                                                  std::ostream& stream) const {
@@ -337,10 +500,13 @@ IItem::Pointer Dropbox::moveItemResponse(const IItem& source, const IItem&,
 IItem::Pointer Dropbox::toItem(const Json::Value& v) {
   IItem::FileType type = IItem::FileType::Unknown;
   if (v[".tag"].asString() == "folder") type = IItem::FileType::Directory;
-  return util::make_unique<Item>(
+  auto item = util::make_unique<Item>(
       v["name"].asString(), v["path_display"].asString(),
       v.isMember("size") ? v["size"].asUInt64() : IItem::UnknownSize,
       util::parse_time(v["client_modified"].asString()), type);
+  item->set_content_hash(IItem::HashType::Dropbox,
+                         v["content_hash"].asString());
+  return item;
 }
 
 void Dropbox::Auth::initialize(IHttp* http, IHttpServerFactory* factory) {
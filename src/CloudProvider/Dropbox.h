@@ -38,6 +38,7 @@ class Dropbox : public CloudProvider {
   void initialize(InitData&& data) override;
   std::string name() const override;
   std::string endpoint() const override;
+  OperationSet supportedOperations() const override;
   IItem::Pointer rootDirectory() const override;
   bool reauthorize(int code,
                    const IHttpRequest::HeaderParameters&) const override;
@@ -64,6 +65,8 @@ class Dropbox : public CloudProvider {
                                                std::ostream&) const override;
   IHttpRequest::Pointer moveItemRequest(const IItem&, const IItem&,
                                         std::ostream&) const override;
+  IHttpRequest::Pointer copyItemRequest(const IItem&, const IItem&,
+                                        std::ostream&) const override;
   IHttpRequest::Pointer renameItemRequest(const IItem& item,
                                           const std::string& name,
                                           std::ostream&) const override;
@@ -86,6 +89,14 @@ class Dropbox : public CloudProvider {
 
   static IItem::Pointer toItem(const Json::Value&);
 
+  /**
+   * Queues commit of a closed upload session; queued commits are sent
+   * together with upload_session/finish_batch_v2 once upload_batch_size of
+   * them are collected or shortly after the first one was queued.
+   */
+  void commitUpload(const Request<EitherError<IItem>>::Pointer&,
+                    const Json::Value& entry, const std::string& journal_key);
+
  private:
   class Auth : public cloudstorage::Auth {
    public:
@@ -109,6 +120,14 @@ class Dropbox : public CloudProvider {
    private:
     std::string code_verifier_;
   };
+
+  struct UploadCommit;
+
+  void finishUploadBatch(const std::vector<std::shared_ptr<UploadCommit>>&);
+
+  uint32_t upload_batch_size_;
+  std::mutex upload_batch_mutex_;
+  std::vector<std::shared_ptr<UploadCommit>> upload_batch_;
 };
 
 }  // namespace cloudstorage
@@ -26,17 +26,28 @@
 #include <json/json.h>
 #include <algorithm>
 #include <cstring>
+#include <limits>
 #include <sstream>
 
 #include "Request/DownloadFileRequest.h"
 #include "Request/UploadFileRequest.h"
 #include "Utility/Item.h"
+#include "Utility/UploadStream.h"
 #include "Utility/Utility.h"
 
 const std::string GOOGLEAPI_ENDPOINT = "https://www.googleapis.com";
 const std::string SHARED_ID = "shared";
 const std::string SHARED_FILENAME = "Shared with me";
 const auto THUMBNAIL_SIZE = 256;
+const uint64_t UPLOAD_CHUNK_GRANULARITY = 256 * 1024;
+const cloudstorage::IChunkSizer::Limits UPLOAD_CHUNK = {
+    UPLOAD_CHUNK_GRANULARITY, 128 * 1024 * 1024, UPLOAD_CHUNK_GRANULARITY,
+    8 * 1024 * 1024};
+const uint32_t MAX_RESUME_COUNT = 5;
+const int RESUME_INCOMPLETE = 308;
+const std::string ITEM_FIELDS =
+    "id,name,thumbnailLink,trashed,"
+    "mimeType,iconLink,parents,size,modifiedTime,md5Checksum";
 
 using namespace std::placeholders;
 
@@ -44,6 +55,23 @@ namespace cloudstorage {
 
 namespace {
 
+bool committed_offset(const IHttpRequest::HeaderParameters& headers,
+                      uint64_t& offset) {
+  auto it = headers.find("range");
+  if (it == headers.end()) {
+    offset = 0;
+    return true;
+  }
+  auto dash = it->second.find('-');
+  if (dash == std::string::npos) return false;
+  try {
+    offset = std::stoull(it->second.substr(dash + 1)) + 1;
+    return true;
+  } catch (const std::exception&) {
+    return false;
+  }
+}
+
 std::string exported_mime_type(const std::string& type) {
   if (type == "application/vnd.google-apps.document")
     return "application/"
@@ -98,12 +126,52 @@ std::string icon_link(const std::string& link) {
 
 }  // namespace
 
-GoogleDrive::GoogleDrive() : CloudProvider(util::make_unique<Auth>()) {}
+struct GoogleDrive::ResumableUpload {
+  Request<EitherError<IItem>>::Pointer request_;
+  IUploadFileCallback::Pointer callback_;
+  IItem::Pointer directory_;
+  std::string filename_;
+  std::string url_;
+  uint64_t size_;
+  uint64_t chunk_size_;
+  uint64_t offset_;
+  uint32_t resume_count_;
+  std::string journal_key_;
+};
+
+GoogleDrive::GoogleDrive()
+    : CloudProvider(util::make_unique<Auth>()),
+      upload_chunk_size_() {}
+
+void GoogleDrive::initialize(InitData&& data) {
+  {
+    auto lock = auth_lock();
+    setWithHint(data.hints_, "upload_part_size", [this](std::string v) {
+      upload_chunk_size_ = std::stoull(v);
+    });
+  }
+  CloudProvider::initialize(std::move(data));
+}
 
 std::string GoogleDrive::name() const { return "google"; }
 
 std::string GoogleDrive::endpoint() const { return GOOGLEAPI_ENDPOINT; }
 
+ICloudProvider::OperationSet GoogleDrive::supportedOperations() const {
+  return CloudProvider::supportedOperations() & ~StreamUpload;
+}
+
+uint32_t GoogleDrive::defaultDownloadStreamCount() const { return 4; }
+
+bool GoogleDrive::isSuccess(
+    int code, const IHttpRequest::HeaderParameters& headers) const {
+  // Upload session reports data it has received so far with 308, which
+  // unlike a redirect carries no location.
+  return (code == RESUME_INCOMPLETE &&
+          headers.find("location") == headers.end()) ||
+         CloudProvider::isSuccess(code, headers);
+}
+
 IHttpRequest::Pointer GoogleDrive::getItemUrlRequest(
     const IItem& item, std::ostream& stream) const {
   return getItemDataRequest(item.id(), stream);
@@ -126,9 +194,7 @@ std::string GoogleDrive::getItemUrlResponse(
 IHttpRequest::Pointer GoogleDrive::getItemDataRequest(const std::string& id,
                                                       std::ostream&) const {
   auto request = http()->create(endpoint() + "/drive/v3/files/" + id, "GET");
-  request->setParameter("fields",
-                        "id,name,thumbnailLink,trashed,"
-                        "mimeType,iconLink,parents,size,modifiedTime");
+  request->setParameter("fields", ITEM_FIELDS);
   return request;
 }
 
@@ -141,9 +207,7 @@ IHttpRequest::Pointer GoogleDrive::listDirectoryRequest(
   else
     request->setParameter("q", std::string("'") + item.id() + "'+in+parents");
   request->setParameter("fields",
-                        "files(id,name,thumbnailLink,trashed,"
-                        "mimeType,iconLink,parents,size,modifiedTime),kind,"
-                        "nextPageToken");
+                        "files(" + ITEM_FIELDS + "),kind,nextPageToken");
   if (!page_token.empty()) request->setParameter("pageToken", page_token);
   return request;
 }
@@ -207,6 +271,9 @@ ICloudProvider::UploadFileRequest::Pointer GoogleDrive::uploadFileAsync(
       auto stream_wrapper = std::make_shared<UploadStreamWrapper>(
           std::bind(&IUploadFileCallback::putData, cb.get(), _1, _2, _3),
           cb->size());
+      if (cb->size() > uploadChunkSize())
+        return resumableUpload(r, directory, cnt == 1 ? item : nullptr,
+                               filename, cb);
       if (cnt != 1)
         return cloudstorage::UploadFileRequest::resolve(
             r, stream_wrapper, directory, filename, cb);
@@ -229,7 +296,7 @@ ICloudProvider::UploadFileRequest::Pointer GoogleDrive::uploadFileAsync(
             }
           },
           [=] { return std::make_shared<std::iostream>(stream_wrapper.get()); },
-          std::make_shared<std::stringstream>(), nullptr,
+          std::make_shared<util::ChunkedStream>(), nullptr,
           std::bind(&IUploadFileCallback::progress, cb, _1, _2), true);
     };
     r->make_subrequest(&GoogleDrive::listDirectorySimpleAsync, directory,
@@ -250,9 +317,7 @@ IHttpRequest::Pointer GoogleDrive::createDirectoryRequest(
     const IItem& item, const std::string& name, std::ostream& input) const {
   auto request = http()->create(endpoint() + "/drive/v3/files", "POST");
   request->setHeaderParameter("Content-Type", "application/json");
-  request->setParameter("fields",
-                        "id,name,thumbnailLink,trashed,"
-                        "mimeType,iconLink,parents,size,modifiedTime");
+  request->setParameter("fields", ITEM_FIELDS);
   Json::Value json;
   json["mimeType"] = "application/vnd.google-apps.folder";
   json["name"] = name;
@@ -268,9 +333,7 @@ IHttpRequest::Pointer GoogleDrive::moveItemRequest(const IItem& s,
   auto request =
       http()->create(endpoint() + "/drive/v3/files/" + source.id(), "PATCH");
   request->setHeaderParameter("Content-Type", "application/json");
-  request->setParameter("fields",
-                        "id,name,thumbnailLink,trashed,"
-                        "mimeType,iconLink,parents,size,modifiedTime");
+  request->setParameter("fields", ITEM_FIELDS);
   std::string current_parents;
   for (const auto& str : source.parents()) current_parents += str + ",";
   current_parents.pop_back();
@@ -280,14 +343,27 @@ IHttpRequest::Pointer GoogleDrive::moveItemRequest(const IItem& s,
   return request;
 }
 
+IHttpRequest::Pointer GoogleDrive::copyItemRequest(const IItem& source,
+                                                   const IItem& destination,
+                                                   std::ostream& input) const {
+  if (source.type() == IItem::FileType::Directory) return nullptr;
+  auto request = http()->create(
+      endpoint() + "/drive/v3/files/" + source.id() + "/copy", "POST");
+  request->setHeaderParameter("Content-Type", "application/json");
+  request->setParameter("fields", ITEM_FIELDS);
+  Json::Value json;
+  json["name"] = source.filename();
+  json["parents"].append(destination.id());
+  input << json;
+  return request;
+}
+
 IHttpRequest::Pointer GoogleDrive::renameItemRequest(
     const IItem& item, const std::string& name, std::ostream& input) const {
   auto request =
       http()->create(endpoint() + "/drive/v3/files/" + item.id(), "PATCH");
   request->setHeaderParameter("Content-Type", "application/json");
-  request->setParameter("fields",
-                        "id,name,thumbnailLink,trashed,"
-                        "mimeType,iconLink,parents,size,modifiedTime");
+  request->setParameter("fields", ITEM_FIELDS);
   Json::Value json;
   json["name"] = name;
   input << json;
@@ -320,6 +396,22 @@ IItem::List GoogleDrive::listDirectoryResponse(
   return result;
 }
 
+ListDirectoryParser::Pointer GoogleDrive::listDirectoryParser(
+    const IItem& item, const ListDirectoryParser::ItemCallback& callback) const {
+  bool root = item.id() == rootDirectory()->id();
+  return util::make_unique<JsonListParser>(
+      "files", [=, this](const Json::Value& v) { callback(toItem(v)); },
+      [=](const Json::Value& response) -> std::string {
+        if (response.isMember("nextPageToken"))
+          return response["nextPageToken"].asString();
+        if (root)
+          callback(util::make_unique<Item>(
+              SHARED_FILENAME, SHARED_ID, IItem::UnknownSize,
+              IItem::UnknownTimeStamp, IItem::FileType::Directory));
+        return "";
+      });
+}
+
 GeneralData GoogleDrive::getGeneralDataResponse(std::istream& response) const {
   auto json = util::json::from_stream(response);
   GeneralData data;
@@ -342,31 +434,198 @@ IHttpRequest::Pointer GoogleDrive::upload(const IItem& f,
                                           std::ostream& prefix_stream,
                                           std::ostream& suffix_stream) const {
   const std::string separator = "fWoDm9QNn3v3Bq3bScUX";
-  const Item& item = static_cast<const Item&>(f);
   IHttpRequest::Pointer request = http()->create(url, method);
   request->setHeaderParameter("Content-Type",
                               "multipart/related; boundary=" + separator);
   request->setParameter("uploadType", "multipart");
-  request->setParameter("fields",
-                        "id,name,thumbnailLink,trashed,"
-                        "mimeType,iconLink,parents,size,modifiedTime");
+  request->setParameter("fields", ITEM_FIELDS);
+  auto request_data = uploadMetadata(f, filename, method == "POST");
+  prefix_stream << "--" << separator << "\r\n"
+                << "Content-Type: application/json; charset=UTF-8\r\n\r\n"
+                << util::json::to_string(request_data) << "\r\n"
+                << "--" << separator << "\r\n"
+                << "Content-Type: \r\n\r\n";
+  suffix_stream << "\r\n--" << separator << "--\r\n";
+  return request;
+}
+
+Json::Value GoogleDrive::uploadMetadata(const IItem& directory,
+                                        const std::string& filename,
+                                        bool create) const {
   Json::Value request_data;
   auto it = filename.find_last_of('.');
   if (it != std::string::npos) {
     auto mime = google_extension_to_mime_type(filename.substr(it));
     if (!mime.empty()) request_data["mimeType"] = mime;
   }
-  if (method == "POST") {
+  if (create) {
     request_data["name"] = filename;
-    request_data["parents"].append(item.id());
+    request_data["parents"].append(directory.id());
   }
-  prefix_stream << "--" << separator << "\r\n"
-                << "Content-Type: application/json; charset=UTF-8\r\n\r\n"
-                << util::json::to_string(request_data) << "\r\n"
-                << "--" << separator << "\r\n"
-                << "Content-Type: \r\n\r\n";
-  suffix_stream << "\r\n--" << separator << "--\r\n";
-  return request;
+  return request_data;
+}
+
+uint64_t GoogleDrive::uploadChunkSize() const {
+  uint64_t chunk_size;
+  {
+    auto lock = auth_lock();
+    chunk_size = upload_chunk_size_;
+  }
+  if (chunk_size == 0)
+    return chunkSizer()->chunkSize("upload", IChunkSizer::Direction::Upload,
+                                   UPLOAD_CHUNK);
+  return std::max<uint64_t>(
+      chunk_size / UPLOAD_CHUNK_GRANULARITY * UPLOAD_CHUNK_GRANULARITY,
+      UPLOAD_CHUNK_GRANULARITY);
+}
+
+void GoogleDrive::resumableUpload(
+    const Request<EitherError<IItem>>::Pointer& r,
+    const IItem::Pointer& directory, const IItem::Pointer& item,
+    const std::string& filename, const IUploadFileCallback::Pointer& callback) {
+  auto upload = std::make_shared<ResumableUpload>(ResumableUpload{
+      r, callback, directory, filename, "", callback->size(),
+      uploadChunkSize(), 0, 0, transferKey(*directory, filename, *callback)});
+  TransferJournal::Entry entry;
+  if (upload->journal_key_.empty() ||
+      !transfer_journal()->find(upload->journal_key_, entry, *callback))
+    return createUploadSession(upload, item);
+  upload->url_ = entry.session_;
+  upload->offset_ = entry.offset_;
+  requestUploadStatus(upload, [=, this](const std::shared_ptr<Error>&) {
+    transfer_journal()->remove(upload->journal_key_);
+    upload->url_.clear();
+    upload->offset_ = 0;
+    createUploadSession(upload, item);
+  });
+}
+
+void GoogleDrive::createUploadSession(
+    const std::shared_ptr<ResumableUpload>& upload,
+    const IItem::Pointer& item) {
+  const auto& r = upload->request_;
+  r->request(
+      [=, this](util::Output stream) {
+        auto request = http()->create(
+            endpoint() + "/upload/drive/v3/files" +
+                (item ? "/" + item->id() : ""),
+            item ? "PATCH" : "POST");
+        request->setParameter("uploadType", "resumable");
+        request->setParameter("fields", ITEM_FIELDS);
+        request->setHeaderParameter("Content-Type",
+                                    "application/json; charset=UTF-8");
+        request->setHeaderParameter("X-Upload-Content-Length",
+                                    std::to_string(upload->size_));
+        auto metadata =
+            uploadMetadata(*upload->directory_, upload->filename_, !item);
+        if (metadata.isNull()) metadata = Json::Value(Json::objectValue);
+        *stream << util::json::to_string(metadata);
+        return request;
+      },
+      [=, this](EitherError<Response> e) {
+        if (e.left()) return r->done(e.left());
+        auto it = e.right()->headers().find("location");
+        if (it == e.right()->headers().end())
+          return r->done(Error{IHttpRequest::Failure,
+                               util::Error::MISSING_UPLOAD_SESSION});
+        upload->url_ = it->second;
+        if (!upload->journal_key_.empty())
+          transfer_journal()->put(upload->journal_key_, {upload->url_, 0, {}},
+                                  *upload->callback_);
+        uploadChunk(upload);
+      });
+}
+
+void GoogleDrive::uploadChunk(const std::shared_ptr<ResumableUpload>& upload) {
+  auto offset = upload->offset_;
+  auto length = std::min(upload->chunk_size_, upload->size_ - offset);
+  upload->request_->send(
+      [=, this](util::Output) {
+        auto request = http()->create(upload->url_, "PUT", false);
+        request->setHeaderParameter(
+            "Content-Range", "bytes " + std::to_string(offset) + "-" +
+                                 std::to_string(offset + length - 1) + "/" +
+                                 std::to_string(upload->size_));
+        return request;
+      },
+      [=, this](EitherError<Response> e) {
+        if (e.left()) return queryUploadStatus(upload, e.left());
+        uploadStatusReceived(upload, *e.right());
+      },
+      [=] {
+        return std::make_shared<util::UploadStream>(upload->callback_.get(),
+                                                    offset, length);
+      },
+      std::make_shared<util::ChunkedStream>(), nullptr,
+      [=](uint64_t, uint64_t now) {
+        upload->callback_->progress(upload->size_, offset + now);
+      },
+      true,
+      // A failed chunk isn't resent as is; the session is asked what it has
+      // received instead, so that no data is sent twice.
+      std::numeric_limits<uint32_t>::max());
+}
+
+void GoogleDrive::queryUploadStatus(
+    const std::shared_ptr<ResumableUpload>& upload,
+    const std::shared_ptr<Error>& error) {
+  if (error->code_ == IHttpRequest::NotFound && !upload->journal_key_.empty())
+    transfer_journal()->remove(upload->journal_key_);
+  if (error->code_ == IHttpRequest::Aborted ||
+      error->code_ == IHttpRequest::NotFound ||
+      ++upload->resume_count_ > MAX_RESUME_COUNT)
+    return upload->request_->done(error);
+  requestUploadStatus(upload, [=](const std::shared_ptr<Error>&) {
+    upload->request_->done(error);
+  });
+}
+
+void GoogleDrive::requestUploadStatus(
+    const std::shared_ptr<ResumableUpload>& upload,
+    const std::function<void(const std::shared_ptr<Error>&)>& failed) {
+  upload->request_->send(
+      [=, this](util::Output) {
+        auto request = http()->create(upload->url_, "PUT", false);
+        request->setHeaderParameter("Content-Range",
+                                    "bytes */" + std::to_string(upload->size_));
+        return request;
+      },
+      [=, this](EitherError<Response> e) {
+        if (e.left()) return failed(e.left());
+        uploadStatusReceived(upload, *e.right());
+      },
+      [] { return std::make_shared<util::ChunkedStream>(); },
+      std::make_shared<util::ChunkedStream>(), nullptr, nullptr, true);
+}
+
+void GoogleDrive::uploadStatusReceived(
+    const std::shared_ptr<ResumableUpload>& upload, Response& response) {
+  const auto& r = upload->request_;
+  if (response.http_code() != RESUME_INCOMPLETE) {
+    if (!upload->journal_key_.empty())
+      transfer_journal()->remove(upload->journal_key_);
+    try {
+      return r->done(uploadFileResponse(*upload->directory_, upload->filename_,
+                                        upload->size_, response.output()));
+    } catch (const std::exception&) {
+      return r->done(Error{IHttpRequest::Failure, response.output().str()});
+    }
+  }
+  uint64_t offset;
+  if (!committed_offset(response.headers(), offset) || offset >= upload->size_)
+    return r->done(
+        Error{IHttpRequest::Failure, util::Error::INVALID_UPLOAD_RANGE});
+  if (offset > upload->offset_) upload->resume_count_ = 0;
+  upload->offset_ = offset;
+  auto pool = thread_pool();
+  if (upload->journal_key_.empty() || !pool) return uploadChunk(upload);
+  // Journal reads the committed range to checksum it; that is left to the
+  // thread pool, as this runs on the http thread.
+  pool->schedule([=, this] {
+    transfer_journal()->put(upload->journal_key_, {upload->url_, offset, {}},
+                            *upload->callback_);
+    uploadChunk(upload);
+  });
 }
 
 bool GoogleDrive::isGoogleMimeType(const std::string& mime_type) const {
@@ -407,6 +666,7 @@ IItem::Pointer GoogleDrive::toItem(const Json::Value& v) const {
                               ? v["thumbnailLink"].asString()
                               : icon_link(v["iconLink"].asString()));
   item->set_mime_type(v["mimeType"].asString());
+  item->set_content_hash(IItem::HashType::MD5, v["md5Checksum"].asString());
   std::vector<std::string> parents;
   for (const auto& id : v["parents"]) parents.push_back(id.asString());
   item->set_parents(parents);
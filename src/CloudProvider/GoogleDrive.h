@@ -34,8 +34,13 @@ namespace cloudstorage {
 class GoogleDrive : public CloudProvider {
  public:
   GoogleDrive();
+  void initialize(InitData&&) override;
   std::string name() const override;
   std::string endpoint() const override;
+  OperationSet supportedOperations() const override;
+  uint32_t defaultDownloadStreamCount() const override;
+  bool isSuccess(int code,
+                 const IHttpRequest::HeaderParameters&) const override;
 
   ICloudProvider::DownloadFileRequest::Pointer downloadFileAsync(
       IItem::Pointer file, IDownloadFileCallback::Pointer callback,
@@ -63,6 +68,8 @@ class GoogleDrive : public CloudProvider {
                                                std::ostream&) const override;
   IHttpRequest::Pointer moveItemRequest(const IItem&, const IItem&,
                                         std::ostream&) const override;
+  IHttpRequest::Pointer copyItemRequest(const IItem&, const IItem&,
+                                        std::ostream&) const override;
   IHttpRequest::Pointer renameItemRequest(const IItem&, const std::string& name,
                                           std::ostream&) const override;
   IHttpRequest::Pointer getGeneralDataRequest(std::ostream&) const override;
@@ -73,6 +80,9 @@ class GoogleDrive : public CloudProvider {
                                  std::istream& response) const override;
   IItem::List listDirectoryResponse(
       const IItem&, std::istream&, std::string& next_page_token) const override;
+  ListDirectoryParser::Pointer listDirectoryParser(
+      const IItem&,
+      const ListDirectoryParser::ItemCallback&) const override;
   GeneralData getGeneralDataResponse(std::istream& response) const override;
 
   IHttpRequest::Pointer upload(const IItem& f, const std::string& url,
@@ -81,6 +91,9 @@ class GoogleDrive : public CloudProvider {
                                std::ostream& prefix_stream,
                                std::ostream& suffix_stream) const;
 
+  Json::Value uploadMetadata(const IItem& directory,
+                             const std::string& filename, bool create) const;
+
   bool isGoogleMimeType(const std::string& mime_type) const;
   IItem::FileType toFileType(const std::string& mime_type) const;
   IItem::Pointer toItem(const Json::Value&) const;
@@ -101,6 +114,28 @@ class GoogleDrive : public CloudProvider {
 
     bool requiresCodeExchange() const override;
   };
+
+ private:
+  struct ResumableUpload;
+
+  uint64_t uploadChunkSize() const;
+  void resumableUpload(const Request<EitherError<IItem>>::Pointer&,
+                       const IItem::Pointer& directory,
+                       const IItem::Pointer& item, const std::string& filename,
+                       const IUploadFileCallback::Pointer&);
+  void createUploadSession(const std::shared_ptr<ResumableUpload>&,
+                           const IItem::Pointer& item);
+  void uploadChunk(const std::shared_ptr<ResumableUpload>&);
+  void queryUploadStatus(const std::shared_ptr<ResumableUpload>&,
+                         const std::shared_ptr<Error>&);
+  void requestUploadStatus(
+      const std::shared_ptr<ResumableUpload>&,
+      const std::function<void(const std::shared_ptr<Error>&)>& failed);
+  void uploadStatusReceived(const std::shared_ptr<ResumableUpload>&,
+                            Response&);
+
+  // Set with the upload_part_size hint; zero lets chunkSizer choose.
+  uint64_t upload_chunk_size_;
 };
 
 }  // namespace cloudstorage
@@ -337,7 +337,7 @@ ICloudProvider::UploadFileRequest::Pointer GooglePhotos::uploadFileAsync(
           create_batch(r, id);
         },
         [=] { return std::make_shared<std::iostream>(wrapper.get()); },
-        std::make_shared<std::stringstream>(), nullptr,
+        std::make_shared<util::ChunkedStream>(), nullptr,
         std::bind(&IUploadFileCallback::progress, cb.get(), _1, _2), true);
   };
   auto resolve = [=, this](Request<EitherError<IItem>>::Pointer r) {
@@ -41,8 +41,13 @@ using error_code = boost::system::error_code;
 
 namespace cloudstorage {
 
-const size_t BUFFER_SIZE = 1024;
+// Disk throughput isn't measured, so buffers stay at the default unless the
+// memory budget runs out.
+const IChunkSizer::Limits BUFFER = {4 * 1024, 4 * 1024 * 1024, 4 * 1024,
+                                    256 * 1024};
 const auto POLL_INTERVAL = std::chrono::seconds(1);
+// Transfer pipes pause requests for short whiles, so polling starts faster.
+const auto MIN_POLL_INTERVAL = std::chrono::milliseconds(10);
 
 namespace {
 
@@ -64,6 +69,25 @@ fs::path from_string(const std::string &string) {
   return fs::path(string, std::codecvt_utf8<wchar_t>());
 }
 
+template <class Request>
+void wait_while_paused(const Request &r) {
+  std::chrono::milliseconds interval = MIN_POLL_INTERVAL;
+  while (r.is_paused()) {
+    std::this_thread::sleep_for(interval);
+    interval = std::min<std::chrono::milliseconds>(interval * 2, POLL_INTERVAL);
+  }
+}
+
+void copy_recursive(const fs::path &source, const fs::path &destination,
+                    error_code &error) {
+  if (!fs::is_directory(source))
+    return static_cast<void>(fs::copy_file(source, destination, error));
+  fs::create_directory(destination, error);
+  for (fs::directory_iterator it(source, error), end;
+       !error && it != end; it.increment(error))
+    copy_recursive(it->path(), destination / it->path().filename(), error);
+}
+
 void list_directory(
     const LocalDrive &p, IItem::Pointer item,
     std::function<void(EitherError<IItem::List>)> done,
@@ -155,7 +179,9 @@ LocalDrive::DownloadFileRequest::Pointer LocalDrive::downloadFileAsync(
       [=](EitherError<void> e) { callback->done(e); },
       [=, this](Request<EitherError<void>>::Pointer r) {
         fs::ifstream stream(from_string(path(item)), std::ios::binary);
-        std::vector<char> buffer(BUFFER_SIZE);
+        auto reservation = chunkSizer()->reserve(
+            "download", IChunkSizer::Direction::Download, BUFFER);
+        std::vector<char> buffer(reservation->size());
         stream.seekg(0, std::ios::end);
         auto range =
             Range{drange.start_,
@@ -167,12 +193,10 @@ LocalDrive::DownloadFileRequest::Pointer LocalDrive::downloadFileAsync(
         while (bytes_read < range.size_) {
           if (r->is_cancelled())
             return r->done(Error{IHttpRequest::Aborted, util::Error::ABORTED});
-          while (r->is_paused()) {
-            std::this_thread::sleep_for(POLL_INTERVAL);
-          }
+          wait_while_paused(*r);
           if (!stream.read(
                   buffer.data(),
-                  std::min<size_t>(BUFFER_SIZE, range.size_ - bytes_read)))
+                  std::min<size_t>(buffer.size(), range.size_ - bytes_read)))
             return r->done(
                 Error{IHttpRequest::Failure, util::Error::COULD_NOT_READ_FILE});
           callback->receivedData(buffer.data(),
@@ -192,15 +216,17 @@ LocalDrive::UploadFileRequest::Pointer LocalDrive::uploadFileAsync(
       [=, this](Request<EitherError<IItem>>::Pointer r) {
         auto path = from_string(this->path(parent)) / name;
         size_t bytes_read = 0, size = callback->size();
-        std::vector<char> buffer(BUFFER_SIZE);
+        auto reservation = chunkSizer()->reserve(
+            "upload", IChunkSizer::Direction::Upload, BUFFER);
+        std::vector<char> buffer(reservation->size());
         fs::ofstream stream(path, std::ios::binary);
         while (bytes_read < size) {
           if (r->is_cancelled())
             return r->done(Error{IHttpRequest::Aborted, util::Error::ABORTED});
-          while (r->is_paused()) {
-            std::this_thread::sleep_for(POLL_INTERVAL);
-          }
-          auto cnt = callback->putData(buffer.data(), BUFFER_SIZE, bytes_read);
+          wait_while_paused(*r);
+          auto cnt = callback->putData(buffer.data(),
+                                       static_cast<uint32_t>(buffer.size()),
+                                       bytes_read);
           bytes_read += cnt;
           if (!stream.write(buffer.data(), cnt))
             return r->done(Error{IHttpRequest::Failure, "couldn't write file"});
@@ -263,6 +289,25 @@ LocalDrive::MoveItemRequest::Pointer LocalDrive::moveItemAsync(
       });
 }
 
+LocalDrive::CopyItemRequest::Pointer LocalDrive::copyItemAsync(
+    IItem::Pointer source, IItem::Pointer destination,
+    CopyItemCallback callback) {
+  return request<EitherError<IItem>>(
+      [=](EitherError<IItem> e) { callback(e); },
+      [=, this](Request<EitherError<IItem>>::Pointer r) {
+        fs::path path(this->path(source));
+        fs::path new_path(fs::path(this->path(destination)) / path.filename());
+        error_code error;
+        copy_recursive(path, new_path, error);
+        if (error)
+          r->done(Error{error.value(), error.message()});
+        else
+          r->done(std::static_pointer_cast<IItem>(std::make_shared<Item>(
+              source->filename(), to_string(new_path), source->size(),
+              source->timestamp(), source->type())));
+      });
+}
+
 LocalDrive::RenameItemRequest::Pointer LocalDrive::renameItemAsync(
     IItem::Pointer item, const std::string &name, RenameItemCallback callback) {
   return request<EitherError<IItem>>(
@@ -61,6 +61,9 @@ class LocalDrive : public CloudProvider {
   MoveItemRequest::Pointer moveItemAsync(IItem::Pointer source,
                                          IItem::Pointer destination,
                                          MoveItemCallback) override;
+  CopyItemRequest::Pointer copyItemAsync(IItem::Pointer source,
+                                         IItem::Pointer destination,
+                                         CopyItemCallback) override;
   RenameItemRequest::Pointer renameItemAsync(IItem::Pointer item,
                                              const std::string&,
                                              RenameItemCallback) override;
@@ -159,6 +159,10 @@ std::string LocalDriveWinRT::name() const { return "localwinrt"; }
 
 std::string LocalDriveWinRT::endpoint() const { return ""; }
 
+ICloudProvider::OperationSet LocalDriveWinRT::supportedOperations() const {
+  return CloudProvider::supportedOperations() & ~StreamUpload;
+}
+
 IItem::Pointer LocalDriveWinRT::rootDirectory() const {
   return util::make_unique<Item>("root", "/", IItem::UnknownSize,
                                  IItem::UnknownTimeStamp,
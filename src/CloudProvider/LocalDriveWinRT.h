@@ -38,6 +38,7 @@ class LocalDriveWinRT : public CloudProvider {
 
   std::string name() const override;
   std::string endpoint() const override;
+  OperationSet supportedOperations() const override;
   AuthorizeRequest::Pointer authorizeAsync() override;
   bool unpackCredentials(const std::string&) override;
   IItem::Pointer rootDirectory() const override;
@@ -900,6 +900,10 @@ std::string MegaNz::name() const { return "mega"; }
 
 std::string MegaNz::endpoint() const { return file_url(); }
 
+ICloudProvider::OperationSet MegaNz::supportedOperations() const {
+  return CloudProvider::supportedOperations() & ~StreamUpload;
+}
+
 void MegaNz::destroy() {
   cancelStreamRequests();
   mega_ = nullptr;
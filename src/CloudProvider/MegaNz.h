@@ -63,6 +63,7 @@ class MegaNz : public CloudProvider {
 
   std::string name() const override;
   std::string endpoint() const override;
+  OperationSet supportedOperations() const override;
   void destroy() override;
 
   const std::atomic_bool& authorized() const { return authorized_; }
@@ -24,6 +24,7 @@
 #include "OneDrive.h"
 
 #include <json/json.h>
+#include <mutex>
 #include <sstream>
 
 #include <iostream>
@@ -31,46 +32,252 @@
 #include "Utility/Item.h"
 #include "Utility/Utility.h"
 
-const uint32_t CHUNK_SIZE = 60 * 1024 * 1024;
+// Chunks have to be multiples of 320 KiB, at most 60 MiB.
+const cloudstorage::IChunkSizer::Limits UPLOAD_CHUNK = {
+    320 * 1024, 192 * 320 * 1024, 320 * 1024, 32 * 320 * 1024};
+const uint32_t MAX_RESUME_COUNT = 3;
+const auto COPY_POLL_INTERVAL = std::chrono::seconds(1);
 using namespace std::placeholders;
 
 namespace cloudstorage {
 
 namespace {
-void upload(const Request<EitherError<IItem>>::Pointer& r,
-            const std::string& upload_url, uint64_t sent,
-            IUploadFileCallback* callback, const Json::Value& response) {
-  auto size = callback->size();
-  auto length = std::make_shared<uint64_t>(0);
-  if (sent >= size)
-    return r->done(
-        static_cast<OneDrive*>(r->provider().get())->toItem(response));
-  r->send(
-      [=](util::Output stream) {
-        std::vector<char> buffer(CHUNK_SIZE);
-        *length = callback->putData(buffer.data(), CHUNK_SIZE, sent);
-        auto request = r->provider()->http()->create(upload_url, "PUT");
-        std::stringstream content_range;
-        content_range << "bytes " << sent << "-" << sent + *length - 1 << "/"
-                      << size;
-        request->setHeaderParameter("Content-Range", content_range.str());
-        stream->write(buffer.data(), *length);
-        return request;
-      },
-      [=](EitherError<Response> e) {
-        if (e.left()) return r->done(e.left());
-        try {
-          auto json = util::json::from_stream(e.right()->output());
-          upload(r, upload_url, sent + *length, callback, json);
-        } catch (const Json::Exception&) {
-          r->done(Error{IHttpRequest::Failure, e.right()->output().str()});
-        }
-      },
-      [] { return std::make_shared<std::stringstream>(); },
-      std::make_shared<std::stringstream>(), nullptr,
-      [=](uint64_t, uint64_t now) { callback->progress(size, sent + now); },
-      true);
+
+uint64_t nextExpectedOffset(const Json::Value& json) {
+  return std::stoull(json["nextExpectedRanges"][0].asString());
 }
+
+/**
+ * Uploads a file through an upload session. Chunks have to be sent one after
+ * another, so the next one is read while the current one is in flight; chunk
+ * buffers are reused for the whole upload. After a failed chunk the upload
+ * resumes from the ranges the server still expects.
+ */
+class UploadSession : public std::enable_shared_from_this<UploadSession> {
+ public:
+  using Chunk = util::ChunkedBuffer::Chunk;
+
+  UploadSession(Request<EitherError<IItem>>::Pointer r, std::string url,
+                IUploadFileCallback* callback, std::string journal_key)
+      : request_(std::move(r)),
+        url_(std::move(url)),
+        journal_key_(std::move(journal_key)),
+        callback_(callback),
+        size_(callback->size()),
+        reservation_(request_->provider()->chunkSizer()->reserve(
+            "upload", IChunkSizer::Direction::Upload, UPLOAD_CHUNK, 2)),
+        next_offset_(),
+        sending_(),
+        sending_offset_(),
+        sending_length_(),
+        reading_(),
+        ready_offset_(),
+        resume_count_(),
+        finished_() {}
+
+  void start() { pump(); }
+
+  /**
+   * Continues session recorded in the transfer journal from the ranges the
+   * server expects; failed is called if the session is gone.
+   */
+  void restore(const std::function<void()>& failed) { query(failed); }
+
+ private:
+  TransferJournal* journal() const {
+    return journal_key_.empty() ? nullptr
+                                : request_->provider()->transfer_journal();
+  }
+
+  uint64_t target() const {
+    return sending_ ? sending_offset_ + sending_length_ : next_offset_;
+  }
+
+  Chunk acquire() {
+    if (buffers_.empty())
+      return std::make_shared<std::vector<char>>(reservation_->size());
+    auto chunk = std::move(buffers_.back());
+    buffers_.pop_back();
+    return chunk;
+  }
+
+  void finish(std::unique_lock<std::mutex>& lock, EitherError<IItem> result) {
+    finished_ = true;
+    lock.unlock();
+    request_->done(result);
+  }
+
+  void pump() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (finished_) return;
+    if (ready_ && ready_offset_ != target())
+      buffers_.push_back(std::move(ready_));
+    Chunk chunk;
+    uint64_t offset = ready_offset_;
+    if (!sending_ && ready_) {
+      sending_ = true;
+      sending_offset_ = ready_offset_;
+      sending_length_ = ready_->size();
+      chunk = std::move(ready_);
+    }
+    Chunk buffer;
+    uint64_t read_offset = target();
+    if (!reading_ && !ready_ && read_offset < size_) {
+      reading_ = true;
+      buffer = acquire();
+    }
+    lock.unlock();
+    if (buffer) read(read_offset, buffer);
+    if (chunk) send(offset, chunk);
+  }
+
+  void read(uint64_t offset, const Chunk& buffer) {
+    auto self = shared_from_this();
+    request_->provider()->thread_pool()->schedule([=] {
+      auto chunk_size = self->reservation_->size();
+      auto length = std::min<uint64_t>(chunk_size, self->size_ - offset);
+      buffer->resize(chunk_size);
+      uint32_t read;
+      {
+        std::lock_guard<std::mutex> lock(self->read_mutex_);
+        read = self->callback_->putData(buffer->data(), length, offset);
+      }
+      buffer->resize(read);
+      std::unique_lock<std::mutex> lock(self->mutex_);
+      self->reading_ = false;
+      if (self->finished_) return;
+      if (read != length)
+        return self->finish(lock, Error{IHttpRequest::Failure,
+                                        util::Error::COULD_NOT_READ_FILE});
+      self->ready_ = buffer;
+      self->ready_offset_ = offset;
+      lock.unlock();
+      self->pump();
+    });
+  }
+
+  void send(uint64_t offset, const Chunk& chunk) {
+    auto self = shared_from_this();
+    request_->send(
+        [=](util::Output stream) {
+          auto request =
+              self->request_->provider()->http()->create(self->url_, "PUT");
+          std::stringstream content_range;
+          content_range << "bytes " << offset << "-"
+                        << offset + chunk->size() - 1 << "/" << self->size_;
+          request->setHeaderParameter("Content-Range", content_range.str());
+          if (auto input = dynamic_cast<util::ChunkedStream*>(stream.get()))
+            input->buffer().append(chunk);
+          else
+            stream->write(chunk->data(), chunk->size());
+          return request;
+        },
+        [=](EitherError<Response> e) { self->sent(chunk, e); },
+        [] { return std::make_shared<util::ChunkedStream>(); },
+        std::make_shared<util::ChunkedStream>(), nullptr,
+        [=](uint64_t, uint64_t now) {
+          self->callback_->progress(self->size_, offset + now);
+        },
+        true);
+  }
+
+  void sent(const Chunk& chunk, EitherError<Response> e) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    sending_ = false;
+    buffers_.push_back(chunk);
+    if (e.left()) {
+      if (e.left()->code_ == IHttpRequest::NotFound && journal())
+        journal()->remove(journal_key_);
+      if (e.left()->code_ == IHttpRequest::Aborted ||
+          e.left()->code_ == IHttpRequest::NotFound ||
+          resume_count_++ >= MAX_RESUME_COUNT)
+        return finish(lock, e.left());
+      lock.unlock();
+      return resume(e.left());
+    }
+    try {
+      auto json = util::json::from_stream(e.right()->output());
+      if (!json.isMember("nextExpectedRanges")) {
+        if (journal()) journal()->remove(journal_key_);
+        return finish(lock, static_cast<OneDrive*>(request_->provider().get())
+                                ->toItem(json));
+      }
+      next_offset_ = nextExpectedOffset(json);
+      resume_count_ = 0;
+    } catch (const std::exception&) {
+      return finish(lock,
+                    Error{IHttpRequest::Failure, e.right()->output().str()});
+    }
+    auto offset = next_offset_;
+    lock.unlock();
+    auto pool = request_->provider()->thread_pool();
+    if (!journal() || !pool) return pump();
+    // Journal reads the committed part to checksum it, which is done on the
+    // thread pool like other reads.
+    auto self = shared_from_this();
+    pool->schedule([=] {
+      {
+        std::lock_guard<std::mutex> lock(self->read_mutex_);
+        self->journal()->put(self->journal_key_, {self->url_, offset, {}},
+                             *self->callback_);
+      }
+      self->pump();
+    });
+  }
+
+  void resume(const std::shared_ptr<Error>& error) {
+    auto self = shared_from_this();
+    query([=] {
+      std::unique_lock<std::mutex> lock(self->mutex_);
+      self->finish(lock, error);
+    });
+  }
+
+  void query(const std::function<void()>& failed) {
+    auto self = shared_from_this();
+    request_->send(
+        [=](util::Output) {
+          return self->request_->provider()->http()->create(self->url_);
+        },
+        [=](EitherError<Response> e) {
+          if (e.left()) return failed();
+          uint64_t offset;
+          try {
+            offset = nextExpectedOffset(
+                util::json::from_stream(e.right()->output()));
+          } catch (const std::exception&) {
+            return failed();
+          }
+          std::unique_lock<std::mutex> lock(self->mutex_);
+          self->next_offset_ = offset;
+          lock.unlock();
+          self->pump();
+        });
+  }
+
+
+  Request<EitherError<IItem>>::Pointer request_;
+  std::string url_;
+  std::string journal_key_;
+  IUploadFileCallback* callback_;
+  uint64_t size_;
+  // Memory of the chunk being sent and of the one read ahead.
+  IChunkSizer::IReservation::Pointer reservation_;
+  std::mutex mutex_;
+  // The callback isn't required to handle concurrent reads.
+  std::mutex read_mutex_;
+  std::vector<Chunk> buffers_;
+  uint64_t next_offset_;
+  bool sending_;
+  uint64_t sending_offset_;
+  uint64_t sending_length_;
+  bool reading_;
+  Chunk ready_;
+  uint64_t ready_offset_;
+  uint32_t resume_count_;
+  bool finished_;
+};
+
 }  // namespace
 
 OneDrive::OneDrive() : CloudProvider(util::make_unique<Auth>()) {}
@@ -82,6 +289,12 @@ std::string OneDrive::endpoint() const {
   return endpoint_;
 }
 
+ICloudProvider::OperationSet OneDrive::supportedOperations() const {
+  return CloudProvider::supportedOperations() & ~StreamUpload;
+}
+
+uint32_t OneDrive::defaultDownloadStreamCount() const { return 4; }
+
 void OneDrive::initialize(ICloudProvider::InitData&& d) {
   setWithHint(d.hints_, "endpoint", [this](std::string v) {
     auto lock = auth_lock();
@@ -142,32 +355,117 @@ ICloudProvider::UploadFileRequest::Pointer OneDrive::uploadFileAsync(
     IItem::Pointer parent, const std::string& filename,
     IUploadFileCallback::Pointer cb) {
   auto callback = cb.get();
+  auto resolver = [=, this](Request<EitherError<IItem>>::Pointer r) {
+    auto key =
+        callback->size() == 0 ? "" : transferKey(*parent, filename, *callback);
+    auto create = [=, this] {
+      if (!key.empty()) transfer_journal()->remove(key);
+      r->request(
+          [=, this](util::Output) {
+            return http()->create(endpoint() + "/me/drive/items/" +
+                                      parent->id() + ":/" +
+                                      util::Url::escape(filename) +
+                                      ":/createUploadSession",
+                                  "POST");
+          },
+          [=, this](EitherError<Response> e) {
+            if (e.left()) return r->done(e.left());
+            try {
+              auto response = util::json::from_stream(e.right()->output());
+              if (callback->size() == 0) return r->done(toItem(response));
+              auto url = response["uploadUrl"].asString();
+              if (!key.empty())
+                transfer_journal()->put(key, {url, 0, {}}, *callback);
+              std::make_shared<UploadSession>(r, url, callback, key)->start();
+            } catch (const Json::Exception& e) {
+              r->done(Error{IHttpRequest::Failure, e.what()});
+            }
+          });
+    };
+    TransferJournal::Entry entry;
+    if (!key.empty() && transfer_journal()->find(key, entry, *callback))
+      return std::make_shared<UploadSession>(r, entry.session_, callback, key)
+          ->restore(create);
+    create();
+  };
   return std::make_shared<Request<EitherError<IItem>>>(
              shared_from_this(), [=](EitherError<IItem> e) { cb->done(e); },
-             [=, this](Request<EitherError<IItem>>::Pointer r) {
-               r->request(
-                   [=, this](util::Output) {
-                     return http()->create(endpoint() + "/me/drive/items/" +
-                                               parent->id() + ":/" +
-                                               util::Url::escape(filename) +
-                                               ":/createUploadSession",
-                                           "POST");
-                   },
-                   [=](EitherError<Response> e) {
-                     if (e.left()) return r->done(e.left());
-                     try {
-                       auto response =
-                           util::json::from_stream(e.right()->output());
-                       upload(r, response["uploadUrl"].asString(), 0, callback,
-                              response);
-                     } catch (const Json::Exception& e) {
-                       r->done(Error{IHttpRequest::Failure, e.what()});
-                     }
-                   });
-             })
+             resolver)
       ->run();
 }
 
+ICloudProvider::CopyItemRequest::Pointer OneDrive::copyItemAsync(
+    IItem::Pointer source, IItem::Pointer destination,
+    CopyItemCallback callback) {
+  auto resolver = [=, this](Request<EitherError<IItem>>::Pointer r) {
+    if (destination->type() != IItem::FileType::Directory)
+      return r->done(
+          Error{IHttpRequest::Forbidden, util::Error::NOT_A_DIRECTORY});
+    r->request(
+        [=, this](util::Output stream) {
+          auto request = http()->create(
+              endpoint() + "/drive/items/" + source->id() + "/copy", "POST");
+          request->setHeaderParameter("Content-Type", "application/json");
+          Json::Value json;
+          if (destination->id() == rootDirectory()->id())
+            json["parentReference"]["path"] = "/drive/root";
+          else
+            json["parentReference"]["id"] = destination->id();
+          *stream << json;
+          return request;
+        },
+        [=, this](EitherError<Response> e) {
+          if (e.left()) return r->done(e.left());
+          auto it = e.right()->headers().find("location");
+          if (it == e.right()->headers().end())
+            return r->done(Error{IHttpRequest::Failure,
+                                 util::Error::UNKNOWN_RESPONSE_RECEIVED});
+          waitForCopy(r, it->second);
+        });
+  };
+  return std::make_shared<Request<EitherError<IItem>>>(shared_from_this(),
+                                                       callback, resolver)
+      ->run();
+}
+
+void OneDrive::waitForCopy(const Request<EitherError<IItem>>::Pointer& r,
+                           const std::string& monitor_url) {
+  // Copies run in the background; the monitor url is preauthenticated and
+  // reports the new item's id once the copy is completed.
+  r->send(
+      [=, this](util::Output) { return http()->create(monitor_url); },
+      [=, this](EitherError<Response> e) {
+        if (e.left()) return r->done(e.left());
+        try {
+          auto json = util::json::from_stream(e.right()->output());
+          auto status = json["status"].asString();
+          if (status.empty() && json.isMember("id"))
+            return r->done(toItem(json));
+          if (status == "completed")
+            return r->make_subrequest(
+                &CloudProvider::getItemDataAsync, json["resourceId"].asString(),
+                [=](EitherError<IItem> e) { r->done(e); });
+          if (status == "failed")
+            return r->done(Error{IHttpRequest::Failure,
+                                 json["error"]["message"].asString()});
+          auto pool = thread_pool();
+          if (!pool)
+            return r->done(
+                Error{IHttpRequest::Aborted, util::Error::ABORTED});
+          pool->schedule(
+              [=, this] {
+                if (r->is_cancelled())
+                  return r->done(
+                      Error{IHttpRequest::Aborted, util::Error::ABORTED});
+                waitForCopy(r, monitor_url);
+              },
+              std::chrono::system_clock::now() + COPY_POLL_INTERVAL);
+        } catch (const Json::Exception& e) {
+          r->done(Error{IHttpRequest::Failure, e.what()});
+        }
+      });
+}
+
 ICloudProvider::GeneralDataRequest::Pointer OneDrive::getGeneralDataAsync(
     GeneralDataCallback callback) {
   auto resolver = [=, this](Request<EitherError<GeneralData>>::Pointer r) {
@@ -207,7 +505,7 @@ IHttpRequest::Pointer OneDrive::getItemDataRequest(const std::string& id,
   IHttpRequest::Pointer request =
       http()->create(endpoint() + "/drive/items/" + id, "GET");
   request->setParameter("select",
-                        "name,folder,audio,image,photo,video,id,size,"
+                        "name,folder,file,audio,image,photo,video,id,size,"
                         "lastModifiedDateTime,thumbnails,@content.downloadUrl");
   request->setParameter("expand", "thumbnails");
   return request;
@@ -219,7 +517,7 @@ IHttpRequest::Pointer OneDrive::listDirectoryRequest(
   auto request = http()->create(
       endpoint() + "/drive/items/" + item.id() + "/children", "GET");
   request->setParameter("select",
-                        "name,folder,audio,image,photo,video,id,size,"
+                        "name,folder,file,audio,image,photo,video,id,size,"
                         "lastModifiedDateTime,thumbnails,@content.downloadUrl");
   request->setParameter("expand", "thumbnails");
   return request;
@@ -296,6 +594,8 @@ IItem::Pointer OneDrive::toItem(const Json::Value& v) const {
       util::parse_time(v["lastModifiedDateTime"].asString()), type);
   item->set_url(v["@microsoft.graph.downloadUrl"].asString());
   item->set_thumbnail_url(v["thumbnails"][0]["small"]["url"].asString());
+  item->set_content_hash(IItem::HashType::QuickXor,
+                         v["file"]["hashes"]["quickXorHash"].asString());
   return std::move(item);
 }
 
@@ -309,6 +609,15 @@ IItem::List OneDrive::listDirectoryResponse(
   return result;
 }
 
+ListDirectoryParser::Pointer OneDrive::listDirectoryParser(
+    const IItem&, const ListDirectoryParser::ItemCallback& callback) const {
+  return util::make_unique<JsonListParser>(
+      "value", [=, this](const Json::Value& v) { callback(toItem(v)); },
+      [](const Json::Value& response) {
+        return response["@odata.nextLink"].asString();
+      });
+}
+
 void OneDrive::Auth::initialize(IHttp* http, IHttpServerFactory* factory) {
   cloudstorage::Auth::initialize(http, factory);
   if (client_id().empty()) {
@@ -37,11 +37,13 @@ class OneDrive : public CloudProvider {
 
   std::string name() const override;
   std::string endpoint() const override;
+  OperationSet supportedOperations() const override;
 
   IItem::Pointer toItem(const Json::Value&) const;
 
  protected:
   void initialize(InitData&&) override;
+  uint32_t defaultDownloadStreamCount() const override;
   bool reauthorize(int code,
                    const IHttpRequest::HeaderParameters& h) const override;
   Hints hints() const override;
@@ -51,6 +53,9 @@ class OneDrive : public CloudProvider {
       IItem::Pointer, const std::string& filename,
       IUploadFileCallback::Pointer) override;
   GeneralDataRequest::Pointer getGeneralDataAsync(GeneralDataCallback) override;
+  CopyItemRequest::Pointer copyItemAsync(IItem::Pointer source,
+                                         IItem::Pointer destination,
+                                         CopyItemCallback) override;
 
   IHttpRequest::Pointer getItemDataRequest(
       const std::string&, std::ostream& input_stream) const override;
@@ -71,9 +76,15 @@ class OneDrive : public CloudProvider {
 
   IItem::List listDirectoryResponse(const IItem&, std::istream&,
                                     std::string&) const override;
+  ListDirectoryParser::Pointer listDirectoryParser(
+      const IItem&,
+      const ListDirectoryParser::ItemCallback&) const override;
   IItem::Pointer getItemDataResponse(std::istream& response) const override;
 
  private:
+  void waitForCopy(const Request<EitherError<IItem>>::Pointer&,
+                   const std::string& monitor_url);
+
   class Auth : public cloudstorage::Auth {
    public:
     void initialize(IHttp*, IHttpServerFactory*) override;
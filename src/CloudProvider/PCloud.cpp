@@ -199,6 +199,24 @@ IHttpRequest::Pointer PCloud::moveItemRequest(const IItem& source,
   }
 }
 
+IHttpRequest::Pointer PCloud::copyItemRequest(const IItem& source,
+                                              const IItem& destination,
+                                              std::ostream&) const {
+  if (source.type() == IItem::FileType::Directory) {
+    auto request = http()->create(endpoint() + "/copyfolder");
+    request->setParameter("folderid", FileId(source.id()).id_);
+    request->setParameter("tofolderid", FileId(destination.id()).id_);
+    request->setParameter("timeformat", "timestamp");
+    return request;
+  } else {
+    auto request = http()->create(endpoint() + "/copyfile");
+    request->setParameter("fileid", FileId(source.id()).id_);
+    request->setParameter("tofolderid", FileId(destination.id()).id_);
+    request->setParameter("timeformat", "timestamp");
+    return request;
+  }
+}
+
 IHttpRequest::Pointer PCloud::renameItemRequest(const IItem& item,
                                                 const std::string& name,
                                                 std::ostream&) const {
@@ -162,6 +162,16 @@ IHttpRequest::Pointer WebDav::moveItemRequest(const IItem& source,
   return request;
 }
 
+IHttpRequest::Pointer WebDav::copyItemRequest(const IItem& source,
+                                              const IItem& destination,
+                                              std::ostream&) const {
+  auto request = http()->create(endpoint() + source.id(), "COPY");
+  request->setHeaderParameter(
+      "Destination",
+      util::Url(endpoint()).path() + destination.id() + source.filename());
+  return request;
+}
+
 IHttpRequest::Pointer WebDav::renameItemRequest(const IItem& item,
                                                 const std::string& name,
                                                 std::ostream&) const {
@@ -195,10 +205,10 @@ IItem::Pointer WebDav::uploadFileResponse(const IItem& item,
 }
 
 GeneralData WebDav::getGeneralDataResponse(std::istream& stream) const {
-  std::stringstream sstream;
-  sstream << stream.rdbuf();
+  std::string storage;
+  auto content = util::contents(stream, storage);
   tinyxml2::XMLDocument document;
-  if (document.Parse(sstream.str().c_str()) != tinyxml2::XML_SUCCESS)
+  if (document.Parse(content.data(), content.size()) != tinyxml2::XML_SUCCESS)
     throw std::logic_error(util::Error::FAILED_TO_PARSE_XML);
   auto response = find(document.RootElement(), "response");
   auto propstat = find(response, "propstat");
@@ -218,10 +228,10 @@ GeneralData WebDav::getGeneralDataResponse(std::istream& stream) const {
 }
 
 IItem::Pointer WebDav::getItemDataResponse(std::istream& stream) const {
-  std::stringstream sstream;
-  sstream << stream.rdbuf();
+  std::string storage;
+  auto content = util::contents(stream, storage);
   tinyxml2::XMLDocument document;
-  if (document.Parse(sstream.str().c_str()) != tinyxml2::XML_SUCCESS)
+  if (document.Parse(content.data(), content.size()) != tinyxml2::XML_SUCCESS)
     throw std::logic_error(util::Error::FAILED_TO_PARSE_XML);
   return toItem(document.RootElement()->FirstChildElement());
 }
@@ -252,10 +262,10 @@ IItem::Pointer WebDav::moveItemResponse(const IItem& source, const IItem& dest,
 
 IItem::List WebDav::listDirectoryResponse(const IItem&, std::istream& stream,
                                           std::string&) const {
-  std::stringstream sstream;
-  sstream << stream.rdbuf();
+  std::string storage;
+  auto content = util::contents(stream, storage);
   tinyxml2::XMLDocument document;
-  if (document.Parse(sstream.str().c_str()) != tinyxml2::XML_SUCCESS)
+  if (document.Parse(content.data(), content.size()) != tinyxml2::XML_SUCCESS)
     throw std::logic_error(util::Error::FAILED_TO_PARSE_XML);
   if (document.RootElement()->FirstChild() == nullptr) return {};
 
@@ -267,6 +277,17 @@ IItem::List WebDav::listDirectoryResponse(const IItem&, std::istream& stream,
   return result;
 }
 
+ListDirectoryParser::Pointer WebDav::listDirectoryParser(
+    const IItem&, const ListDirectoryParser::ItemCallback& callback) const {
+  auto first = std::make_shared<bool>(true);
+  return util::make_unique<XmlListParser>(
+      std::vector<std::string>{"response"},
+      [=, this](const tinyxml2::XMLElement* element) {
+        if (!util::exchange(*first, false)) callback(toItem(element));
+      },
+      [](const tinyxml2::XMLElement*) { return ""; });
+}
+
 IItem::Pointer WebDav::toItem(const tinyxml2::XMLElement* node) const {
   if (!node) throw std::logic_error(util::Error::INVALID_XML);
   auto element = find(node, "href");
@@ -0,0 +1,146 @@
+/*****************************************************************************
+ * IChunkSizer.h
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef ICHUNKSIZER_H
+#define ICHUNKSIZER_H
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "IHttp.h"
+
+namespace cloudstorage {
+
+/**
+ * Chooses sizes of the pieces transfers are split into: upload chunks, ranges
+ * of streamed downloads, read ahead of mounted files. A chunk should take
+ * many round trips to transfer, so that the link doesn't idle while a request
+ * is being set up, but not that long that a failed chunk is expensive to
+ * retry; the sizes therefore follow throughput and latency measured for the
+ * provider. Buffered chunks are taken out of a memory budget, when it runs
+ * out transfers get smaller chunks.
+ */
+class CLOUDSTORAGE_API IChunkSizer {
+ public:
+  using Pointer = std::unique_ptr<IChunkSizer>;
+
+  static constexpr uint64_t DEFAULT_MEMORY_BUDGET = 256 * 1024 * 1024;
+
+  enum class Direction { Download, Upload };
+
+  /**
+   * Bounds of chunk size imposed by the code path.
+   */
+  struct Limits {
+    uint64_t min_;
+    uint64_t max_;
+    /**
+     * Chunk sizes are multiples of granularity_, e.g. protocols may require
+     * that.
+     */
+    uint64_t granularity_;
+    /**
+     * Used until throughput and latency are known.
+     */
+    uint64_t default_;
+  };
+
+  /**
+   * Memory taken out of the budget; it is given back when the reservation is
+   * destroyed.
+   */
+  class IReservation {
+   public:
+    using Pointer = std::unique_ptr<IReservation>;
+
+    virtual ~IReservation() = default;
+
+    /**
+     * @return chosen chunk size
+     */
+    virtual uint64_t size() const = 0;
+  };
+
+  struct Statistics {
+    IHttp::Bandwidth throughput_;
+    std::chrono::milliseconds latency_;
+    uint64_t memory_budget_;
+    uint64_t reserved_memory_;
+    /**
+     * Chunk size chosen most recently for each code path.
+     */
+    std::map<std::string, uint64_t> chunk_sizes_;
+  };
+
+  virtual ~IChunkSizer() = default;
+
+  /**
+   * @param memory_budget count of bytes all reservations may take together
+   */
+  static Pointer create(uint64_t memory_budget = DEFAULT_MEMORY_BUDGET);
+
+  /**
+   * Feeds a measurement of the link; zero values mean unknown and are
+   * ignored.
+   *
+   * @param throughput bytes per second
+   * @param latency time between sending a request and receiving the first
+   * byte of the response
+   */
+  virtual void update(const IHttp::Bandwidth& throughput,
+                      std::chrono::milliseconds latency) = 0;
+
+  /**
+   * Chooses chunk size for data which isn't buffered in memory.
+   *
+   * @param path name of the code path, reported in statistics
+   * @param direction
+   * @param limits
+   * @return chunk size
+   */
+  virtual uint64_t chunkSize(const std::string& path, Direction direction,
+                             const Limits& limits) = 0;
+
+  /**
+   * Chooses chunk size for count buffers and reserves memory for them; the
+   * size shrinks when the budget runs out, but it's never below limits.min_.
+   *
+   * @param path name of the code path, reported in statistics
+   * @param direction
+   * @param limits
+   * @param count count of buffers of chunk size the caller holds at once
+   * @return reservation
+   */
+  virtual IReservation::Pointer reserve(const std::string& path,
+                                        Direction direction,
+                                        const Limits& limits,
+                                        uint32_t count = 1) = 0;
+
+  virtual Statistics statistics() const = 0;
+};
+
+}  // namespace cloudstorage
+
+#endif  // ICHUNKSIZER_H
@@ -73,13 +73,16 @@ class CLOUDSTORAGE_API ICloudAccess {
       IItem::Pointer parent, const std::string& filename) = 0;
   virtual Promise<IItem::Pointer> moveItem(IItem::Pointer item,
                                            IItem::Pointer new_parent) = 0;
+  virtual Promise<IItem::Pointer> copyItem(IItem::Pointer item,
+                                           IItem::Pointer new_parent) = 0;
   virtual Promise<IItem::Pointer> renameItem(IItem::Pointer item,
                                              const std::string& new_name) = 0;
   virtual Promise<PageData> listDirectoryPage(IItem::Pointer item,
                                               const std::string& token) = 0;
   virtual Promise<IItem::Pointer> uploadFile(
       IItem::Pointer parent, const std::string& filename,
-      const std::shared_ptr<ICloudUploadCallback>&) = 0;
+      const std::shared_ptr<ICloudUploadCallback>&,
+      ICloudProvider::UploadMode = ICloudProvider::UploadMode::Always) = 0;
   virtual Promise<> downloadFile(
       IItem::Pointer file, Range range,
       const std::shared_ptr<ICloudDownloadCallback>&) = 0;
@@ -74,6 +74,11 @@ class CLOUDSTORAGE_API ICloudFactory {
     IThreadPoolFactory::Pointer thread_pool_factory_;
     ICallback::Pointer callback_;
     std::unordered_map<std::string, ProviderInitData> provider_init_data_;
+    /**
+     * Path of the journal of unfinished uploads, empty disables it; it is
+     * passed to every created provider as the transfer_journal hint.
+     */
+    std::string transfer_journal_;
   };
 
   virtual ~ICloudFactory() = default;
@@ -86,6 +91,23 @@ class CLOUDSTORAGE_API ICloudFactory {
   virtual std::string pretty(const std::string& provider) const = 0;
   virtual bool httpServerAvailable() const = 0;
 
+  /**
+   * Caps throughput of all accounts of provider, or of every request if
+   * provider is empty; may be called at any time. The initial global limit
+   * is taken from IHttp::InitData.
+   *
+   * @param provider name of the provider, e.g. google
+   * @param limit bytes per second, 0 means unlimited
+   */
+  virtual void setBandwidthLimit(const std::string& provider,
+                                 const IHttp::Bandwidth& limit) = 0;
+
+  /**
+   * @return throughput recently achieved by provider, or by every request if
+   * provider is empty
+   */
+  virtual IHttp::Bandwidth bandwidth(const std::string& provider) const = 0;
+
   virtual void processEvents() = 0;
 
   virtual std::vector<std::string> availableProviders() const = 0;
@@ -29,6 +29,7 @@
 #include <unordered_map>
 #include <vector>
 
+#include "IChunkSizer.h"
 #include "ICrypto.h"
 #include "IHttp.h"
 #include "IHttpServer.h"
@@ -55,6 +56,7 @@ class CLOUDSTORAGE_API ICloudProvider {
   using CreateDirectoryRequest = IRequest<EitherError<IItem>>;
   using MoveItemRequest = IRequest<EitherError<IItem>>;
   using RenameItemRequest = IRequest<EitherError<IItem>>;
+  using CopyItemRequest = IRequest<EitherError<IItem>>;
   using GeneralDataRequest = IRequest<EitherError<GeneralData>>;
 
   using OperationSet = uint32_t;
@@ -82,6 +84,11 @@ class CLOUDSTORAGE_API ICloudProvider {
     virtual void done(const ICloudProvider&, EitherError<void>) = 0;
   };
 
+  enum class UploadMode {
+    Always,        // upload the file in any case
+    SkipIdentical  // keep the file in the cloud if it has the same content
+  };
+
   enum class Permission {
     ReadMetaData,  // list files
     Read,          // read files
@@ -99,7 +106,16 @@ class CLOUDSTORAGE_API ICloudProvider {
     DeleteItem = 1 << 7,
     CreateDirectory = 1 << 8,
     MoveItem = 1 << 9,
-    RenameItem = 1 << 10
+    RenameItem = 1 << 10,
+    CopyItem = 1 << 11,
+    /**
+     * Upload reads the data once, front to back, and waits while its request
+     * is paused; IUploadFileCallback::putData may then pause the request and
+     * return 0 when the data isn't available yet, the same offset is asked
+     * for again after the request is resumed. Progress keeps being reported
+     * while the request is paused.
+     */
+    StreamUpload = 1 << 12
   };
 
   /**
@@ -159,6 +175,11 @@ class CLOUDSTORAGE_API ICloudProvider {
      *  - access_token
      *  - file_url (used by mega.nz, url provider's base url)
      *  - metadata_url, content_url (amazon drive's endpoints)
+     *  - upload_part_size (amazon s3's multipart upload part size and google
+     *    drive's resumable upload chunk size in bytes; larger files are
+     *    uploaded in parts)
+     *  - upload_batch_size (how many dropbox uploads may be committed with a
+     *    single finish_batch call, 1 commits every upload separately)
      *  - temporary_directory (used by mega.nz, has to use native path
      * separators i.e. \ for windows and / for others; has to end with a
      * separator)
@@ -168,6 +189,13 @@ class CLOUDSTORAGE_API ICloudProvider {
      *  - success_page (page to be displayed when library was authorized
      *    successfully)
      *  - error_page (page to be displayed when library authorization failed)
+     *  - retry_limit (how many times a failed http request may be retried,
+     *    0 disables retries)
+     *  - download_streams (maximum count of connections a file download may
+     *    be split into, 1 disables parallel downloads)
+     *  - transfer_journal (path of the journal of unfinished uploads; an
+     *    upload of the same content to the same place continues the session
+     *    recorded there, also after a restart)
      */
     Hints hints_;
   };
@@ -252,6 +280,15 @@ class CLOUDSTORAGE_API ICloudProvider {
    */
   virtual IItem::Pointer rootDirectory() const = 0;
 
+  /**
+   * Chooses chunk sizes of the provider's transfers from throughput and
+   * latency measured for it; statistics tell what was chosen. Its memory
+   * budget is set with the chunk_memory_budget hint.
+   *
+   * @return chunk sizer, valid as long as the provider
+   */
+  virtual IChunkSizer* chunkSizer() const = 0;
+
   /**
    * Exchanges authorization code which was sent to redirect_uri() by cloud
    * provider for a token.
@@ -312,6 +349,27 @@ class CLOUDSTORAGE_API ICloudProvider {
       IItem::Pointer parent, const std::string& filename,
       IUploadFileCallback::Pointer) = 0;
 
+  /**
+   * Uploads the file provided by callback. With UploadMode::SkipIdentical
+   * parent is listed first; if it already has a file with the same name, size
+   * and content hash, the upload finishes with it and no data is sent. The
+   * data is read twice when the hashes differ: once to compute the hash, then
+   * to upload it. Files of providers which don't report content hashes are
+   * always uploaded.
+   *
+   * @param parent parent of the uploaded file
+   *
+   * @param filename name at which the uploaded file will be saved in cloud
+   * provider
+   *
+   * @param mode
+   *
+   * @return object representing the pending request
+   */
+  virtual UploadFileRequest::Pointer uploadFileAsync(
+      IItem::Pointer parent, const std::string& filename,
+      IUploadFileCallback::Pointer, UploadMode mode) = 0;
+
   /**
    * Retrieves IItem object from its id. That's the preferred way of updating
    * the IItem structure; IItem caches some data(e.g. thumbnail url or file url)
@@ -396,6 +454,23 @@ class CLOUDSTORAGE_API ICloudProvider {
       IItem::Pointer item, const std::string& name,
       RenameItemCallback callback = [](const EitherError<IItem>&) {}) = 0;
 
+  /**
+   * Copies item; directories are copied recursively. The copy is done on the
+   * server side when the cloud provider supports it, otherwise the data is
+   * downloaded and uploaded again.
+   *
+   * @param source item to be copied
+   *
+   * @param destination destination directory
+   *
+   * @param callback called when finished, receives the new item
+   *
+   * @return object representing the pending request
+   */
+  virtual CopyItemRequest::Pointer copyItemAsync(
+      IItem::Pointer source, IItem::Pointer destination,
+      CopyItemCallback callback = [](const EitherError<IItem>&) {}) = 0;
+
   /**
    * Lists directory, but returns only one page of items.
    *
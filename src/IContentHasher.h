@@ -0,0 +1,67 @@
+/*****************************************************************************
+ * IContentHasher.h : IContentHasher interface
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef ICONTENTHASHER_H
+#define ICONTENTHASHER_H
+
+#include <memory>
+#include <string>
+
+#include "IItem.h"
+
+namespace cloudstorage {
+
+/**
+ * Computes hash of file's content the same way a cloud provider does, so that
+ * local data can be compared with IItem::content_hash.
+ */
+class CLOUDSTORAGE_API IContentHasher {
+ public:
+  using Pointer = std::unique_ptr<IContentHasher>;
+
+  virtual ~IContentHasher() = default;
+
+  /**
+   * Hashes next part of the content.
+   *
+   * @param data
+   * @param length
+   */
+  virtual void update(const char* data, size_t length) = 0;
+
+  /**
+   * @return hash of the content hashed so far, in the format of
+   * IItem::content_hash
+   */
+  virtual std::string digest() const = 0;
+
+  /**
+   * @param type
+   * @return hasher of given type, nullptr for IItem::HashType::Unknown
+   */
+  static Pointer create(IItem::HashType type);
+};
+
+}  // namespace cloudstorage
+
+#endif  // ICONTENTHASHER_H
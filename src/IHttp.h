@@ -24,10 +24,13 @@
 #ifndef IHTTP_H
 #define IHTTP_H
 
+#include <array>
+#include <chrono>
 #include <functional>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "IRequest.h"
 
@@ -42,6 +45,22 @@ class CLOUDSTORAGE_API IHttpRequest {
   using HeaderParameters = std::unordered_multimap<std::string, std::string>;
   using CompleteCallback = GenericCallback<Response>;
 
+  /**
+   * Transfer rate in bytes per second; as a limit, 0 means unlimited.
+   */
+  struct Bandwidth {
+    uint64_t download_ = 0;
+    uint64_t upload_ = 0;
+  };
+
+  /**
+   * Scheduling class; someone is waiting on interactive requests right now,
+   * e.g. on a read of a mounted file, while bulk ones move whole files in
+   * the background.
+   */
+  enum class Priority { Interactive, Metadata, Bulk };
+  static constexpr size_t PriorityCount = 3;
+
   struct Response {
     int http_code_;
     HeaderParameters headers_;  // header names should be lower cased
@@ -58,9 +77,13 @@ class CLOUDSTORAGE_API IHttpRequest {
   static constexpr int Unauthorized = 401;
   static constexpr int Forbidden = 403;
   static constexpr int NotFound = 404;
+  static constexpr int Conflict = 409;
   static constexpr int RangeInvalid = 416;
+  static constexpr int TooManyRequests = 429;
   static constexpr int InternalServerError = 500;
+  static constexpr int BadGateway = 502;
   static constexpr int ServiceUnavailable = 503;
+  static constexpr int GatewayTimeout = 504;
   static constexpr int Aborted = 600;
   static constexpr int Unknown = 700;
   static constexpr int Failure = 800;
@@ -85,6 +108,13 @@ class CLOUDSTORAGE_API IHttpRequest {
      */
     virtual bool pause() = 0;
 
+    /**
+     * @return count of times the request was paused so far; a short read of
+     * the request body during which it changed is taken as a pause even if
+     * the request was resumed since, rather than as the end of the body
+     */
+    virtual uint32_t pauseCount() { return 0; }
+
     /**
      * Called when download progress changed.
      *
@@ -100,6 +130,14 @@ class CLOUDSTORAGE_API IHttpRequest {
      * @param now count of bytes uploaded
      */
     virtual void progressUpload(uint64_t total, uint64_t now) = 0;
+
+    /**
+     * Polled while the request is running, so that the limit may change
+     * during the transfer.
+     *
+     * @return limit of this request's own throughput
+     */
+    virtual Bandwidth bandwidthLimit() { return {}; }
   };
 
   /**
@@ -134,6 +172,26 @@ class CLOUDSTORAGE_API IHttpRequest {
    */
   virtual const HeaderParameters& headerParameters() const = 0;
 
+  /**
+   * Makes the request share the bandwidth limit of group, see
+   * IHttp::setBandwidthLimit.
+   *
+   * @param group
+   */
+  virtual void setBandwidthGroup(const std::string& /* group */) {}
+
+  /**
+   * Sets scheduling class of the request; Metadata if not set.
+   *
+   * With the default InitData the class only sets the HTTP/2 stream weight,
+   * which orders streams sharing a connection; bulk transfers give way to
+   * other classes only once bandwidth_limit_ or max_running_ of a class is
+   * configured.
+   *
+   * @param priority
+   */
+  virtual void setPriority(Priority /* priority */) {}
+
   /**
    * @return url(without parameters set with setParameter)
    */
@@ -181,6 +239,75 @@ class CLOUDSTORAGE_API IHttpRequest {
 class CLOUDSTORAGE_API IHttp {
  public:
   using Pointer = std::unique_ptr<IHttp>;
+  using Bandwidth = IHttpRequest::Bandwidth;
+
+  /**
+   * Settings of the default http implementation's connection pool.
+   */
+  struct InitData {
+    /**
+     * Maximum count of simultaneously open connections to a single host; 0
+     * means no limit.
+     */
+    uint32_t max_host_connections_ = 0;
+    /**
+     * Maximum count of simultaneously open connections; 0 means no limit.
+     */
+    uint32_t max_total_connections_ = 0;
+    /**
+     * Count of idle connection handles kept around for reuse.
+     */
+    uint32_t idle_handle_count_ = 16;
+    /**
+     * Count of transport threads; requests to the same host stick to one
+     * thread unless it is much busier than the others.
+     */
+    uint32_t worker_count_ = 1;
+    /**
+     * Whether responses to metadata requests may be sent compressed; HEAD
+     * requests, requests with a Range header or an explicit Accept-Encoding
+     * header and file transfers are always sent as they are.
+     */
+    bool compression_ = true;
+    /**
+     * Initial limit of the throughput of all requests together.
+     */
+    Bandwidth bandwidth_limit_;
+    /**
+     * Settings of a priority class, see IHttpRequest::Priority.
+     */
+    struct PriorityClass {
+      /**
+       * Maximum count of running requests of the class on a transport
+       * thread, the rest wait in order; 0 means no limit.
+       */
+      uint32_t max_running_ = 0;
+      /**
+       * Percentage of the global bandwidth limit which bulk transfers leave
+       * to requests of the class while any of them are running.
+       */
+      uint32_t reserved_bandwidth_ = 0;
+    };
+    /**
+     * Indexed by IHttpRequest::Priority.
+     */
+    std::array<PriorityClass, IHttpRequest::PriorityCount> priority_classes_ =
+        {{{0, 50}, {0, 10}, {0, 0}}};
+  };
+
+  /**
+   * Counters of received response bodies.
+   */
+  struct Statistics {
+    /**
+     * Bytes as received from the network, before content decoding.
+     */
+    uint64_t wire_bytes_ = 0;
+    /**
+     * Bytes after content decoding.
+     */
+    uint64_t decoded_bytes_ = 0;
+  };
 
   virtual ~IHttp() = default;
 
@@ -196,7 +323,45 @@ class CLOUDSTORAGE_API IHttp {
                                        const std::string& method = "GET",
                                        bool follow_redirect = true) const = 0;
 
+  /**
+   * Count of queued and running requests of each transport thread; may be
+   * empty if the implementation doesn't track it.
+   */
+  virtual std::vector<uint32_t> queueDepth() const { return {}; }
+
+  /**
+   * Totals over all completed requests; zero if the implementation doesn't
+   * track them.
+   */
+  virtual Statistics statistics() const { return {}; }
+
+  /**
+   * Caps throughput of requests of group, see IHttpRequest::setBandwidthGroup;
+   * empty group stands for all requests. May be called at any time, running
+   * transfers adapt to the new limit.
+   */
+  virtual void setBandwidthLimit(const std::string& /* group */,
+                                 const Bandwidth&) {}
+
+  /**
+   * Throughput recently achieved by requests of group; zero if the
+   * implementation doesn't track it.
+   */
+  virtual Bandwidth bandwidth(const std::string& /* group */) const {
+    return {};
+  }
+
+  /**
+   * Average time between sending a request of group and receiving the first
+   * byte of its response; zero if the implementation doesn't track it.
+   */
+  virtual std::chrono::milliseconds latency(
+      const std::string& /* group */) const {
+    return std::chrono::milliseconds::zero();
+  }
+
   static IHttp::Pointer create();
+  static IHttp::Pointer create(const InitData&);
 };
 
 }  // namespace cloudstorage
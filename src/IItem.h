@@ -55,6 +55,16 @@ class CLOUDSTORAGE_API IItem {
 
   enum class FileType { Directory, Video, Audio, Image, Unknown };
 
+  /**
+   * Algorithm of content_hash; each provider uses its own one.
+   *  - MD5: lowercase hex md5 (Google Drive, Amazon S3 objects which weren't
+   *    uploaded in parts)
+   *  - Dropbox: lowercase hex sha256 of concatenated sha256 hashes of 4 MiB
+   *    blocks
+   *  - QuickXor: base64 encoded QuickXorHash (OneDrive)
+   */
+  enum class HashType { Unknown, MD5, Dropbox, QuickXor };
+
   virtual ~IItem() = default;
 
   virtual TimeStamp timestamp() const = 0;
@@ -63,6 +73,13 @@ class CLOUDSTORAGE_API IItem {
   virtual std::string id() const = 0;
   virtual size_t size() const = 0;
 
+  /**
+   * @return hash of file's content as reported by the provider, empty if it
+   * isn't known
+   */
+  virtual std::string content_hash() const = 0;
+  virtual HashType content_hash_type() const = 0;
+
   virtual bool is_hidden() const = 0;
   virtual FileType type() const = 0;
 
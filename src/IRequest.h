@@ -89,6 +89,13 @@ class CLOUDSTORAGE_API IGenericRequest {
   virtual void pause() = 0;
 
   virtual void resume() = 0;
+
+  /**
+   * Caps throughput of the request's http transfers, in bytes per second; 0
+   * means unlimited. Applies on top of limits set on IHttp.
+   */
+  virtual void setBandwidthLimit(uint64_t /* download */,
+                                 uint64_t /* upload */) {}
 };
 
 template <class ReturnValue>
@@ -265,6 +272,7 @@ using GetItemDataCallback = GenericCallback<EitherError<IItem>>;
 using DeleteItemCallback = GenericCallback<EitherError<void>>;
 using CreateDirectoryCallback = GenericCallback<EitherError<IItem>>;
 using MoveItemCallback = GenericCallback<EitherError<IItem>>;
+using CopyItemCallback = GenericCallback<EitherError<IItem>>;
 using RenameItemCallback = GenericCallback<EitherError<IItem>>;
 using ListDirectoryPageCallback = GenericCallback<EitherError<PageData>>;
 using ListDirectoryCallback = GenericCallback<EitherError<IItem::List>>;
@@ -0,0 +1,94 @@
+/*****************************************************************************
+ * ITransferPipe.h
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef ITRANSFERPIPE_H
+#define ITRANSFERPIPE_H
+
+#include <memory>
+#include <string>
+
+#include "ICloudProvider.h"
+
+namespace cloudstorage {
+
+/**
+ * Copies files between cloud providers, also different ones. The data
+ * downloaded from the source is handed directly to the upload to the
+ * destination through a bounded buffer: when the buffer is full the download
+ * is paused, when it runs dry the upload is paused, so memory use doesn't
+ * depend on the file size and nothing touches the disk.
+ *
+ * That only works if the destination reads the uploaded data once, front to
+ * back, and waits while its request is paused (ICloudProvider::StreamUpload)
+ * and if the size of the source is known up front. Otherwise the file is
+ * first downloaded to a temporary file and uploaded from there.
+ */
+class CLOUDSTORAGE_API ITransferPipe {
+ public:
+  using Pointer = std::unique_ptr<ITransferPipe>;
+  using TransferRequest = IRequest<EitherError<IItem>>;
+
+  static constexpr uint32_t DEFAULT_BUFFER_SIZE = 4 * 1024 * 1024;
+
+  class ICallback : public IGenericCallback<EitherError<IItem>> {
+   public:
+    using Pointer = std::shared_ptr<ICallback>;
+
+    /**
+     * Called when transfer progress changed.
+     *
+     * @param total count of bytes to transfer
+     * @param now count of bytes already stored at the destination
+     */
+    virtual void progress(uint64_t total, uint64_t now) = 0;
+  };
+
+  virtual ~ITransferPipe() = default;
+
+  /**
+   * @param buffer_size count of bytes buffered between the download and the
+   * upload
+   */
+  static Pointer create(uint32_t buffer_size = DEFAULT_BUFFER_SIZE);
+
+  /**
+   * Copies a file. Pausing, resuming or cancelling the returned request
+   * applies to both the download and the upload. The pipe and both
+   * providers have to outlive the request.
+   *
+   * @param source_provider provider the file is downloaded from
+   * @param source file to copy
+   * @param destination_provider provider the file is uploaded to
+   * @param destination directory to put the file in
+   * @param filename name of the uploaded file
+   * @param callback called with the uploaded item
+   * @return object representing the pending request
+   */
+  virtual TransferRequest::Pointer transfer(
+      ICloudProvider& source_provider, IItem::Pointer source,
+      ICloudProvider& destination_provider, IItem::Pointer destination,
+      const std::string& filename, ICallback::Pointer callback) = 0;
+};
+
+}  // namespace cloudstorage
+
+#endif  // ITRANSFERPIPE_H
@@ -0,0 +1,151 @@
+/*****************************************************************************
+ * CopyItemRequest.cpp : CopyItemRequest implementation
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "CopyItemRequest.h"
+
+#include "CloudProvider/CloudProvider.h"
+#include "Utility/Item.h"
+
+namespace cloudstorage {
+
+CopyItemRequest::CopyItemRequest(std::shared_ptr<CloudProvider> p,
+                                 const IItem::Pointer& source,
+                                 const IItem::Pointer& destination,
+                                 const CopyItemCallback& callback)
+    : Request(std::move(p), callback, [=](Request::Pointer request) {
+        if (destination->type() != IItem::FileType::Directory)
+          return request->done(
+              Error{IHttpRequest::Forbidden, util::Error::NOT_A_DIRECTORY});
+        auto copied = std::make_shared<std::string>();
+        auto start = [=] {
+          copy(request, source, destination, copied,
+               [=](EitherError<IItem> e) { request->done(e); });
+        };
+        if (source->type() != IItem::FileType::Directory) return start();
+        checkDestination(request, source, destination,
+                         [=](EitherError<void> e) {
+                           if (e.left()) return request->done(e.left());
+                           start();
+                         });
+      }) {}
+
+CopyItemRequest::~CopyItemRequest() { cancel(); }
+
+void CopyItemRequest::checkDestination(
+    const Request::Pointer& r, const IItem::Pointer& source,
+    const IItem::Pointer& ancestor,
+    const std::function<void(EitherError<void>)>& callback) {
+  if (ancestor->id() == source->id())
+    return callback(Error{IHttpRequest::Forbidden,
+                          util::Error::DESTINATION_INSIDE_SOURCE});
+  auto item = std::dynamic_pointer_cast<Item>(ancestor);
+  if (!item || item->parents().empty() ||
+      ancestor->id() == r->provider()->rootDirectory()->id())
+    return callback(nullptr);
+  r->make_subrequest(&CloudProvider::getItemDataAsync, item->parents().front(),
+                     [=](EitherError<IItem> e) {
+                       if (e.left()) return callback(e.left());
+                       checkDestination(r, source, e.right(), callback);
+                     });
+}
+
+void CopyItemRequest::copy(const Request::Pointer& r,
+                           const IItem::Pointer& source,
+                           const IItem::Pointer& destination,
+                           const std::shared_ptr<std::string>& copied,
+                           const CompleteCallback& callback) {
+  r->request(
+      [=](util::Output stream) {
+        return r->provider()->copyItemRequest(*source, *destination, *stream);
+      },
+      [=](EitherError<Response> e) {
+        if (e.left()) {
+          if (e.left()->code_ != IHttpRequest::Aborted ||
+              e.left()->description_ != util::Error::UNIMPLEMENTED)
+            return callback(e.left());
+          if (source->type() == IItem::FileType::Directory)
+            copyDirectory(r, source, destination, copied, callback);
+          else
+            transfer(r, source, destination, callback);
+          return;
+        }
+        try {
+          callback(r->provider()->copyItemResponse(*source, *destination,
+                                                   e.right()->output()));
+        } catch (const std::exception& e) {
+          callback(Error{IHttpRequest::Failure, e.what()});
+        }
+      });
+}
+
+void CopyItemRequest::copyDirectory(const Request::Pointer& r,
+                                    const IItem::Pointer& source,
+                                    const IItem::Pointer& destination,
+                                    const std::shared_ptr<std::string>& copied,
+                                    const CompleteCallback& callback) {
+  // Providers which don't report parents of items get past checkDestination;
+  // the copy of a directory into its descendant shows up in the listing then.
+  if (!copied->empty() && source->id() == *copied)
+    return callback(Error{IHttpRequest::Forbidden,
+                          util::Error::DESTINATION_INSIDE_SOURCE});
+  r->make_subrequest(
+      &CloudProvider::createDirectoryAsync, destination, source->filename(),
+      [=](EitherError<IItem> directory) {
+        if (directory.left()) return callback(directory.left());
+        if (copied->empty()) *copied = directory.right()->id();
+        r->make_subrequest(
+            &CloudProvider::listDirectorySimpleAsync, source,
+            [=](EitherError<IItem::List> children) {
+              if (children.left()) return callback(children.left());
+              copyChildren(r, children.right(), directory.right(), copied,
+                           [=](EitherError<void> e) {
+                             if (e.left()) return callback(e.left());
+                             callback(directory.right());
+                           });
+            });
+      });
+}
+
+void CopyItemRequest::copyChildren(
+    const Request::Pointer& r, const std::shared_ptr<IItem::List>& children,
+    const IItem::Pointer& destination,
+    const std::shared_ptr<std::string>& copied,
+    const std::function<void(EitherError<void>)>& callback) {
+  if (children->empty()) return callback(nullptr);
+  auto item = children->back();
+  children->pop_back();
+  copy(r, item, destination, copied, [=](EitherError<IItem> e) {
+    if (e.left()) return callback(e.left());
+    copyChildren(r, children, destination, copied, callback);
+  });
+}
+
+void CopyItemRequest::transfer(const Request::Pointer& r,
+                               const IItem::Pointer& source,
+                               const IItem::Pointer& destination,
+                               const CompleteCallback& callback) {
+  r->make_subrequest(&CloudProvider::transferFileAsync, source, destination,
+                     callback);
+}
+
+}  // namespace cloudstorage
@@ -0,0 +1,71 @@
+/*****************************************************************************
+ * CopyItemRequest.h : CopyItemRequest headers
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef COPYITEMREQUEST_H
+#define COPYITEMREQUEST_H
+
+#include "Request.h"
+
+namespace cloudstorage {
+
+class CopyItemRequest : public Request<EitherError<IItem>> {
+ public:
+  CopyItemRequest(std::shared_ptr<CloudProvider>, const IItem::Pointer& source,
+                  const IItem::Pointer& destination, const CopyItemCallback&);
+  ~CopyItemRequest() override;
+
+ private:
+  using CompleteCallback = std::function<void(EitherError<IItem>)>;
+
+  /**
+   * Fails if ancestor is source or one of its descendants, which is found out
+   * by following parents of items as far as the provider reports them.
+   */
+  static void checkDestination(const Request::Pointer&,
+                               const IItem::Pointer& source,
+                               const IItem::Pointer& ancestor,
+                               const std::function<void(EitherError<void>)>&);
+
+  // copied is the id of the first directory created by the request.
+  static void copy(const Request::Pointer&, const IItem::Pointer& source,
+                   const IItem::Pointer& destination,
+                   const std::shared_ptr<std::string>& copied,
+                   const CompleteCallback&);
+  static void copyDirectory(const Request::Pointer&,
+                            const IItem::Pointer& source,
+                            const IItem::Pointer& destination,
+                            const std::shared_ptr<std::string>& copied,
+                            const CompleteCallback&);
+  static void copyChildren(const Request::Pointer&,
+                           const std::shared_ptr<IItem::List>& children,
+                           const IItem::Pointer& destination,
+                           const std::shared_ptr<std::string>& copied,
+                           const std::function<void(EitherError<void>)>&);
+  static void transfer(const Request::Pointer&, const IItem::Pointer& source,
+                       const IItem::Pointer& destination,
+                       const CompleteCallback&);
+};
+
+}  // namespace cloudstorage
+
+#endif  // COPYITEMREQUEST_H
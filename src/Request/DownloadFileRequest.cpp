@@ -26,10 +26,86 @@
 #include "CloudProvider/CloudProvider.h"
 #include "Utility/Item.h"
 
+#include <chrono>
+#include <map>
+
 using namespace std::placeholders;
 
 namespace cloudstorage {
 
+namespace {
+
+const uint64_t PART_SIZE = 4 * 1024 * 1024;
+const uint32_t INITIAL_STREAM_COUNT = 2;
+// Relative throughput change which makes the stream count move.
+const double THROUGHPUT_THRESHOLD = 0.1;
+
+bool validContentRange(const Response& response, Range range,
+                       uint64_t file_size) {
+  auto it = response.headers().find("content-range");
+  std::stringstream range_stream;
+  range_stream << "bytes " << range.start_ << "-"
+               << range.start_ + range.size_ - 1 << "/" << file_size;
+  return it != response.headers().end() && it->second == range_stream.str();
+}
+
+}  // namespace
+
+struct DownloadFileRequest::ParallelDownload {
+  using Clock = std::chrono::steady_clock;
+
+  Request::Pointer request_;
+  IItem::Pointer file_;
+  ICallback* callback_;
+  RequestFactory factory_;
+  Range range_;
+  uint32_t max_stream_count_;
+
+  std::mutex mutex_;
+  uint32_t stream_count_;
+  uint64_t part_count_;
+  uint64_t next_part_ = 0;
+  uint64_t next_delivery_ = 0;
+  uint32_t running_ = 0;
+  std::map<uint64_t, std::shared_ptr<util::ChunkedStream>> finished_;
+  bool delivering_ = false;
+  bool done_ = false;
+  std::shared_ptr<Error> error_;
+  uint64_t delivered_bytes_ = 0;
+
+  Clock::time_point sample_start_ = Clock::now();
+  uint64_t sample_bytes_ = 0;
+  uint32_t sample_parts_ = 0;
+  double best_throughput_ = 0;
+
+  Range part(uint64_t index) const {
+    auto start = index * PART_SIZE;
+    return {range_.start_ + start, std::min(PART_SIZE, range_.size_ - start)};
+  }
+
+  /**
+   * Hill climbing on aggregate throughput: after every stream_count_ parts
+   * one more stream is tried while it pays off, and one is dropped when
+   * throughput falls.
+   */
+  void sample(uint64_t bytes) {
+    sample_bytes_ += bytes;
+    if (++sample_parts_ < stream_count_) return;
+    auto elapsed = std::chrono::duration<double>(Clock::now() - sample_start_);
+    auto throughput = sample_bytes_ / std::max(elapsed.count(), 1e-6);
+    if (throughput > best_throughput_ * (1 + THROUGHPUT_THRESHOLD)) {
+      best_throughput_ = throughput;
+      if (stream_count_ < max_stream_count_) stream_count_++;
+    } else if (throughput < best_throughput_ * (1 - THROUGHPUT_THRESHOLD)) {
+      best_throughput_ = throughput;
+      if (stream_count_ > 1) stream_count_--;
+    }
+    sample_start_ = Clock::now();
+    sample_bytes_ = 0;
+    sample_parts_ = 0;
+  }
+};
+
 DownloadFileRequest::DownloadFileRequest(std::shared_ptr<CloudProvider> p,
                                          const IItem::Pointer& file,
                                          const ICallback::Pointer& cb,
@@ -47,6 +123,18 @@ void DownloadFileRequest::resolve(const Request::Pointer& request,
                                   const IItem::Pointer& file,
                                   ICallback* callback, Range range,
                                   const RequestFactory& request_factory) {
+  // Parts of a parallel download carry a Range header too, but belong to
+  // the class of the whole read.
+  setPriority(range == FullRange ? IHttpRequest::Priority::Bulk
+                                 : IHttpRequest::Priority::Interactive);
+  auto stream_count = provider()->downloadStreamCount();
+  if (stream_count > 1 && file->size() != IItem::UnknownSize &&
+      range.start_ < file->size()) {
+    auto size = std::min(range.size_, file->size() - range.start_);
+    if (size >= 2 * PART_SIZE)
+      return downloadParallel(request, file, callback, {range.start_, size},
+                              request_factory, stream_count);
+  }
   send(
       [=](util::Output input) {
         auto request = request_factory(*file, *input);
@@ -58,27 +146,129 @@ void DownloadFileRequest::resolve(const Request::Pointer& request,
         if (e.left())
           request->done(e.left());
         else {
-          if (range != FullRange && file->size() != IItem::UnknownSize) {
-            auto it = e.right()->headers().find("content-range");
-            std::stringstream range_stream;
-            range_stream << "bytes " << range.start_ << "-"
-                         << range.start_ + range.size_ - 1 << "/"
-                         << file->size();
-            if (it == e.right()->headers().end() ||
-                it->second != range_stream.str())
-              return request->done(
-                  Error{IHttpRequest::ServiceUnavailable,
-                        util::Error::INVALID_RANGE_HEADER_RESPONSE});
-          }
+          if (range != FullRange && file->size() != IItem::UnknownSize &&
+              !validContentRange(*e.right(), range, file->size()))
+            return request->done(
+                Error{IHttpRequest::ServiceUnavailable,
+                      util::Error::INVALID_RANGE_HEADER_RESPONSE});
           request->done(nullptr);
         }
       },
-      []() { return std::make_shared<std::stringstream>(); },
+      []() { return std::make_shared<util::ChunkedStream>(); },
       std::make_shared<std::ostream>(&stream_wrapper_),
       std::bind(&DownloadFileRequest::ICallback::progress, callback, _1, _2),
       nullptr, true);
 }
 
+void DownloadFileRequest::downloadParallel(
+    const Request::Pointer& request, const IItem::Pointer& file,
+    ICallback* callback, Range range, const RequestFactory& request_factory,
+    uint32_t stream_count) {
+  auto state = std::make_shared<ParallelDownload>();
+  state->request_ = request;
+  state->file_ = file;
+  state->callback_ = callback;
+  state->factory_ = request_factory;
+  state->range_ = range;
+  state->max_stream_count_ = stream_count;
+  state->stream_count_ = std::min(INITIAL_STREAM_COUNT, stream_count);
+  state->part_count_ = (range.size_ + PART_SIZE - 1) / PART_SIZE;
+  schedule(state);
+}
+
+void DownloadFileRequest::schedule(
+    const std::shared_ptr<ParallelDownload>& state) {
+  std::vector<uint64_t> parts;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex_);
+    while (!state->error_ && state->next_part_ < state->part_count_ &&
+           state->next_part_ < state->next_delivery_ + state->stream_count_) {
+      parts.push_back(state->next_part_++);
+      state->running_++;
+    }
+  }
+  for (auto index : parts) downloadPart(state, index);
+}
+
+void DownloadFileRequest::downloadPart(
+    const std::shared_ptr<ParallelDownload>& state, uint64_t index) {
+  auto range = state->part(index);
+  auto content = std::make_shared<util::ChunkedStream>();
+  send(
+      [=](util::Output input) {
+        auto request = state->factory_(*state->file_, *input);
+        request->setHeaderParameter("Range", util::range_to_string(range));
+        return request;
+      },
+      [=, this](EitherError<Response> e) {
+        if (e.left())
+          return partDone(state, index, e.left(), content);
+        if (!validContentRange(*e.right(), range, state->file_->size()))
+          return partDone(state, index,
+                          Error{IHttpRequest::ServiceUnavailable,
+                                util::Error::INVALID_RANGE_HEADER_RESPONSE},
+                          content);
+        partDone(state, index, nullptr, content);
+      },
+      [] { return std::make_shared<util::ChunkedStream>(); }, content, nullptr,
+      nullptr, true);
+}
+
+void DownloadFileRequest::partDone(
+    const std::shared_ptr<ParallelDownload>& state, uint64_t index,
+    EitherError<void> e, const std::shared_ptr<util::ChunkedStream>& content) {
+  std::vector<std::shared_ptr<util::ChunkedStream>> ready;
+  auto take_ready = [&] {
+    while (!state->error_) {
+      auto it = state->finished_.find(state->next_delivery_);
+      if (it == state->finished_.end()) break;
+      ready.push_back(std::move(it->second));
+      state->finished_.erase(it);
+      state->next_delivery_++;
+    }
+    state->delivering_ = !ready.empty();
+  };
+  {
+    std::lock_guard<std::mutex> lock(state->mutex_);
+    state->running_--;
+    if (e.left()) {
+      if (!state->error_) state->error_ = e.left();
+      state->finished_.clear();
+    } else {
+      state->finished_[index] = content;
+      state->sample(content->buffer().size());
+    }
+    if (!state->delivering_) take_ready();
+  }
+  while (!ready.empty()) {
+    for (const auto& part : ready) {
+      for (const auto& chunk : part->buffer().chunks())
+        state->callback_->receivedData(chunk->data(),
+                                       static_cast<uint32_t>(chunk->size()));
+      state->delivered_bytes_ += part->buffer().size();
+      state->callback_->progress(state->range_.size_,
+                                 state->delivered_bytes_);
+    }
+    ready.clear();
+    std::lock_guard<std::mutex> lock(state->mutex_);
+    take_ready();
+  }
+  schedule(state);
+  std::shared_ptr<Error> error;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex_);
+    if (state->done_ || state->delivering_ || state->running_ > 0 ||
+        (!state->error_ && state->next_delivery_ < state->part_count_))
+      return;
+    state->done_ = true;
+    error = state->error_;
+  }
+  if (error)
+    state->request_->done(*error);
+  else
+    state->request_->done(nullptr);
+}
+
 DownloadStreamWrapper::DownloadStreamWrapper(
     std::function<void(const char*, uint32_t)> callback)
     : callback_(std::move(callback)) {}
@@ -116,22 +306,15 @@ void DownloadFileFromUrlRequest::resolve(const Pointer& r,
           if (e.left())
             cb(e.left());
           else {
-            if (range != FullRange && file->size() != IItem::UnknownSize) {
-              auto it = e.right()->headers().find("content-range");
-              std::stringstream range_stream;
-              range_stream << "bytes " << range.start_ << "-"
-                           << range.start_ + range.size_ - 1 << "/"
-                           << file->size();
-              if (it == e.right()->headers().end() ||
-                  it->second != range_stream.str())
-                return r->done(
-                    Error{IHttpRequest::ServiceUnavailable,
-                          util::Error::INVALID_RANGE_HEADER_RESPONSE});
-            }
+            if (range != FullRange && file->size() != IItem::UnknownSize &&
+                !validContentRange(*e.right(), range, file->size()))
+              return r->done(
+                  Error{IHttpRequest::ServiceUnavailable,
+                        util::Error::INVALID_RANGE_HEADER_RESPONSE});
             r->done(nullptr);
           }
         },
-        [] { return std::make_shared<std::stringstream>(); },
+        [] { return std::make_shared<util::ChunkedStream>(); },
         std::make_shared<std::ostream>(&stream_wrapper_),
         std::bind(&IDownloadFileCallback::progress, callback, _1, _2), nullptr,
         true);
@@ -51,9 +51,26 @@ class DownloadFileRequest : public Request<EitherError<void>> {
   ~DownloadFileRequest() override;
 
  private:
+  struct ParallelDownload;
+
   void resolve(const Request::Pointer& request, const IItem::Pointer& file,
                ICallback*, Range, const RequestFactory& request_factory);
 
+  /**
+   * Splits range into parts fetched over up to stream_count connections;
+   * parts are handed to the callback in order, at most stream_count of them
+   * are buffered or in flight at once.
+   */
+  void downloadParallel(const Request::Pointer& request,
+                        const IItem::Pointer& file, ICallback*, Range,
+                        const RequestFactory& request_factory,
+                        uint32_t stream_count);
+  void schedule(const std::shared_ptr<ParallelDownload>&);
+  void downloadPart(const std::shared_ptr<ParallelDownload>&, uint64_t index);
+  void partDone(const std::shared_ptr<ParallelDownload>&, uint64_t index,
+                EitherError<void>,
+                const std::shared_ptr<util::ChunkedStream>& content);
+
   DownloadStreamWrapper stream_wrapper_;
 };
 
@@ -30,11 +30,14 @@ namespace cloudstorage {
 HttpCallback::HttpCallback(
     std::function<int()> status,
     std::function<bool(int, const IHttpRequest::HeaderParameters&)> is_success,
-    ProgressFunction progress_download, ProgressFunction progress_upload)
+    ProgressFunction progress_download, ProgressFunction progress_upload,
+    BandwidthFunction bandwidth_limit, PauseCountFunction pause_count)
     : status_(std::move(status)),
       is_success_(std::move(is_success)),
       progress_download_(std::move(progress_download)),
-      progress_upload_(std::move(progress_upload)) {}
+      progress_upload_(std::move(progress_upload)),
+      bandwidth_limit_(std::move(bandwidth_limit)),
+      pause_count_(std::move(pause_count)) {}
 
 bool HttpCallback::isSuccess(int code,
                              const IHttpRequest::HeaderParameters& h) const {
@@ -45,6 +48,10 @@ bool HttpCallback::abort() { return status_() == Request<int>::Cancelled; }
 
 bool HttpCallback::pause() { return status_() == Request<int>::Paused; }
 
+uint32_t HttpCallback::pauseCount() {
+  return pause_count_ ? pause_count_() : 0;
+}
+
 void HttpCallback::progressDownload(uint64_t total, uint64_t now) {
   if (progress_download_) progress_download_(total, now);
 }
@@ -53,4 +60,8 @@ void HttpCallback::progressUpload(uint64_t total, uint64_t now) {
   if (progress_upload_) progress_upload_(total, now);
 }
 
+IHttpRequest::Bandwidth HttpCallback::bandwidthLimit() {
+  return bandwidth_limit_ ? bandwidth_limit_() : IHttpRequest::Bandwidth();
+}
+
 }  // namespace cloudstorage
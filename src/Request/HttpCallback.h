@@ -33,12 +33,16 @@ namespace cloudstorage {
 class HttpCallback : public IHttpRequest::ICallback {
  public:
   using ProgressFunction = std::function<void(uint64_t, uint64_t)>;
+  using BandwidthFunction = std::function<IHttpRequest::Bandwidth()>;
+  using PauseCountFunction = std::function<uint32_t()>;
 
   HttpCallback(std::function<int()> status,
                std::function<bool(int, const IHttpRequest::HeaderParameters&)>
                    is_success,
                ProgressFunction progress_download,
-               ProgressFunction progress_upload);
+               ProgressFunction progress_upload,
+               BandwidthFunction bandwidth_limit = nullptr,
+               PauseCountFunction pause_count = nullptr);
 
   bool isSuccess(int, const IHttpRequest::HeaderParameters&) const override;
 
@@ -46,15 +50,21 @@ class HttpCallback : public IHttpRequest::ICallback {
 
   bool pause() override;
 
+  uint32_t pauseCount() override;
+
   void progressDownload(uint64_t total, uint64_t now) override;
 
   void progressUpload(uint64_t, uint64_t) override;
 
+  IHttpRequest::Bandwidth bandwidthLimit() override;
+
  private:
   std::function<int()> status_;
   std::function<bool(int, const IHttpRequest::HeaderParameters&)> is_success_;
   ProgressFunction progress_download_;
   ProgressFunction progress_upload_;
+  BandwidthFunction bandwidth_limit_;
+  PauseCountFunction pause_count_;
 };
 }  // namespace cloudstorage
 
@@ -0,0 +1,235 @@
+/*****************************************************************************
+ * ListDirectoryParser.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "ListDirectoryParser.h"
+
+#include <tinyxml2.h>
+#include <algorithm>
+#include <cstring>
+
+namespace cloudstorage {
+
+namespace {
+bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+}  // namespace
+
+std::string ListDirectoryParser::finish() {
+  if (error_) std::rethrow_exception(error_);
+  return done();
+}
+
+std::streamsize ListDirectoryParser::xsputn(const char* data,
+                                            std::streamsize size) {
+  if (error_) return 0;
+  try {
+    write(data, static_cast<size_t>(size));
+    return size;
+  } catch (...) {
+    error_ = std::current_exception();
+    return 0;
+  }
+}
+
+ListDirectoryParser::int_type ListDirectoryParser::overflow(int_type c) {
+  if (traits_type::eq_int_type(c, traits_type::eof()))
+    return traits_type::not_eof(c);
+  char d = traits_type::to_char_type(c);
+  return xsputn(&d, 1) == 1 ? c : traits_type::eof();
+}
+
+JsonListParser::JsonListParser(std::string array_name,
+                               ElementCallback element_callback,
+                               FinishCallback finish_callback)
+    : array_name_(std::move(array_name)),
+      element_callback_(std::move(element_callback)),
+      finish_callback_(std::move(finish_callback)),
+      reader_(Json::CharReaderBuilder().newCharReader()),
+      depth_(),
+      in_string_(),
+      escape_(),
+      expect_key_(),
+      in_array_() {}
+
+void JsonListParser::write(const char* data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    if (in_array_ && in_string_ && !escape_) {
+      auto end = std::find_if(data + i, data + size,
+                              [](char c) { return c == '"' || c == '\\'; });
+      element_.append(data + i, end);
+      i = end - data;
+      if (i == size) break;
+    }
+    char c = data[i];
+    if (in_array_ && depth_ == 2 && !in_string_) {
+      if (is_space(c)) continue;
+      if (c == ',') {
+        if (!element_.empty()) emit();
+        continue;
+      }
+      if (c == ']') {
+        if (!element_.empty()) emit();
+        in_array_ = false;
+        depth_ = 1;
+        document_ += c;
+        continue;
+      }
+    }
+    if (in_array_) {
+      element_ += c;
+      if (in_string_) {
+        if (escape_)
+          escape_ = false;
+        else if (c == '\\')
+          escape_ = true;
+        else if (c == '"')
+          in_string_ = false;
+      } else if (c == '"') {
+        in_string_ = true;
+      } else if (c == '{' || c == '[') {
+        depth_++;
+      } else if (c == '}' || c == ']') {
+        if (--depth_ == 2) emit();
+      }
+      continue;
+    }
+    document_ += c;
+    if (in_string_) {
+      if (escape_)
+        escape_ = false;
+      else if (c == '\\')
+        escape_ = true;
+      else if (c == '"')
+        in_string_ = false;
+      else if (depth_ == 1 && expect_key_)
+        key_ += c;
+    } else if (c == '"') {
+      in_string_ = true;
+      if (depth_ == 1 && expect_key_) key_.clear();
+    } else if (c == ':') {
+      if (depth_ == 1) expect_key_ = false;
+    } else if (c == ',') {
+      if (depth_ == 1) expect_key_ = true;
+    } else if (c == '{') {
+      if (++depth_ == 1) expect_key_ = true;
+    } else if (c == '[') {
+      if (++depth_ == 2 && !expect_key_ && key_ == array_name_)
+        in_array_ = true;
+    } else if (c == '}' || c == ']') {
+      depth_--;
+    }
+  }
+}
+
+std::string JsonListParser::done() {
+  return finish_callback_(util::json::from_string(document_));
+}
+
+void JsonListParser::emit() {
+  Json::Value json;
+  std::string error;
+  if (!reader_->parse(element_.data(), element_.data() + element_.size(),
+                      &json, &error))
+    throw Json::Exception(error);
+  element_.clear();
+  element_callback_(json);
+}
+
+XmlListParser::XmlListParser(std::vector<std::string> names,
+                             ElementCallback element_callback,
+                             FinishCallback finish_callback)
+    : names_(std::move(names)),
+      element_callback_(std::move(element_callback)),
+      finish_callback_(std::move(finish_callback)),
+      position_(),
+      element_start_(std::string::npos),
+      depth_() {}
+
+void XmlListParser::write(const char* data, size_t size) {
+  buffer_.append(data, size);
+  while (true) {
+    auto open = buffer_.find('<', position_);
+    if (open == std::string::npos) {
+      position_ = buffer_.size();
+      return;
+    }
+    position_ = open;
+    const char* terminator = ">";
+    if (buffer_.size() - open < 9 && buffer_.compare(open, 2, "<!") == 0)
+      return;
+    if (buffer_.compare(open, 4, "<!--") == 0)
+      terminator = "-->";
+    else if (buffer_.compare(open, 9, "<![CDATA[") == 0)
+      terminator = "]]>";
+    auto close = buffer_.find(terminator, open);
+    if (close == std::string::npos) return;
+    close += strlen(terminator);
+    char kind = buffer_[open + 1];
+    if (kind == '?' || kind == '!') {
+      position_ = close;
+    } else if (kind == '/') {
+      position_ = close;
+      if (--depth_ == 1 && element_start_ != std::string::npos)
+        emit(util::exchange(element_start_, std::string::npos), close);
+    } else {
+      position_ = close;
+      auto name_end = buffer_.find_first_of(" \t\r\n/>", open + 1);
+      if (depth_ == 1 && matches(buffer_.substr(open + 1, name_end - open - 1)))
+        element_start_ = open;
+      if (buffer_[close - 2] != '/')
+        depth_++;
+      else if (element_start_ == open)
+        emit(util::exchange(element_start_, std::string::npos), close);
+    }
+  }
+}
+
+std::string XmlListParser::done() {
+  tinyxml2::XMLDocument document;
+  if (document.Parse(buffer_.c_str(), buffer_.size()) !=
+          tinyxml2::XML_SUCCESS ||
+      !document.RootElement())
+    throw std::logic_error(util::Error::FAILED_TO_PARSE_XML);
+  return finish_callback_(document.RootElement());
+}
+
+void XmlListParser::emit(size_t begin, size_t end) {
+  tinyxml2::XMLDocument document;
+  if (document.Parse(buffer_.c_str() + begin, end - begin) !=
+      tinyxml2::XML_SUCCESS)
+    throw std::logic_error(util::Error::FAILED_TO_PARSE_XML);
+  element_callback_(document.RootElement());
+  buffer_.erase(begin, end - begin);
+  position_ = begin;
+}
+
+bool XmlListParser::matches(const std::string& tag) const {
+  auto colon = tag.find(':');
+  auto name = colon == std::string::npos ? tag : tag.substr(colon + 1);
+  for (auto&& n : names_)
+    if (n == name) return true;
+  return false;
+}
+
+}  // namespace cloudstorage
@@ -0,0 +1,143 @@
+/*****************************************************************************
+ * ListDirectoryParser.h
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef LIST_DIRECTORY_PARSER_H
+#define LIST_DIRECTORY_PARSER_H
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "IItem.h"
+#include "Utility/Utility.h"
+
+namespace tinyxml2 {
+class XMLElement;
+}  // namespace tinyxml2
+
+namespace cloudstorage {
+
+/**
+ * Parses a directory listing page while it is being received and reports
+ * items as soon as their description is complete. Bytes written to the
+ * buffer are passed to write().
+ */
+class ListDirectoryParser : public std::streambuf {
+ public:
+  using Pointer = std::unique_ptr<ListDirectoryParser>;
+  using ItemCallback = std::function<void(IItem::Pointer)>;
+
+  /**
+   * Consumes next part of the response; may throw on malformed input.
+   */
+  virtual void write(const char* data, size_t size) = 0;
+
+  /**
+   * Should be called once the whole response was received; throws if the
+   * response turned out to be malformed.
+   *
+   * @return next page token or empty string if there is no next page
+   */
+  std::string finish();
+
+ protected:
+  virtual std::string done() = 0;
+
+  std::streamsize xsputn(const char* data, std::streamsize size) override;
+  int_type overflow(int_type c) override;
+
+ private:
+  std::exception_ptr error_;
+};
+
+/**
+ * Reports elements of the top level json array array_name as soon as they are
+ * complete; the rest of the document is passed to the finish callback.
+ */
+class JsonListParser : public ListDirectoryParser {
+ public:
+  using ElementCallback = std::function<void(const Json::Value&)>;
+  using FinishCallback = std::function<std::string(const Json::Value&)>;
+
+  JsonListParser(std::string array_name, ElementCallback, FinishCallback);
+
+  void write(const char* data, size_t size) override;
+
+ protected:
+  std::string done() override;
+
+ private:
+  void emit();
+
+  std::string array_name_;
+  ElementCallback element_callback_;
+  FinishCallback finish_callback_;
+  std::unique_ptr<Json::CharReader> reader_;
+  std::string document_;
+  std::string element_;
+  std::string key_;
+  int depth_;
+  bool in_string_;
+  bool escape_;
+  bool expect_key_;
+  bool in_array_;
+};
+
+/**
+ * Reports children of the root xml element whose names end with one of names
+ * as soon as their closing tag arrives; the document stripped of them is
+ * passed to the finish callback.
+ */
+class XmlListParser : public ListDirectoryParser {
+ public:
+  using ElementCallback = std::function<void(const tinyxml2::XMLElement*)>;
+  using FinishCallback =
+      std::function<std::string(const tinyxml2::XMLElement*)>;
+
+  XmlListParser(std::vector<std::string> names, ElementCallback,
+                FinishCallback);
+
+  void write(const char* data, size_t size) override;
+
+ protected:
+  std::string done() override;
+
+ private:
+  void emit(size_t begin, size_t end);
+  bool matches(const std::string& tag) const;
+
+  std::vector<std::string> names_;
+  ElementCallback element_callback_;
+  FinishCallback finish_callback_;
+  std::string buffer_;
+  size_t position_;
+  size_t element_start_;
+  int depth_;
+};
+
+}  // namespace cloudstorage
+
+#endif  // LIST_DIRECTORY_PARSER_H
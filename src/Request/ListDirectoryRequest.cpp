@@ -51,6 +51,9 @@ void ListDirectoryRequest::resolve(const Request::Pointer& request,
 void ListDirectoryRequest::work(const IItem::Pointer& directory,
                                 std::string page_token, ICallback* callback) {
   auto request = this->shared_from_this();
+  auto page = std::make_shared<Page>(this, directory, callback);
+  if (page->parser_)
+    return work(directory, std::move(page_token), callback, page);
   request->make_subrequest(
       &CloudProvider::listDirectoryPageAsync, directory, std::move(page_token),
       [=, this](EitherError<PageData> e) {
@@ -66,4 +69,75 @@ void ListDirectoryRequest::work(const IItem::Pointer& directory,
       });
 }
 
+void ListDirectoryRequest::work(const IItem::Pointer& directory,
+                                const std::string& page_token,
+                                ICallback* callback,
+                                const std::shared_ptr<Page>& page) {
+  auto request = this->shared_from_this();
+  auto output = std::shared_ptr<std::ostream>(
+      new std::ostream(page.get()),
+      [page](std::ostream* stream) { delete stream; });
+  auto attempt = std::make_shared<bool>(false);
+  request->send(
+      [=, this](util::Output input) {
+        if (*attempt) page->start();
+        *attempt = true;
+        return provider()->listDirectoryRequest(*directory, page_token,
+                                                *input);
+      },
+      [=, this](EitherError<Response> e) {
+        if (e.left()) return request->done(e.left());
+        std::string next_token;
+        try {
+          next_token = page->parser_->finish();
+        } catch (const std::exception& e) {
+          return request->done(Error{IHttpRequest::Failure, e.what()});
+        }
+        result_.insert(result_.end(), page->items_.begin(),
+                       page->items_.end());
+        if (!next_token.empty())
+          work(directory, std::move(next_token), callback);
+        else
+          request->done(result_);
+      },
+      [] { return std::make_shared<util::ChunkedStream>(); }, output, nullptr,
+      nullptr, true);
+}
+
+ListDirectoryRequest::Page::Page(ListDirectoryRequest* request,
+                                 const IItem::Pointer& directory,
+                                 ICallback* callback)
+    : request_(request),
+      directory_(directory),
+      callback_(callback),
+      reported_() {
+  start();
+}
+
+void ListDirectoryRequest::Page::start() {
+  items_.clear();
+  parser_ = request_->provider()->listDirectoryParser(
+      *directory_, std::bind(&Page::received, this, _1));
+}
+
+void ListDirectoryRequest::Page::received(IItem::Pointer item) {
+  items_.push_back(item);
+  if (items_.size() > reported_) {
+    reported_++;
+    callback_->receivedItem(item);
+  }
+}
+
+std::streamsize ListDirectoryRequest::Page::xsputn(const char* data,
+                                                   std::streamsize size) {
+  return parser_->sputn(data, size);
+}
+
+ListDirectoryRequest::Page::int_type ListDirectoryRequest::Page::overflow(
+    int_type c) {
+  if (traits_type::eq_int_type(c, traits_type::eof()))
+    return traits_type::not_eof(c);
+  return parser_->sputc(traits_type::to_char_type(c));
+}
+
 }  // namespace cloudstorage
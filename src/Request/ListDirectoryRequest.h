@@ -25,6 +25,7 @@
 #define LISTDIRECTORYREQUEST_H
 
 #include "IItem.h"
+#include "ListDirectoryParser.h"
 #include "Request.h"
 
 namespace cloudstorage {
@@ -39,10 +40,37 @@ class ListDirectoryRequest : public Request<EitherError<IItem::List>> {
   ~ListDirectoryRequest() override;
 
  private:
+  /**
+   * Page being parsed while it is received; each attempt to fetch it gets a
+   * new parser, items reported by an earlier attempt aren't reported again.
+   */
+  class Page : public std::streambuf {
+   public:
+    Page(ListDirectoryRequest*, const IItem::Pointer& directory, ICallback*);
+
+    void start();
+    void received(IItem::Pointer);
+
+    std::shared_ptr<ListDirectoryParser> parser_;
+    IItem::List items_;
+
+   protected:
+    std::streamsize xsputn(const char* data, std::streamsize size) override;
+    int_type overflow(int_type c) override;
+
+   private:
+    ListDirectoryRequest* request_;
+    IItem::Pointer directory_;
+    ICallback* callback_;
+    size_t reported_;
+  };
+
   void resolve(const Request::Pointer&, const IItem::Pointer& directory,
                ICallback* cb);
   void work(const IItem::Pointer& directory, std::string page_token,
             ICallback*);
+  void work(const IItem::Pointer& directory, const std::string& page_token,
+            ICallback*, const std::shared_ptr<Page>&);
 
   IItem::List result_;
 };
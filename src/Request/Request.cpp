@@ -28,6 +28,7 @@
 #include "Utility/Utility.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 
 using namespace std::placeholders;
@@ -46,6 +47,35 @@ struct compare<T, T> {
   bool operator()(Request<T>* d1, Request<T>* d2) const { return d1 == d2; }
 };
 
+// Passes the response body to the request's output and counts the bytes
+// delivered; once a failed transfer delivered part of the body it can't be
+// retried into the same output.
+class DeliveredBuffer : public std::streambuf {
+ public:
+  DeliveredBuffer(std::shared_ptr<std::ostream> output,
+                  std::shared_ptr<std::atomic<uint64_t>> delivered)
+      : output_(std::move(output)), delivered_(std::move(delivered)) {}
+
+ protected:
+  std::streamsize xsputn(const char* data, std::streamsize size) override {
+    output_->write(data, size);
+    *delivered_ += static_cast<uint64_t>(size);
+    return size;
+  }
+
+  int_type overflow(int_type c) override {
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+      return traits_type::not_eof(c);
+    char d = traits_type::to_char_type(c);
+    xsputn(&d, 1);
+    return c;
+  }
+
+ private:
+  std::shared_ptr<std::ostream> output_;
+  std::shared_ptr<std::atomic<uint64_t>> delivered_;
+};
+
 }  // namespace
 
 Response::Response(IHttpRequest::Response r) : http_(std::move(r)) {}
@@ -56,12 +86,12 @@ const IHttpRequest::HeaderParameters& Response::headers() const {
   return http_.headers_;
 }
 
-std::stringstream& Response::output() {
-  return static_cast<std::stringstream&>(*http_.output_stream_.get());
+util::ChunkedStream& Response::output() {
+  return static_cast<util::ChunkedStream&>(*http_.output_stream_.get());
 }
 
-std::stringstream& Response::error_output() {
-  return static_cast<std::stringstream&>(*http_.error_stream_.get());
+util::ChunkedStream& Response::error_output() {
+  return static_cast<util::ChunkedStream&>(*http_.error_stream_.get());
 }
 
 template <class T>
@@ -98,6 +128,12 @@ void Request<T>::Wrapper::resume() {
   return request_->resume();
 }
 
+template <class T>
+void Request<T>::Wrapper::setBandwidthLimit(uint64_t download,
+                                            uint64_t upload) {
+  return request_->setBandwidthLimit(download, upload);
+}
+
 template <class T>
 Request<T>::Request(std::shared_ptr<CloudProvider> provider, Callback callback,
                     Resolver resolver)
@@ -133,10 +169,14 @@ void Request<T>::finish() {
 
 template <class T>
 void Request<T>::cancel() {
+  std::vector<std::shared_ptr<std::function<void()>>> pending_retries;
   {
     std::unique_lock<std::mutex> lock(status_mutex_);
     status_ = Cancelled;
+    pending_retries = std::move(pending_retries_);
+    pending_retries_.clear();
   }
+  for (const auto& r : pending_retries) (*r)();
   {
     std::unique_lock<std::mutex> lock(provider_mutex_);
     auto p = provider();
@@ -180,7 +220,10 @@ template <class T>
 void Request<T>::pause() {
   std::unique_lock<std::mutex> lock1(status_mutex_);
   std::unique_lock<std::mutex> lock2(subrequest_mutex_);
-  if (status_ != Cancelled) status_ = Paused;
+  if (status_ != Cancelled) {
+    status_ = Paused;
+    pause_count_++;
+  }
   for (size_t i = 0; i < subrequests_.size(); i++) {
     subrequests_[i]->pause();
   }
@@ -198,6 +241,22 @@ void Request<T>::resume() {
   }
 }
 
+template <class T>
+void Request<T>::setBandwidthLimit(uint64_t download, uint64_t upload) {
+  std::unique_lock<std::mutex> lock1(status_mutex_);
+  std::unique_lock<std::mutex> lock2(subrequest_mutex_);
+  bandwidth_limit_ = {download, upload};
+  for (size_t i = 0; i < subrequests_.size(); i++) {
+    subrequests_[i]->setBandwidthLimit(download, upload);
+  }
+}
+
+template <class T>
+void Request<T>::setPriority(IHttpRequest::Priority priority) {
+  std::unique_lock<std::mutex> lock(status_mutex_);
+  priority_ = priority;
+}
+
 template <class T>
 T Request<T>::result() {
   finish();
@@ -228,7 +287,15 @@ std::unique_ptr<HttpCallback> Request<T>::http_callback(
         return status_;
       },
       std::bind(&CloudProvider::isSuccess, provider_.get(), _1, _2),
-      progress_download, progress_upload);
+      progress_download, progress_upload,
+      [this] {
+        std::unique_lock<std::mutex> lock(status_mutex_);
+        return bandwidth_limit_;
+      },
+      [this] {
+        std::unique_lock<std::mutex> lock(status_mutex_);
+        return pause_count_;
+      });
 }
 
 template <class T>
@@ -269,26 +336,26 @@ template <class T>
 void Request<T>::request(const RequestFactory& factory,
                          const RequestCompleted& complete) {
   this->send(
-      factory, complete, [] { return std::make_shared<std::stringstream>(); },
-      std::make_shared<std::stringstream>(), nullptr, nullptr, true);
+      factory, complete, [] { return std::make_shared<util::ChunkedStream>(); },
+      std::make_shared<util::ChunkedStream>(), nullptr, nullptr, true);
 }
 
 template <class T>
 void Request<T>::send(const RequestFactory& factory,
                       const RequestCompleted& complete) {
   this->send(
-      factory, complete, [] { return std::make_shared<std::stringstream>(); },
-      std::make_shared<std::stringstream>(), nullptr, nullptr, false);
+      factory, complete, [] { return std::make_shared<util::ChunkedStream>(); },
+      std::make_shared<util::ChunkedStream>(), nullptr, nullptr, false);
 }
 
 template <class T>
 void Request<T>::query(const RequestFactory& factory,
                        const IHttpRequest::CompleteCallback& complete) {
-  auto input = std::make_shared<std::stringstream>();
+  auto input = std::make_shared<util::ChunkedStream>();
   auto request = factory(input);
   this->send(request.get(), complete, input,
-             std::make_shared<std::stringstream>(),
-             std::make_shared<std::stringstream>(), nullptr, nullptr);
+             std::make_shared<util::ChunkedStream>(),
+             std::make_shared<util::ChunkedStream>(), nullptr, nullptr);
 }
 
 template <class T>
@@ -297,17 +364,53 @@ void Request<T>::send(const RequestFactory& factory,
                       const InputFactory& input_factory,
                       const std::shared_ptr<std::ostream>& output,
                       const ProgressFunction& download,
-                      const ProgressFunction& upload, bool authorized) {
+                      const ProgressFunction& upload, bool authorized,
+                      uint32_t attempt) {
+  auto delivered = std::make_shared<std::atomic<uint64_t>>(0);
+  auto buffer = std::make_shared<DeliveredBuffer>(output, delivered);
+  auto body = std::shared_ptr<std::ostream>(
+      new std::ostream(buffer.get()),
+      [buffer](std::ostream* stream) { delete stream; });
+  send(factory, complete, input_factory, output, download, upload, authorized,
+       attempt, body, delivered);
+}
+
+template <class T>
+void Request<T>::send(const RequestFactory& factory,
+                      const RequestCompleted& complete,
+                      const InputFactory& input_factory,
+                      const std::shared_ptr<std::ostream>& output,
+                      const ProgressFunction& download,
+                      const ProgressFunction& upload, bool authorized,
+                      uint32_t attempt,
+                      const std::shared_ptr<std::ostream>& body,
+                      const std::shared_ptr<std::atomic<uint64_t>>& delivered) {
   auto request = this->shared_from_this();
+  auto failed = [=, this](const std::string& method,
+                          const IHttpRequest::Response& response,
+                          const std::shared_ptr<util::ChunkedStream>& error) {
+    auto resend = [=, this] {
+      this->send(factory, complete, input_factory, output, download, upload,
+                 authorized, attempt + 1, body, delivered);
+    };
+    if (!this->retry(method, attempt, *delivered > 0, response, resend))
+      complete(Error{response.http_code_, error->str()});
+  };
+  auto succeeded = [=, this](IHttpRequest::Response response) {
+    provider()->retry_policy()->succeeded();
+    response.output_stream_ = output;
+    complete(Response(response));
+  };
   auto input = input_factory();
-  auto error_stream = std::make_shared<std::stringstream>();
+  auto error_stream = std::make_shared<util::ChunkedStream>();
   auto r = factory(input);
   if (authorized) authorize(r);
+  auto method = r ? r->method() : "";
   send(
       r.get(),
       [=, this](IHttpRequest::Response response) {
         if (provider()->isSuccess(response.http_code_, response.headers_))
-          return complete(Response(response));
+          return succeeded(response);
         if (authorized &&
             this->reauthorize(response.http_code_, response.headers_)) {
           this->reauthorize([=, this](EitherError<void> e) {
@@ -321,7 +424,7 @@ void Request<T>::send(const RequestFactory& factory,
                     Error{response.http_code_, error_stream->str()});
             }
             auto input = input_factory();
-            auto error_stream = std::make_shared<std::stringstream>();
+            auto error_stream = std::make_shared<util::ChunkedStream>();
             auto r = factory(input);
             if (authorized) authorize(r);
             this->send(
@@ -330,17 +433,50 @@ void Request<T>::send(const RequestFactory& factory,
                   (void)request;
                   if (provider()->isSuccess(response.http_code_,
                                             response.headers_))
-                    complete(Response(response));
+                    succeeded(response);
                   else
-                    complete(Error{response.http_code_, error_stream->str()});
+                    failed(method, response, error_stream);
                 },
-                input, output, error_stream, download, upload);
+                input, body, error_stream, download, upload);
           });
         } else {
-          complete(Error{response.http_code_, error_stream->str()});
+          failed(method, response, error_stream);
         }
       },
-      input, output, error_stream, download, upload);
+      input, body, error_stream, download, upload);
+}
+
+template <class T>
+bool Request<T>::retry(const std::string& method, uint32_t attempt,
+                       bool received_data,
+                       const IHttpRequest::Response& response,
+                       const std::function<void()>& resend) {
+  auto p = provider();
+  std::chrono::milliseconds delay;
+  if (!p->thread_pool() ||
+      !p->retry_policy()->retry(method, attempt, response.http_code_,
+                                response.headers_, received_data, delay))
+    return false;
+  auto task = std::make_shared<std::function<void()>>(resend);
+  {
+    std::lock_guard<std::mutex> lock(status_mutex_);
+    if (status_ == Cancelled) return false;
+    pending_retries_.push_back(task);
+  }
+  auto request = this->shared_from_this();
+  p->thread_pool()->schedule(
+      [=] {
+        {
+          std::lock_guard<std::mutex> lock(request->status_mutex_);
+          auto it = std::find(request->pending_retries_.begin(),
+                              request->pending_retries_.end(), task);
+          if (it == request->pending_retries_.end()) return;
+          request->pending_retries_.erase(it);
+        }
+        (*task)();
+      },
+      std::chrono::system_clock::now() + delay);
+  return true;
 }
 
 template <class T>
@@ -351,10 +487,11 @@ void Request<T>::send(IHttpRequest* request,
                       const std::shared_ptr<std::ostream>& error,
                       const ProgressFunction& download,
                       const ProgressFunction& upload) {
-  if (request)
+  if (request) {
+    request->setPriority(priority(*request, download, upload));
     request->send(complete, input, output, error,
                   http_callback(download, upload));
-  else {
+  } else {
     *error << util::Error::UNIMPLEMENTED;
     complete({IHttpRequest::Aborted, {}, output, error});
   }
@@ -377,6 +514,22 @@ bool Request<T>::is_paused() const {
   return status_ == Paused;
 }
 
+template <class T>
+IHttpRequest::Priority Request<T>::priority(
+    const IHttpRequest& request, const ProgressFunction& download,
+    const ProgressFunction& upload) const {
+  {
+    std::unique_lock<std::mutex> lock(status_mutex_);
+    if (priority_) return *priority_;
+  }
+  if (upload) return IHttpRequest::Priority::Bulk;
+  if (download)
+    return request.headerParameters().count("Range")
+               ? IHttpRequest::Priority::Interactive
+               : IHttpRequest::Priority::Bulk;
+  return IHttpRequest::Priority::Metadata;
+}
+
 template <class T>
 void Request<T>::subrequest(std::shared_ptr<IGenericRequest> request) {
   std::unique_lock<std::mutex> lock1(status_mutex_);
@@ -385,6 +538,9 @@ void Request<T>::subrequest(std::shared_ptr<IGenericRequest> request) {
     request->cancel();
   } else {
     std::lock_guard<std::mutex> lock2(subrequest_mutex_);
+    if (bandwidth_limit_.download_ || bandwidth_limit_.upload_)
+      request->setBandwidthLimit(bandwidth_limit_.download_,
+                                 bandwidth_limit_.upload_);
     subrequests_.emplace_back(std::move(request));
   }
 }
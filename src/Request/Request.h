@@ -24,13 +24,16 @@
 #ifndef REQUEST_H
 #define REQUEST_H
 
+#include <atomic>
 #include <future>
 #include <mutex>
+#include <optional>
 #include <sstream>
 #include <vector>
 
 #include "IHttp.h"
 #include "IRequest.h"
+#include "Utility/ChunkedBuffer.h"
 #include "Utility/Utility.h"
 
 namespace cloudstorage {
@@ -45,8 +48,8 @@ class Response {
 
   int http_code() const;
   const IHttpRequest::HeaderParameters& headers() const;
-  std::stringstream& output();
-  std::stringstream& error_output();
+  util::ChunkedStream& output();
+  util::ChunkedStream& error_output();
 
  private:
   IHttpRequest::Response http_;
@@ -78,6 +81,7 @@ class Request : public IRequest<ReturnValue>,
     ReturnValue result() override;
     void pause() override;
     void resume() override;
+    void setBandwidthLimit(uint64_t download, uint64_t upload) override;
 
    private:
     typename Request<ReturnValue>::Pointer request_;
@@ -91,6 +95,16 @@ class Request : public IRequest<ReturnValue>,
   ReturnValue result() override;
   void pause() override;
   void resume() override;
+  void setBandwidthLimit(uint64_t download, uint64_t upload) override;
+
+  /**
+   * Overrides the scheduling class picked for each http request; by default
+   * file uploads and downloads of whole files are bulk, downloads of ranges
+   * interactive and everything else metadata. Classes take effect only
+   * under a global bandwidth limit or a limit of running requests, see
+   * IHttpRequest::setPriority.
+   */
+  void setPriority(IHttpRequest::Priority);
 
   typename Wrapper::Pointer run();
   void done(const ReturnValue&);
@@ -100,7 +114,7 @@ class Request : public IRequest<ReturnValue>,
   void send(const RequestFactory& factory, const RequestCompleted&,
             const InputFactory&, const std::shared_ptr<std::ostream>& output,
             const ProgressFunction& download, const ProgressFunction& upload,
-            bool authorized);
+            bool authorized, uint32_t attempt = 0);
 
   void request(const RequestFactory& factory, const RequestCompleted&);
   void send(const RequestFactory& factory, const RequestCompleted&);
@@ -140,8 +154,27 @@ class Request : public IRequest<ReturnValue>,
             const ProgressFunction& download = nullptr,
             const ProgressFunction& upload = nullptr);
 
+  /**
+   * Sends one attempt of the request; body is the output wrapped so that
+   * delivered counts bytes of the response body written to it by all the
+   * attempts.
+   */
+  void send(const RequestFactory& factory, const RequestCompleted&,
+            const InputFactory&, const std::shared_ptr<std::ostream>& output,
+            const ProgressFunction& download, const ProgressFunction& upload,
+            bool authorized, uint32_t attempt,
+            const std::shared_ptr<std::ostream>& body,
+            const std::shared_ptr<std::atomic<uint64_t>>& delivered);
+
   void subrequest(std::shared_ptr<IGenericRequest>);
 
+  IHttpRequest::Priority priority(const IHttpRequest&,
+                                  const ProgressFunction& download,
+                                  const ProgressFunction& upload) const;
+
+  bool retry(const std::string& method, uint32_t attempt, bool received_data,
+             const IHttpRequest::Response&, const std::function<void()>&);
+
   template <class First, class... Rest>
   struct LastArgument {
     using Type = typename LastArgument<Rest...>::Type;
@@ -181,6 +214,10 @@ class Request : public IRequest<ReturnValue>,
   std::shared_ptr<CloudProvider> provider_;
   mutable std::mutex status_mutex_;
   Status status_;
+  uint32_t pause_count_ = 0;
+  IHttpRequest::Bandwidth bandwidth_limit_;
+  std::optional<IHttpRequest::Priority> priority_;
+  std::vector<std::shared_ptr<std::function<void()>>> pending_retries_;
   std::mutex subrequest_mutex_;
   std::vector<std::shared_ptr<IGenericRequest>> subrequests_;
 };
@@ -0,0 +1,106 @@
+/*****************************************************************************
+ * RetryPolicy.cpp : RetryPolicy implementation
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "RetryPolicy.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iomanip>
+#include <sstream>
+
+#include "Utility/Utility.h"
+
+namespace cloudstorage {
+
+RetryPolicy::RetryPolicy(uint32_t max_attempts)
+    : random_(std::random_device()()),
+      max_attempts_(max_attempts),
+      tokens_(MAX_TOKENS) {}
+
+bool RetryPolicy::retry(const std::string& method, uint32_t attempt,
+                        int http_code,
+                        const IHttpRequest::HeaderParameters& headers,
+                        bool received_data, std::chrono::milliseconds& delay) {
+  if (!isRetryable(method, http_code, received_data)) return false;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (attempt >= max_attempts_ || tokens_ < TOKENS_PER_RETRY) return false;
+  auto it = headers.find("retry-after");
+  if (it != headers.end() && retryAfter(it->second, delay)) {
+    if (delay > MAX_DELAY) return false;
+  } else {
+    auto cap = std::min<std::chrono::milliseconds::rep>(
+        MAX_DELAY.count(), BASE_DELAY.count() << std::min(attempt, 16u));
+    delay = std::chrono::milliseconds(
+        std::uniform_int_distribution<std::chrono::milliseconds::rep>(
+            0, cap)(random_));
+  }
+  tokens_ -= TOKENS_PER_RETRY;
+  return true;
+}
+
+void RetryPolicy::succeeded() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  tokens_ = std::min(MAX_TOKENS, tokens_ + TOKENS_PER_SUCCESS);
+}
+
+void RetryPolicy::set_max_attempts(uint32_t max_attempts) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_attempts_ = max_attempts;
+}
+
+bool RetryPolicy::isIdempotent(const std::string& method) {
+  return method == "GET" || method == "HEAD" || method == "PUT" ||
+         method == "DELETE" || method == "OPTIONS" || method == "PROPFIND";
+}
+
+bool RetryPolicy::isRetryable(const std::string& method, int http_code,
+                              bool received_data) {
+  if (http_code == IHttpRequest::TooManyRequests) return true;
+  if (!isIdempotent(method)) return false;
+  if (http_code < 0) return !received_data;
+  return http_code == IHttpRequest::BadGateway ||
+         http_code == IHttpRequest::ServiceUnavailable ||
+         http_code == IHttpRequest::GatewayTimeout;
+}
+
+bool RetryPolicy::retryAfter(const std::string& value,
+                             std::chrono::milliseconds& delay) {
+  if (!value.empty() && std::all_of(value.begin(), value.end(), [](char c) {
+        return std::isdigit(static_cast<unsigned char>(c));
+      })) {
+    delay = value.size() > 9 ? std::chrono::hours(24)
+                             : std::chrono::seconds(std::stoll(value));
+    return true;
+  }
+  std::stringstream stream(value);
+  std::tm time = {};
+  stream >> std::get_time(&time, "%a, %d %b %Y %H:%M:%S GMT");
+  if (stream.fail()) return false;
+  auto when = std::chrono::system_clock::from_time_t(util::timegm(time));
+  delay = std::max(std::chrono::milliseconds::zero(),
+                   std::chrono::duration_cast<std::chrono::milliseconds>(
+                       when - std::chrono::system_clock::now()));
+  return true;
+}
+
+}  // namespace cloudstorage
@@ -0,0 +1,96 @@
+/*****************************************************************************
+ * RetryPolicy.h : RetryPolicy headers
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef RETRYPOLICY_H
+#define RETRYPOLICY_H
+
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+
+#include "IHttp.h"
+
+namespace cloudstorage {
+
+/**
+ * Decides whether a failed http request should be sent again and how long to
+ * wait before doing so.
+ *
+ * Delays grow exponentially with full jitter; a Retry-After header sent by
+ * the server takes precedence. Retries are drawn from a budget shared by all
+ * requests of a provider, so that a failing service doesn't get hammered
+ * with retries of every request at once.
+ */
+class RetryPolicy {
+ public:
+  static constexpr uint32_t MAX_ATTEMPTS = 5;
+  static constexpr std::chrono::milliseconds BASE_DELAY{500};
+  static constexpr std::chrono::milliseconds MAX_DELAY{30000};
+  static constexpr uint32_t MAX_TOKENS = 100;
+  static constexpr uint32_t TOKENS_PER_RETRY = 10;
+  static constexpr uint32_t TOKENS_PER_SUCCESS = 1;
+
+  RetryPolicy(uint32_t max_attempts = MAX_ATTEMPTS);
+
+  /**
+   * @param method http method of the failed request
+   * @param attempt number of retries already done for this request
+   * @param http_code response code, negative for transport errors
+   * @param received_data whether any part of the response body was received
+   * @param delay set to the time to wait before retrying
+   * @return whether the request should be retried
+   */
+  bool retry(const std::string& method, uint32_t attempt, int http_code,
+             const IHttpRequest::HeaderParameters&, bool received_data,
+             std::chrono::milliseconds& delay);
+
+  /**
+   * Called after a successful request, refills the retry budget.
+   */
+  void succeeded();
+
+  void set_max_attempts(uint32_t);
+
+  static bool isIdempotent(const std::string& method);
+  static bool isRetryable(const std::string& method, int http_code,
+                          bool received_data);
+
+  /**
+   * Parses Retry-After header value, either delay in seconds or http date.
+   *
+   * @return false if the value couldn't be parsed
+   */
+  static bool retryAfter(const std::string& value,
+                         std::chrono::milliseconds& delay);
+
+ private:
+  std::mutex mutex_;
+  std::mt19937 random_;
+  uint32_t max_attempts_;
+  uint32_t tokens_;
+};
+
+}  // namespace cloudstorage
+
+#endif  // RETRYPOLICY_H
@@ -0,0 +1,137 @@
+/*****************************************************************************
+ * SkipIdenticalUploadRequest.cpp : SkipIdenticalUploadRequest implementation
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "SkipIdenticalUploadRequest.h"
+
+#include "CloudProvider/CloudProvider.h"
+#include "IContentHasher.h"
+
+using namespace std::placeholders;
+
+namespace cloudstorage {
+
+namespace {
+
+const uint32_t HASH_BUFFER_SIZE = 64 * 1024;
+
+class UploadCallback : public IUploadFileCallback {
+ public:
+  UploadCallback(IUploadFileCallback::Pointer callback,
+                 std::function<void(EitherError<IItem>)> done)
+      : callback_(std::move(callback)), done_(std::move(done)) {}
+
+  uint32_t putData(char* data, uint32_t maxlength, uint64_t offset) override {
+    return callback_->putData(data, maxlength, offset);
+  }
+
+  uint64_t size() override { return callback_->size(); }
+
+  void progress(uint64_t total, uint64_t now) override {
+    callback_->progress(total, now);
+  }
+
+  void done(EitherError<IItem> e) override { done_(e); }
+
+ private:
+  IUploadFileCallback::Pointer callback_;
+  std::function<void(EitherError<IItem>)> done_;
+};
+
+}  // namespace
+
+SkipIdenticalUploadRequest::SkipIdenticalUploadRequest(
+    std::shared_ptr<CloudProvider> p, const IItem::Pointer& directory,
+    const std::string& filename, const ICallback::Pointer& callback)
+    : Request(std::move(p), [=](EitherError<IItem> e) { callback->done(e); },
+              std::bind(&SkipIdenticalUploadRequest::resolve, _1, directory,
+                        filename, callback)) {}
+
+SkipIdenticalUploadRequest::~SkipIdenticalUploadRequest() { cancel(); }
+
+void SkipIdenticalUploadRequest::resolve(const Request::Pointer& r,
+                                         const IItem::Pointer& directory,
+                                         const std::string& filename,
+                                         const ICallback::Pointer& callback) {
+  r->make_subrequest(
+      &CloudProvider::listDirectorySimpleAsync, directory,
+      [=](EitherError<IItem::List> e) {
+        // Without the listing the file is just uploaded, that's what would
+        // happen without the check.
+        if (e.left()) return upload(r, directory, filename, callback);
+        for (const auto& item : *e.right())
+          if (item->filename() == filename &&
+              item->type() != IItem::FileType::Directory)
+            return compare(r, directory, item, filename, callback);
+        upload(r, directory, filename, callback);
+      });
+}
+
+void SkipIdenticalUploadRequest::compare(const Request::Pointer& r,
+                                         const IItem::Pointer& directory,
+                                         const IItem::Pointer& existing,
+                                         const std::string& filename,
+                                         const ICallback::Pointer& callback) {
+  auto size = callback->size();
+  std::shared_ptr<IContentHasher> hasher =
+      IContentHasher::create(existing->content_hash_type());
+  if (!hasher || existing->size() != size)
+    return upload(r, directory, filename, callback);
+  // Hashing reads the whole file, which shouldn't hold up the thread
+  // delivering http responses.
+  r->provider()->thread_pool()->schedule([=] {
+    std::vector<char> buffer(HASH_BUFFER_SIZE);
+    uint64_t offset = 0;
+    while (offset < size) {
+      if (r->is_cancelled())
+        return r->done(Error{IHttpRequest::Aborted, util::Error::ABORTED});
+      auto count = callback->putData(
+          buffer.data(),
+          static_cast<uint32_t>(std::min<uint64_t>(buffer.size(),
+                                                   size - offset)),
+          offset);
+      if (count == 0) break;
+      hasher->update(buffer.data(), count);
+      offset += count;
+    }
+    if (offset != size || hasher->digest() != existing->content_hash())
+      return upload(r, directory, filename, callback);
+    callback->progress(size, size);
+    r->done(existing);
+  });
+}
+
+void SkipIdenticalUploadRequest::upload(const Request::Pointer& r,
+                                        const IItem::Pointer& directory,
+                                        const std::string& filename,
+                                        const ICallback::Pointer& callback) {
+  using UploadMethod = ICloudProvider::UploadFileRequest::Pointer (
+      CloudProvider::*)(IItem::Pointer, const std::string&,
+                        IUploadFileCallback::Pointer);
+  r->make_subrequest(
+      static_cast<UploadMethod>(&CloudProvider::uploadFileAsync), directory,
+      filename,
+      std::make_shared<UploadCallback>(
+          callback, [=](EitherError<IItem> e) { r->done(e); }));
+}
+
+}  // namespace cloudstorage
@@ -0,0 +1,57 @@
+/*****************************************************************************
+ * SkipIdenticalUploadRequest.h : SkipIdenticalUploadRequest headers
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef SKIPIDENTICALUPLOADREQUEST_H
+#define SKIPIDENTICALUPLOADREQUEST_H
+
+#include "Request.h"
+
+namespace cloudstorage {
+
+/**
+ * Uploads a file unless the directory already has one with the same name,
+ * size and content hash.
+ */
+class SkipIdenticalUploadRequest : public Request<EitherError<IItem>> {
+ public:
+  using ICallback = IUploadFileCallback;
+
+  SkipIdenticalUploadRequest(std::shared_ptr<CloudProvider>,
+                             const IItem::Pointer& directory,
+                             const std::string& filename,
+                             const ICallback::Pointer&);
+  ~SkipIdenticalUploadRequest() override;
+
+ private:
+  static void resolve(const Request::Pointer&, const IItem::Pointer& directory,
+                      const std::string& filename, const ICallback::Pointer&);
+  static void compare(const Request::Pointer&, const IItem::Pointer& directory,
+                      const IItem::Pointer& existing,
+                      const std::string& filename, const ICallback::Pointer&);
+  static void upload(const Request::Pointer&, const IItem::Pointer& directory,
+                     const std::string& filename, const ICallback::Pointer&);
+};
+
+}  // namespace cloudstorage
+
+#endif  // SKIPIDENTICALUPLOADREQUEST_H
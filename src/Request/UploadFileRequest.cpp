@@ -64,7 +64,7 @@ void UploadFileRequest::resolve(
         }
       },
       [=] { return std::make_shared<std::iostream>(stream_wrapper.get()); },
-      std::make_shared<std::stringstream>(), nullptr,
+      std::make_shared<util::ChunkedStream>(), nullptr,
       std::bind(&UploadFileRequest::ICallback::progress, callback, _1, _2),
       true);
 }
@@ -0,0 +1,137 @@
+/*****************************************************************************
+ * ChunkSizer.cpp : ChunkSizer implementation
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "ChunkSizer.h"
+
+#include <algorithm>
+
+#include "Utility/Utility.h"
+
+namespace cloudstorage {
+
+namespace {
+
+// A chunk should take that many round trips to transfer, so that setting up
+// the next request costs little of the throughput.
+const uint64_t ROUND_TRIPS_PER_CHUNK = 16;
+// Longer chunks are expensive to retry and make progress jumpy.
+const auto MAX_CHUNK_DURATION = std::chrono::seconds(30);
+// Weight of the previous estimate when a new measurement comes in.
+const uint64_t HISTORY_WEIGHT = 3;
+
+template <class T>
+T average(T estimate, T sample) {
+  if (sample == T()) return estimate;
+  if (estimate == T()) return sample;
+  return (estimate * HISTORY_WEIGHT + sample) / (HISTORY_WEIGHT + 1);
+}
+
+uint64_t fit(uint64_t size, const IChunkSizer::Limits& limits) {
+  auto granularity = std::max<uint64_t>(limits.granularity_, 1);
+  auto min = (limits.min_ + granularity - 1) / granularity * granularity;
+  size = std::min(size, limits.max_);
+  return std::max(size / granularity * granularity, min);
+}
+
+}  // namespace
+
+class ChunkSizer::Reservation : public IReservation {
+ public:
+  Reservation(std::shared_ptr<State> state, uint64_t size, uint64_t bytes)
+      : state_(std::move(state)), size_(size), bytes_(bytes) {}
+
+  ~Reservation() override {
+    std::lock_guard<std::mutex> lock(state_->mutex_);
+    state_->reserved_memory_ -= bytes_;
+  }
+
+  uint64_t size() const override { return size_; }
+
+ private:
+  std::shared_ptr<State> state_;
+  uint64_t size_;
+  uint64_t bytes_;
+};
+
+ChunkSizer::ChunkSizer(uint64_t memory_budget)
+    : state_(std::make_shared<State>()) {
+  state_->latency_ = std::chrono::milliseconds::zero();
+  state_->memory_budget_ = memory_budget;
+  state_->reserved_memory_ = 0;
+}
+
+void ChunkSizer::update(const IHttp::Bandwidth& throughput,
+                        std::chrono::milliseconds latency) {
+  std::lock_guard<std::mutex> lock(state_->mutex_);
+  auto& current = state_->throughput_;
+  current.download_ = average(current.download_, throughput.download_);
+  current.upload_ = average(current.upload_, throughput.upload_);
+  state_->latency_ = std::chrono::milliseconds(
+      average(state_->latency_.count(), latency.count()));
+}
+
+uint64_t ChunkSizer::chunkSize(const std::string& path, Direction direction,
+                               const Limits& limits) {
+  std::lock_guard<std::mutex> lock(state_->mutex_);
+  auto size = fit(target(direction, limits), limits);
+  state_->chunk_sizes_[path] = size;
+  return size;
+}
+
+IChunkSizer::IReservation::Pointer ChunkSizer::reserve(const std::string& path,
+                                                       Direction direction,
+                                                       const Limits& limits,
+                                                       uint32_t count) {
+  std::lock_guard<std::mutex> lock(state_->mutex_);
+  count = std::max<uint32_t>(count, 1);
+  auto available = state_->memory_budget_ > state_->reserved_memory_
+                       ? state_->memory_budget_ - state_->reserved_memory_
+                       : 0;
+  auto size =
+      fit(std::min(target(direction, limits), available / count), limits);
+  state_->reserved_memory_ += size * count;
+  state_->chunk_sizes_[path] = size;
+  return util::make_unique<Reservation>(state_, size, size * count);
+}
+
+IChunkSizer::Statistics ChunkSizer::statistics() const {
+  std::lock_guard<std::mutex> lock(state_->mutex_);
+  return {state_->throughput_, state_->latency_, state_->memory_budget_,
+          state_->reserved_memory_, state_->chunk_sizes_};
+}
+
+uint64_t ChunkSizer::target(Direction direction, const Limits& limits) const {
+  auto rate = direction == Direction::Download
+                  ? state_->throughput_.download_
+                  : state_->throughput_.upload_;
+  auto latency = static_cast<uint64_t>(state_->latency_.count());
+  if (rate == 0 || latency == 0) return limits.default_;
+  return std::min(rate * latency * ROUND_TRIPS_PER_CHUNK / 1000,
+                  rate * static_cast<uint64_t>(MAX_CHUNK_DURATION.count()));
+}
+
+IChunkSizer::Pointer IChunkSizer::create(uint64_t memory_budget) {
+  return util::make_unique<ChunkSizer>(memory_budget);
+}
+
+}  // namespace cloudstorage
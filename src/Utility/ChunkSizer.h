@@ -0,0 +1,68 @@
+/*****************************************************************************
+ * ChunkSizer.h : adaptive transfer chunk sizes
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef CHUNKSIZER_H
+#define CHUNKSIZER_H
+
+#include <memory>
+#include <mutex>
+
+#include "IChunkSizer.h"
+
+namespace cloudstorage {
+
+class ChunkSizer : public IChunkSizer {
+ public:
+  ChunkSizer(uint64_t memory_budget);
+
+  void update(const IHttp::Bandwidth& throughput,
+              std::chrono::milliseconds latency) override;
+  uint64_t chunkSize(const std::string& path, Direction,
+                     const Limits&) override;
+  IReservation::Pointer reserve(const std::string& path, Direction,
+                                const Limits&, uint32_t count) override;
+  Statistics statistics() const override;
+
+ private:
+  class Reservation;
+
+  struct State {
+    std::mutex mutex_;
+    IHttp::Bandwidth throughput_;
+    std::chrono::milliseconds latency_;
+    uint64_t memory_budget_;
+    uint64_t reserved_memory_;
+    std::map<std::string, uint64_t> chunk_sizes_;
+  };
+
+  /**
+   * Size which keeps the link busy; state_->mutex_ has to be held.
+   */
+  uint64_t target(Direction, const Limits&) const;
+
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace cloudstorage
+
+#endif  // CHUNKSIZER_H
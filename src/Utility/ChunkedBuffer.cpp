@@ -0,0 +1,178 @@
+/*****************************************************************************
+ * ChunkedBuffer.cpp : segmented in-memory stream buffer
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#include "ChunkedBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace cloudstorage {
+namespace util {
+
+namespace {
+const size_t MIN_CHUNK_SIZE = 4 * 1024;
+const size_t MAX_CHUNK_SIZE = 1024 * 1024;
+}  // namespace
+
+ChunkedBuffer::ChunkedBuffer()
+    : read_chunk_(), read_chunk_offset_(), size_(), shared_tail_() {}
+
+uint64_t ChunkedBuffer::size() const { return size_; }
+
+const std::vector<ChunkedBuffer::Chunk>& ChunkedBuffer::chunks() const {
+  return chunks_;
+}
+
+std::string ChunkedBuffer::str() const {
+  std::string result;
+  result.reserve(size_);
+  for (auto&& chunk : chunks_) result.append(chunk->data(), chunk->size());
+  return result;
+}
+
+std::string_view ChunkedBuffer::view() {
+  if (underflow() == traits_type::eof()) return {};
+  if (read_chunk_ + 1 < chunks_.size()) {
+    auto position = read_chunk_offset_ + (gptr() - eback());
+    auto merged = std::make_shared<std::vector<char>>();
+    merged->reserve(size_);
+    for (auto&& chunk : chunks_)
+      merged->insert(merged->end(), chunk->begin(), chunk->end());
+    chunks_ = {merged};
+    shared_tail_ = false;
+    seek(position);
+  }
+  return std::string_view(gptr(), egptr() - gptr());
+}
+
+void ChunkedBuffer::append(Chunk chunk) {
+  if (chunk->empty()) return;
+  size_ += chunk->size();
+  chunks_.push_back(std::move(chunk));
+  shared_tail_ = true;
+}
+
+std::streamsize ChunkedBuffer::xsputn(const char* data,
+                                      std::streamsize count) {
+  std::streamsize written = 0;
+  while (written < count) {
+    if (chunks_.empty() || shared_tail_ ||
+        chunks_.back()->size() == chunks_.back()->capacity()) {
+      auto chunk = std::make_shared<std::vector<char>>();
+      chunk->reserve(chunks_.empty() ? MIN_CHUNK_SIZE
+                                     : std::min(2 * chunks_.back()->capacity(),
+                                                MAX_CHUNK_SIZE));
+      chunks_.push_back(std::move(chunk));
+      shared_tail_ = false;
+    }
+    auto& chunk = *chunks_.back();
+    auto length = std::min<size_t>(count - written,
+                                   chunk.capacity() - chunk.size());
+    chunk.insert(chunk.end(), data + written, data + written + length);
+    written += length;
+  }
+  size_ += count;
+  return count;
+}
+
+ChunkedBuffer::int_type ChunkedBuffer::overflow(int_type c) {
+  if (traits_type::eq_int_type(c, traits_type::eof()))
+    return traits_type::not_eof(c);
+  char d = traits_type::to_char_type(c);
+  xsputn(&d, 1);
+  return c;
+}
+
+ChunkedBuffer::int_type ChunkedBuffer::underflow() {
+  if (read_chunk_ >= chunks_.size()) return traits_type::eof();
+  auto& chunk = *chunks_[read_chunk_];
+  size_t offset = eback() ? gptr() - eback() : 0;
+  if (offset < chunk.size()) {
+    setg(chunk.data(), chunk.data() + offset, chunk.data() + chunk.size());
+    return traits_type::to_int_type(*gptr());
+  }
+  if (read_chunk_ + 1 < chunks_.size()) {
+    read_chunk_offset_ += chunk.size();
+    auto& next = *chunks_[++read_chunk_];
+    setg(next.data(), next.data(), next.data() + next.size());
+    return traits_type::to_int_type(*gptr());
+  }
+  return traits_type::eof();
+}
+
+ChunkedBuffer::pos_type ChunkedBuffer::seekoff(off_type offset,
+                                               std::ios_base::seekdir dir,
+                                               std::ios_base::openmode mode) {
+  if (!(mode & std::ios_base::in)) {
+    if (offset != 0 || dir == std::ios_base::beg) return pos_type(-1);
+    return pos_type(size_);
+  }
+  off_type base = 0;
+  if (dir == std::ios_base::cur)
+    base = read_chunk_offset_ + (eback() ? gptr() - eback() : 0);
+  else if (dir == std::ios_base::end)
+    base = size_;
+  return seekpos(pos_type(base + offset), mode);
+}
+
+ChunkedBuffer::pos_type ChunkedBuffer::seekpos(pos_type position,
+                                               std::ios_base::openmode mode) {
+  auto offset = static_cast<off_type>(position);
+  if (!(mode & std::ios_base::in) || offset < 0 ||
+      static_cast<uint64_t>(offset) > size_)
+    return pos_type(-1);
+  seek(offset);
+  return position;
+}
+
+void ChunkedBuffer::seek(uint64_t position) {
+  read_chunk_ = 0;
+  read_chunk_offset_ = 0;
+  while (read_chunk_ + 1 < chunks_.size() &&
+         read_chunk_offset_ + chunks_[read_chunk_]->size() <= position)
+    read_chunk_offset_ += chunks_[read_chunk_++]->size();
+  if (read_chunk_ >= chunks_.size()) return setg(nullptr, nullptr, nullptr);
+  auto& chunk = *chunks_[read_chunk_];
+  setg(chunk.data(), chunk.data() + (position - read_chunk_offset_),
+       chunk.data() + chunk.size());
+}
+
+ChunkedStream::ChunkedStream() : std::iostream(&buffer_) {}
+
+ChunkedBuffer& ChunkedStream::buffer() { return buffer_; }
+
+std::string ChunkedStream::str() const { return buffer_.str(); }
+
+std::string_view ChunkedStream::view() { return buffer_.view(); }
+
+std::string_view contents(std::istream& stream, std::string& storage) {
+  if (auto buffer = dynamic_cast<ChunkedBuffer*>(stream.rdbuf()))
+    return buffer->view();
+  std::stringstream sstream;
+  sstream << stream.rdbuf();
+  storage = sstream.str();
+  return storage;
+}
+
+}  // namespace util
+}  // namespace cloudstorage
@@ -0,0 +1,103 @@
+/*****************************************************************************
+ * ChunkedBuffer.h : segmented in-memory stream buffer
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef CHUNKEDBUFFER_H
+#define CHUNKEDBUFFER_H
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "IItem.h"
+
+namespace cloudstorage {
+namespace util {
+
+/**
+ * Append-only stream buffer which keeps its contents in refcounted chunks of
+ * growing size, so writing never moves data that was already written.
+ */
+class CLOUDSTORAGE_API ChunkedBuffer : public std::streambuf {
+ public:
+  using Chunk = std::shared_ptr<std::vector<char>>;
+
+  ChunkedBuffer();
+
+  uint64_t size() const;
+  const std::vector<Chunk>& chunks() const;
+  std::string str() const;
+
+  /**
+   * Returns unread contents as one contiguous block; chunks are merged only
+   * if the contents span more than one of them.
+   */
+  std::string_view view();
+
+  /**
+   * Appends chunk without copying it; the chunk stays shared with the caller,
+   * so subsequent writes always start a new chunk.
+   */
+  void append(Chunk);
+
+ protected:
+  std::streamsize xsputn(const char*, std::streamsize) override;
+  int_type overflow(int_type) override;
+  int_type underflow() override;
+  pos_type seekoff(off_type, std::ios_base::seekdir,
+                   std::ios_base::openmode) override;
+  pos_type seekpos(pos_type, std::ios_base::openmode) override;
+
+ private:
+  void seek(uint64_t position);
+
+  std::vector<Chunk> chunks_;
+  size_t read_chunk_;
+  uint64_t read_chunk_offset_;
+  uint64_t size_;
+  bool shared_tail_;
+};
+
+class CLOUDSTORAGE_API ChunkedStream : public std::iostream {
+ public:
+  ChunkedStream();
+
+  ChunkedBuffer& buffer();
+  std::string str() const;
+  std::string_view view();
+
+ private:
+  ChunkedBuffer buffer_;
+};
+
+/**
+ * Returns unread contents of the stream; reads them in place if the stream is
+ * backed by a ChunkedBuffer, otherwise copies them to storage.
+ */
+CLOUDSTORAGE_API std::string_view contents(std::istream&,
+                                           std::string& storage);
+
+}  // namespace util
+}  // namespace cloudstorage
+
+#endif  // CHUNKEDBUFFER_H
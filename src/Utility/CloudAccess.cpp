@@ -195,6 +195,11 @@ Promise<IItem::Pointer> CloudAccess::moveItem(IItem::Pointer item,
   return wrap(&ICloudProvider::moveItemAsync, item, new_parent);
 }
 
+Promise<IItem::Pointer> CloudAccess::copyItem(IItem::Pointer item,
+                                              IItem::Pointer new_parent) {
+  return wrap(&ICloudProvider::copyItemAsync, item, new_parent);
+}
+
 Promise<IItem::Pointer> CloudAccess::renameItem(IItem::Pointer item,
                                                 const std::string& new_name) {
   return wrap(&ICloudProvider::renameItemAsync, item, new_name);
@@ -207,12 +212,13 @@ Promise<PageData> CloudAccess::listDirectoryPage(IItem::Pointer item,
 
 Promise<IItem::Pointer> CloudAccess::uploadFile(
     IItem::Pointer parent, const std::string& filename,
-    const std::shared_ptr<ICloudUploadCallback>& cb) {
+    const std::shared_ptr<ICloudUploadCallback>& cb,
+    ICloudProvider::UploadMode mode) {
   Promise<IItem::Pointer> promise;
   auto tag = promise.id();
   auto request = provider_->uploadFileAsync(
       parent, filename,
-      util::make_unique<UploadCallback>(cb, promise, tag, loop_));
+      util::make_unique<UploadCallback>(cb, promise, tag, loop_), mode);
   loop_->add(tag, std::move(request));
   return promise;
 }
@@ -104,13 +104,16 @@ class CloudAccess : public ICloudAccess {
                                           const std::string& filename) override;
   Promise<IItem::Pointer> moveItem(IItem::Pointer item,
                                    IItem::Pointer new_parent) override;
+  Promise<IItem::Pointer> copyItem(IItem::Pointer item,
+                                   IItem::Pointer new_parent) override;
   Promise<IItem::Pointer> renameItem(IItem::Pointer item,
                                      const std::string& new_name) override;
   Promise<PageData> listDirectoryPage(IItem::Pointer item,
                                       const std::string& token) override;
   Promise<IItem::Pointer> uploadFile(
       IItem::Pointer parent, const std::string& filename,
-      const std::shared_ptr<ICloudUploadCallback>&) override;
+      const std::shared_ptr<ICloudUploadCallback>&,
+      ICloudProvider::UploadMode = ICloudProvider::UploadMode::Always) override;
   Promise<> downloadFile(
       IItem::Pointer file, Range range,
       const std::shared_ptr<ICloudDownloadCallback>&) override;
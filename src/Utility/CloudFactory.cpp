@@ -35,15 +35,38 @@ namespace cloudstorage {
 
 namespace {
 struct HttpWrapper : public IHttp {
-  HttpWrapper(std::shared_ptr<IHttp> http) : http_(std::move(http)) {}
+  HttpWrapper(std::shared_ptr<IHttp> http, std::string bandwidth_group)
+      : http_(std::move(http)), bandwidth_group_(std::move(bandwidth_group)) {}
 
   IHttpRequest::Pointer create(const std::string& url,
                                const std::string& method,
                                bool follow_redirect) const override {
-    return http_->create(url, method, follow_redirect);
+    auto request = http_->create(url, method, follow_redirect);
+    if (request) request->setBandwidthGroup(bandwidth_group_);
+    return request;
+  }
+
+  std::vector<uint32_t> queueDepth() const override {
+    return http_->queueDepth();
+  }
+
+  Statistics statistics() const override { return http_->statistics(); }
+
+  void setBandwidthLimit(const std::string& group,
+                         const Bandwidth& limit) override {
+    http_->setBandwidthLimit(group, limit);
+  }
+
+  Bandwidth bandwidth(const std::string& group) const override {
+    return http_->bandwidth(group);
+  }
+
+  std::chrono::milliseconds latency(const std::string& group) const override {
+    return http_->latency(group);
   }
 
   std::shared_ptr<IHttp> http_;
+  std::string bandwidth_group_;
 };
 
 struct CryptoWrapper : public ICrypto {
@@ -224,6 +247,10 @@ CloudFactory::CloudFactory(CloudFactory::InitData&& d)
       thread_pool_(d.thread_pool_factory_->create(1)),
       thread_pool_factory_(std::move(d.thread_pool_factory_)),
       init_data_(std::move(d.provider_init_data_)),
+      transfer_journal_path_(std::move(d.transfer_journal_)),
+      transfer_journal_(transfer_journal_path_.empty()
+                            ? nullptr
+                            : TransferJournal::open(transfer_journal_path_)),
       cloud_storage_(ICloudStorage::create()),
       loop_(event_loop_->impl()) {
   std::random_device device;
@@ -282,9 +309,11 @@ std::unique_ptr<CloudAccess> CloudFactory::createImpl(
   ICloudProvider::InitData init_data;
   init_data.token_ = data.token_;
   init_data.hints_ = data.hints_;
+  if (!transfer_journal_path_.empty())
+    init_data.hints_.insert({"transfer_journal", transfer_journal_path_});
   init_data.permission_ = data.permission_;
   init_data.http_engine_ =
-      http_ ? util::make_unique<HttpWrapper>(http_) : nullptr;
+      http_ ? util::make_unique<HttpWrapper>(http_, provider_name) : nullptr;
   init_data.http_server_ =
       http_server_factory_
           ? util::make_unique<HttpServerFactoryWrapper>(http_server_factory_)
@@ -424,6 +453,15 @@ std::vector<std::string> CloudFactory::availableProviders() const {
   return cloud_storage_->providers();
 }
 
+void CloudFactory::setBandwidthLimit(const std::string& provider,
+                                     const IHttp::Bandwidth& limit) {
+  if (http_) http_->setBandwidthLimit(provider, limit);
+}
+
+IHttp::Bandwidth CloudFactory::bandwidth(const std::string& provider) const {
+  return http_ ? http_->bandwidth(provider) : IHttp::Bandwidth();
+}
+
 bool CloudFactory::httpServerAvailable() const {
   return http_server_factory_->serverAvailable();
 }
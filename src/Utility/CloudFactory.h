@@ -29,6 +29,7 @@
 #include <condition_variable>
 
 #include "ICloudFactory.h"
+#include "TransferJournal.h"
 #include "Utility.h"
 
 class ServerWrapperFactory;
@@ -60,6 +61,10 @@ class CloudFactory : public ICloudFactory {
   std::vector<std::string> availableProviders() const override;
   bool httpServerAvailable() const override;
 
+  void setBandwidthLimit(const std::string& provider,
+                         const IHttp::Bandwidth&) override;
+  IHttp::Bandwidth bandwidth(const std::string& provider) const override;
+
   void onCloudRemoved(ICloudAccess*);
 
   bool dumpAccounts(std::ostream& stream) override;
@@ -98,6 +103,8 @@ class CloudFactory : public ICloudFactory {
   std::shared_ptr<IThreadPool> thread_pool_;
   std::unique_ptr<IThreadPoolFactory> thread_pool_factory_;
   std::unordered_map<std::string, ProviderInitData> init_data_;
+  std::string transfer_journal_path_;
+  std::shared_ptr<TransferJournal> transfer_journal_;
   ICloudStorage::Pointer cloud_storage_;
   std::vector<IHttpServer::Pointer> http_server_handles_;
   std::unordered_set<std::shared_ptr<CloudAccess>> cloud_access_;
@@ -68,6 +68,8 @@ class CloudProviderWrapper : public ICloudProvider {
 
   IItem::Pointer rootDirectory() const override { return p_->rootDirectory(); }
 
+  IChunkSizer* chunkSizer() const override { return p_->chunkSizer(); }
+
   ExchangeCodeRequest::Pointer exchangeCodeAsync(
       const std::string& code, ExchangeCodeCallback cb) override {
     return p_->exchangeCodeAsync(code, cb);
@@ -107,6 +109,13 @@ class CloudProviderWrapper : public ICloudProvider {
     return p_->uploadFileAsync(parent, filename, cb);
   }
 
+  UploadFileRequest::Pointer uploadFileAsync(IItem::Pointer parent,
+                                             const std::string& filename,
+                                             IUploadFileCallback::Pointer cb,
+                                             UploadMode mode) override {
+    return p_->uploadFileAsync(parent, filename, cb, mode);
+  }
+
   GetItemDataRequest::Pointer getItemDataAsync(
       const std::string& id, GetItemDataCallback callback) override {
     return p_->getItemDataAsync(id, callback);
@@ -134,6 +143,12 @@ class CloudProviderWrapper : public ICloudProvider {
     return p_->moveItemAsync(source, destination, callback);
   }
 
+  CopyItemRequest::Pointer copyItemAsync(IItem::Pointer source,
+                                         IItem::Pointer destination,
+                                         CopyItemCallback callback) override {
+    return p_->copyItemAsync(source, destination, callback);
+  }
+
   RenameItemRequest::Pointer renameItemAsync(
       IItem::Pointer item, const std::string& name,
       RenameItemCallback callback) override {
@@ -0,0 +1,332 @@
+/*****************************************************************************
+ * ContentHasher.cpp : IContentHasher implementation
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "IContentHasher.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include "Utility/Utility.h"
+
+namespace cloudstorage {
+
+namespace {
+
+const uint32_t MD5_K[] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+    0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+    0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+    0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+    0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+    0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+    0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+    0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+    0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+
+const uint32_t MD5_SHIFT[] = {7, 12, 17, 22, 5, 9,  14, 20,
+                              4, 11, 16, 23, 6, 10, 15, 21};
+
+const uint32_t SHA256_K[] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+const uint32_t DROPBOX_BLOCK_SIZE = 4 * 1024 * 1024;
+const uint32_t QUICKXOR_WIDTH = 160;
+const uint32_t QUICKXOR_SHIFT = 11;
+
+uint32_t rotl(uint32_t x, uint32_t n) { return (x << n) | (x >> (32 - n)); }
+
+uint32_t rotr(uint32_t x, uint32_t n) { return (x >> n) | (x << (32 - n)); }
+
+std::string hex(const std::string& data) {
+  const char* digits = "0123456789abcdef";
+  std::string result;
+  for (uint8_t c : data) {
+    result += digits[c >> 4];
+    result += digits[c & 0xf];
+  }
+  return result;
+}
+
+/**
+ * Buffering and padding shared by md5 and sha256, which both hash 64 byte
+ * blocks and end the message with its length in bits.
+ */
+template <class Hash>
+class BlockHash {
+ public:
+  void update(const uint8_t* data, size_t length) {
+    auto used = static_cast<size_t>(length_ % 64);
+    length_ += length;
+    if (used != 0) {
+      auto count = std::min(64 - used, length);
+      std::memcpy(buffer_.data() + used, data, count);
+      data += count;
+      length -= count;
+      if (used + count < 64) return;
+      static_cast<Hash*>(this)->transform(buffer_.data());
+    }
+    for (; length >= 64; data += 64, length -= 64)
+      static_cast<Hash*>(this)->transform(data);
+    std::memcpy(buffer_.data(), data, length);
+  }
+
+  std::string digest() const {
+    auto hash = *static_cast<const Hash*>(this);
+    uint64_t bits = length_ * 8;
+    std::array<uint8_t, 72> padding = {0x80};
+    auto used = static_cast<size_t>(length_ % 64);
+    auto count = (used < 56 ? 56 : 120) - used;
+    for (size_t i = 0; i < 8; i++)
+      padding[count + i] = static_cast<uint8_t>(
+          bits >> (Hash::BIG_ENDIAN_LENGTH ? 56 - 8 * i : 8 * i));
+    hash.update(padding.data(), count + 8);
+    return hash.state();
+  }
+
+ private:
+  uint64_t length_ = 0;
+  std::array<uint8_t, 64> buffer_ = {};
+};
+
+class Md5 : public BlockHash<Md5> {
+ public:
+  static constexpr bool BIG_ENDIAN_LENGTH = false;
+
+  void transform(const uint8_t* block) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; i++)
+      m[i] = static_cast<uint32_t>(block[4 * i]) |
+             static_cast<uint32_t>(block[4 * i + 1]) << 8 |
+             static_cast<uint32_t>(block[4 * i + 2]) << 16 |
+             static_cast<uint32_t>(block[4 * i + 3]) << 24;
+    auto a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+    for (uint32_t i = 0; i < 64; i++) {
+      uint32_t f, g;
+      if (i < 16) {
+        f = (b & c) | (~b & d);
+        g = i;
+      } else if (i < 32) {
+        f = (d & b) | (~d & c);
+        g = (5 * i + 1) % 16;
+      } else if (i < 48) {
+        f = b ^ c ^ d;
+        g = (3 * i + 5) % 16;
+      } else {
+        f = c ^ (b | ~d);
+        g = (7 * i) % 16;
+      }
+      f += a + MD5_K[i] + m[g];
+      a = d;
+      d = c;
+      c = b;
+      b += rotl(f, MD5_SHIFT[i / 16 * 4 + i % 4]);
+    }
+    state_[0] += a;
+    state_[1] += b;
+    state_[2] += c;
+    state_[3] += d;
+  }
+
+  std::string state() const {
+    std::string result;
+    for (auto v : state_)
+      for (int i = 0; i < 4; i++) result += static_cast<char>(v >> (8 * i));
+    return result;
+  }
+
+ private:
+  std::array<uint32_t, 4> state_ = {0x67452301, 0xefcdab89, 0x98badcfe,
+                                    0x10325476};
+};
+
+class Sha256 : public BlockHash<Sha256> {
+ public:
+  static constexpr bool BIG_ENDIAN_LENGTH = true;
+
+  void transform(const uint8_t* block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+      w[i] = static_cast<uint32_t>(block[4 * i]) << 24 |
+             static_cast<uint32_t>(block[4 * i + 1]) << 16 |
+             static_cast<uint32_t>(block[4 * i + 2]) << 8 |
+             static_cast<uint32_t>(block[4 * i + 3]);
+    for (int i = 16; i < 64; i++) {
+      auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    auto s = state_;
+    for (int i = 0; i < 64; i++) {
+      auto s1 = rotr(s[4], 6) ^ rotr(s[4], 11) ^ rotr(s[4], 25);
+      auto ch = (s[4] & s[5]) ^ (~s[4] & s[6]);
+      auto t1 = s[7] + s1 + ch + SHA256_K[i] + w[i];
+      auto s0 = rotr(s[0], 2) ^ rotr(s[0], 13) ^ rotr(s[0], 22);
+      auto maj = (s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]);
+      std::move_backward(s.begin(), s.end() - 1, s.end());
+      s[4] += t1;
+      s[0] = t1 + s0 + maj;
+    }
+    for (size_t i = 0; i < state_.size(); i++) state_[i] += s[i];
+  }
+
+  std::string state() const {
+    std::string result;
+    for (auto v : state_)
+      for (int i = 3; i >= 0; i--) result += static_cast<char>(v >> (8 * i));
+    return result;
+  }
+
+ private:
+  std::array<uint32_t, 8> state_ = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                    0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                    0x1f83d9ab, 0x5be0cd19};
+};
+
+class Md5Hasher : public IContentHasher {
+ public:
+  void update(const char* data, size_t length) override {
+    md5_.update(reinterpret_cast<const uint8_t*>(data), length);
+  }
+
+  std::string digest() const override { return hex(md5_.digest()); }
+
+ private:
+  Md5 md5_;
+};
+
+class DropboxHasher : public IContentHasher {
+ public:
+  void update(const char* data, size_t length) override {
+    while (length > 0) {
+      auto count = std::min<size_t>(length, DROPBOX_BLOCK_SIZE - block_size_);
+      block_.update(reinterpret_cast<const uint8_t*>(data), count);
+      block_size_ += count;
+      data += count;
+      length -= count;
+      if (block_size_ == DROPBOX_BLOCK_SIZE) {
+        auto hash = block_.digest();
+        hash_.update(reinterpret_cast<const uint8_t*>(hash.data()),
+                     hash.size());
+        block_ = Sha256();
+        block_size_ = 0;
+      }
+    }
+  }
+
+  std::string digest() const override {
+    auto hash = hash_;
+    if (block_size_ > 0) {
+      auto block = block_.digest();
+      hash.update(reinterpret_cast<const uint8_t*>(block.data()),
+                  block.size());
+    }
+    return hex(hash.digest());
+  }
+
+ private:
+  Sha256 hash_;
+  Sha256 block_;
+  size_t block_size_ = 0;
+};
+
+/**
+ * Port of the reference implementation of QuickXorHash: bytes are xored into
+ * a 160 bit cell, each one shifted 11 bits further than the previous one; the
+ * content length is xored into the last 8 bytes of the result.
+ */
+class QuickXorHasher : public IContentHasher {
+ public:
+  void update(const char* data, size_t length) override {
+    auto bytes = reinterpret_cast<const uint8_t*>(data);
+    auto index = shift_ / 64;
+    auto offset = shift_ % 64;
+    auto iterations = std::min<size_t>(length, QUICKXOR_WIDTH);
+    for (size_t i = 0; i < iterations; i++) {
+      bool last = index == cells_.size() - 1;
+      uint32_t bits = last ? QUICKXOR_WIDTH % 64 : 64;
+      if (offset <= bits - 8) {
+        for (auto j = i; j < length; j += QUICKXOR_WIDTH)
+          cells_[index] ^= static_cast<uint64_t>(bytes[j]) << offset;
+      } else {
+        uint8_t value = 0;
+        for (auto j = i; j < length; j += QUICKXOR_WIDTH) value ^= bytes[j];
+        cells_[index] ^= static_cast<uint64_t>(value) << offset;
+        cells_[last ? 0 : index + 1] ^=
+            static_cast<uint64_t>(value) >> (bits - offset);
+      }
+      offset += QUICKXOR_SHIFT;
+      while (offset >= bits) {
+        index = last ? 0 : index + 1;
+        offset -= bits;
+      }
+    }
+    shift_ = static_cast<uint32_t>(
+        (shift_ + QUICKXOR_SHIFT * (length % QUICKXOR_WIDTH)) %
+        QUICKXOR_WIDTH);
+    length_ += length;
+  }
+
+  std::string digest() const override {
+    std::string result(QUICKXOR_WIDTH / 8, 0);
+    for (size_t i = 0; i < result.size(); i++)
+      result[i] = static_cast<char>(cells_[i / 8] >> (8 * (i % 8)));
+    for (size_t i = 0; i < 8; i++)
+      result[result.size() - 8 + i] ^= static_cast<char>(length_ >> (8 * i));
+    return util::to_base64(result);
+  }
+
+ private:
+  std::array<uint64_t, (QUICKXOR_WIDTH - 1) / 64 + 1> cells_ = {};
+  uint32_t shift_ = 0;
+  uint64_t length_ = 0;
+};
+
+}  // namespace
+
+IContentHasher::Pointer IContentHasher::create(IItem::HashType type) {
+  switch (type) {
+    case IItem::HashType::MD5:
+      return util::make_unique<Md5Hasher>();
+    case IItem::HashType::Dropbox:
+      return util::make_unique<DropboxHasher>();
+    case IItem::HashType::QuickXor:
+      return util::make_unique<QuickXorHasher>();
+    default:
+      return nullptr;
+  }
+}
+
+}  // namespace cloudstorage
@@ -25,8 +25,10 @@
 
 #include "CurlHttp.h"
 
+#include <algorithm>
 #include <array>
 #include <cstring>
+#include <limits>
 #include <sstream>
 
 #include "IRequest.h"
@@ -36,25 +38,62 @@
 #include <jni.h>
 #endif
 
+#if LIBCURL_VERSION_NUM >= 0x074400
+#define HAVE_CURL_MULTI_POLL
+#endif
+
 const uint32_t MAX_URL_LENGTH = 1024;
+// Upper bound on how long the worker sleeps while transfers are in flight;
+// keeps pause / abort checks in progress_callback responsive.
 const uint32_t POLL_TIMEOUT = 100;
+// Paused requests are resumed only by the worker, which polls for that.
+const uint32_t PAUSED_POLL_TIMEOUT = 5;
+// A host's requests leave its own worker only once that worker has this many
+// more requests in flight than the least loaded one.
+const uint32_t MAX_AFFINITY_IMBALANCE = 4;
+// Token bucket holds at most this many milliseconds worth of its rate, but
+// never less than what a single write callback may deliver.
+const uint32_t BURST_DURATION = 100;
+const uint64_t MIN_BURST = CURL_MAX_WRITE_SIZE;
+// Achieved rate is measured over windows of this many milliseconds.
+const uint32_t RATE_WINDOW = 1000;
+// Time to the first byte of the response includes sending the request body;
+// only requests with bodies up to this size are taken as latency samples.
+const uint64_t MAX_LATENCY_SAMPLE_BODY = 64 * 1024;
+// Weight of the previous latency estimate when a new sample comes in.
+const int64_t LATENCY_HISTORY_WEIGHT = 7;
+// HTTP/2 stream weights of priority classes; curl's default is 16.
+const long STREAM_WEIGHT[] = {256, 64, 16};
 
 namespace cloudstorage {
 
 IHttp::Pointer IHttp::create() { return util::make_unique<curl::CurlHttp>(); }
 
+IHttp::Pointer IHttp::create(const InitData& data) {
+  return util::make_unique<curl::CurlHttp>(data);
+}
+
 namespace curl {
 
 namespace {
 
 size_t write_callback(char* ptr, size_t size, size_t nmemb, void* userdata) {
   auto data = static_cast<RequestData*>(userdata);
+  if (data->callback_ && data->callback_->pause()) {
+    data->paused_ = true;
+    return CURL_WRITEFUNC_PAUSE;
+  }
+  if (data->available(false, size * nmemb) == 0) {
+    data->download_throttled_ = true;
+    return CURL_WRITEFUNC_PAUSE;
+  }
+  data->consume(false, size * nmemb);
   if (!data->http_code_)
     curl_easy_getinfo(data->handle_.get(), CURLINFO_RESPONSE_CODE,
                       &data->http_code_);
   if (!data->error_stream_ ||
       data->callback_->isSuccess(static_cast<int>(data->http_code_),
-                                 data->response_headers_)) {
+                                 data->responseHeaders())) {
     auto range_it = data->query_headers_.find("Range");
     if (range_it != data->query_headers_.end() &&
         data->http_code_ != IHttpRequest::Partial) {
@@ -76,29 +115,45 @@ size_t write_callback(char* ptr, size_t size, size_t nmemb, void* userdata) {
 size_t read_callback(char* buffer, size_t size, size_t nmemb, void* userdata) {
   auto data = static_cast<RequestData*>(userdata);
   auto stream = data->data_.get();
-  stream->read(buffer, size * nmemb);
+  auto length = data->available(true, size * nmemb);
+  if (length == 0) {
+    data->upload_throttled_ = true;
+    return CURL_READFUNC_PAUSE;
+  }
+  auto pause_count = data->callback_ ? data->callback_->pauseCount() : 0;
+  stream->read(buffer, static_cast<std::streamsize>(length));
+  // The stream may have paused the request while reading and got resumed
+  // before the check below; the read was still cut short by the pause.
+  if (static_cast<uint64_t>(stream->gcount()) < length && data->callback_ &&
+      (data->callback_->pause() ||
+       data->callback_->pauseCount() != pause_count)) {
+    // The rest of the data isn't there yet, it's read again on resume.
+    stream->clear();
+    if (stream->gcount() == 0) {
+      data->paused_ = true;
+      return CURL_READFUNC_PAUSE;
+    }
+  }
+  data->consume(true, static_cast<uint64_t>(stream->gcount()));
   return stream->gcount();
 }
 
+bool is_space(char c) { return std::isspace(static_cast<unsigned char>(c)); }
+
 size_t header_callback(char* buffer, size_t size, size_t nitems,
                        void* userdata) {
-  auto header_data = static_cast<IHttpRequest::HeaderParameters*>(userdata);
-  std::string header(buffer, buffer + size * nitems);
-  auto pos = header.find_first_of(':');
-  const auto http_prefix = "HTTP/";
-  if (header.substr(0, strlen(http_prefix)) == http_prefix) {
-    header_data->clear();
-  }
-  if (pos != std::string::npos) {
-    auto header_name = header.substr(0, pos);
-    for (auto&& c : header_name) c = std::tolower(c);
-    std::stringstream stream(header.substr(pos + 1));
-    std::string header_value, token;
-    while (stream >> token) header_value += token + " ";
-    header_data->insert(
-        {header_name, header_value.substr(0, header_value.size() - 1)});
+  auto data = static_cast<RequestData*>(userdata);
+  auto length = size * nitems;
+  const char http_prefix[] = "HTTP/";
+  if (length >= strlen(http_prefix) &&
+      memcmp(buffer, http_prefix, strlen(http_prefix)) == 0) {
+    data->response_table_.clear();
+    data->response_headers_valid_ = false;
+  } else if (!std::all_of(buffer, buffer + length, is_space)) {
+    data->response_table_.add(buffer, length);
+    data->response_headers_valid_ = false;
   }
-  return size * nitems;
+  return length;
 }
 
 int progress_callback(void* clientp, curl_off_t dltotal, curl_off_t dlnow,
@@ -112,15 +167,73 @@ int progress_callback(void* clientp, curl_off_t dltotal, curl_off_t dlnow,
     if (dltotal != 0)
       callback->progressDownload(static_cast<uint64_t>(dltotal),
                                  static_cast<uint64_t>(dlnow));
-    if (callback->pause())
+    if (callback->pause()) {
       curl_easy_pause(data->handle_.get(), CURLPAUSE_ALL);
-    else
-      curl_easy_pause(data->handle_.get(), CURLPAUSE_CONT);
+      data->paused_ = true;
+    }
+    if (!data->bandwidth_.empty()) {
+      auto limit = callback->bandwidthLimit();
+      auto& own = data->bandwidth_.back();
+      own->download_.setRate(limit.download_);
+      own->upload_.setRate(limit.upload_);
+    }
     if (callback->abort()) return 1;
   }
   return 0;
 }
 
+uint64_t wire_bytes(CURL* handle) {
+#if LIBCURL_VERSION_NUM >= 0x073700
+  curl_off_t size = 0;
+  curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &size);
+#else
+  double size = 0;
+  curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD, &size);
+#endif
+  return static_cast<uint64_t>(size);
+}
+
+std::chrono::microseconds response_latency(CURL* handle) {
+#if LIBCURL_VERSION_NUM >= 0x073d00
+  curl_off_t uploaded = 0, pretransfer = 0, start = 0;
+  curl_easy_getinfo(handle, CURLINFO_SIZE_UPLOAD_T, &uploaded);
+  curl_easy_getinfo(handle, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+  curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &start);
+  if (static_cast<uint64_t>(uploaded) > MAX_LATENCY_SAMPLE_BODY ||
+      start <= pretransfer)
+    return std::chrono::microseconds::zero();
+  return std::chrono::microseconds(start - pretransfer);
+#else
+  double uploaded = 0, pretransfer = 0, start = 0;
+  curl_easy_getinfo(handle, CURLINFO_SIZE_UPLOAD, &uploaded);
+  curl_easy_getinfo(handle, CURLINFO_PRETRANSFER_TIME, &pretransfer);
+  curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME, &start);
+  if (uploaded > MAX_LATENCY_SAMPLE_BODY || start <= pretransfer)
+    return std::chrono::microseconds::zero();
+  return std::chrono::microseconds(
+      static_cast<int64_t>((start - pretransfer) * 1000000));
+#endif
+}
+
+bool has_header(const IHttpRequest::HeaderParameters& headers,
+                const std::string& name) {
+  return std::any_of(headers.begin(), headers.end(), [&](const auto& h) {
+    return h.first.size() == name.size() &&
+           std::equal(name.begin(), name.end(), h.first.begin(),
+                      [](char a, char b) {
+                        return std::tolower(static_cast<unsigned char>(a)) ==
+                               std::tolower(static_cast<unsigned char>(b));
+                      });
+  });
+}
+
+std::string host(const std::string& url) {
+  auto begin = url.find("://");
+  begin = begin == std::string::npos ? 0 : begin + 3;
+  auto end = url.find_first_of("/?#", begin);
+  return url.substr(begin, end == std::string::npos ? end : end - begin);
+}
+
 std::ios::pos_type stream_length(std::istream& data) {
   data.seekg(0, data.end);
   std::ios::pos_type length = data.tellg();
@@ -130,33 +243,310 @@ std::ios::pos_type stream_length(std::istream& data) {
 
 }  // namespace
 
-CurlHttp::Worker::Worker() : done_(), thread_(std::bind(&Worker::work, this)) {}
+TokenBucket::TokenBucket()
+    : rate_(),
+      tokens_(),
+      refill_time_(Clock::now()),
+      window_start_(refill_time_),
+      window_bytes_(),
+      achieved_rate_() {}
+
+void TokenBucket::setRate(uint64_t rate, Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (rate == rate_) return;
+  refill(now);
+  if (rate_ == 0) tokens_ = std::numeric_limits<double>::max();
+  rate_ = rate;
+  tokens_ = std::min(tokens_, capacity());
+}
+
+uint64_t TokenBucket::rate() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return rate_;
+}
+
+uint64_t TokenBucket::available(uint64_t count, Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (rate_ == 0) return count;
+  refill(now);
+  if (tokens_ < 1) return 0;
+  return std::min(count, static_cast<uint64_t>(tokens_));
+}
+
+void TokenBucket::consume(uint64_t count, Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (rate_ != 0) {
+    refill(now);
+    tokens_ -= static_cast<double>(count);
+  }
+  measure(now);
+  window_bytes_ += count;
+}
+
+void TokenBucket::charge(uint64_t count, Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (rate_ != 0) {
+    refill(now);
+    tokens_ = std::max(tokens_ - static_cast<double>(count), -capacity());
+  }
+  measure(now);
+  window_bytes_ += count;
+}
+
+TokenBucket::Clock::duration TokenBucket::delay(Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (rate_ == 0) return Clock::duration::zero();
+  refill(now);
+  if (tokens_ >= 1) return Clock::duration::zero();
+  return std::chrono::ceil<Clock::duration>(
+      std::chrono::duration<double>((1 - tokens_) / rate_));
+}
+
+uint64_t TokenBucket::achievedRate(Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  measure(now);
+  return achieved_rate_;
+}
+
+double TokenBucket::capacity() const {
+  return std::max(static_cast<double>(rate_) * BURST_DURATION / 1000,
+                  static_cast<double>(MIN_BURST));
+}
+
+void TokenBucket::refill(Clock::time_point now) {
+  if (now <= refill_time_) return;
+  std::chrono::duration<double> elapsed = now - refill_time_;
+  tokens_ = std::min(tokens_ + elapsed.count() * rate_, capacity());
+  refill_time_ = now;
+}
+
+void TokenBucket::measure(Clock::time_point now) {
+  std::chrono::duration<double> elapsed = now - window_start_;
+  if (elapsed < std::chrono::milliseconds(RATE_WINDOW)) return;
+  achieved_rate_ = static_cast<uint64_t>(window_bytes_ / elapsed.count());
+  window_start_ = now;
+  window_bytes_ = 0;
+}
+
+LatencyEstimate::LatencyEstimate() : value_() {}
+
+void LatencyEstimate::add(std::chrono::microseconds sample) {
+  auto current = value_.load();
+  int64_t next;
+  do {
+    next = current == 0 ? sample.count()
+                        : (current * LATENCY_HISTORY_WEIGHT + sample.count()) /
+                              (LATENCY_HISTORY_WEIGHT + 1);
+  } while (!value_.compare_exchange_weak(current, next));
+}
+
+std::chrono::microseconds LatencyEstimate::value() const {
+  return std::chrono::microseconds(value_.load());
+}
+
+BandwidthScheduler::BandwidthScheduler(const IHttp::InitData& data)
+    : unreserved_(100), foreground_() {
+  for (size_t i = 0; i < IHttpRequest::PriorityCount; i++)
+    if (i != static_cast<size_t>(IHttpRequest::Priority::Bulk))
+      unreserved_ -= std::min(unreserved_,
+                              data.priority_classes_[i].reserved_bandwidth_);
+  unreserved_ = std::max<uint32_t>(unreserved_, 1);
+  setLimit("", data.bandwidth_limit_);
+}
+
+std::shared_ptr<BandwidthScheduler::Group> BandwidthScheduler::group(
+    const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& group = groups_[name];
+  if (!group) group = std::make_shared<Group>();
+  return group;
+}
+
+void BandwidthScheduler::setLimit(const std::string& name,
+                                  const IHttp::Bandwidth& limit) {
+  auto buckets = group(name);
+  buckets->download_.setRate(limit.download_);
+  buckets->upload_.setRate(limit.upload_);
+  if (!name.empty() || unreserved_ == 100) return;
+  bulk_.download_.setRate(limit.download_ * unreserved_ / 100);
+  bulk_.upload_.setRate(limit.upload_ * unreserved_ / 100);
+}
+
+BandwidthScheduler::Group& BandwidthScheduler::bulk() { return bulk_; }
+
+bool BandwidthScheduler::contended() const { return foreground_ > 0; }
+
+void BandwidthScheduler::started(IHttpRequest::Priority priority) {
+  if (priority != IHttpRequest::Priority::Bulk) foreground_++;
+}
+
+void BandwidthScheduler::finished(IHttpRequest::Priority priority) {
+  if (priority != IHttpRequest::Priority::Bulk) foreground_--;
+}
+
+AdmissionQueue::AdmissionQueue(const IHttp::InitData& data) : running_() {
+  for (size_t i = 0; i < IHttpRequest::PriorityCount; i++)
+    max_running_[i] = data.priority_classes_[i].max_running_;
+}
+
+bool AdmissionQueue::empty() const {
+  return std::all_of(queued_.begin(), queued_.end(),
+                     [](const auto& q) { return q.empty(); });
+}
+
+void AdmissionQueue::push(RequestData::Pointer r) {
+  queued_[static_cast<size_t>(r->priority_)].push_back(std::move(r));
+}
+
+std::vector<RequestData::Pointer> AdmissionQueue::admit() {
+  std::vector<RequestData::Pointer> result;
+  for (size_t i = 0; i < IHttpRequest::PriorityCount; i++) {
+    auto& queue = queued_[i];
+    while (!queue.empty() &&
+           (max_running_[i] == 0 || running_[i] < max_running_[i])) {
+      result.push_back(std::move(queue.front()));
+      queue.pop_front();
+      running_[i]++;
+    }
+  }
+  return result;
+}
+
+void AdmissionQueue::finished(IHttpRequest::Priority priority) {
+  running_[static_cast<size_t>(priority)]--;
+}
+
+HeaderTable::HeaderTable() {
+  buffer_.reserve(1024);
+  entries_.reserve(16);
+}
+
+void HeaderTable::clear() {
+  buffer_.clear();
+  entries_.clear();
+}
+
+void HeaderTable::add(const char* line, size_t length) {
+  auto colon = static_cast<const char*>(memchr(line, ':', length));
+  if (!colon) return;
+  auto end = line + length;
+  Entry entry;
+  entry.name_ = static_cast<uint32_t>(buffer_.size());
+  for (auto it = line; it != colon; it++)
+    buffer_ += static_cast<char>(std::tolower(static_cast<unsigned char>(*it)));
+  entry.name_length_ = static_cast<uint32_t>(colon - line);
+  entry.value_ = static_cast<uint32_t>(buffer_.size());
+  bool space = false;
+  for (auto it = colon + 1; it != end; it++) {
+    if (is_space(*it)) {
+      space = true;
+    } else {
+      if (space && buffer_.size() != entry.value_) buffer_ += ' ';
+      buffer_ += *it;
+      space = false;
+    }
+  }
+  entry.value_length_ = static_cast<uint32_t>(buffer_.size() - entry.value_);
+  entries_.push_back(entry);
+}
+
+void HeaderTable::get(IHttpRequest::HeaderParameters& headers) const {
+  headers.clear();
+  headers.reserve(entries_.size());
+  for (auto&& e : entries_)
+    headers.emplace(std::string(buffer_, e.name_, e.name_length_),
+                    std::string(buffer_, e.value_, e.value_length_));
+}
+
+ConnectionPool::ConnectionPool(uint32_t idle_handle_count)
+    : share_(curl_share_init()), idle_handle_count_(idle_handle_count) {
+  curl_share_setopt(share_.get(), CURLSHOPT_LOCKFUNC, lock);
+  curl_share_setopt(share_.get(), CURLSHOPT_UNLOCKFUNC, unlock);
+  curl_share_setopt(share_.get(), CURLSHOPT_USERDATA, this);
+  curl_share_setopt(share_.get(), CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share_.get(), CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+std::unique_ptr<CURL, CurlDeleter> ConnectionPool::acquire() {
+  std::unique_ptr<CURL, CurlDeleter> handle;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!idle_handles_.empty()) {
+      handle = std::move(idle_handles_.back());
+      idle_handles_.pop_back();
+    }
+  }
+  if (!handle) handle.reset(curl_easy_init());
+  curl_easy_setopt(handle.get(), CURLOPT_SHARE, share_.get());
+  return handle;
+}
+
+void ConnectionPool::release(std::unique_ptr<CURL, CurlDeleter> handle) {
+  curl_easy_reset(handle.get());
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (idle_handles_.size() < idle_handle_count_)
+    idle_handles_.push_back(std::move(handle));
+}
+
+void ConnectionPool::lock(CURL*, curl_lock_data data, curl_lock_access,
+                          void* userdata) {
+  static_cast<ConnectionPool*>(userdata)->share_mutex_[data].lock();
+}
+
+void ConnectionPool::unlock(CURL*, curl_lock_data data, void* userdata) {
+  static_cast<ConnectionPool*>(userdata)->share_mutex_[data].unlock();
+}
+
+CurlHttp::Worker::Worker(const InitData& data,
+                         std::shared_ptr<ConnectionPool> pool,
+                         std::shared_ptr<BandwidthScheduler> bandwidth)
+    : done_(),
+      queue_depth_(),
+      wire_bytes_(),
+      decoded_bytes_(),
+      compression_(data.compression_),
+      admission_(data),
+      pool_(std::move(pool)),
+      bandwidth_(std::move(bandwidth)),
+      handle_(curl_multi_init()) {
+  curl_multi_setopt(handle_.get(), CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  curl_multi_setopt(handle_.get(), CURLMOPT_MAX_HOST_CONNECTIONS,
+                    static_cast<long>(data.max_host_connections_));
+  curl_multi_setopt(handle_.get(), CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                    static_cast<long>(data.max_total_connections_));
+  thread_ = std::thread(std::bind(&Worker::work, this));
+}
 
 CurlHttp::Worker::~Worker() {
-  done_ = true;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    done_ = true;
+  }
   nonempty_.notify_one();
+#ifdef HAVE_CURL_MULTI_POLL
+  curl_multi_wakeup(handle_.get());
+#endif
   thread_.join();
 }
 
 void CurlHttp::Worker::work() {
   util::set_thread_name("cs-curl");
   util::attach_thread();
-  auto handle = curl_multi_init();
-  while (!done_ || !pending_.empty()) {
+  auto handle = handle_.get();
+  while (true) {
     std::unique_lock<std::mutex> lock(lock_);
-    nonempty_.wait(lock, [this] {
-      return done_ || !requests_.empty() || !pending_.empty();
-    });
+    if (pending_.empty() && admission_.empty())
+      nonempty_.wait(lock, [this] { return done_ || !requests_.empty(); });
+    if (done_ && requests_.empty() && pending_.empty() && admission_.empty())
+      break;
     auto requests = util::exchange(requests_, {});
     lock.unlock();
-    for (auto&& r : requests) {
+    for (auto&& r : requests) admission_.push(std::move(r));
+    for (auto&& r : admission_.admit()) {
+      bandwidth_->started(r->priority_);
       curl_multi_add_handle(handle, r->handle_.get());
       pending_[r->handle_.get()] = std::move(r);
     }
-    int rc;
-    curl_multi_wait(handle, nullptr, 0, POLL_TIMEOUT, &rc);
-    if (rc == 0)
-      std::this_thread::sleep_for(std::chrono::milliseconds(POLL_TIMEOUT));
     int running_handles = 0;
     curl_multi_perform(handle, &running_handles);
     CURLMsg* msg;
@@ -167,21 +557,74 @@ void CurlHttp::Worker::work() {
         auto easy_handle = msg->easy_handle;
         curl_multi_remove_handle(handle, easy_handle);
         auto it = pending_.find(easy_handle);
+        wire_bytes_ += wire_bytes(easy_handle);
+        auto sample = response_latency(easy_handle);
+        if (msg->data.result == CURLE_OK && sample.count() > 0)
+          for (auto&& group : it->second->bandwidth_)
+            group->latency_.add(sample);
+        decoded_bytes_ += it->second->received_bytes_;
+        queue_depth_--;
+        admission_.finished(it->second->priority_);
+        bandwidth_->finished(it->second->priority_);
         it->second->done(msg->data.result);
+        pool_->release(std::move(it->second->handle_));
         pending_.erase(it);
       }
     } while (msg);
+    if (pending_.empty()) continue;
+    auto timeout = std::chrono::milliseconds(POLL_TIMEOUT);
+    bool resumed = false;
+    for (auto&& p : pending_) {
+      auto r = p.second.get();
+      if (r->callback_ && r->callback_->pause()) {
+        if (r->paused_)
+          timeout = std::min(timeout,
+                             std::chrono::milliseconds(PAUSED_POLL_TIMEOUT));
+        continue;
+      }
+      // Unpausing from within the callbacks doesn't get curl to read the
+      // upload data again, so paused requests are resumed from here.
+      if (r->paused_ && !r->throttled()) {
+        r->paused_ = false;
+        curl_easy_pause(p.first, CURLPAUSE_CONT);
+        resumed = true;
+      }
+      r->paused_ = false;
+      if (!r->throttled()) continue;
+      auto delay = r->delay();
+      if (delay == TokenBucket::Clock::duration::zero()) {
+        r->download_throttled_ = r->upload_throttled_ = false;
+        curl_easy_pause(p.first, CURLPAUSE_CONT);
+        resumed = true;
+      } else {
+        timeout = std::min(
+            timeout, std::chrono::ceil<std::chrono::milliseconds>(delay));
+      }
+    }
+    if (resumed) continue;
+#ifdef HAVE_CURL_MULTI_POLL
+    curl_multi_poll(handle, nullptr, 0, static_cast<int>(timeout.count()),
+                    nullptr);
+#else
+    int rc;
+    curl_multi_wait(handle, nullptr, 0, static_cast<int>(timeout.count()),
+                    &rc);
+    if (rc == 0) std::this_thread::sleep_for(timeout);
+#endif
   }
-  curl_multi_cleanup(handle);
   util::detach_thread();
 }
 
 void CurlHttp::Worker::add(RequestData::Pointer r) {
+  queue_depth_++;
   {
     std::lock_guard<std::mutex> lock(lock_);
     requests_.push_back(std::move(r));
   }
   nonempty_.notify_all();
+#ifdef HAVE_CURL_MULTI_POLL
+  curl_multi_wakeup(handle_.get());
+#endif
 }
 
 void RequestData::done(int code) {
@@ -200,7 +643,55 @@ void RequestData::done(int code) {
     *error_stream_ << curl_easy_strerror(static_cast<CURLcode>(code));
     ret = (code == CURLE_ABORTED_BY_CALLBACK) ? IHttpRequest::Aborted : -code;
   }
-  complete_({ret, response_headers_, stream_, error_stream_});
+  complete_({ret, responseHeaders(), stream_, error_stream_});
+}
+
+const IHttpRequest::HeaderParameters& RequestData::responseHeaders() {
+  if (!response_headers_valid_) {
+    response_table_.get(response_headers_);
+    response_headers_valid_ = true;
+  }
+  return response_headers_;
+}
+
+bool RequestData::throttled() const {
+  return download_throttled_ || upload_throttled_;
+}
+
+uint64_t RequestData::available(bool upload, uint64_t count) const {
+  for (auto&& group : bandwidth_) {
+    if (count == 0) break;
+    count = (upload ? group->upload_ : group->download_).available(count);
+  }
+  if (count != 0 && scheduler_ && scheduler_->contended()) {
+    auto& bulk = scheduler_->bulk();
+    count = (upload ? bulk.upload_ : bulk.download_).available(count);
+  }
+  return count;
+}
+
+void RequestData::consume(bool upload, uint64_t count) const {
+  for (auto&& group : bandwidth_)
+    (upload ? group->upload_ : group->download_).consume(count);
+  // Charged even when uncontended, so that bulk transfers which took all
+  // of the bandwidth back off as soon as other requests start; the debt is
+  // bounded, so they don't stall for longer than a burst.
+  if (scheduler_) {
+    auto& bulk = scheduler_->bulk();
+    (upload ? bulk.upload_ : bulk.download_).charge(count);
+  }
+}
+
+TokenBucket::Clock::duration RequestData::delay() const {
+  auto result = TokenBucket::Clock::duration::zero();
+  auto delay = [&](BandwidthScheduler::Group& group) {
+    if (download_throttled_)
+      result = std::max(result, group.download_.delay());
+    if (upload_throttled_) result = std::max(result, group.upload_.delay());
+  };
+  for (auto&& group : bandwidth_) delay(*group);
+  if (scheduler_ && scheduler_->contended()) delay(scheduler_->bulk());
+  return result;
 }
 
 CurlHttpRequest::CurlHttpRequest(std::string url, std::string method,
@@ -209,10 +700,11 @@ CurlHttpRequest::CurlHttpRequest(std::string url, std::string method,
     : url_(std::move(url)),
       method_(std::move(method)),
       follow_redirect_(follow_redirect),
+      priority_(Priority::Metadata),
       worker_(std::move(worker)) {}
 
 std::unique_ptr<CURL, CurlDeleter> CurlHttpRequest::init() const {
-  std::unique_ptr<CURL, CurlDeleter> handle(curl_easy_init());
+  auto handle = worker_->pool_->acquire();
   curl_easy_setopt(handle.get(), CURLOPT_WRITEFUNCTION, write_callback);
   curl_easy_setopt(handle.get(), CURLOPT_READFUNCTION, read_callback);
   curl_easy_setopt(handle.get(), CURLOPT_HEADERFUNCTION, header_callback);
@@ -222,6 +714,11 @@ std::unique_ptr<CURL, CurlDeleter> CurlHttpRequest::init() const {
                    static_cast<long>(follow_redirect_));
   curl_easy_setopt(handle.get(), CURLOPT_XFERINFOFUNCTION, progress_callback);
   curl_easy_setopt(handle.get(), CURLOPT_NOPROGRESS, static_cast<long>(false));
+  curl_easy_setopt(handle.get(), CURLOPT_TCP_KEEPALIVE,
+                   static_cast<long>(true));
+  curl_easy_setopt(handle.get(), CURLOPT_HTTP_VERSION,
+                   static_cast<long>(CURL_HTTP_VERSION_2TLS));
+  curl_easy_setopt(handle.get(), CURLOPT_PIPEWAIT, static_cast<long>(true));
   std::string parameters = parametersToString();
   std::string url = url_ + (!parameters.empty() ? ("?" + parameters) : "");
   curl_easy_setopt(handle.get(), CURLOPT_URL, url.c_str());
@@ -238,6 +735,12 @@ void CurlHttpRequest::setHeaderParameter(const std::string& parameter,
   header_parameters_.insert({parameter, value});
 }
 
+void CurlHttpRequest::setBandwidthGroup(const std::string& group) {
+  bandwidth_group_ = group;
+}
+
+void CurlHttpRequest::setPriority(Priority priority) { priority_ = priority; }
+
 const IHttpRequest::GetParameters& CurlHttpRequest::parameters() const {
   return parameters_;
 }
@@ -263,6 +766,7 @@ RequestData::Pointer CurlHttpRequest::prepare(
                                                  headerParametersToList(),
                                                  headerParameters(),
                                                  {},
+                                                 {},
                                                  data,
                                                  std::move(response),
                                                  std::move(error_stream),
@@ -271,12 +775,39 @@ RequestData::Pointer CurlHttpRequest::prepare(
                                                  follow_redirect(),
                                                  0,
                                                  0});
+  // Local files don't go over the network; curl can't pause their transfers
+  // anyway.
+  auto& bandwidth = cb_data->bandwidth_;
+  if (url_.compare(0, strlen("file://"), "file://") != 0) {
+    bandwidth.push_back(worker_->bandwidth_->group(""));
+    if (!bandwidth_group_.empty())
+      bandwidth.push_back(worker_->bandwidth_->group(bandwidth_group_));
+    if (priority_ == Priority::Bulk) cb_data->scheduler_ = worker_->bandwidth_;
+  }
+  cb_data->priority_ = priority_;
+  if (callback && !bandwidth.empty()) {
+    auto limit = callback->bandwidthLimit();
+    auto own = std::make_shared<BandwidthScheduler::Group>();
+    own->download_.setRate(limit.download_);
+    own->upload_.setRate(limit.upload_);
+    bandwidth.push_back(own);
+  }
   auto handle = cb_data->handle_.get();
+  curl_easy_setopt(handle, CURLOPT_STREAM_WEIGHT,
+                   STREAM_WEIGHT[static_cast<size_t>(priority_)]);
   curl_easy_setopt(handle, CURLOPT_WRITEDATA, cb_data.get());
   curl_easy_setopt(handle, CURLOPT_XFERINFODATA, cb_data.get());
-  curl_easy_setopt(handle, CURLOPT_HEADERDATA, &cb_data->response_headers_);
+  curl_easy_setopt(handle, CURLOPT_HEADERDATA, cb_data.get());
   curl_easy_setopt(handle, CURLOPT_READDATA, cb_data.get());
   curl_easy_setopt(handle, CURLOPT_HTTPHEADER, cb_data->headers_.get());
+  // Empty string lets curl offer every encoding it was built with. Only
+  // metadata is compressed: ranges address bytes of the unencoded content, and
+  // sizes of files are taken from content-length of HEAD requests and
+  // downloads, which would become the size on the wire.
+  if (worker_->compression_ && priority_ == Priority::Metadata &&
+      method_ != "HEAD" && !has_header(header_parameters_, "Range") &&
+      !has_header(header_parameters_, "Accept-Encoding"))
+    curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, "");
   if (method_ == "POST") {
     curl_easy_setopt(handle, CURLOPT_POST, static_cast<long>(true));
     curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE,
@@ -333,13 +864,71 @@ void CurlListDeleter::operator()(curl_slist* lst) const {
   curl_slist_free_all(lst);
 }
 
-CurlHttp::CurlHttp() : worker_(std::make_shared<Worker>()) {}
+void CurlMultiDeleter::operator()(CURLM* handle) const {
+  curl_multi_cleanup(handle);
+}
+
+void CurlShareDeleter::operator()(CURLSH* handle) const {
+  curl_share_cleanup(handle);
+}
+
+CurlHttp::CurlHttp(const InitData& data)
+    : bandwidth_(std::make_shared<BandwidthScheduler>(data)) {
+  auto pool = std::make_shared<ConnectionPool>(data.idle_handle_count_);
+  for (uint32_t i = 0; i < std::max<uint32_t>(data.worker_count_, 1); i++)
+    workers_.push_back(std::make_shared<Worker>(data, pool, bandwidth_));
+}
 
 IHttpRequest::Pointer CurlHttp::create(const std::string& url,
                                        const std::string& method,
                                        bool follow_redirect) const {
   return util::make_unique<CurlHttpRequest>(url, method, follow_redirect,
-                                            worker_);
+                                            worker(url));
+}
+
+std::vector<uint32_t> CurlHttp::queueDepth() const {
+  std::vector<uint32_t> result;
+  for (auto&& w : workers_) result.push_back(w->queue_depth_);
+  return result;
+}
+
+IHttp::Statistics CurlHttp::statistics() const {
+  Statistics result;
+  for (auto&& w : workers_) {
+    result.wire_bytes_ += w->wire_bytes_;
+    result.decoded_bytes_ += w->decoded_bytes_;
+  }
+  return result;
+}
+
+void CurlHttp::setBandwidthLimit(const std::string& group,
+                                 const Bandwidth& limit) {
+  bandwidth_->setLimit(group, limit);
+}
+
+IHttp::Bandwidth CurlHttp::bandwidth(const std::string& group) const {
+  auto buckets = bandwidth_->group(group);
+  return {buckets->download_.achievedRate(), buckets->upload_.achievedRate()};
+}
+
+std::chrono::milliseconds CurlHttp::latency(const std::string& group) const {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      bandwidth_->group(group)->latency_.value());
+}
+
+std::shared_ptr<CurlHttp::Worker> CurlHttp::worker(
+    const std::string& url) const {
+  if (workers_.size() == 1) return workers_.front();
+  auto& preferred =
+      workers_[std::hash<std::string>()(host(url)) % workers_.size()];
+  auto& least_loaded = *std::min_element(
+      workers_.begin(), workers_.end(), [](const auto& a, const auto& b) {
+        return a->queue_depth_ < b->queue_depth_;
+      });
+  if (preferred->queue_depth_ >
+      least_loaded->queue_depth_ + MAX_AFFINITY_IMBALANCE)
+    return least_loaded;
+  return preferred;
 }
 
 }  // namespace curl
@@ -352,6 +941,7 @@ IHttpRequest::Pointer CurlHttp::create(const std::string& url,
 
 namespace cloudstorage {
 IHttp::Pointer IHttp::create() { return nullptr; }
+IHttp::Pointer IHttp::create(const InitData&) { return nullptr; }
 }  // namespace cloudstorage
 
 #endif  // WITH_CURL
@@ -27,10 +27,14 @@
 #ifdef WITH_CURL
 
 #include <curl/curl.h>
+#include <array>
 #include <atomic>
 #include <cctype>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <unordered_map>
@@ -50,6 +54,158 @@ struct CurlListDeleter {
   void operator()(curl_slist*) const;
 };
 
+struct CurlMultiDeleter {
+  void operator()(CURLM*) const;
+};
+
+struct CurlShareDeleter {
+  void operator()(CURLSH*) const;
+};
+
+class ConnectionPool {
+ public:
+  explicit ConnectionPool(uint32_t idle_handle_count);
+
+  /**
+   * Returns a recycled easy handle if one is available, otherwise a fresh
+   * one; either way it is attached to the shared DNS / TLS session cache.
+   */
+  std::unique_ptr<CURL, CurlDeleter> acquire();
+  void release(std::unique_ptr<CURL, CurlDeleter>);
+
+ private:
+  static void lock(CURL*, curl_lock_data, curl_lock_access, void*);
+  static void unlock(CURL*, curl_lock_data, void*);
+
+  std::mutex share_mutex_[CURL_LOCK_DATA_LAST];
+  std::unique_ptr<CURLSH, CurlShareDeleter> share_;
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<CURL, CurlDeleter>> idle_handles_;
+  uint32_t idle_handle_count_;
+};
+
+/**
+ * Response headers kept in one buffer; names are lower cased and values have
+ * whitespace collapsed while being copied in, so adding a header line doesn't
+ * allocate once the buffer has grown to fit a typical response. Header
+ * parameters are built from it only for the response which is handed over.
+ */
+class HeaderTable {
+ public:
+  HeaderTable();
+
+  void clear();
+  void add(const char* line, size_t length);
+  void get(IHttpRequest::HeaderParameters&) const;
+
+ private:
+  struct Entry {
+    uint32_t name_;
+    uint32_t name_length_;
+    uint32_t value_;
+    uint32_t value_length_;
+  };
+
+  std::string buffer_;
+  std::vector<Entry> entries_;
+};
+
+/**
+ * Caps throughput to rate bytes per second, allowing bursts of a tenth of a
+ * second. Tokens may go negative: once curl has received data it can't take
+ * it back, so the debt is paid by waiting longer. Also measures the rate
+ * actually achieved, whether it is limited or not.
+ */
+class TokenBucket {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  TokenBucket();
+
+  void setRate(uint64_t rate, Clock::time_point now = Clock::now());
+  uint64_t rate() const;
+
+  /**
+   * @return count of bytes, at most count, which may be transferred now
+   */
+  uint64_t available(uint64_t count, Clock::time_point now = Clock::now());
+  void consume(uint64_t count, Clock::time_point now = Clock::now());
+
+  /**
+   * Like consume, but the debt is kept within capacity; for traffic which
+   * didn't wait for the bucket's tokens before it was transferred.
+   */
+  void charge(uint64_t count, Clock::time_point now = Clock::now());
+
+  /**
+   * @return time until available returns nonzero
+   */
+  Clock::duration delay(Clock::time_point now = Clock::now());
+
+  uint64_t achievedRate(Clock::time_point now = Clock::now());
+
+ private:
+  double capacity() const;
+  void refill(Clock::time_point now);
+  void measure(Clock::time_point now);
+
+  mutable std::mutex mutex_;
+  uint64_t rate_;
+  double tokens_;
+  Clock::time_point refill_time_;
+  Clock::time_point window_start_;
+  uint64_t window_bytes_;
+  uint64_t achieved_rate_;
+};
+
+/**
+ * Moving average of the time between sending a request and receiving the
+ * first byte of its response.
+ */
+class LatencyEstimate {
+ public:
+  LatencyEstimate();
+
+  void add(std::chrono::microseconds sample);
+  std::chrono::microseconds value() const;
+
+ private:
+  std::atomic<int64_t> value_;
+};
+
+/**
+ * Token buckets of named groups of requests; the group with empty name
+ * covers all requests. While interactive or metadata requests run, bulk
+ * transfers are additionally held to the share of the global limit which
+ * isn't reserved for them.
+ */
+class BandwidthScheduler {
+ public:
+  struct Group {
+    TokenBucket download_;
+    TokenBucket upload_;
+    LatencyEstimate latency_;
+  };
+
+  explicit BandwidthScheduler(const IHttp::InitData&);
+
+  std::shared_ptr<Group> group(const std::string& name);
+  void setLimit(const std::string& group, const IHttp::Bandwidth&);
+
+  Group& bulk();
+  bool contended() const;
+
+  void started(IHttpRequest::Priority);
+  void finished(IHttpRequest::Priority);
+
+ private:
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<Group>> groups_;
+  uint32_t unreserved_;
+  Group bulk_;
+  std::atomic<uint32_t> foreground_;
+};
+
 struct RequestData {
   using Pointer = std::unique_ptr<RequestData>;
 
@@ -57,6 +213,7 @@ struct RequestData {
   std::unique_ptr<curl_slist, CurlListDeleter> headers_;
   IHttpRequest::HeaderParameters query_headers_;
   IHttpRequest::HeaderParameters response_headers_;
+  HeaderTable response_table_;
   std::shared_ptr<std::istream> data_;
   std::shared_ptr<std::ostream> stream_;
   std::shared_ptr<std::ostream> error_stream_;
@@ -65,36 +222,98 @@ struct RequestData {
   bool follow_redirect_;
   long http_code_;
   uint64_t received_bytes_;
+  // Global bucket, bucket of the request's group and its own one.
+  std::vector<std::shared_ptr<BandwidthScheduler::Group>> bandwidth_ = {};
+  // Set for bulk transfers, which yield bandwidth to other requests.
+  std::shared_ptr<BandwidthScheduler> scheduler_ = nullptr;
+  // Whether curl was paused because a bucket ran out of tokens.
+  bool download_throttled_ = false;
+  bool upload_throttled_ = false;
+  // Whether curl was paused because the request was paused.
+  bool paused_ = false;
+  // Whether response_headers_ were built from current response_table_.
+  bool response_headers_valid_ = false;
+  IHttpRequest::Priority priority_ = IHttpRequest::Priority::Metadata;
 
   void done(int result);
+
+  const IHttpRequest::HeaderParameters& responseHeaders();
+
+  bool throttled() const;
+  uint64_t available(bool upload, uint64_t count) const;
+  void consume(bool upload, uint64_t count) const;
+  TokenBucket::Clock::duration delay() const;
+};
+
+/**
+ * Requests waiting to be handed to curl, one queue per priority class;
+ * higher classes are admitted first, each up to its limit of running
+ * requests.
+ */
+class AdmissionQueue {
+ public:
+  explicit AdmissionQueue(const IHttp::InitData&);
+
+  bool empty() const;
+  void push(RequestData::Pointer);
+
+  /**
+   * Removes requests which may start now from the queue.
+   */
+  std::vector<RequestData::Pointer> admit();
+  void finished(IHttpRequest::Priority);
+
+ private:
+  std::array<std::deque<RequestData::Pointer>, IHttpRequest::PriorityCount>
+      queued_;
+  std::array<uint32_t, IHttpRequest::PriorityCount> running_;
+  std::array<uint32_t, IHttpRequest::PriorityCount> max_running_;
 };
 
 class CurlHttp : public IHttp {
  public:
-  CurlHttp();
+  CurlHttp(const InitData& = {});
 
   IHttpRequest::Pointer create(const std::string&, const std::string&,
                                bool) const override;
 
+  std::vector<uint32_t> queueDepth() const override;
+  Statistics statistics() const override;
+  void setBandwidthLimit(const std::string& group, const Bandwidth&) override;
+  Bandwidth bandwidth(const std::string& group) const override;
+  std::chrono::milliseconds latency(const std::string& group) const override;
+
  private:
   friend class CurlHttpRequest;
 
   struct Worker {
-    Worker();
+    Worker(const InitData&, std::shared_ptr<ConnectionPool>,
+           std::shared_ptr<BandwidthScheduler>);
     ~Worker();
 
     void work();
     void add(RequestData::Pointer r);
 
     std::atomic_bool done_;
+    std::atomic<uint32_t> queue_depth_;
+    std::atomic<uint64_t> wire_bytes_;
+    std::atomic<uint64_t> decoded_bytes_;
+    bool compression_;
     std::condition_variable nonempty_;
     std::vector<RequestData::Pointer> requests_;
+    AdmissionQueue admission_;
     std::unordered_map<CURL*, RequestData::Pointer> pending_;
     std::mutex lock_;
+    std::shared_ptr<ConnectionPool> pool_;
+    std::shared_ptr<BandwidthScheduler> bandwidth_;
+    std::unique_ptr<CURLM, CurlMultiDeleter> handle_;
     std::thread thread_;
   };
 
-  std::shared_ptr<Worker> worker_;
+  std::shared_ptr<Worker> worker(const std::string& url) const;
+
+  std::shared_ptr<BandwidthScheduler> bandwidth_;
+  std::vector<std::shared_ptr<Worker>> workers_;
 };
 
 class CurlHttpRequest : public IHttpRequest,
@@ -108,6 +327,8 @@ class CurlHttpRequest : public IHttpRequest,
                     const std::string& value) override;
   void setHeaderParameter(const std::string& parameter,
                           const std::string& value) override;
+  void setBandwidthGroup(const std::string& group) override;
+  void setPriority(Priority) override;
 
   const GetParameters& parameters() const override;
   const HeaderParameters& headerParameters() const override;
@@ -137,6 +358,8 @@ class CurlHttpRequest : public IHttpRequest,
   HeaderParameters header_parameters_;
   std::string method_;
   bool follow_redirect_;
+  std::string bandwidth_group_;
+  Priority priority_;
   std::shared_ptr<CurlHttp::Worker> worker_;
 };
 
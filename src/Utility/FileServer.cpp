@@ -31,7 +31,10 @@
 
 namespace cloudstorage {
 
-const int CHUNK_SIZE = 8 * 1024 * 1024;
+// Streamed file is downloaded in ranges of chunk size; the next range is
+// requested when less than half of a chunk remains buffered.
+const IChunkSizer::Limits STREAM_CHUNK = {1024 * 1024, 64 * 1024 * 1024, 1,
+                                          8 * 1024 * 1024};
 const int CACHE_SIZE = 128;
 
 namespace {
@@ -96,8 +99,13 @@ class StreamRequest : public Request<EitherError<void>> {
 struct Buffer : public std::enable_shared_from_this<Buffer> {
   using Pointer = std::shared_ptr<Buffer>;
 
+  Buffer(IChunkSizer::IReservation::Pointer reservation)
+      : reservation_(std::move(reservation)) {}
+
+  uint64_t chunk_size() const { return reservation_->size(); }
+
   int read(char* buf, uint32_t max) {
-    if (2 * size() < CHUNK_SIZE) {
+    if (2 * size() < chunk_size()) {
       std::unique_lock<std::mutex> lock(delayed_mutex_);
       if (delayed_) {
         delayed_ = false;
@@ -146,10 +154,10 @@ struct Buffer : public std::enable_shared_from_this<Buffer> {
   }
 
   void continue_download(const EitherError<void>& e) {
-    if (e.left() || range_.size_ < CHUNK_SIZE) return done(e);
-    range_.size_ -= CHUNK_SIZE;
-    range_.start_ += CHUNK_SIZE;
-    if (2 * size() < CHUNK_SIZE)
+    if (e.left() || range_.size_ < chunk_size()) return done(e);
+    range_.size_ -= chunk_size();
+    range_.start_ += chunk_size();
+    if (2 * size() < chunk_size())
       run_download();
     else {
       std::unique_lock<std::mutex> lock(delayed_mutex_);
@@ -160,10 +168,12 @@ struct Buffer : public std::enable_shared_from_this<Buffer> {
   void run_download() {
     request_->make_subrequest(
         &CloudProvider::downloadFileRangeAsync, item_,
-        Range{range_.start_, std::min<uint64_t>(range_.size_, CHUNK_SIZE)},
+        Range{range_.start_, std::min<uint64_t>(range_.size_, chunk_size())},
         util::make_unique<HttpDataCallback>(shared_from_this()));
   }
 
+  // Memory of the buffered chunk and of the one being downloaded.
+  IChunkSizer::IReservation::Pointer reservation_;
   std::mutex mutex_;
   std::queue<char> data_;
   std::mutex response_mutex_;
@@ -230,7 +240,8 @@ class HttpData : public IHttpServer::IResponse::ICallback {
             r->make_subrequest(
                 &CloudProvider::downloadFileRangeAsync, e.right(),
                 Range{range.start_,
-                      std::min<uint64_t>(range.size_, CHUNK_SIZE)},
+                      std::min<uint64_t>(range.size_,
+                                         buffer_->chunk_size())},
                 util::make_unique<HttpDataCallback>(buffer_));
           }
         }
@@ -310,7 +321,8 @@ IHttpServer::IResponse::Pointer HttpServerCallback::handle(
       headers["Content-Range"] = stream.str();
       code = IHttpRequest::Partial;
     }
-    auto buffer = std::make_shared<Buffer>();
+    auto buffer = std::make_shared<Buffer>(provider_->chunkSizer()->reserve(
+        "stream", IChunkSizer::Direction::Download, STREAM_CHUNK, 2));
     auto data =
         util::make_unique<HttpData>(buffer, provider_, id, range, item_cache_);
     auto response =
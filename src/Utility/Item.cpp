@@ -65,7 +65,8 @@ Item::Item(std::string filename, std::string id, size_t size,
       timestamp_(timestamp),
       thumbnail_url_(),
       type_(type),
-      is_hidden_(false) {
+      is_hidden_(false),
+      content_hash_type_(HashType::Unknown) {
   if (type_ == IItem::FileType::Unknown)
     type_ = fromExtension(Item::extension());
 }
@@ -92,6 +93,15 @@ size_t Item::size() const { return size_; }
 
 void Item::set_size(size_t size) { size_ = size; }
 
+std::string Item::content_hash() const { return content_hash_; }
+
+IItem::HashType Item::content_hash_type() const { return content_hash_type_; }
+
+void Item::set_content_hash(HashType type, std::string hash) {
+  content_hash_type_ = hash.empty() ? HashType::Unknown : type;
+  content_hash_ = std::move(hash);
+}
+
 std::string Item::toString() const {
   Json::Value json;
   json["filename"] = filename();
@@ -109,6 +119,10 @@ std::string Item::toString() const {
   if (is_hidden()) json["hidden"] = is_hidden();
   if (!thumbnail_url().empty()) json["thumbnail_url"] = thumbnail_url();
   if (!url().empty()) json["url"] = url();
+  if (content_hash_type() != HashType::Unknown) {
+    json["content_hash"] = content_hash();
+    json["content_hash_type"] = static_cast<int>(content_hash_type());
+  }
   return util::json::to_string(json);
 }
 
@@ -123,6 +137,9 @@ IItem::Pointer IItem::fromString(const std::string& str) {
   item->set_hidden(json["hidden"].asBool());
   item->set_url(json["url"].asString());
   item->set_mime_type(json["mime_type"].asString());
+  item->set_content_hash(
+      static_cast<IItem::HashType>(json["content_hash_type"].asInt()),
+      json["content_hash"].asString());
   std::vector<std::string> parents;
   for (auto&& p : json["parents"]) parents.push_back(p.asString());
   item->set_parents(parents);
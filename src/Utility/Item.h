@@ -49,6 +49,10 @@ class CLOUDSTORAGE_API Item : public IItem {
   size_t size() const override;
   void set_size(size_t);
 
+  std::string content_hash() const override;
+  HashType content_hash_type() const override;
+  void set_content_hash(HashType, std::string);
+
   std::string toString() const override;
 
   std::string url() const;
@@ -84,6 +88,8 @@ class CLOUDSTORAGE_API Item : public IItem {
   bool is_hidden_;
   std::string mime_type_;
   std::vector<std::string> parents_;
+  HashType content_hash_type_;
+  std::string content_hash_;
 };
 
 }  // namespace cloudstorage
@@ -0,0 +1,226 @@
+/*****************************************************************************
+ * TransferJournal.cpp : TransferJournal implementation
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#include "TransferJournal.h"
+
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "Utility/Utility.h"
+
+namespace cloudstorage {
+
+namespace {
+
+int64_t now() {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace
+
+constexpr std::chrono::hours TransferJournal::MAX_AGE;
+constexpr uint32_t TransferJournal::FINGERPRINT_SIZE;
+
+std::shared_ptr<TransferJournal> TransferJournal::open(
+    const std::string& path) {
+  static std::mutex mutex;
+  static std::unordered_map<std::string, std::weak_ptr<TransferJournal>>
+      journals;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto journal = journals[path].lock();
+  if (!journal) {
+    journal = std::make_shared<TransferJournal>(path);
+    journals[path] = journal;
+  }
+  return journal;
+}
+
+std::string TransferJournal::key(const std::string& provider,
+                                 const std::string& id,
+                                 const std::string& filename,
+                                 IUploadFileCallback& callback) {
+  auto size = callback.size();
+  std::vector<char> buffer(std::min<uint64_t>(size, FINGERPRINT_SIZE));
+  auto read = callback.putData(buffer.data(),
+                               static_cast<uint32_t>(buffer.size()), 0);
+  std::stringstream stream;
+  stream << provider << "/" << id << "/" << filename << ":" << size << ":"
+         << std::hex << std::setw(16) << std::setfill('0')
+         << util::fnv1a(buffer.data(), read);
+  return stream.str();
+}
+
+TransferJournal::TransferJournal(const std::string& path) : path_(path) {
+  load();
+}
+
+bool TransferJournal::find(const std::string& key, Entry& entry,
+                           IUploadFileCallback& callback) {
+  uint64_t expected;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return false;
+    entry = it->second.entry_;
+    expected = it->second.checksum_;
+  }
+  bool valid = true;
+  if (checksum(callback, 0, entry.offset_, util::FNV1A_OFFSET_BASIS,
+               valid) == expected &&
+      valid)
+    return true;
+  // Source was modified since the range was committed.
+  remove(key);
+  return false;
+}
+
+void TransferJournal::put(const std::string& key, const Entry& entry,
+                          IUploadFileCallback& callback) {
+  uint64_t offset = 0, hash = util::FNV1A_OFFSET_BASIS;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it != entries_.end() && it->second.entry_.offset_ <= entry.offset_) {
+      offset = it->second.entry_.offset_;
+      hash = it->second.checksum_;
+    }
+  }
+  bool valid = true;
+  hash = checksum(callback, offset, entry.offset_, hash, valid);
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!valid) {
+    if (entries_.erase(key) == 0) return;
+    Json::Value json;
+    json["key"] = key;
+    json["removed"] = true;
+    return append(json);
+  }
+  auto& record = entries_[key];
+  record = Record{entry, now(), hash};
+  append(toJson(key, record));
+}
+
+void TransferJournal::remove(const std::string& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (entries_.erase(key) == 0) return;
+  Json::Value json;
+  json["key"] = key;
+  json["removed"] = true;
+  append(json);
+}
+
+uint64_t TransferJournal::checksum(IUploadFileCallback& callback,
+                                   uint64_t begin, uint64_t end, uint64_t hash,
+                                   bool& valid) {
+  std::vector<char> buffer(std::min<uint64_t>(end - begin, FINGERPRINT_SIZE));
+  while (begin < end) {
+    auto read = callback.putData(
+        buffer.data(),
+        static_cast<uint32_t>(std::min<uint64_t>(end - begin, buffer.size())),
+        begin);
+    if (read == 0) {
+      valid = false;
+      return hash;
+    }
+    hash = util::fnv1a(buffer.data(), read, hash);
+    begin += read;
+  }
+  return hash;
+}
+
+Json::Value TransferJournal::toJson(const std::string& key,
+                                    const Record& record) {
+  Json::Value json;
+  json["key"] = key;
+  json["session"] = record.entry_.session_;
+  json["offset"] = Json::UInt64(record.entry_.offset_);
+  json["time"] = Json::Int64(record.time_);
+  json["checksum"] = Json::UInt64(record.checksum_);
+  if (!record.entry_.data_.isNull()) json["data"] = record.entry_.data_;
+  return json;
+}
+
+void TransferJournal::load() {
+  std::ifstream file(path_);
+  std::string line;
+  auto expired = now() -
+                 std::chrono::duration_cast<std::chrono::seconds>(MAX_AGE)
+                     .count();
+  while (std::getline(file, line)) {
+    try {
+      auto json = util::json::from_string(line);
+      auto key = json["key"].asString();
+      if (json["removed"].asBool())
+        entries_.erase(key);
+      else
+        entries_[key] = Record{
+            Entry{json["session"].asString(), json["offset"].asUInt64(),
+                  json["data"]},
+            json["time"].asInt64(), json["checksum"].asUInt64()};
+    } catch (const Json::Exception&) {
+      // A record torn by a crash is as good as missing.
+    }
+  }
+  file.close();
+  for (auto it = entries_.begin(); it != entries_.end();)
+    if (it->second.time_ < expired)
+      it = entries_.erase(it);
+    else
+      ++it;
+  auto temporary = path_ + ".tmp";
+  if (auto compacted = fopen(temporary.c_str(), "wb")) {
+    for (auto&& e : entries_) {
+      auto line = util::json::to_string(toJson(e.first, e.second)) + "\n";
+      fwrite(line.data(), 1, line.size(), compacted);
+    }
+    // Contents have to reach the disk before the rename does, otherwise a
+    // crash may leave the journal empty.
+    bool written = fflush(compacted) == 0;
+#ifdef _WIN32
+    written = written && _commit(_fileno(compacted)) == 0;
+#else
+    written = written && ::fsync(fileno(compacted)) == 0;
+#endif
+    if (fclose(compacted) == 0 && written)
+      std::rename(temporary.c_str(), path_.c_str());
+    else
+      std::remove(temporary.c_str());
+  }
+  stream_.open(path_, std::ios::app);
+}
+
+void TransferJournal::append(const Json::Value& json) {
+  stream_ << util::json::to_string(json) << "\n";
+  stream_.flush();
+}
+
+}  // namespace cloudstorage
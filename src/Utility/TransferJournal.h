@@ -0,0 +1,112 @@
+/*****************************************************************************
+ * TransferJournal.h : persistent log of resumable transfers
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef TRANSFERJOURNAL_H
+#define TRANSFERJOURNAL_H
+
+#include <json/json.h>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "IRequest.h"
+
+namespace cloudstorage {
+
+/**
+ * Append-only on-disk log of upload sessions which were started but not
+ * finished. Each record stores the session's url or id, the offset the
+ * server has committed and provider specific data, so that an upload of the
+ * same content to the same place may continue where it stopped, even after
+ * the process was restarted. A checksum of the committed range is kept as
+ * well; the session is resumed only if the source still matches it.
+ *
+ * The log is replayed and compacted when it is opened; records older than
+ * MAX_AGE are dropped as upload sessions expire by then anyway.
+ */
+class CLOUDSTORAGE_API TransferJournal {
+ public:
+  static constexpr std::chrono::hours MAX_AGE{24 * 7};
+  static constexpr uint32_t FINGERPRINT_SIZE = 64 * 1024;
+
+  struct Entry {
+    std::string session_;
+    uint64_t offset_ = 0;
+    Json::Value data_;
+  };
+
+  /**
+   * Returns journal stored at path; all callers opening the same path share
+   * one instance.
+   */
+  static std::shared_ptr<TransferJournal> open(const std::string& path);
+
+  /**
+   * Builds key identifying an upload; content is identified by its size and
+   * a checksum of its first FINGERPRINT_SIZE bytes, read with putData.
+   */
+  static std::string key(const std::string& provider, const std::string& id,
+                         const std::string& filename, IUploadFileCallback&);
+
+  explicit TransferJournal(const std::string& path);
+
+  /**
+   * Looks up entry stored under key and reads its committed range with
+   * putData; if it no longer matches the checksum the entry is removed.
+   */
+  bool find(const std::string& key, Entry&, IUploadFileCallback&);
+
+  /**
+   * Stores entry under key along with a checksum of its committed range,
+   * extending the one of the previous entry if its offset grew. The newly
+   * committed data is read with putData, so providers call it from the
+   * thread pool rather than from http callbacks.
+   */
+  void put(const std::string& key, const Entry&, IUploadFileCallback&);
+  void remove(const std::string& key);
+
+ private:
+  struct Record {
+    Entry entry_;
+    int64_t time_;
+    uint64_t checksum_;
+  };
+
+  static uint64_t checksum(IUploadFileCallback&, uint64_t begin, uint64_t end,
+                           uint64_t hash, bool& valid);
+  static Json::Value toJson(const std::string& key, const Record&);
+
+  void load();
+  void append(const Json::Value&);
+
+  std::string path_;
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Record> entries_;
+  std::ofstream stream_;
+};
+
+}  // namespace cloudstorage
+
+#endif  // TRANSFERJOURNAL_H
@@ -0,0 +1,476 @@
+/*****************************************************************************
+ * TransferPipe.cpp : TransferPipe implementation
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#include "TransferPipe.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Utility/Utility.h"
+
+namespace cloudstorage {
+
+namespace {
+
+using SpillFile = std::shared_ptr<std::FILE>;
+using GenericRequest = std::shared_ptr<IGenericRequest>;
+
+/**
+ * State shared by both ends of a transfer and the request handed out to the
+ * user.
+ *
+ * When streaming, downloaded data waits in a ring buffer for the upload. The
+ * download is paused once the buffer is full and resumed after the upload
+ * drained half of it. The upload is paused once the buffer is empty and
+ * resumed after a quarter of the buffer got filled; the http layer takes an
+ * empty read during which the upload was paused for a pause even if it was
+ * resumed right away, not for the end of the file.
+ *
+ * Otherwise the whole file is downloaded to a temporary file first.
+ */
+class Pipe : public std::enable_shared_from_this<Pipe> {
+ public:
+  Pipe(IThreadPool* thread_pool, uint32_t buffer_size,
+       ITransferPipe::ICallback::Pointer callback)
+      : thread_pool_(thread_pool),
+        callback_(std::move(callback)),
+        future_(promise_.get_future()),
+        capacity_(buffer_size) {}
+
+  void start(ICloudProvider& source_provider, IItem::Pointer source,
+             ICloudProvider& destination_provider, IItem::Pointer destination,
+             const std::string& filename);
+
+  void receivedData(const char* data, uint32_t length);
+  void downloaded(EitherError<void>);
+  uint32_t putData(char* data, uint32_t maxlength, uint64_t offset);
+  uint64_t size();
+  void progress(uint64_t total, uint64_t now);
+  void uploaded(EitherError<IItem>);
+
+  void cancel();
+  void pause();
+  void resume();
+  void setBandwidthLimit(uint64_t download, uint64_t upload);
+
+  std::shared_future<EitherError<IItem>> future() const { return future_; }
+
+  /**
+   * Drops the download and the upload; done by the user's request when it's
+   * destroyed, since a request can't be destroyed from its own callback.
+   */
+  void release();
+
+ private:
+  using Lock = std::unique_lock<std::mutex>;
+
+  void startUpload();
+  void resumeUpload(Lock&);
+  void attach(GenericRequest& slot, GenericRequest request);
+  void fail(const Error&);
+  void abort(const GenericRequest&);
+  void finished(Lock&);
+  void push(const char* data, uint32_t length);
+  uint32_t pop(char* data, uint32_t maxlength);
+
+  IThreadPool* thread_pool_;
+  ITransferPipe::ICallback::Pointer callback_;
+  std::promise<EitherError<IItem>> promise_;
+  std::shared_future<EitherError<IItem>> future_;
+  ICloudProvider* destination_provider_ = nullptr;
+  IItem::Pointer destination_;
+  std::string filename_;
+
+  std::mutex mutex_;
+  std::condition_variable attached_;
+  std::thread::id starting_thread_;
+  GenericRequest download_;
+  GenericRequest upload_;
+  uint64_t download_limit_ = 0;
+  uint64_t upload_limit_ = 0;
+  int pending_ = 0;
+  bool download_done_ = false;
+  bool upload_done_ = false;
+  bool download_paused_ = false;
+  bool upload_paused_ = false;
+  bool user_paused_ = false;
+  bool finished_ = false;
+  std::shared_ptr<Error> error_;
+  EitherError<IItem> item_;
+
+  SpillFile spill_;
+  uint64_t spill_size_ = 0;
+
+  uint32_t capacity_;
+  uint64_t total_ = 0;
+  uint64_t uploaded_ = 0;
+  std::vector<char> buffer_;
+  size_t head_ = 0;
+  size_t size_ = 0;
+};
+
+class DownloadCallback : public IDownloadFileCallback {
+ public:
+  DownloadCallback(std::shared_ptr<Pipe> pipe) : pipe_(std::move(pipe)) {}
+
+  void receivedData(const char* data, uint32_t length) override {
+    pipe_->receivedData(data, length);
+  }
+
+  void progress(uint64_t, uint64_t) override {}
+
+  void done(EitherError<void> e) override { pipe_->downloaded(e); }
+
+ private:
+  std::shared_ptr<Pipe> pipe_;
+};
+
+class UploadCallback : public IUploadFileCallback {
+ public:
+  UploadCallback(std::shared_ptr<Pipe> pipe) : pipe_(std::move(pipe)) {}
+
+  uint32_t putData(char* data, uint32_t maxlength, uint64_t offset) override {
+    return pipe_->putData(data, maxlength, offset);
+  }
+
+  uint64_t size() override { return pipe_->size(); }
+
+  void progress(uint64_t total, uint64_t now) override {
+    pipe_->progress(total, now);
+  }
+
+  void done(EitherError<IItem> e) override { pipe_->uploaded(e); }
+
+ private:
+  std::shared_ptr<Pipe> pipe_;
+};
+
+class PipeRequest : public ITransferPipe::TransferRequest {
+ public:
+  PipeRequest(std::shared_ptr<Pipe> pipe) : pipe_(std::move(pipe)) {}
+  ~PipeRequest() override {
+    PipeRequest::cancel();
+    pipe_->release();
+  }
+
+  void finish() override { pipe_->future().wait(); }
+
+  void cancel() override {
+    pipe_->cancel();
+    finish();
+  }
+
+  EitherError<IItem> result() override { return pipe_->future().get(); }
+
+  void pause() override { pipe_->pause(); }
+
+  void resume() override { pipe_->resume(); }
+
+  void setBandwidthLimit(uint64_t download, uint64_t upload) override {
+    pipe_->setBandwidthLimit(download, upload);
+  }
+
+ private:
+  std::shared_ptr<Pipe> pipe_;
+};
+
+void Pipe::start(ICloudProvider& source_provider, IItem::Pointer source,
+                 ICloudProvider& destination_provider,
+                 IItem::Pointer destination, const std::string& filename) {
+  Lock lock(mutex_);
+  destination_provider_ = &destination_provider;
+  destination_ = std::move(destination);
+  filename_ = filename;
+  total_ = source->size();
+  if (total_ == IItem::UnknownSize ||
+      !(destination_provider.supportedOperations() &
+        ICloudProvider::StreamUpload)) {
+    spill_ = SpillFile(std::tmpfile(), [](std::FILE* f) {
+      if (f) std::fclose(f);
+    });
+    if (!spill_) {
+      fail(Error{IHttpRequest::Failure, util::Error::COULD_NOT_WRITE_FILE});
+      return finished(lock);
+    }
+  }
+  pending_ = spill_ ? 1 : 2;
+  starting_thread_ = std::this_thread::get_id();
+  lock.unlock();
+  attach(download_, source_provider.downloadFileAsync(
+                        source, std::make_shared<DownloadCallback>(
+                                    shared_from_this())));
+  if (!spill_) startUpload();
+  lock.lock();
+  starting_thread_ = std::thread::id();
+}
+
+void Pipe::startUpload() {
+  {
+    Lock lock(mutex_);
+    if (error_) {
+      if (--pending_ == 0) finished(lock);
+      return;
+    }
+  }
+  attach(upload_, destination_provider_->uploadFileAsync(
+                      destination_, filename_,
+                      std::make_shared<UploadCallback>(shared_from_this())));
+}
+
+void Pipe::attach(GenericRequest& slot, GenericRequest request) {
+  Lock lock(mutex_);
+  // The request completed before it got here, and so did the transfer.
+  if (finished_) return lock.unlock();
+  slot = request;
+  bool download = &slot == &download_;
+  if (download_limit_ || upload_limit_)
+    request->setBandwidthLimit(download ? download_limit_ : 0,
+                               download ? 0 : upload_limit_);
+  if (error_)
+    abort(request);
+  else if (user_paused_ || (download ? download_paused_ : upload_paused_))
+    request->pause();
+  attached_.notify_all();
+}
+
+void Pipe::receivedData(const char* data, uint32_t length) {
+  Lock lock(mutex_);
+  if (error_) return;
+  if (spill_) {
+    if (std::fwrite(data, 1, length, spill_.get()) != length)
+      fail(Error{IHttpRequest::Failure, util::Error::COULD_NOT_WRITE_FILE});
+    return;
+  }
+  push(data, length);
+  if (size_ >= capacity_ && !download_paused_) {
+    download_paused_ = true;
+    if (download_) download_->pause();
+  }
+  resumeUpload(lock);
+}
+
+void Pipe::downloaded(EitherError<void> e) {
+  Lock lock(mutex_);
+  download_done_ = true;
+  if (e.left() && !upload_done_) {
+    fail(*e.left());
+  } else if (spill_ && !error_) {
+    std::fseek(spill_.get(), 0, SEEK_END);
+    spill_size_ = static_cast<uint64_t>(std::ftell(spill_.get()));
+    lock.unlock();
+    return startUpload();
+  }
+  resumeUpload(lock);
+  if (--pending_ == 0) finished(lock);
+}
+
+uint32_t Pipe::putData(char* data, uint32_t maxlength, uint64_t offset) {
+  Lock lock(mutex_);
+  if (spill_) {
+    if (std::fseek(spill_.get(), static_cast<long>(offset), SEEK_SET) != 0)
+      return 0;
+    return static_cast<uint32_t>(std::fread(data, 1, maxlength, spill_.get()));
+  }
+  // Pausing needs the upload, which is attached once uploadFileAsync returns.
+  if (size_ == 0 && !upload_ &&
+      std::this_thread::get_id() != starting_thread_)
+    attached_.wait(lock, [this] { return upload_ || finished_; });
+  if (offset != uploaded_)
+    fail(Error{IHttpRequest::Failure, util::Error::INVALID_UPLOAD_RANGE});
+  else if (size_ == 0 && download_done_)
+    fail(Error{IHttpRequest::Failure, util::Error::INCOMPLETE_DOWNLOAD});
+  if (error_ || size_ == 0) {
+    upload_paused_ = true;
+    if (upload_) upload_->pause();
+    return 0;
+  }
+  auto count = pop(data, maxlength);
+  uploaded_ += count;
+  if (download_paused_ && size_ <= capacity_ / 2) {
+    download_paused_ = false;
+    if (download_ && !user_paused_) download_->resume();
+  }
+  return count;
+}
+
+uint64_t Pipe::size() {
+  Lock lock(mutex_);
+  return spill_ ? spill_size_ : total_;
+}
+
+void Pipe::progress(uint64_t total, uint64_t now) {
+  callback_->progress(total, now);
+}
+
+void Pipe::resumeUpload(Lock&) {
+  if (!upload_paused_ || error_ ||
+      (size_ < capacity_ / 4 && !download_done_ && uploaded_ + size_ < total_))
+    return;
+  upload_paused_ = false;
+  if (upload_ && !user_paused_) upload_->resume();
+}
+
+void Pipe::uploaded(EitherError<IItem> e) {
+  Lock lock(mutex_);
+  upload_done_ = true;
+  item_ = e;
+  if (e.left())
+    fail(*e.left());
+  else if (!spill_ && uploaded_ != total_)
+    // Upload ended before it took all of the data.
+    fail(Error{IHttpRequest::Failure, util::Error::INCOMPLETE_UPLOAD});
+  else if (!download_done_)
+    abort(download_);
+  if (--pending_ == 0) finished(lock);
+}
+
+void Pipe::cancel() {
+  std::vector<GenericRequest> requests;
+  {
+    Lock lock(mutex_);
+    if (finished_) return;
+    if (!error_)
+      error_ = std::make_shared<Error>(
+          Error{IHttpRequest::Aborted, util::Error::ABORTED});
+    if (download_ && !download_done_) requests.push_back(download_);
+    if (upload_ && !upload_done_) requests.push_back(upload_);
+  }
+  for (auto&& r : requests) r->cancel();
+}
+
+void Pipe::pause() {
+  Lock lock(mutex_);
+  user_paused_ = true;
+  if (download_) download_->pause();
+  if (upload_) upload_->pause();
+}
+
+void Pipe::resume() {
+  Lock lock(mutex_);
+  user_paused_ = false;
+  if (error_) return;
+  if (download_ && !download_paused_) download_->resume();
+  if (upload_ && !upload_paused_) upload_->resume();
+}
+
+void Pipe::setBandwidthLimit(uint64_t download, uint64_t upload) {
+  Lock lock(mutex_);
+  download_limit_ = download;
+  upload_limit_ = upload;
+  if (download_) download_->setBandwidthLimit(download, 0);
+  if (upload_) upload_->setBandwidthLimit(0, upload);
+}
+
+void Pipe::fail(const Error& e) {
+  if (error_) return;
+  error_ = std::make_shared<Error>(e);
+  if (!download_done_) abort(download_);
+  if (!upload_done_) abort(upload_);
+}
+
+void Pipe::abort(const GenericRequest& request) {
+  if (!request) return;
+  // Cancelling waits for the request to finish, which can't be done from
+  // the callbacks of the transfer.
+  request->pause();
+  thread_pool_->schedule([request] { request->cancel(); });
+}
+
+void Pipe::finished(Lock& lock) {
+  finished_ = true;
+  auto result = error_ ? EitherError<IItem>(error_) : item_;
+  lock.unlock();
+  callback_->done(result);
+  promise_.set_value(result);
+}
+
+void Pipe::release() {
+  GenericRequest download, upload;
+  Lock lock(mutex_);
+  download = std::move(download_);
+  upload = std::move(upload_);
+}
+
+void Pipe::push(const char* data, uint32_t length) {
+  if (size_ + length > buffer_.size()) {
+    std::vector<char> buffer(std::max<size_t>(capacity_, size_ + length));
+    auto size = size_;
+    pop(buffer.data(), static_cast<uint32_t>(size));
+    buffer_ = std::move(buffer);
+    head_ = 0;
+    size_ = size;
+  }
+  auto tail = (head_ + size_) % buffer_.size();
+  auto first = std::min<size_t>(length, buffer_.size() - tail);
+  std::memcpy(buffer_.data() + tail, data, first);
+  std::memcpy(buffer_.data(), data + first, length - first);
+  size_ += length;
+}
+
+uint32_t Pipe::pop(char* data, uint32_t maxlength) {
+  auto count = std::min<size_t>(maxlength, size_);
+  if (count == 0) return 0;
+  auto first = std::min<size_t>(count, buffer_.size() - head_);
+  std::memcpy(data, buffer_.data() + head_, first);
+  std::memcpy(data + first, buffer_.data(), count - first);
+  head_ = (head_ + count) % buffer_.size();
+  size_ -= count;
+  return static_cast<uint32_t>(count);
+}
+
+}  // namespace
+
+TransferPipe::TransferPipe(uint32_t buffer_size)
+    : buffer_size_(buffer_size), thread_pool_(IThreadPool::create(1)) {}
+
+ITransferPipe::TransferRequest::Pointer TransferPipe::transfer(
+    ICloudProvider& source_provider, IItem::Pointer source,
+    ICloudProvider& destination_provider, IItem::Pointer destination,
+    const std::string& filename, ICallback::Pointer callback) {
+  return transfer(thread_pool_.get(), buffer_size_, source_provider, source,
+                  destination_provider, destination, filename, callback);
+}
+
+ITransferPipe::TransferRequest::Pointer TransferPipe::transfer(
+    IThreadPool* thread_pool, uint32_t buffer_size,
+    ICloudProvider& source_provider, IItem::Pointer source,
+    ICloudProvider& destination_provider, IItem::Pointer destination,
+    const std::string& filename, ICallback::Pointer callback) {
+  auto pipe =
+      std::make_shared<Pipe>(thread_pool, buffer_size, std::move(callback));
+  auto request = util::make_unique<PipeRequest>(pipe);
+  pipe->start(source_provider, std::move(source), destination_provider,
+              std::move(destination), filename);
+  return request;
+}
+
+ITransferPipe::Pointer ITransferPipe::create(uint32_t buffer_size) {
+  return util::make_unique<TransferPipe>(buffer_size);
+}
+
+}  // namespace cloudstorage
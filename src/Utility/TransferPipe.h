@@ -0,0 +1,60 @@
+/*****************************************************************************
+ * TransferPipe.h : streaming copy between cloud providers
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef TRANSFERPIPE_H
+#define TRANSFERPIPE_H
+
+#include "ITransferPipe.h"
+#include "IThreadPool.h"
+
+namespace cloudstorage {
+
+class TransferPipe : public ITransferPipe {
+ public:
+  TransferPipe(uint32_t buffer_size);
+
+  TransferRequest::Pointer transfer(ICloudProvider& source_provider,
+                                    IItem::Pointer source,
+                                    ICloudProvider& destination_provider,
+                                    IItem::Pointer destination,
+                                    const std::string& filename,
+                                    ICallback::Pointer) override;
+
+  /**
+   * Starts a transfer which cancels one of its ends from given thread pool
+   * when the other one fails; it mustn't be a pool the transfer itself
+   * depends on.
+   */
+  static TransferRequest::Pointer transfer(
+      IThreadPool* thread_pool, uint32_t buffer_size,
+      ICloudProvider& source_provider, IItem::Pointer source,
+      ICloudProvider& destination_provider, IItem::Pointer destination,
+      const std::string& filename, ICallback::Pointer);
+
+ private:
+  uint32_t buffer_size_;
+  IThreadPool::Pointer thread_pool_;
+};
+
+}  // namespace cloudstorage
+
+#endif  // TRANSFERPIPE_H
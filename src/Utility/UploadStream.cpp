@@ -0,0 +1,87 @@
+/*****************************************************************************
+ * UploadStream.cpp : UploadStream implementation
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#include "UploadStream.h"
+
+#include <algorithm>
+
+namespace cloudstorage {
+namespace util {
+
+namespace {
+const uint32_t BUFFER_SIZE = 64 * 1024;
+}  // namespace
+
+UploadBuffer::UploadBuffer(IUploadFileCallback* callback, uint64_t offset,
+                           uint64_t length)
+    : callback_(callback),
+      offset_(offset),
+      length_(length),
+      position_(),
+      buffer_(BUFFER_SIZE) {}
+
+UploadBuffer::int_type UploadBuffer::underflow() {
+  if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+  position_ += egptr() - eback();
+  setg(nullptr, nullptr, nullptr);
+  if (position_ >= length_) return traits_type::eof();
+  auto size = static_cast<uint32_t>(
+      std::min<uint64_t>(buffer_.size(), length_ - position_));
+  auto read = callback_->putData(buffer_.data(), size, offset_ + position_);
+  if (read == 0) return traits_type::eof();
+  setg(buffer_.data(), buffer_.data(), buffer_.data() + read);
+  return traits_type::to_int_type(*gptr());
+}
+
+UploadBuffer::pos_type UploadBuffer::seekoff(off_type offset,
+                                             std::ios_base::seekdir dir,
+                                             std::ios_base::openmode mode) {
+  off_type base = 0;
+  if (dir == std::ios_base::cur)
+    base = position_ + (gptr() - eback());
+  else if (dir == std::ios_base::end)
+    base = length_;
+  return seekpos(pos_type(base + offset), mode);
+}
+
+UploadBuffer::pos_type UploadBuffer::seekpos(pos_type position,
+                                             std::ios_base::openmode mode) {
+  auto offset = static_cast<off_type>(position);
+  if (!(mode & std::ios_base::in) || offset < 0 ||
+      static_cast<uint64_t>(offset) > length_)
+    return pos_type(-1);
+  if (static_cast<uint64_t>(offset) >= position_ &&
+      static_cast<uint64_t>(offset) < position_ + (egptr() - eback())) {
+    setg(eback(), eback() + (offset - position_), egptr());
+  } else {
+    position_ = offset;
+    setg(nullptr, nullptr, nullptr);
+  }
+  return position;
+}
+
+UploadStream::UploadStream(IUploadFileCallback* callback, uint64_t offset,
+                           uint64_t length)
+    : std::iostream(&buffer_), buffer_(callback, offset, length) {}
+
+}  // namespace util
+}  // namespace cloudstorage
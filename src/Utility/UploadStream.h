@@ -0,0 +1,74 @@
+/*****************************************************************************
+ * UploadStream.h : stream reading upload data on demand
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef UPLOADSTREAM_H
+#define UPLOADSTREAM_H
+
+#include <iostream>
+#include <vector>
+
+#include "IRequest.h"
+
+namespace cloudstorage {
+namespace util {
+
+/**
+ * Read-only stream buffer exposing range [offset, offset + length) of an
+ * upload; data is pulled from IUploadFileCallback::putData as it is consumed,
+ * through a fixed size buffer, so memory use does not depend on the length.
+ */
+class UploadBuffer : public std::streambuf {
+ public:
+  UploadBuffer(IUploadFileCallback* callback, uint64_t offset,
+               uint64_t length);
+
+ protected:
+  int_type underflow() override;
+  pos_type seekoff(off_type, std::ios_base::seekdir,
+                   std::ios_base::openmode) override;
+  pos_type seekpos(pos_type, std::ios_base::openmode) override;
+
+ private:
+  IUploadFileCallback* callback_;
+  uint64_t offset_;
+  uint64_t length_;
+  uint64_t position_;
+  std::vector<char> buffer_;
+};
+
+/**
+ * Stream over UploadBuffer; it is an iostream only so that it can be used as
+ * request input, writing to it always fails.
+ */
+class UploadStream : public std::iostream {
+ public:
+  UploadStream(IUploadFileCallback* callback, uint64_t offset,
+               uint64_t length);
+
+ private:
+  UploadBuffer buffer_;
+};
+
+}  // namespace util
+}  // namespace cloudstorage
+
+#endif  // UPLOADSTREAM_H
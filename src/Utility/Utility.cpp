@@ -23,6 +23,7 @@
 
 #include "Utility.h"
 
+#include "ChunkedBuffer.h"
 #include "IItem.h"
 #include "IRequest.h"
 
@@ -282,6 +283,14 @@ std::string from_base64(const std::string& in) {
   return out;
 }
 
+uint64_t fnv1a(const char* data, size_t length, uint64_t hash) {
+  for (size_t i = 0; i < length; i++) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
 std::string encode_token(const std::string& token) {
   return util::to_base64(util::Url::escape(token));
 }
@@ -495,9 +504,15 @@ Json::Value json::from_stream(std::istream&& stream) {
 }
 
 Json::Value json::from_stream(std::istream& stream) {
-  std::stringstream sstream;
-  sstream << stream.rdbuf();
-  return from_string(sstream.str());
+  std::string storage;
+  auto data = contents(stream, storage);
+  Json::CharReaderBuilder factory;
+  std::unique_ptr<Json::CharReader> reader(factory.newCharReader());
+  Json::Value json;
+  std::string error;
+  if (!reader->parse(data.data(), data.data() + data.size(), &json, &error))
+    throw Json::Exception(error);
+  return json;
 }
 
 void set_thread_name(const std::string& name) {
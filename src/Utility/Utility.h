@@ -187,6 +187,10 @@ CLOUDSTORAGE_API std::tm gmtime(time_t);
 CLOUDSTORAGE_API time_t timegm(const std::tm&);
 CLOUDSTORAGE_API std::string to_base64(const std::string&);
 CLOUDSTORAGE_API std::string from_base64(const std::string&);
+const uint64_t FNV1A_OFFSET_BASIS = 14695981039346656037ull;
+// Continues the hash of the data preceding this chunk when given one.
+CLOUDSTORAGE_API uint64_t fnv1a(const char* data, size_t length,
+                                uint64_t hash = FNV1A_OFFSET_BASIS);
 CLOUDSTORAGE_API std::string encode_token(const std::string&);
 CLOUDSTORAGE_API std::string decode_token(const std::string&);
 CLOUDSTORAGE_API void set_thread_name(const std::string&);
@@ -221,6 +225,7 @@ constexpr auto COULD_NOT_FIND_SESSION_TOKEN = "couldn't find session token";
 constexpr auto UNKNOWN_RESPONSE_RECEIVED = "unknown response received";
 constexpr auto UNSUPPORTED_PLAYER = "unsupported player";
 constexpr auto COULD_NOT_READ_FILE = "couldn't read file";
+constexpr auto COULD_NOT_WRITE_FILE = "couldn't write file";
 constexpr auto INVALID_NODE = "invalid node";
 constexpr auto INVALID_RANGE = "invalid range";
 constexpr auto INVALID_REQUEST = "invalid request";
@@ -250,6 +255,13 @@ constexpr auto RESOLVER_NOT_SET = "resolver not set";
 constexpr auto COULD_NOT_START_HTTP_SERVER = "couldn't start http server";
 constexpr auto INVALID_RADIX_BASE = "invalid radix base";
 constexpr auto UNIMPLEMENTED = "unimplemented";
+constexpr auto MISSING_ETAG = "missing etag";
+constexpr auto MISSING_UPLOAD_SESSION = "missing upload session";
+constexpr auto INVALID_UPLOAD_RANGE = "invalid upload range";
+constexpr auto INCOMPLETE_DOWNLOAD = "incomplete download";
+constexpr auto INCOMPLETE_UPLOAD = "incomplete upload";
+constexpr auto DESTINATION_INSIDE_SOURCE =
+    "destination is inside the source directory";
 
 }  // namespace Error
 
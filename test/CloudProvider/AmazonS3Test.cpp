@@ -266,6 +266,75 @@ TEST(AmazonS3Test, UploadsItem) {
                          Pointee(Property(&IItem::filename, "filename")));
 }
 
+TEST(AmazonS3Test, UploadsItemInParts) {
+  auto mock = CloudFactoryMock::create();
+  auto data = GetDefaultInitData();
+  data.hints_["upload_part_size"] = std::to_string(5 * 1024 * 1024);
+  auto provider = mock.factory()->create("amazons3", data);
+
+  const std::string content(11 * 1024 * 1024, 'x');
+
+  ExpectHttp(mock.http(), "endpoint/bucket/parent_id/filename")
+      .WithMethod("POST")
+      .WithRequestMatching(Property(&IHttpRequest::parameters,
+                                    Contains(std::make_pair("uploads", ""))))
+      .WillRespondWith(R"(
+        <?xml version="1.0" encoding="UTF-8"?>
+        <InitiateMultipartUploadResult>
+          <Bucket>bucket</Bucket>
+          <Key>parent_id/filename</Key>
+          <UploadId>upload_id</UploadId>
+        </InitiateMultipartUploadResult>
+      )")
+      .AndThen()
+      .WithRequestMatching(
+          Property(&IHttpRequest::parameters,
+                   Contains(std::make_pair("uploadId", "upload_id"))))
+      .WithBody(
+          "<CompleteMultipartUpload>"
+          "<Part><PartNumber>1</PartNumber><ETag>\"etag1\"</ETag></Part>"
+          "<Part><PartNumber>2</PartNumber><ETag>\"etag2\"</ETag></Part>"
+          "<Part><PartNumber>3</PartNumber><ETag>\"etag3\"</ETag></Part>"
+          "</CompleteMultipartUpload>")
+      .WillRespondWith("<CompleteMultipartUploadResult/>");
+
+  const auto part_size = 5 * 1024 * 1024;
+  auto part = [](int index) {
+    return Property(
+        &IHttpRequest::parameters,
+        AllOf(Contains(std::make_pair("partNumber", std::to_string(index))),
+              Contains(std::make_pair("uploadId", "upload_id"))));
+  };
+  auto etag = [](int index) {
+    return HttpResponse().WithHeaders(
+        {{"etag", "\"etag" + std::to_string(index) + "\""}});
+  };
+  ExpectHttp(mock.http(), "endpoint/bucket/parent_id/filename")
+      .WithMethod("PUT")
+      .WithRequestMatching(part(1))
+      .WithBody(content.substr(0, part_size))
+      .WillRespondWith(etag(1))
+      .AndThen()
+      .WithRequestMatching(part(2))
+      .WithBody(content.substr(part_size, part_size))
+      .WillRespondWith(etag(2))
+      .AndThen()
+      .WithRequestMatching(part(3))
+      .WithBody(content.substr(2 * part_size))
+      .WillRespondWith(etag(3));
+
+  auto parent = std::make_shared<Item>(
+      "directory", "parent_id/", IItem::UnknownSize, IItem::UnknownTimeStamp,
+      IItem::FileType::Directory);
+
+  auto stream = std::make_shared<std::stringstream>(content);
+  ExpectImmediatePromise(
+      provider->uploadFile(parent, "filename",
+                           provider->streamUploader(stream)),
+      Pointee(AllOf(Property(&IItem::filename, "filename"),
+                    Property(&IItem::size, content.size()))));
+}
+
 TEST(AmazonS3Test, DownloadsItem) {
   auto mock = CloudFactoryMock::create();
   auto provider = mock.factory()->create("amazons3", GetDefaultInitData());
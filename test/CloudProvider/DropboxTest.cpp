@@ -179,6 +179,32 @@ TEST(DropboxTest, MovesItem) {
                     Property(&IItem::type, IItem::FileType::Image))));
 }
 
+TEST(DropboxTest, CopiesItem) {
+  auto mock = CloudFactoryMock::create();
+  auto provider = mock.factory()->create("dropbox", {});
+
+  ExpectHttp(mock.http(), "https://api.dropboxapi.com/2/files/copy_v2")
+      .WithMethod("POST")
+      .WithHeaderParameter("Content-Type", "application/json")
+      .WithHeaderParameter("Authorization", _)
+      .WithBody(IgnoringWhitespace(
+          R"js({ "from_path": "/some/source", "to_path": "/path/source" })js"))
+      .WillRespondWith(R"js({ "metadata": { "name": "source" } })js");
+
+  auto source =
+      std::make_shared<Item>("source", "/some/source", IItem::UnknownSize,
+                             IItem::UnknownTimeStamp, IItem::FileType::Image);
+
+  auto destination = std::make_shared<Item>(
+      "destination", "/path", IItem::UnknownSize, IItem::UnknownTimeStamp,
+      IItem::FileType::Directory);
+
+  ExpectImmediatePromise(
+      provider->copyItem(source, destination),
+      Pointee(AllOf(Property(&IItem::filename, "source"),
+                    Property(&IItem::type, IItem::FileType::Image))));
+}
+
 TEST(DropboxTest, RenamesItem) {
   auto mock = CloudFactoryMock::create();
   auto provider = mock.factory()->create("dropbox", {});
@@ -244,6 +270,120 @@ TEST(DropboxTest, UploadsItem) {
                          Pointee(Property(&IItem::filename, "new_name")));
 }
 
+TEST(DropboxTest, CommitsUploadsInBatch) {
+  auto mock = CloudFactoryMock::create();
+  ICloudFactory::ProviderInitData data;
+  data.hints_["upload_batch_size"] = "2";
+  auto provider = mock.factory()->create("dropbox", data);
+
+  ExpectHttp(mock.http(),
+             "https://content.dropboxapi.com/2/files/upload_session/start")
+      .WithMethod("POST")
+      .WithHeaderParameter("Authorization", _)
+      .WithHeaderParameter("Content-Type", "application/octet-stream")
+      .WithHeaderParameter("Dropbox-API-Arg",
+                           IgnoringWhitespace(R"js({ "close": true })js"))
+      .WithBody("content")
+      .WillRespondWith(R"js({ "session_id": "ssid" })js");
+
+  ExpectHttp(
+      mock.http(),
+      "https://api.dropboxapi.com/2/files/upload_session/finish_batch_v2")
+      .WithMethod("POST")
+      .WithHeaderParameter("Authorization", _)
+      .WithHeaderParameter("Content-Type", "application/json")
+      .WithBody(IgnoringWhitespace(
+          R"js({
+                 "entries": [{
+                   "commit": {
+                     "mode": "overwrite",
+                     "path": "/some/path/new_name"
+                   },
+                   "cursor": { "offset": 7, "session_id": "ssid" }
+                 }]
+               })js"))
+      .WillRespondWith(
+          R"js({ "entries": [{ ".tag": "success", "name": "new_name" }] })js");
+
+  auto parent = std::make_shared<Item>(
+      "directory", "/some/path", IItem::UnknownSize, IItem::UnknownTimeStamp,
+      IItem::FileType::Directory);
+
+  auto stream = std::make_shared<std::stringstream>("content");
+  ExpectImmediatePromise(provider->uploadFile(parent, "new_name",
+                                              provider->streamUploader(stream)),
+                         Pointee(Property(&IItem::filename, "new_name")));
+}
+
+TEST(DropboxTest, SkipsUploadOfIdenticalFile) {
+  auto mock = CloudFactoryMock::create();
+  auto provider = mock.factory()->create("dropbox", {});
+
+  ExpectHttp(mock.http(), "https://api.dropboxapi.com/2/files/list_folder")
+      .WithMethod("POST")
+      .WithBody(IgnoringWhitespace(R"js({ "path": "/some/path" })js"))
+      .WillRespondWith(R"js({
+        "entries": [{
+          "name": "new_name",
+          "path_display": "/some/path/new_name",
+          "size": 7,
+          "content_hash":
+            "c4eec85eb66b79b8f59ff76a97d5d97aac1b5eca8c6675b4e988a5deea786e53"
+        }]
+      })js");
+
+  auto parent = std::make_shared<Item>(
+      "directory", "/some/path", IItem::UnknownSize, IItem::UnknownTimeStamp,
+      IItem::FileType::Directory);
+
+  auto stream = std::make_shared<std::stringstream>("content");
+  ExpectImmediatePromise(
+      provider->uploadFile(parent, "new_name", provider->streamUploader(stream),
+                           ICloudProvider::UploadMode::SkipIdentical),
+      Pointee(AllOf(Property(&IItem::id, "/some/path/new_name"),
+                    Property(&IItem::content_hash_type,
+                             IItem::HashType::Dropbox))));
+}
+
+TEST(DropboxTest, UploadsFileWithDifferentContent) {
+  auto mock = CloudFactoryMock::create();
+  auto provider = mock.factory()->create("dropbox", {});
+
+  ExpectHttp(mock.http(), "https://api.dropboxapi.com/2/files/list_folder")
+      .WithMethod("POST")
+      .WithBody(IgnoringWhitespace(R"js({ "path": "/some/path" })js"))
+      .WillRespondWith(R"js({
+        "entries": [{
+          "name": "new_name",
+          "path_display": "/some/path/new_name",
+          "size": 7,
+          "content_hash":
+            "0000000000000000000000000000000000000000000000000000000000000000"
+        }]
+      })js");
+
+  ExpectHttp(mock.http(),
+             "https://content.dropboxapi.com/2/files/upload_session/start")
+      .WithMethod("POST")
+      .WithBody("content")
+      .WillRespondWith(R"js({ "session_id": "ssid" })js");
+
+  ExpectHttp(mock.http(),
+             "https://content.dropboxapi.com/2/files/upload_session/finish")
+      .WithMethod("POST")
+      .WillRespondWith(R"js({ "name": "new_name" })js");
+
+  auto parent = std::make_shared<Item>(
+      "directory", "/some/path", IItem::UnknownSize, IItem::UnknownTimeStamp,
+      IItem::FileType::Directory);
+
+  auto stream = std::make_shared<std::stringstream>("content");
+  ExpectImmediatePromise(
+      provider->uploadFile(parent, "new_name", provider->streamUploader(stream),
+                           ICloudProvider::UploadMode::SkipIdentical),
+      Pointee(Property(&IItem::filename, "new_name")));
+}
+
 TEST(DropboxTest, GetsThumbnail) {
   auto mock = CloudFactoryMock::create();
   auto provider = mock.factory()->create("dropbox", {});
@@ -27,6 +27,7 @@
 #include "Utility/HttpServerMock.h"
 #include "Utility/Item.h"
 #include "Utility/ThreadPoolMock.h"
+#include "Utility/TransferJournal.h"
 #include "Utility/Utility.h"
 #include "gtest/gtest.h"
 
@@ -167,7 +168,7 @@ TEST(GoogleDriveTest, GetsItem) {
   ExpectHttp(mock.http(), "https://www.googleapis.com/drive/v3/files/item")
       .WithParameter("fields",
                      "id,name,thumbnailLink,trashed,mimeType,"
-                     "iconLink,parents,size,modifiedTime")
+                     "iconLink,parents,size,modifiedTime,md5Checksum")
       .WillRespondWith(R"js({ "name": "filename" })js");
 
   ExpectImmediatePromise(provider->getItemData("item"),
@@ -181,7 +182,7 @@ TEST(GoogleDriveTest, PatchesIconLink) {
   ExpectHttp(mock.http(), "https://www.googleapis.com/drive/v3/files/item")
       .WithParameter("fields",
                      "id,name,thumbnailLink,trashed,mimeType,"
-                     "iconLink,parents,size,modifiedTime")
+                     "iconLink,parents,size,modifiedTime,md5Checksum")
       .WillRespondWith(R"js({ "iconLink": "icon?size=16" })js");
 
   ExpectImmediatePromise(
@@ -263,7 +264,7 @@ TEST(GoogleDriveTest, CreatesDirectory) {
       .WithHeaderParameter("Authorization", _)
       .WithParameter("fields",
                      "id,name,thumbnailLink,trashed,"
-                     "mimeType,iconLink,parents,size,modifiedTime")
+                     "mimeType,iconLink,parents,size,modifiedTime,md5Checksum")
       .WithBody(IgnoringWhitespace(
           R"js({
                  "mimeType": "application/vnd.google-apps.folder",
@@ -291,7 +292,7 @@ TEST(GoogleDriveTest, MovesItem) {
       .WithHeaderParameter("Authorization", _)
       .WithParameter("fields",
                      "id,name,thumbnailLink,trashed,"
-                     "mimeType,iconLink,parents,size,modifiedTime")
+                     "mimeType,iconLink,parents,size,modifiedTime,md5Checksum")
       .WithParameter("addParents", "dstid")
       .WithParameter("removeParents", "srcparent")
       .WillRespondWith(R"js({ "name": "src" })js");
@@ -308,6 +309,108 @@ TEST(GoogleDriveTest, MovesItem) {
                          Pointee(AllOf(Property(&IItem::filename, "src"))));
 }
 
+TEST(GoogleDriveTest, CopiesItem) {
+  auto mock = CloudFactoryMock::create();
+  auto provider = mock.factory()->create("google", {});
+
+  ExpectHttp(mock.http(),
+             "https://www.googleapis.com/drive/v3/files/srcid/copy")
+      .WithMethod("POST")
+      .WithHeaderParameter("Content-Type", "application/json")
+      .WithHeaderParameter("Authorization", _)
+      .WithParameter("fields",
+                     "id,name,thumbnailLink,trashed,"
+                     "mimeType,iconLink,parents,size,modifiedTime,md5Checksum")
+      .WithBody(IgnoringWhitespace(
+          R"js({ "name": "src", "parents": [ "dstid" ] })js"))
+      .WillRespondWith(R"js({ "id": "copyid", "name": "src" })js");
+
+  auto source = std::make_shared<Item>("src", "srcid", IItem::UnknownSize,
+                                       IItem::UnknownTimeStamp,
+                                       IItem::FileType::Image);
+  auto destination = std::make_shared<Item>("dst", "dstid", IItem::UnknownSize,
+                                            IItem::UnknownTimeStamp,
+                                            IItem::FileType::Directory);
+
+  ExpectImmediatePromise(provider->copyItem(source, destination),
+                         Pointee(AllOf(Property(&IItem::id, "copyid"),
+                                       Property(&IItem::filename, "src"))));
+}
+
+TEST(GoogleDriveTest, CopiesDirectoryItemByItem) {
+  auto mock = CloudFactoryMock::create();
+  auto provider = mock.factory()->create("google", {});
+
+  ExpectHttp(mock.http(), "https://www.googleapis.com/drive/v3/files")
+      .WithMethod("POST")
+      .WithBody(IgnoringWhitespace(
+          R"js({
+                 "mimeType": "application/vnd.google-apps.folder",
+                 "name": "src",
+                 "parents": [ "dstid" ]
+               })js"))
+      .WillRespondWith(
+          R"js({
+                 "id": "newid",
+                 "name": "src",
+                 "mimeType": "application/vnd.google-apps.folder"
+               })js");
+  ExpectHttp(mock.http(), "https://www.googleapis.com/drive/v3/files")
+      .WithMethod("GET")
+      .WithParameter("q", "'srcid'+in+parents")
+      .WithParameter("fields",
+                     "files(id,name,thumbnailLink,trashed,mimeType,iconLink,"
+                     "parents,size,modifiedTime,md5Checksum),kind,"
+                     "nextPageToken")
+      .WillRespondWith(
+          R"js({
+                 "files": [ { "id": "fileid", "name": "file" } ]
+               })js");
+  ExpectHttp(mock.http(),
+             "https://www.googleapis.com/drive/v3/files/fileid/copy")
+      .WithMethod("POST")
+      .WithBody(IgnoringWhitespace(
+          R"js({ "name": "file", "parents": [ "newid" ] })js"))
+      .WillRespondWith(R"js({ "id": "copyid", "name": "file" })js");
+
+  auto source = std::make_shared<Item>("src", "srcid", IItem::UnknownSize,
+                                       IItem::UnknownTimeStamp,
+                                       IItem::FileType::Directory);
+  auto destination = std::make_shared<Item>("dst", "dstid", IItem::UnknownSize,
+                                            IItem::UnknownTimeStamp,
+                                            IItem::FileType::Directory);
+
+  ExpectImmediatePromise(
+      provider->copyItem(source, destination),
+      Pointee(AllOf(Property(&IItem::id, "newid"),
+                    Property(&IItem::type, IItem::FileType::Directory))));
+}
+
+TEST(GoogleDriveTest, RefusesToCopyDirectoryIntoItsDescendant) {
+  auto mock = CloudFactoryMock::create();
+  auto provider = mock.factory()->create("google", {});
+
+  ExpectHttp(mock.http(), "https://www.googleapis.com/drive/v3/files/childid")
+      .WillRespondWith(
+          R"js({
+                 "id": "childid",
+                 "name": "child",
+                 "mimeType": "application/vnd.google-apps.folder",
+                 "parents": [ "srcid" ]
+               })js");
+
+  auto source = std::make_shared<Item>("src", "srcid", IItem::UnknownSize,
+                                       IItem::UnknownTimeStamp,
+                                       IItem::FileType::Directory);
+  auto destination = std::make_shared<Item>("dst", "dstid", IItem::UnknownSize,
+                                            IItem::UnknownTimeStamp,
+                                            IItem::FileType::Directory);
+  destination->set_parents({"childid"});
+
+  ExpectFailedPromise(provider->copyItem(source, destination),
+                      Field(&Error::code_, IHttpRequest::Forbidden));
+}
+
 TEST(GoogleDriveTest, RenamesItem) {
   auto mock = CloudFactoryMock::create();
   auto provider = mock.factory()->create("google", {});
@@ -318,7 +421,7 @@ TEST(GoogleDriveTest, RenamesItem) {
       .WithHeaderParameter("Authorization", _)
       .WithParameter("fields",
                      "id,name,thumbnailLink,trashed,"
-                     "mimeType,iconLink,parents,size,modifiedTime")
+                     "mimeType,iconLink,parents,size,modifiedTime,md5Checksum")
       .WithBody(IgnoringWhitespace(R"js({ "name": "new_name" })js"))
       .WillRespondWith(R"js({ "name": "new_name" })js");
 
@@ -370,6 +473,66 @@ TEST(GoogleDriveTest, DownloadsItem) {
       provider->downloadFile(item, FullRange, download_callback));
 }
 
+TEST(GoogleDriveTest, DownloadsItemInParallel) {
+  auto mock = CloudFactoryMock::create();
+  auto provider = mock.factory()->create("google", {});
+
+  const uint64_t size = 10 * 1024 * 1024;
+  std::string expected_content(size, 0);
+  for (uint64_t i = 0; i < size; i++)
+    expected_content[i] = static_cast<char>(i % 251);
+
+  std::vector<std::string> ranges;
+  EXPECT_CALL(*mock.http(),
+              create("https://www.googleapis.com/drive/v3/files/id", "GET", _))
+      .WillRepeatedly([&](const std::string&, const std::string&, bool) {
+        auto request = request_mock();
+        auto range = std::make_shared<std::string>();
+        EXPECT_CALL(*request, setHeaderParameter(StrEq("Range"), _))
+            .WillOnce([range](const std::string&, const std::string& value) {
+              *range = value;
+            });
+        EXPECT_CALL(*request, send)
+            .WillOnce([&, range](const IHttpRequest::CompleteCallback& complete,
+                                 const std::shared_ptr<std::istream>&,
+                                 const std::shared_ptr<std::ostream>& output,
+                                 const std::shared_ptr<std::ostream>& error,
+                                 const IHttpRequest::ICallback::Pointer&) {
+              ranges.push_back(*range);
+              auto r = util::parse_range(*range);
+              *output << expected_content.substr(r.start_, r.size_);
+              auto content_range = "bytes " + std::to_string(r.start_) + "-" +
+                                   std::to_string(r.start_ + r.size_ - 1) +
+                                   "/" + std::to_string(size);
+              complete(IHttpRequest::Response{
+                  IHttpRequest::Partial,
+                  {{"content-range", content_range}},
+                  output,
+                  error});
+            });
+        return request;
+      });
+
+  std::string content;
+  auto download_callback = std::make_shared<DownloadCallbackMock>();
+  EXPECT_CALL(*download_callback, receivedData)
+      .WillRepeatedly([&](const char* data, uint32_t length) {
+        content.append(data, length);
+      });
+  EXPECT_CALL(*download_callback, progress).Times(AtLeast(1));
+
+  auto item = std::make_shared<Item>("item", "id", size,
+                                     IItem::UnknownTimeStamp,
+                                     IItem::FileType::Unknown);
+  ExpectImmediatePromise(
+      provider->downloadFile(item, FullRange, download_callback));
+
+  EXPECT_THAT(ranges, testing::UnorderedElementsAre("bytes=0-4194303",
+                                                    "bytes=4194304-8388607",
+                                                    "bytes=8388608-10485759"));
+  EXPECT_TRUE(content == expected_content);
+}
+
 TEST(GoogleDriveTest, FailsPartialDownloadForExportedItem) {
   auto mock = CloudFactoryMock::create();
   auto provider = mock.factory()->create("google", {});
@@ -427,7 +590,7 @@ TEST(GoogleDriveTest, UploadsItem) {
                            "multipart/related; boundary=fWoDm9QNn3v3Bq3bScUX")
       .WithParameter("fields",
                      "id,name,thumbnailLink,trashed,"
-                     "mimeType,iconLink,parents,size,modifiedTime")
+                     "mimeType,iconLink,parents,size,modifiedTime,md5Checksum")
       .WithParameter("uploadType", "multipart")
       .WithBody(
           "--fWoDm9QNn3v3Bq3bScUX\r\nContent-Type: application/json; "
@@ -451,6 +614,138 @@ TEST(GoogleDriveTest, UploadsItem) {
       Pointee(AllOf(Property(&IItem::filename, "filename.txt"))));
 }
 
+TEST(GoogleDriveTest, ResumesChunkedUpload) {
+  auto mock = CloudFactoryMock::create();
+  ICloudFactory::ProviderInitData data;
+  data.hints_["upload_part_size"] = std::to_string(256 * 1024);
+  auto provider = mock.factory()->create("google", data);
+
+  std::string content;
+  for (int i = 0; content.size() < 600 * 1024; i++)
+    content += std::to_string(i);
+  const auto size = std::to_string(content.size());
+
+  ExpectHttp(mock.http(), "https://www.googleapis.com/drive/v3/files")
+      .WillRespondWith("{}");
+
+  ExpectHttp(mock.http(), "https://www.googleapis.com/upload/drive/v3/files")
+      .WithMethod("POST")
+      .WithHeaderParameter("Authorization", _)
+      .WithHeaderParameter("Content-Type", "application/json; charset=UTF-8")
+      .WithHeaderParameter("X-Upload-Content-Length", size)
+      .WithParameter("uploadType", "resumable")
+      .WithParameter("fields",
+                     "id,name,thumbnailLink,trashed,"
+                     "mimeType,iconLink,parents,size,modifiedTime,md5Checksum")
+      .WithBody(IgnoringWhitespace(
+          R"js({ "name": "filename.bin", "parents": ["id"] })js"))
+      .WillRespondWith(HttpResponse().WithHeaders(
+          {{"location", "http://upload-session/"}}));
+
+  ExpectHttp(mock.http(), "http://upload-session/")
+      .WithMethod("PUT")
+      .WithFollowNoRedirect()
+      .WithHeaderParameter("Authorization", _)
+      .WithHeaderParameter("Content-Range", "bytes 0-262143/" + size)
+      .WithBody(content.substr(0, 262144))
+      .WillRespondWith(HttpResponse().WithStatus(308).WithHeaders(
+          {{"range", "bytes=0-262143"}}))
+      .AndThen()
+      .WithHeaderParameter("Authorization", _)
+      .WithHeaderParameter("Content-Range", "bytes 262144-524287/" + size)
+      .WillRespondWithCode(503)
+      .AndThen()
+      .WithHeaderParameter("Authorization", _)
+      .WithHeaderParameter("Content-Range", "bytes */" + size)
+      .WithBody("")
+      .WillRespondWith(HttpResponse().WithStatus(308).WithHeaders(
+          {{"range", "bytes=0-399999"}}))
+      .AndThen()
+      .WithHeaderParameter("Authorization", _)
+      .WithHeaderParameter("Content-Range", "bytes 400000-" +
+                                                std::to_string(
+                                                    content.size() - 1) +
+                                                "/" + size)
+      .WithBody(content.substr(400000))
+      .WillRespondWith(R"js({ "name": "filename.bin" })js");
+
+  auto item = std::make_shared<Item>("item", "id", IItem::UnknownSize,
+                                     IItem::UnknownTimeStamp,
+                                     IItem::FileType::Directory);
+
+  auto stream = std::make_shared<std::stringstream>(content);
+  ExpectImmediatePromise(
+      provider->uploadFile(item, "filename.bin",
+                           provider->streamUploader(stream)),
+      Pointee(Property(&IItem::filename, "filename.bin")));
+}
+
+TEST(GoogleDriveTest, ResumesUploadFromTransferJournal) {
+  const auto path = util::temporary_directory() + "cloudstorage-gdrive-journal";
+  std::remove(path.c_str());
+  auto mock = CloudFactoryMock::create();
+  ICloudFactory::ProviderInitData data;
+  data.hints_["upload_part_size"] = std::to_string(256 * 1024);
+  data.hints_["transfer_journal"] = path;
+  auto provider = mock.factory()->create("google", data);
+
+  std::string content;
+  for (int i = 0; content.size() < 300 * 1024; i++)
+    content += std::to_string(i);
+  const auto size = std::to_string(content.size());
+
+  auto journal = TransferJournal::open(path);
+  auto callback = provider->streamUploader(
+      std::make_shared<std::stringstream>(content));
+  struct Callback : IUploadFileCallback {
+    std::string content_;
+    uint32_t putData(char* data, uint32_t length, uint64_t offset) override {
+      auto size = std::min<uint64_t>(length, content_.size() - offset);
+      memcpy(data, content_.data() + offset, size);
+      return static_cast<uint32_t>(size);
+    }
+    uint64_t size() override { return content_.size(); }
+    void progress(uint64_t, uint64_t) override {}
+    void done(EitherError<IItem>) override {}
+  } key_callback;
+  key_callback.content_ = content;
+  const auto key =
+      TransferJournal::key("google", "id", "filename.bin", key_callback);
+  journal->put(key, {"http://upload-session/", 262144, {}}, key_callback);
+
+  ExpectHttp(mock.http(), "https://www.googleapis.com/drive/v3/files")
+      .WillRespondWith("{}");
+
+  ExpectHttp(mock.http(), "http://upload-session/")
+      .WithMethod("PUT")
+      .WithFollowNoRedirect()
+      .WithHeaderParameter("Authorization", _)
+      .WithHeaderParameter("Content-Range", "bytes */" + size)
+      .WillRespondWith(HttpResponse().WithStatus(308).WithHeaders(
+          {{"range", "bytes=0-262143"}}))
+      .AndThen()
+      .WithHeaderParameter("Authorization", _)
+      .WithHeaderParameter("Content-Range", "bytes 262144-" +
+                                                std::to_string(
+                                                    content.size() - 1) +
+                                                "/" + size)
+      .WithBody(content.substr(262144))
+      .WillRespondWith(R"js({ "name": "filename.bin" })js");
+
+  auto item = std::make_shared<Item>("item", "id", IItem::UnknownSize,
+                                     IItem::UnknownTimeStamp,
+                                     IItem::FileType::Directory);
+
+  ExpectImmediatePromise(
+      provider->uploadFile(item, "filename.bin", std::move(callback)),
+      Pointee(Property(&IItem::filename, "filename.bin")));
+
+  TransferJournal::Entry entry;
+  EXPECT_FALSE(journal->find(key, entry, key_callback));
+  journal.reset();
+  std::remove(path.c_str());
+}
+
 TEST(GoogleDriveTest, PatchesAlreadyPresentFile) {
   auto mock = CloudFactoryMock::create();
   auto provider = mock.factory()->create("google", {});
@@ -464,7 +759,7 @@ TEST(GoogleDriveTest, PatchesAlreadyPresentFile) {
       .WithParameter("uploadType", "multipart")
       .WithParameter("fields",
                      "id,name,thumbnailLink,trashed,"
-                     "mimeType,iconLink,parents,size,modifiedTime")
+                     "mimeType,iconLink,parents,size,modifiedTime,md5Checksum")
       .WithBody(
           "--fWoDm9QNn3v3Bq3bScUX\r\nContent-Type: application/json; "
           "charset=UTF-8\r\n\r\nnull\r\n--fWoDm9QNn3v3Bq3bScUX\r\nContent-Type:"
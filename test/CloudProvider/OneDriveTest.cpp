@@ -36,7 +36,7 @@ TEST(OneDriveTest, GetsItemData) {
   ExpectHttp(mock.http(), "/drive/items/id")
       .WithMethod("GET")
       .WithParameter("select",
-                     "name,folder,audio,image,photo,video,id,size,"
+                     "name,folder,file,audio,image,photo,video,id,size,"
                      "lastModifiedDateTime,thumbnails,@content.downloadUrl")
       .WithParameter("expand", "thumbnails")
       .WillRespondWith(
@@ -63,7 +63,7 @@ TEST(OneDriveTest, ListsDirectory) {
   ExpectHttp(mock.http(), "/drive/items/id/children")
       .WithMethod("GET")
       .WithParameter("select",
-                     "name,folder,audio,image,photo,video,id,size,"
+                     "name,folder,file,audio,image,photo,video,id,size,"
                      "lastModifiedDateTime,thumbnails,@content.downloadUrl")
       .WithParameter("expand", "thumbnails")
       .WillRespondWith(R"({ "value": [{}] })");
@@ -233,6 +233,54 @@ TEST(OneDriveTest, UploadsItem) {
                          Pointee(Property(&IItem::filename, "filename")));
 }
 
+TEST(OneDriveTest, UploadsItemInChunksAndResumes) {
+  auto mock = CloudFactoryMock::create();
+  ICloudFactory::ProviderInitData data;
+  data.hints_["endpoint"] = "http://endpoint";
+  auto provider = mock.factory()->create("onedrive", data);
+
+  const uint64_t chunk_size = 32 * 320 * 1024;
+  const std::string content = std::string(chunk_size, 'x') + "abc";
+
+  ExpectHttp(mock.http(),
+             "http://endpoint/me/drive/items/parent_id:/filename:/"
+             "createUploadSession")
+      .WithMethod("POST")
+      .WillRespondWith(R"js({ "uploadUrl": "http://upload-url/" })js");
+
+  ExpectHttp(mock.http(), "http://upload-url/")
+      .WithMethod("PUT")
+      .WithHeaderParameter("Content-Range", "bytes 0-10485759/10485763")
+      .WithHeaderParameter("Authorization", _)
+      .WithBody(content.substr(0, chunk_size))
+      .WillRespondWith(HttpResponse().WithStatus(202).WithContent(
+          R"js({ "nextExpectedRanges": ["10485760-"] })js"))
+      .AndThen()
+      .WithHeaderParameter("Content-Range",
+                           "bytes 10485760-10485762/10485763")
+      .WithHeaderParameter("Authorization", _)
+      .WithBody("abc")
+      .WillRespondWithCode(416)
+      .AndThen()
+      .WithHeaderParameter("Content-Range",
+                           "bytes 10485761-10485762/10485763")
+      .WithHeaderParameter("Authorization", _)
+      .WithBody("bc")
+      .WillRespondWith(R"js({ "name": "filename" })js");
+
+  ExpectHttp(mock.http(), "http://upload-url/")
+      .WillRespondWith(R"js({ "nextExpectedRanges": ["10485761-"] })js");
+
+  auto parent = std::make_shared<Item>(
+      "directory", "parent_id", IItem::UnknownSize, IItem::UnknownTimeStamp,
+      IItem::FileType::Directory);
+
+  auto stream = std::make_shared<std::stringstream>(content);
+  ExpectImmediatePromise(provider->uploadFile(parent, "filename",
+                                              provider->streamUploader(stream)),
+                         Pointee(Property(&IItem::filename, "filename")));
+}
+
 TEST(OneDriveTest, AuthorizationTest) {
   auto mock = CloudFactoryMock::create();
 
@@ -0,0 +1,66 @@
+#include "gtest/gtest.h"
+
+#include "IChunkSizer.h"
+
+namespace cloudstorage {
+
+namespace {
+
+using Direction = IChunkSizer::Direction;
+using std::chrono::milliseconds;
+
+const uint64_t MiB = 1024 * 1024;
+const IChunkSizer::Limits LIMITS = {MiB, 64 * MiB, 256 * 1024, 8 * MiB};
+
+}  // namespace
+
+TEST(ChunkSizerTest, UsesDefaultUntilLinkIsMeasured) {
+  auto sizer = IChunkSizer::create();
+  EXPECT_EQ(sizer->chunkSize("upload", Direction::Upload, LIMITS), 8 * MiB);
+  sizer->update({10 * MiB, 0}, milliseconds(50));
+  EXPECT_EQ(sizer->chunkSize("upload", Direction::Upload, LIMITS), 8 * MiB);
+}
+
+TEST(ChunkSizerTest, FollowsBandwidthDelayProduct) {
+  auto sizer = IChunkSizer::create();
+  sizer->update({10 * MiB, 2 * MiB}, milliseconds(100));
+  auto download = sizer->chunkSize("download", Direction::Download, LIMITS);
+  auto upload = sizer->chunkSize("upload", Direction::Upload, LIMITS);
+  EXPECT_EQ(download % LIMITS.granularity_, 0u);
+  EXPECT_EQ(upload % LIMITS.granularity_, 0u);
+  EXPECT_GT(download, upload);
+  EXPECT_GE(upload, LIMITS.min_);
+
+  sizer->update({1024 * MiB, 1024 * MiB}, milliseconds(500));
+  for (int i = 0; i < 16; i++)
+    sizer->update({1024 * MiB, 1024 * MiB}, milliseconds(500));
+  EXPECT_EQ(sizer->chunkSize("upload", Direction::Upload, LIMITS), 64 * MiB);
+
+  auto slow = IChunkSizer::create();
+  slow->update({16 * 1024, 16 * 1024}, milliseconds(20));
+  EXPECT_EQ(slow->chunkSize("upload", Direction::Upload, LIMITS), MiB);
+
+  auto statistics = sizer->statistics();
+  EXPECT_EQ(statistics.chunk_sizes_["upload"], 64 * MiB);
+  EXPECT_EQ(statistics.chunk_sizes_["download"], download);
+}
+
+TEST(ChunkSizerTest, ReservationsStayWithinMemoryBudget) {
+  auto sizer = IChunkSizer::create(20 * MiB);
+  auto first = sizer->reserve("stream", Direction::Download, LIMITS, 2);
+  EXPECT_EQ(first->size(), 8 * MiB);
+  EXPECT_EQ(sizer->statistics().reserved_memory_, 16 * MiB);
+
+  auto second = sizer->reserve("stream", Direction::Download, LIMITS, 2);
+  EXPECT_EQ(second->size(), 2 * MiB);
+  auto third = sizer->reserve("stream", Direction::Download, LIMITS, 2);
+  EXPECT_EQ(third->size(), LIMITS.min_);
+  EXPECT_EQ(sizer->statistics().reserved_memory_, 22 * MiB);
+
+  first = nullptr;
+  second = nullptr;
+  third = nullptr;
+  EXPECT_EQ(sizer->statistics().reserved_memory_, 0u);
+}
+
+}  // namespace cloudstorage
@@ -0,0 +1,65 @@
+#include "gtest/gtest.h"
+
+#include "Utility/ChunkedBuffer.h"
+#include "Utility/Utility.h"
+
+namespace cloudstorage {
+
+TEST(ChunkedBufferTest, ReadsBackDataSpanningManyChunks) {
+  std::string data;
+  for (int i = 0; i < 100000; i++) data += std::to_string(i);
+  util::ChunkedStream stream;
+  stream << data;
+  EXPECT_GT(stream.buffer().chunks().size(), 1u);
+  EXPECT_EQ(stream.buffer().size(), data.size());
+  EXPECT_EQ(stream.str(), data);
+
+  std::string read(data.size(), 0);
+  stream.read(&read[0], static_cast<std::streamsize>(read.size()));
+  EXPECT_EQ(read, data);
+  EXPECT_EQ(stream.get(), std::char_traits<char>::eof());
+}
+
+TEST(ChunkedBufferTest, SeeksWithinReadableData) {
+  std::string data(10000, 'a');
+  data += "marker";
+  util::ChunkedStream stream;
+  stream << data;
+  stream.seekg(0, std::ios::end);
+  EXPECT_EQ(static_cast<size_t>(stream.tellg()), data.size());
+  stream.seekg(10000);
+  std::string word;
+  stream >> word;
+  EXPECT_EQ(word, "marker");
+}
+
+TEST(ChunkedBufferTest, ViewKeepsReadPosition) {
+  std::string data(10000, 'b');
+  util::ChunkedStream stream;
+  stream << "x" << data;
+  EXPECT_EQ(stream.get(), 'x');
+  EXPECT_EQ(stream.view(), data);
+  EXPECT_EQ(stream.buffer().chunks().size(), 1u);
+  EXPECT_EQ(stream.str(), "x" + data);
+}
+
+TEST(ChunkedBufferTest, AppendsChunkWithoutCopying) {
+  auto chunk = std::make_shared<std::vector<char>>(1024, 'c');
+  chunk->resize(3);
+  util::ChunkedStream stream;
+  stream.buffer().append(chunk);
+  stream << "d";
+  EXPECT_EQ(stream.buffer().chunks().front(), chunk);
+  EXPECT_EQ(chunk->size(), 3u);
+  EXPECT_EQ(stream.str(), "cccd");
+}
+
+TEST(ChunkedBufferTest, ParsesJsonInPlace) {
+  util::ChunkedStream stream;
+  stream << R"({"key": "value"})";
+  EXPECT_EQ(util::json::from_stream(stream)["key"].asString(), "value");
+  std::stringstream sstream(R"({"key": 1})");
+  EXPECT_EQ(util::json::from_stream(sstream)["key"].asInt(), 1);
+}
+
+}  // namespace cloudstorage
@@ -89,7 +89,7 @@ CloudFactoryMock CloudFactoryMock::create() {
           "http://cloudstorage-test/", std::move(http_mock),
           std::move(http_server_factory_mock), nullptr,
           std::move(thread_pool_factory_mock), std::move(callback_mock),
-          std::move(init_data)});
+          std::move(init_data), ""});
 
   EXPECT_CALL(*callback_mock_ptr, onEventsAdded)
       .WillRepeatedly(Invoke(
@@ -76,6 +76,10 @@ class CloudProviderMock : public cloudstorage::CloudProvider {
               (cloudstorage::IItem::Pointer, cloudstorage::IItem::Pointer,
                cloudstorage::MoveItemCallback),
               (override));
+  MOCK_METHOD(CopyItemRequest::Pointer, copyItemAsync,
+              (cloudstorage::IItem::Pointer, cloudstorage::IItem::Pointer,
+               cloudstorage::CopyItemCallback),
+              (override));
   MOCK_METHOD(RenameItemRequest::Pointer, renameItemAsync,
               (cloudstorage::IItem::Pointer, const std::string&,
                cloudstorage::RenameItemCallback),
@@ -105,6 +109,13 @@ class CloudProviderMock : public cloudstorage::CloudProvider {
   MOCK_METHOD(GetItemUrlRequest::Pointer, getFileDaemonUrlAsync,
               (cloudstorage::IItem::Pointer, cloudstorage::GetItemUrlCallback),
               (override));
+  MOCK_METHOD(cloudstorage::IHttpRequest::Pointer, listDirectoryRequest,
+              (const cloudstorage::IItem&, const std::string&, std::ostream&),
+              (const, override));
+  MOCK_METHOD(cloudstorage::ListDirectoryParser::Pointer, listDirectoryParser,
+              (const cloudstorage::IItem&,
+               const cloudstorage::ListDirectoryParser::ItemCallback&),
+              (const, override));
 
   HttpMock* http() const;
 
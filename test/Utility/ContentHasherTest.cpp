@@ -0,0 +1,59 @@
+#include "gtest/gtest.h"
+
+#include "IContentHasher.h"
+
+namespace cloudstorage {
+
+namespace {
+
+std::string content() {
+  std::string result(5 * 1024 * 1024 + 123, 0);
+  for (size_t i = 0; i < result.size(); i++)
+    result[i] = static_cast<char>((i * 31 + 7) % 251);
+  return result;
+}
+
+std::string hash(IItem::HashType type, const std::string& data,
+                 size_t chunk_size) {
+  auto hasher = IContentHasher::create(type);
+  for (size_t i = 0; i < data.size(); i += chunk_size)
+    hasher->update(data.data() + i, std::min(chunk_size, data.size() - i));
+  return hasher->digest();
+}
+
+}  // namespace
+
+TEST(ContentHasherTest, ComputesMD5) {
+  EXPECT_EQ(hash(IItem::HashType::MD5, "", 1),
+            "d41d8cd98f00b204e9800998ecf8427e");
+  EXPECT_EQ(hash(IItem::HashType::MD5, "abc", 1),
+            "900150983cd24fb0d6963f7d28e17f72");
+  EXPECT_EQ(hash(IItem::HashType::MD5, content(), 1000003),
+            "9442dff95c87d9ff204eeb1deceee2e4");
+}
+
+TEST(ContentHasherTest, ComputesDropboxContentHash) {
+  EXPECT_EQ(hash(IItem::HashType::Dropbox, "", 1),
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  EXPECT_EQ(hash(IItem::HashType::Dropbox, "abc", 2),
+            "4f8b42c22dd3729b519ba6f68d2da7cc5b2d606d05daed5ad5128cc03e6c6358");
+  EXPECT_EQ(hash(IItem::HashType::Dropbox, content(), 1000003),
+            "22937b44a13a1ad50f8803a949c7203227ae0b85fe0836daba905bfac7418b0b");
+}
+
+TEST(ContentHasherTest, ComputesQuickXorHash) {
+  EXPECT_EQ(hash(IItem::HashType::QuickXor, "", 1),
+            "AAAAAAAAAAAAAAAAAAAAAAAAAAA=");
+  EXPECT_EQ(hash(IItem::HashType::QuickXor, "J", 1),
+            "SgAAAAAAAAAAAAAAAQAAAAAAAAA=");
+  EXPECT_EQ(hash(IItem::HashType::QuickXor, content(), 1000003),
+            "K+u1XP35j839JcKd/JQ64Utw5Qw=");
+  EXPECT_EQ(hash(IItem::HashType::QuickXor, content(), 7),
+            "K+u1XP35j839JcKd/JQ64Utw5Qw=");
+}
+
+TEST(ContentHasherTest, HasNoHasherForUnknownType) {
+  EXPECT_EQ(IContentHasher::create(IItem::HashType::Unknown), nullptr);
+}
+
+}  // namespace cloudstorage
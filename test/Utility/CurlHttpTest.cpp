@@ -0,0 +1,426 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "IHttp.h"
+#include "Utility/CurlHttp.h"
+#include "Utility/Utility.h"
+
+namespace cloudstorage {
+
+#ifdef WITH_CURL
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+class HttpCallback : public IHttpRequest::ICallback {
+ public:
+  bool isSuccess(int, const IHttpRequest::HeaderParameters&) const override {
+    return true;
+  }
+  bool abort() override { return false; }
+  bool pause() override { return false; }
+  void progressDownload(uint64_t, uint64_t) override {}
+  void progressUpload(uint64_t, uint64_t) override {}
+};
+
+#ifndef _WIN32
+
+// Serves content to a single client over plain HTTP on a loopback port.
+class ContentServer {
+ public:
+  explicit ContentServer(std::string content)
+      : content_(std::move(content)),
+        socket_(::socket(AF_INET, SOCK_STREAM, 0)) {
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    ::bind(socket_, reinterpret_cast<sockaddr*>(&address), length);
+    ::listen(socket_, 1);
+    ::getsockname(socket_, reinterpret_cast<sockaddr*>(&address), &length);
+    port_ = ntohs(address.sin_port);
+    thread_ = std::thread([this] { serve(); });
+  }
+
+  ~ContentServer() {
+    ::shutdown(socket_, SHUT_RDWR);
+    if (thread_.joinable()) thread_.join();
+    ::close(socket_);
+  }
+
+  std::string url() const {
+    return "http://127.0.0.1:" + std::to_string(port_) + "/";
+  }
+
+  // Headers of the request served; valid once the response was received.
+  std::string request() {
+    thread_.join();
+    return request_;
+  }
+
+ private:
+  void serve() {
+    int client = ::accept(socket_, nullptr, nullptr);
+    if (client < 0) return;
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos) {
+      auto count = ::recv(client, buffer, sizeof(buffer), 0);
+      if (count <= 0) break;
+      request.append(buffer, static_cast<size_t>(count));
+    }
+    request_ = request;
+    auto response = "HTTP/1.1 200 OK\r\nContent-Length: " +
+                    std::to_string(content_.size()) +
+                    "\r\nConnection: close\r\n\r\n" + content_;
+    size_t sent = 0;
+    while (sent < response.size()) {
+      auto count =
+          ::send(client, response.data() + sent, response.size() - sent, 0);
+      if (count <= 0) break;
+      sent += static_cast<size_t>(count);
+    }
+    ::close(client);
+  }
+
+  std::string content_;
+  std::string request_;
+  int socket_;
+  uint16_t port_;
+  std::thread thread_;
+};
+
+#endif  // _WIN32
+
+class FirstByteBuffer : public std::streambuf {
+ public:
+  Clock::time_point first_byte() const { return first_byte_; }
+
+ protected:
+  std::streamsize xsputn(const char*, std::streamsize count) override {
+    mark();
+    return count;
+  }
+
+  int_type overflow(int_type c) override {
+    mark();
+    return c;
+  }
+
+ private:
+  void mark() {
+    if (first_byte_ == Clock::time_point()) first_byte_ = Clock::now();
+  }
+
+  Clock::time_point first_byte_;
+};
+
+class FirstByteStream : public std::ostream {
+ public:
+  FirstByteStream() : std::ostream(&buffer_) {}
+
+  Clock::time_point first_byte() const { return buffer_.first_byte(); }
+
+ private:
+  FirstByteBuffer buffer_;
+};
+
+}  // namespace
+
+TEST(CurlHttpTest, MeasuresQueueToFirstByteLatency) {
+  const int REQUEST_COUNT = 20;
+  const auto path = util::temporary_directory() + "cloudstorage-curl-test";
+  std::ofstream(path) << "content";
+
+  auto http = IHttp::create();
+  std::vector<Clock::duration> latency;
+  for (int i = 0; i < REQUEST_COUNT; i++) {
+    auto output = std::make_shared<FirstByteStream>();
+    std::promise<void> done;
+    auto start = Clock::now();
+    http->create("file://" + path)
+        ->send([&](const IHttpRequest::Response&) { done.set_value(); },
+               std::make_shared<std::stringstream>(), output,
+               std::make_shared<std::stringstream>(),
+               std::make_shared<HttpCallback>());
+    done.get_future().wait();
+    ASSERT_NE(output->first_byte(), Clock::time_point());
+    latency.push_back(output->first_byte() - start);
+  }
+  std::remove(path.c_str());
+
+  std::sort(latency.begin(), latency.end());
+  auto to_us = [](Clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+  };
+  util::log("queue-to-first-byte latency [us]: min", to_us(latency.front()),
+            "median", to_us(latency[latency.size() / 2]), "max",
+            to_us(latency.back()));
+
+  EXPECT_LT(latency[latency.size() / 2], std::chrono::milliseconds(50));
+}
+
+TEST(CurlHttpTest, RecycledHandlesDoNotLeakRequestState) {
+  const int REQUEST_COUNT = 8;
+  const auto path = util::temporary_directory() + "cloudstorage-curl-test";
+  std::ofstream(path) << "0123456789";
+
+  IHttp::InitData data;
+  data.idle_handle_count_ = 1;
+  auto http = IHttp::create(data);
+  for (int i = 0; i < REQUEST_COUNT; i++) {
+    auto output = std::make_shared<std::stringstream>();
+    std::promise<int> done;
+    auto request = http->create("file://" + path);
+    if (i % 2 == 0) request->setHeaderParameter("Range", "bytes=2-4");
+    request->send(
+        [&](const IHttpRequest::Response& r) { done.set_value(r.http_code_); },
+        std::make_shared<std::stringstream>(), output,
+        std::make_shared<std::stringstream>(),
+        std::make_shared<HttpCallback>());
+    EXPECT_GE(done.get_future().get(), 0);
+    EXPECT_EQ(output->str(), i % 2 == 0 ? "234" : "0123456789");
+  }
+  std::remove(path.c_str());
+}
+
+TEST(CurlHttpTest, ShardedWorkersCompleteAllRequests) {
+  const int REQUEST_COUNT = 32;
+  const auto path = util::temporary_directory() + "cloudstorage-curl-test";
+  std::ofstream(path) << "content";
+
+  IHttp::InitData data;
+  data.worker_count_ = 4;
+  auto http = IHttp::create(data);
+  EXPECT_EQ(http->queueDepth(), std::vector<uint32_t>(4, 0));
+
+  std::vector<std::future<int>> results;
+  std::vector<std::shared_ptr<std::stringstream>> outputs;
+  for (int i = 0; i < REQUEST_COUNT; i++) {
+    auto done = std::make_shared<std::promise<int>>();
+    results.push_back(done->get_future());
+    outputs.push_back(std::make_shared<std::stringstream>());
+    http->create("file://" + path)
+        ->send([=](const IHttpRequest::Response& r) {
+                 done->set_value(r.http_code_);
+               },
+               std::make_shared<std::stringstream>(), outputs.back(),
+               std::make_shared<std::stringstream>(),
+               std::make_shared<HttpCallback>());
+  }
+  for (int i = 0; i < REQUEST_COUNT; i++) {
+    EXPECT_GE(results[i].get(), 0);
+    EXPECT_EQ(outputs[i]->str(), "content");
+  }
+  std::remove(path.c_str());
+
+  EXPECT_EQ(http->queueDepth(), std::vector<uint32_t>(4, 0));
+}
+
+TEST(CurlHttpTest, CountsReceivedBytes) {
+  const int REQUEST_COUNT = 4;
+  const auto path = util::temporary_directory() + "cloudstorage-curl-test";
+  std::ofstream(path) << "content";
+
+  auto http = IHttp::create();
+  for (int i = 0; i < REQUEST_COUNT; i++) {
+    std::promise<void> done;
+    http->create("file://" + path)
+        ->send([&](const IHttpRequest::Response&) { done.set_value(); },
+               std::make_shared<std::stringstream>(),
+               std::make_shared<std::stringstream>(),
+               std::make_shared<std::stringstream>(),
+               std::make_shared<HttpCallback>());
+    done.get_future().wait();
+  }
+  std::remove(path.c_str());
+
+  auto statistics = http->statistics();
+  EXPECT_EQ(statistics.decoded_bytes_, REQUEST_COUNT * strlen("content"));
+  EXPECT_EQ(statistics.wire_bytes_, statistics.decoded_bytes_);
+}
+
+#ifndef _WIN32
+
+TEST(CurlHttpTest, AcceptsCompressionOnlyForMetadata) {
+  auto http = IHttp::create();
+  auto accepts_encoding = [&](const std::string& method,
+                              IHttpRequest::Priority priority) {
+    ContentServer server("content");
+    auto request = http->create(server.url(), method);
+    request->setPriority(priority);
+    std::promise<void> done;
+    request->send([&](const IHttpRequest::Response&) { done.set_value(); },
+                  std::make_shared<std::stringstream>(),
+                  std::make_shared<std::stringstream>(),
+                  std::make_shared<std::stringstream>(),
+                  std::make_shared<HttpCallback>());
+    done.get_future().wait();
+    auto headers = server.request();
+    std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+    return headers.find("accept-encoding:") != std::string::npos;
+  };
+
+  if (curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_LIBZ) {
+    EXPECT_TRUE(accepts_encoding("GET", IHttpRequest::Priority::Metadata));
+  }
+  EXPECT_FALSE(accepts_encoding("HEAD", IHttpRequest::Priority::Metadata));
+  EXPECT_FALSE(accepts_encoding("GET", IHttpRequest::Priority::Bulk));
+  EXPECT_FALSE(accepts_encoding("GET", IHttpRequest::Priority::Interactive));
+}
+
+#endif  // _WIN32
+
+TEST(CurlHttpTest, ParsesHeaderLines) {
+  curl::HeaderTable table;
+  for (std::string line :
+       {"Content-Length: 1024\r\n", "Content-Range:  bytes   0-1023/4096 \r\n",
+        "Set-Cookie: a=b\r\n", "set-cookie: c=d\r\n", "X-Empty:\r\n",
+        "garbage\r\n"})
+    table.add(line.data(), line.size());
+
+  IHttpRequest::HeaderParameters headers;
+  table.get(headers);
+  EXPECT_EQ(headers.size(), 5u);
+  EXPECT_EQ(headers.count("set-cookie"), 2u);
+  EXPECT_EQ(headers.find("content-length")->second, "1024");
+  EXPECT_EQ(headers.find("content-range")->second, "bytes 0-1023/4096");
+  EXPECT_EQ(headers.find("x-empty")->second, "");
+
+  table.clear();
+  table.get(headers);
+  EXPECT_TRUE(headers.empty());
+}
+
+TEST(CurlHttpTest, TokenBucketCapsRate) {
+  using std::chrono::milliseconds;
+  curl::TokenBucket bucket;
+  auto start = curl::TokenBucket::Clock::now();
+  EXPECT_EQ(bucket.available(1 << 20, start), 1u << 20);
+
+  bucket.setRate(1000000, start);
+  EXPECT_EQ(bucket.available(1 << 20, start), 100000u);
+  bucket.consume(150000, start);
+  EXPECT_EQ(bucket.available(1, start), 0u);
+  EXPECT_GE(bucket.delay(start), milliseconds(50));
+  EXPECT_LE(bucket.delay(start), milliseconds(51));
+  EXPECT_EQ(bucket.available(1 << 20, start + milliseconds(60)), 10000u);
+  EXPECT_EQ(bucket.available(1 << 20, start + milliseconds(500)), 100000u);
+
+  bucket.consume(100000, start + milliseconds(500));
+  EXPECT_NEAR(bucket.achievedRate(start + milliseconds(1250)), 200000, 2000);
+
+  bucket.setRate(0, start + milliseconds(1250));
+  EXPECT_EQ(bucket.available(1 << 20, start + milliseconds(1250)), 1u << 20);
+  EXPECT_EQ(bucket.delay(start + milliseconds(1250)),
+            curl::TokenBucket::Clock::duration::zero());
+}
+
+TEST(CurlHttpTest, BoundsBulkDelayAfterUncontendedTraffic) {
+  using Priority = IHttpRequest::Priority;
+  const uint64_t RATE = 1000000;
+  IHttp::InitData data;
+  data.bandwidth_limit_.download_ = RATE;
+  data.priority_classes_[static_cast<size_t>(Priority::Interactive)]
+      .reserved_bandwidth_ = 50;
+  auto scheduler = std::make_shared<curl::BandwidthScheduler>(data);
+  curl::RequestData request{};
+  request.scheduler_ = scheduler;
+  request.priority_ = Priority::Bulk;
+  request.download_throttled_ = true;
+
+  // Ten seconds worth of the bulk share, received while nothing else ran.
+  for (int i = 0; i < 100; i++) request.consume(false, RATE / 20);
+  EXPECT_EQ(request.delay(), curl::TokenBucket::Clock::duration::zero());
+
+  // Debt of the bulk bucket is at most its tenth of a second burst.
+  scheduler->started(Priority::Interactive);
+  EXPECT_GT(request.delay(), std::chrono::milliseconds(90));
+  EXPECT_LE(request.delay(), std::chrono::milliseconds(101));
+  scheduler->finished(Priority::Interactive);
+}
+
+TEST(CurlHttpTest, AdmitsRequestsByPriority) {
+  using Priority = IHttpRequest::Priority;
+  IHttp::InitData data;
+  data.priority_classes_[static_cast<size_t>(Priority::Bulk)].max_running_ = 1;
+  curl::AdmissionQueue queue(data);
+  auto request = [](Priority priority, long id) {
+    auto r = util::make_unique<curl::RequestData>();
+    r->priority_ = priority;
+    r->http_code_ = id;
+    return r;
+  };
+  auto admit = [&] {
+    std::vector<long> result;
+    for (auto&& r : queue.admit()) result.push_back(r->http_code_);
+    return result;
+  };
+
+  queue.push(request(Priority::Bulk, 1));
+  queue.push(request(Priority::Bulk, 2));
+  queue.push(request(Priority::Metadata, 3));
+  queue.push(request(Priority::Interactive, 4));
+  EXPECT_EQ(admit(), std::vector<long>({4, 3, 1}));
+  EXPECT_EQ(admit(), std::vector<long>());
+  EXPECT_FALSE(queue.empty());
+
+  queue.finished(Priority::Interactive);
+  queue.finished(Priority::Bulk);
+  queue.push(request(Priority::Interactive, 5));
+  EXPECT_EQ(admit(), std::vector<long>({5, 2}));
+  EXPECT_TRUE(queue.empty());
+}
+
+#ifndef _WIN32
+
+TEST(CurlHttpTest, ThrottlesDownload) {
+  const uint64_t RATE = 256 * 1024;
+  std::string content;
+  for (int i = 0; content.size() < 128 * 1024; i++)
+    content += std::to_string(i);
+  ContentServer server(content);
+
+  IHttp::InitData data;
+  data.bandwidth_limit_.download_ = RATE;
+  auto http = IHttp::create(data);
+  auto output = std::make_shared<std::stringstream>();
+  std::promise<int> done;
+  auto start = Clock::now();
+  http->create(server.url())
+      ->send([&](const IHttpRequest::Response& r) {
+               done.set_value(r.http_code_);
+             },
+             std::make_shared<std::stringstream>(), output,
+             std::make_shared<std::stringstream>(),
+             std::make_shared<HttpCallback>());
+  EXPECT_EQ(done.get_future().get(), IHttpRequest::Ok);
+  auto elapsed = Clock::now() - start;
+
+  EXPECT_EQ(output->str(), content);
+  // Bucket starts full, so that much is received without waiting.
+  auto burst = std::max<uint64_t>(RATE / 10, CURL_MAX_WRITE_SIZE);
+  EXPECT_GE(elapsed,
+            std::chrono::milliseconds(1000 * (content.size() - burst) / RATE));
+}
+
+#endif  // _WIN32
+
+#endif  // WITH_CURL
+
+}  // namespace cloudstorage
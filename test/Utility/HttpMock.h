@@ -30,6 +30,9 @@ class LimitedHttpRequestMatcher;
 
 class HttpRequestMock : public cloudstorage::IHttpRequest {
  public:
+  explicit HttpRequestMock(std::string method = "")
+      : method_(std::move(method)) {}
+
   MOCK_METHOD2(setParameter,
                void(const std::string& parameter, const std::string& value));
 
@@ -0,0 +1,226 @@
+#include "gtest/gtest.h"
+
+#include <tinyxml2.h>
+#include <chrono>
+
+#include "CloudProvider/GoogleDrive.h"
+#include "Request/ListDirectoryParser.h"
+#include "Request/ListDirectoryRequest.h"
+#include "Utility/CloudProviderMock.h"
+#include "Utility/Item.h"
+#include "Utility/Utility.h"
+
+namespace cloudstorage {
+
+using ::testing::_;
+using ::testing::ByMove;
+using ::testing::Invoke;
+using ::testing::InvokeArgument;
+using ::testing::Return;
+
+namespace {
+
+class ListDirectoryCallbackMock : public IListDirectoryCallback {
+ public:
+  MOCK_METHOD(void, receivedItem, (IItem::Pointer), (override));
+  MOCK_METHOD(void, done, (EitherError<IItem::List>), (override));
+};
+
+void write(ListDirectoryParser& parser, const std::string& data,
+           size_t chunk_size) {
+  for (size_t i = 0; i < data.size(); i += chunk_size)
+    parser.write(data.data() + i, std::min(chunk_size, data.size() - i));
+}
+
+std::string google_drive_page(int item_count) {
+  Json::Value json;
+  for (int i = 0; i < item_count; i++) {
+    Json::Value item;
+    item["id"] = "id" + std::to_string(i);
+    item["name"] = "file \"" + std::to_string(i) + "\" [1].txt";
+    item["mimeType"] = "text/plain";
+    item["size"] = std::to_string(i * 1000);
+    item["modifiedTime"] = "2017-05-02T18:05:18.735Z";
+    item["thumbnailLink"] = "https://example.com/thumbnail/" +
+                            std::to_string(i);
+    json["files"].append(item);
+  }
+  json["nextPageToken"] = "next";
+  return util::json::to_string(json);
+}
+
+}  // namespace
+
+TEST(ListDirectoryParserTest, ReportsJsonElementsBeforeDocumentEnds) {
+  std::vector<Json::Value> elements;
+  JsonListParser parser(
+      "files", [&](const Json::Value& v) { elements.push_back(v); },
+      [](const Json::Value& v) { return v["nextPageToken"].asString(); });
+
+  std::string first = R"({"kind": "list", "files": [{"name": "a]}\"{"}, )";
+  std::string second = R"({"name": "b", "x": [1, {}]}], "nextPageToken": "t"})";
+  parser.write(first.data(), first.size());
+  ASSERT_EQ(elements.size(), 1u);
+  EXPECT_EQ(elements[0]["name"].asString(), "a]}\"{");
+  parser.write(second.data(), second.size());
+  ASSERT_EQ(elements.size(), 2u);
+  EXPECT_EQ(elements[1]["name"].asString(), "b");
+  EXPECT_EQ(parser.finish(), "t");
+}
+
+TEST(ListDirectoryParserTest, ReportsXmlElementsBeforeDocumentEnds) {
+  std::vector<std::string> keys;
+  XmlListParser parser(
+      {"Contents"},
+      [&](const tinyxml2::XMLElement* e) {
+        keys.push_back(e->FirstChildElement("Key")->GetText());
+      },
+      [](const tinyxml2::XMLElement* root) {
+        return root->FirstChildElement("NextContinuationToken")->GetText();
+      });
+
+  std::string first =
+      "<?xml version=\"1.0\"?><ListBucketResult><Name>b</Name>"
+      "<Contents><Key>a</Key></Contents><!-- <Contents> --><Conte";
+  std::string second =
+      "nts><Key>b</Key></Contents>"
+      "<NextContinuationToken>t</NextContinuationToken></ListBucketResult>";
+  parser.write(first.data(), first.size());
+  EXPECT_EQ(keys, std::vector<std::string>({"a"}));
+  parser.write(second.data(), second.size());
+  EXPECT_EQ(keys, std::vector<std::string>({"a", "b"}));
+  EXPECT_EQ(parser.finish(), "t");
+}
+
+TEST(ListDirectoryParserTest, ReportsMalformedInputOnFinish) {
+  JsonListParser parser(
+      "files", [](const Json::Value&) {},
+      [](const Json::Value&) { return ""; });
+  std::ostream stream(&parser);
+  stream << R"({"files": [{"name": }])";
+  EXPECT_THROW(parser.finish(), Json::Exception);
+}
+
+TEST(ListDirectoryParserTest, MeasuresItemsPerSecond) {
+  const int ITEM_COUNT = 1000;
+  const int ITERATION_COUNT = 20;
+  const size_t CHUNK_SIZE = 16 * 1024;
+  using Clock = std::chrono::steady_clock;
+
+  auto provider = std::make_shared<GoogleDrive>();
+  auto directory = std::make_shared<Item>(
+      "directory", "directory_id", IItem::UnknownSize, IItem::UnknownTimeStamp,
+      IItem::FileType::Directory);
+  auto page = google_drive_page(ITEM_COUNT);
+
+  size_t dom_items = 0;
+  auto dom_start = Clock::now();
+  for (int i = 0; i < ITERATION_COUNT; i++) {
+    util::ChunkedStream stream;
+    for (size_t j = 0; j < page.size(); j += CHUNK_SIZE)
+      stream.write(page.data() + j, std::min(CHUNK_SIZE, page.size() - j));
+    std::string token;
+    dom_items += provider->listDirectoryResponse(*directory, stream, token).size();
+  }
+  auto dom_time = Clock::now() - dom_start;
+
+  size_t streaming_items = 0;
+  Clock::duration first_item_time{};
+  auto streaming_start = Clock::now();
+  for (int i = 0; i < ITERATION_COUNT; i++) {
+    auto start = Clock::now();
+    bool first = true;
+    auto parser =
+        provider->listDirectoryParser(*directory, [&](IItem::Pointer) {
+          if (util::exchange(first, false)) first_item_time += Clock::now() - start;
+          streaming_items++;
+        });
+    write(*parser, page, CHUNK_SIZE);
+    parser->finish();
+  }
+  auto streaming_time = Clock::now() - streaming_start;
+
+  EXPECT_EQ(dom_items, streaming_items);
+  auto per_second = [](size_t count, Clock::duration d) {
+    return static_cast<uint64_t>(
+        count / std::chrono::duration<double>(d).count());
+  };
+  auto to_us = [](Clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+  };
+  util::log("listing parse [items/s]: dom", per_second(dom_items, dom_time),
+            "streaming", per_second(streaming_items, streaming_time));
+  util::log("time to first item [us]: dom", to_us(dom_time / ITERATION_COUNT),
+            "streaming", to_us(first_item_time / ITERATION_COUNT));
+}
+
+TEST(ListDirectoryParserTest, ReportsItemsOnceWhenPageIsRetried) {
+  auto provider = CloudProviderMock::create();
+  EXPECT_CALL(*provider->auth(), refreshTokenRequest).WillOnce(Return([] {
+    auto mock_request = std::make_shared<HttpRequestMock>();
+    EXPECT_CALL(*mock_request, send)
+        .WillOnce(InvokeArgument<0>(
+            IHttpRequest::Response{200, {}, nullptr, nullptr}));
+    return mock_request;
+  }()));
+  EXPECT_CALL(*provider->auth(), refreshTokenResponse)
+      .WillOnce(Return(ByMove(std::make_unique<IAuth::Token>())));
+  EXPECT_CALL(*provider, listDirectoryParser)
+      .WillRepeatedly(Invoke([](const IItem&,
+                                const ListDirectoryParser::ItemCallback& cb) {
+        return util::make_unique<JsonListParser>(
+            "files",
+            [=](const Json::Value& v) {
+              cb(util::make_unique<Item>(
+                  v["name"].asString(), v["name"].asString(), 0,
+                  IItem::UnknownTimeStamp, IItem::FileType::Unknown));
+            },
+            [](const Json::Value&) { return ""; });
+      }));
+
+  // The first attempt is rejected after part of the page was received.
+  int request_count = 0;
+  EXPECT_CALL(*provider, listDirectoryRequest)
+      .WillRepeatedly(Invoke([&](const IItem&, const std::string&,
+                                 std::ostream&) {
+        auto mock_request = std::make_shared<HttpRequestMock>("GET");
+        auto first = request_count++ == 0;
+        EXPECT_CALL(*mock_request, send)
+            .WillOnce(Invoke(
+                [=](const IHttpRequest::CompleteCallback& complete,
+                    const std::shared_ptr<std::istream>&,
+                    const std::shared_ptr<std::ostream>& response,
+                    const std::shared_ptr<std::ostream>& error,
+                    const IHttpRequest::ICallback::Pointer&) {
+                  *response << R"({"files": [{"name": "a"}, )";
+                  if (first)
+                    return complete({IHttpRequest::Unauthorized, {}, response,
+                                     error});
+                  *response << R"({"name": "b"}]})";
+                  complete({IHttpRequest::Ok, {}, response, error});
+                }));
+        return mock_request;
+      }));
+
+  auto callback = std::make_shared<ListDirectoryCallbackMock>();
+  std::vector<std::string> reported;
+  EXPECT_CALL(*callback, receivedItem)
+      .WillRepeatedly(Invoke(
+          [&](IItem::Pointer item) { reported.push_back(item->filename()); }));
+  EXPECT_CALL(*callback, done);
+
+  auto request = std::make_shared<ListDirectoryRequest>(
+      provider,
+      util::make_unique<Item>("root", "root", IItem::UnknownSize,
+                              IItem::UnknownTimeStamp,
+                              IItem::FileType::Directory),
+      callback);
+  auto result = request->run()->result();
+
+  ASSERT_NE(result.right(), nullptr);
+  EXPECT_EQ(result.right()->size(), 2u);
+  EXPECT_EQ(reported, (std::vector<std::string>{"a", "b"}));
+  EXPECT_EQ(request_count, 2);
+}
+
+}  // namespace cloudstorage
@@ -1,6 +1,7 @@
 #include "gtest/gtest.h"
 
 #include "Request/Request.h"
+#include "Request/RetryPolicy.h"
 #include "Utility/AuthMock.h"
 #include "Utility/CloudProviderMock.h"
 
@@ -8,6 +9,7 @@ namespace cloudstorage {
 
 using ::testing::ByMove;
 using ::testing::Eq;
+using ::testing::Field;
 using ::testing::Invoke;
 using ::testing::InvokeArgument;
 using ::testing::MockFunction;
@@ -195,7 +197,7 @@ TEST(RequestTest, CancelPropagates) {
   std::shared_ptr<Request<ReturnValue>> subrequest;
   EXPECT_CALL(resolver, Call(request))
       .WillOnce(Invoke(
-          [=, &subrequest](const std::shared_ptr<Request<ReturnValue>>& r) {
+          [=, &subrequest](const std::shared_ptr<Request<ReturnValue>>&) {
             request->make_subrequest<CloudProviderMock>(
                 &CloudProviderMock::request<ReturnValue>,
                 [provider, &subrequest](
@@ -218,4 +220,167 @@ TEST(RequestTest, CancelPropagates) {
   EXPECT_TRUE(subrequest->is_cancelled());
 }
 
+TEST(RequestTest, RetriesThrottledRequest) {
+  using ReturnValue = EitherError<std::string>;
+
+  MockFunction<void(std::shared_ptr<Request<ReturnValue>>)> resolver;
+  MockFunction<void(ReturnValue)> callback;
+  auto provider = CloudProviderMock::create();
+  auto request = std::make_shared<Request<ReturnValue>>(
+      provider, callback.AsStdFunction(), resolver.AsStdFunction());
+
+  int request_count = 0;
+
+  EXPECT_CALL(resolver, Call(request))
+      .WillOnce(Invoke(
+          [=, &request_count](const std::shared_ptr<Request<ReturnValue>>& r) {
+            r->request(
+                [=, &request_count](const util::Output&) {
+                  auto mock_request = std::make_shared<HttpRequestMock>();
+                  EXPECT_CALL(*mock_request, send)
+                      .WillOnce(InvokeArgument<0>(
+                          request_count == 0
+                              ? IHttpRequest::Response{429,
+                                                       {{"retry-after", "0"}}}
+                              : IHttpRequest::Response{242}));
+                  request_count++;
+                  return mock_request;
+                },
+                [=](const EitherError<Response>& e) {
+                  ASSERT_NE(e.right(), nullptr);
+                  EXPECT_THAT(e.right()->http_code(), Eq(242));
+                  request->done(std::string("test"));
+                });
+          }));
+
+  EXPECT_THAT(request->run()->result().right(), Pointee(Eq("test")));
+  EXPECT_EQ(request_count, 2);
+}
+
+TEST(RequestTest, DoesNotRetryNonIdempotentRequest) {
+  using ReturnValue = EitherError<std::string>;
+
+  MockFunction<void(std::shared_ptr<Request<ReturnValue>>)> resolver;
+  MockFunction<void(ReturnValue)> callback;
+  auto provider = CloudProviderMock::create();
+  auto request = std::make_shared<Request<ReturnValue>>(
+      provider, callback.AsStdFunction(), resolver.AsStdFunction());
+
+  EXPECT_CALL(resolver, Call(request))
+      .WillOnce(Invoke([=](const std::shared_ptr<Request<ReturnValue>>& r) {
+        r->request(
+            [=](const util::Output&) {
+              auto mock_request = std::make_shared<HttpRequestMock>();
+              EXPECT_CALL(*mock_request, send)
+                  .WillOnce(InvokeArgument<0>(IHttpRequest::Response{
+                      IHttpRequest::ServiceUnavailable}));
+              return mock_request;
+            },
+            [=](const EitherError<Response>& e) {
+              ASSERT_NE(e.left(), nullptr);
+              request->done(*e.left());
+            });
+      }));
+
+  EXPECT_THAT(request->run()->result().left(),
+              Pointee(Field(&Error::code_, IHttpRequest::ServiceUnavailable)));
+}
+
+TEST(RequestTest, DoesNotRetryPartiallyDeliveredResponse) {
+  using ReturnValue = EitherError<std::string>;
+
+  MockFunction<void(std::shared_ptr<Request<ReturnValue>>)> resolver;
+  MockFunction<void(ReturnValue)> callback;
+  auto provider = CloudProviderMock::create();
+  auto request = std::make_shared<Request<ReturnValue>>(
+      provider, callback.AsStdFunction(), resolver.AsStdFunction());
+  auto output = std::make_shared<std::stringstream>();
+
+  int request_count = 0;
+
+  EXPECT_CALL(resolver, Call(request))
+      .WillOnce(Invoke(
+          [=, &request_count](const std::shared_ptr<Request<ReturnValue>>& r) {
+            r->send(
+                [=, &request_count](const util::Output&) {
+                  auto mock_request = std::make_shared<HttpRequestMock>("GET");
+                  EXPECT_CALL(*mock_request, send)
+                      .WillOnce(Invoke(
+                          [](const IHttpRequest::CompleteCallback& complete,
+                             const std::shared_ptr<std::istream>&,
+                             const std::shared_ptr<std::ostream>& response,
+                             const std::shared_ptr<std::ostream>& error,
+                             const IHttpRequest::ICallback::Pointer&) {
+                            *response << "partial";
+                            complete({-1, {}, response, error});
+                          }));
+                  request_count++;
+                  return mock_request;
+                },
+                [=](const EitherError<Response>& e) {
+                  ASSERT_NE(e.left(), nullptr);
+                  request->done(*e.left());
+                },
+                [] { return std::make_shared<std::stringstream>(); }, output,
+                nullptr, nullptr, false);
+          }));
+
+  EXPECT_THAT(request->run()->result().left(),
+              Pointee(Field(&Error::code_, -1)));
+  EXPECT_EQ(request_count, 1);
+  EXPECT_EQ(output->str(), "partial");
+}
+
+TEST(RetryPolicyTest, DecidesWhetherToRetry) {
+  RetryPolicy policy(2);
+  std::chrono::milliseconds delay;
+
+  EXPECT_TRUE(policy.retry("GET", 0, IHttpRequest::ServiceUnavailable, {},
+                           false, delay));
+  EXPECT_LE(delay, RetryPolicy::BASE_DELAY);
+  EXPECT_TRUE(policy.retry("GET", 1, -1, {}, false, delay));
+  EXPECT_LE(delay, 2 * RetryPolicy::BASE_DELAY);
+  EXPECT_FALSE(policy.retry("GET", 2, IHttpRequest::ServiceUnavailable, {},
+                            false, delay));
+  EXPECT_FALSE(policy.retry("GET", 0, -1, {}, true, delay));
+  EXPECT_FALSE(policy.retry("POST", 0, IHttpRequest::BadGateway, {}, false,
+                            delay));
+  EXPECT_FALSE(
+      policy.retry("GET", 0, IHttpRequest::Aborted, {}, false, delay));
+  EXPECT_FALSE(
+      policy.retry("GET", 0, IHttpRequest::NotFound, {}, false, delay));
+
+  EXPECT_TRUE(policy.retry("POST", 0, IHttpRequest::TooManyRequests,
+                           {{"retry-after", "7"}}, false, delay));
+  EXPECT_EQ(delay, std::chrono::seconds(7));
+  EXPECT_FALSE(policy.retry("POST", 0, IHttpRequest::TooManyRequests,
+                            {{"retry-after", "3600"}}, false, delay));
+}
+
+TEST(RetryPolicyTest, ParsesRetryAfter) {
+  std::chrono::milliseconds delay;
+  EXPECT_TRUE(RetryPolicy::retryAfter("120", delay));
+  EXPECT_EQ(delay, std::chrono::seconds(120));
+  EXPECT_TRUE(
+      RetryPolicy::retryAfter("Wed, 21 Oct 2015 07:28:00 GMT", delay));
+  EXPECT_EQ(delay, std::chrono::milliseconds::zero());
+  EXPECT_FALSE(RetryPolicy::retryAfter("soon", delay));
+  EXPECT_FALSE(RetryPolicy::retryAfter("", delay));
+}
+
+TEST(RetryPolicyTest, LimitsRetryBudget) {
+  RetryPolicy policy;
+  std::chrono::milliseconds delay;
+  int retries = 0;
+  while (policy.retry("GET", 0, IHttpRequest::ServiceUnavailable, {}, false,
+                      delay))
+    retries++;
+  EXPECT_EQ(retries, static_cast<int>(RetryPolicy::MAX_TOKENS /
+                                       RetryPolicy::TOKENS_PER_RETRY));
+  for (uint32_t i = 0; i < RetryPolicy::TOKENS_PER_RETRY; i++)
+    policy.succeeded();
+  EXPECT_TRUE(policy.retry("GET", 0, IHttpRequest::ServiceUnavailable, {},
+                           false, delay));
+}
+
 }  // namespace cloudstorage
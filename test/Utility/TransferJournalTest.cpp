@@ -0,0 +1,97 @@
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "Utility/TransferJournal.h"
+#include "Utility/Utility.h"
+
+namespace cloudstorage {
+
+namespace {
+
+class UploadCallback : public IUploadFileCallback {
+ public:
+  explicit UploadCallback(const std::string& content) : content_(content) {}
+
+  uint32_t putData(char* data, uint32_t maxlength, uint64_t offset) override {
+    auto size = std::min<uint64_t>(maxlength, content_.size() - offset);
+    memcpy(data, content_.data() + offset, size);
+    return static_cast<uint32_t>(size);
+  }
+  uint64_t size() override { return content_.size(); }
+  void progress(uint64_t, uint64_t) override {}
+  void done(EitherError<IItem>) override {}
+
+ private:
+  std::string content_;
+};
+
+}  // namespace
+
+TEST(TransferJournalTest, KeepsEntriesAcrossReopening) {
+  const auto path =
+      util::temporary_directory() + "cloudstorage-transfer-journal";
+  std::remove(path.c_str());
+  UploadCallback callback(std::string(400, 'x'));
+  {
+    TransferJournal journal(path);
+    journal.put("first", {"session1", 100, {}}, callback);
+    journal.put("second", {"session2", 200, {}}, callback);
+    journal.put("first", {"session1", 300, {}}, callback);
+    journal.remove("second");
+  }
+  {
+    std::ofstream(path, std::ios::app) << "{ \"key\": \"torn";
+  }
+  TransferJournal journal(path);
+  TransferJournal::Entry entry;
+  ASSERT_TRUE(journal.find("first", entry, callback));
+  EXPECT_EQ(entry.session_, "session1");
+  EXPECT_EQ(entry.offset_, 300u);
+  EXPECT_FALSE(journal.find("second", entry, callback));
+
+  std::ifstream file(path);
+  std::string line;
+  int count = 0;
+  while (std::getline(file, line)) count++;
+  EXPECT_EQ(count, 1);
+  std::remove(path.c_str());
+}
+
+TEST(TransferJournalTest, DropsEntryWhenCommittedRangeChanged) {
+  const auto path =
+      util::temporary_directory() + "cloudstorage-transfer-journal-checksum";
+  std::remove(path.c_str());
+  std::string content(256 * 1024, 'a');
+  UploadCallback original(content);
+  TransferJournal journal(path);
+  journal.put("key", {"session", 100 * 1024, {}}, original);
+  journal.put("key", {"session", 200 * 1024, {}}, original);
+
+  TransferJournal::Entry entry;
+  auto modified = content;
+  modified[250 * 1024] = 'b';
+  UploadCallback modified_after(modified);
+  EXPECT_TRUE(journal.find("key", entry, modified_after));
+  EXPECT_EQ(entry.offset_, 200u * 1024);
+
+  modified[150 * 1024] = 'b';
+  UploadCallback modified_within(modified);
+  EXPECT_FALSE(journal.find("key", entry, modified_within));
+  EXPECT_FALSE(journal.find("key", entry, original));
+  std::remove(path.c_str());
+}
+
+TEST(TransferJournalTest, KeysUploadsByDestinationAndContent) {
+  auto key = [](const std::string& filename, const std::string& content) {
+    UploadCallback callback(content);
+    return TransferJournal::key("google", "id", filename, callback);
+  };
+  EXPECT_EQ(key("file", "content"), key("file", "content"));
+  EXPECT_NE(key("file", "content"), key("file", "contenu"));
+  EXPECT_NE(key("file", "content"), key("other", "content"));
+}
+
+}  // namespace cloudstorage
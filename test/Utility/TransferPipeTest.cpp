@@ -0,0 +1,104 @@
+#include "gtest/gtest.h"
+
+#include <json/json.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#include "CloudProvider/LocalDrive.h"
+#include "ICloudStorage.h"
+#include "ITransferPipe.h"
+#include "Utility/Item.h"
+#include "Utility/Utility.h"
+
+#ifdef WITH_LOCALDRIVE
+
+namespace cloudstorage {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+class TransferCallback : public ITransferPipe::ICallback {
+ public:
+  void progress(uint64_t, uint64_t) override {}
+  void done(EitherError<IItem>) override {}
+};
+
+class TransferPipeTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    fs::remove_all(directory_);
+    fs::create_directories(directory_ / "destination");
+    content_.resize(1024 * 1024);
+    for (size_t i = 0; i < content_.size(); i++)
+      content_[i] = static_cast<char>(i * 7 + i / 4096);
+    std::ofstream(directory_ / "source", std::ios::binary) << content_;
+  }
+
+  void TearDown() override { fs::remove_all(directory_); }
+
+  static ICloudProvider::Pointer localDrive() {
+    Json::Value json;
+    json["path"] = util::temporary_directory();
+    ICloudProvider::InitData data;
+    data.token_ = util::encode_token(util::json::to_string(json));
+    return ICloudStorage::create()->provider("local", std::move(data));
+  }
+
+  EitherError<IItem> transfer(uint32_t buffer_size, const std::string& source,
+                              uint64_t size) {
+    auto source_provider = localDrive();
+    auto destination_provider = localDrive();
+    auto pipe = ITransferPipe::create(buffer_size);
+    return pipe
+        ->transfer(*source_provider,
+                   std::make_shared<Item>(
+                       source, (directory_ / source).string(), size,
+                       IItem::UnknownTimeStamp, IItem::FileType::Unknown),
+                   *destination_provider,
+                   std::make_shared<Item>(
+                       "destination", (directory_ / "destination").string(),
+                       IItem::UnknownSize, IItem::UnknownTimeStamp,
+                       IItem::FileType::Directory),
+                   "copy", std::make_shared<TransferCallback>())
+        ->result();
+  }
+
+  std::string copied() const {
+    std::ifstream file(directory_ / "destination" / "copy", std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), {});
+  }
+
+  fs::path directory_ =
+      fs::path(util::temporary_directory()) / "cloudstorage-transfer-pipe";
+  std::string content_;
+};
+
+}  // namespace
+
+TEST_F(TransferPipeTest, StreamsFileThroughSmallerBuffer) {
+  auto result = transfer(64 * 1024, "source", content_.size());
+
+  ASSERT_TRUE(result.right());
+  EXPECT_EQ(result.right()->size(), content_.size());
+  EXPECT_EQ(copied(), content_);
+}
+
+TEST_F(TransferPipeTest, SpillsFileOfUnknownSize) {
+  auto result = transfer(64 * 1024, "source", IItem::UnknownSize);
+
+  ASSERT_TRUE(result.right());
+  EXPECT_EQ(copied(), content_);
+}
+
+TEST_F(TransferPipeTest, CancelsUploadWhenDownloadFails) {
+  auto result = transfer(64 * 1024, "missing", content_.size());
+
+  ASSERT_TRUE(result.left());
+  EXPECT_EQ(result.left()->description_, util::Error::COULD_NOT_READ_FILE);
+}
+
+}  // namespace cloudstorage
+
+#endif  // WITH_LOCALDRIVE